@@ -34,11 +34,8 @@
 /*******************************************************************************
 ******************************** Private define ********************************
 *******************************************************************************/
-/* slave's address bias, default are all zero */
-const uint16_t   usSDiscInStart   = 0;
-const uint16_t   usSCoilStart     = 0;
-const uint16_t   usSRegInStart    = 0;
-const uint16_t   usSRegHoldStart  = 0;
+/* slave's address bias is the 'xxx_start' in the register image below,
+default are all zero, see MB_APP_XXX_START_ADDR. */
 
 /*******************************************************************************
 ******************************** Private typedef *******************************
@@ -66,8 +63,30 @@ static uint16_t             input_registers[MB_APP_INPUT_REG_NUM];
 static uint16_t             hold_registers[MB_APP_HOLDING_REG_NUM];
 
 
+                                                            //the default register image, for a single address slave, and for a unit without its own image.
+static MB_REG_IMAGE_STRU    app_image =
+{
+    .p_hold      = hold_registers,
+    .hold_start  = MB_APP_HOLDING_REG_START_ADDR,
+    .hold_num    = MB_APP_HOLDING_REG_NUM,
+    .p_input     = input_registers,
+    .input_start = MB_APP_INPUT_REG_START_ADDR,
+    .input_num   = MB_APP_INPUT_REG_NUM,
+    .p_coil      = ucSCoilBuf,
+    .coil_start  = MB_APP_COIL_START_ADDR,
+    .coil_num    = MB_APP_COIL_NUM,
+    .p_disc      = ucSDiscInBuf,
+    .disc_start  = MB_APP_DISC_START_ADDR,
+    .disc_num    = MB_APP_DISC_NUM,
+};
+
                                                             //callback in eMBRegHoldingCB, executed when any hoding reg changes */
 static MB_HOLD_UPDATE_CB    cb_mb_hold_updated;
+
+#if MB_IMAGE_SEQLOCK_ENABLED > 0
+                                                            //sequence of the writes to all images, odd= a writer is in
+static uint32_t             image_seq;
+#endif
 /*******************************************************************************
 ************************* Private function declaration *************************
 *******************************************************************************/
@@ -118,6 +137,102 @@ uint16_t *mb_get_input_ptr(void)
 }
 
 
+/*******************************************************************************
+  * @brief  take the turn to write the register images, the readers go on and
+            copy again if they saw a part of the write.
+  *
+  * @param  none
+  *
+  * @retval none
+  *
+  * @note   the callbacks below do it, a task which updates the registers by
+            mb_get_hold_ptr() / mb_get_input_ptr() while other threads serve
+            them does it as well. keep it short, the readers spin meanwhile.
+  *****************************************************************************/
+void mb_image_write_begin(void)
+{
+#if MB_IMAGE_SEQLOCK_ENABLED > 0
+    uint32_t s;
+
+    for(;;){
+        s = __atomic_load_n(&image_seq, __ATOMIC_RELAXED);
+        if((s & 1U) == 0
+        && __atomic_compare_exchange_n(&image_seq, &s, s + 1U, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+            break;
+        }
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);                //the odd sequence is seen before any store of the write, or a reader misses it
+#endif
+}
+
+
+void mb_image_write_end(void)
+{
+#if MB_IMAGE_SEQLOCK_ENABLED > 0
+    __atomic_store_n(&image_seq, image_seq + 1U, __ATOMIC_RELEASE);
+#endif
+}
+
+
+/*******************************************************************************
+  * @brief  start to read the register images, no lock is taken.
+  *
+  * @param  none
+  *
+  * @retval the sequence, give it to mb_image_read_retry()
+  *
+  * @note   do{ s = mb_image_read_begin(); copy; }while(mb_image_read_retry(s));
+  *****************************************************************************/
+uint32_t mb_image_read_begin(void)
+{
+#if MB_IMAGE_SEQLOCK_ENABLED > 0
+    uint32_t s;
+
+    while((s = __atomic_load_n(&image_seq, __ATOMIC_ACQUIRE)) & 1U){
+        ;                                                   //a writer is in
+    }
+    return s;
+#else
+    return 0;
+#endif
+}
+
+
+/*******************************************************************************
+  * @brief  the read is over, see if a write came meanwhile.
+  *
+  * @param  s = of mb_image_read_begin()
+  *
+  * @retval 1= a writer was in, copy again, 0= the copy is whole.
+  *****************************************************************************/
+int32_t mb_image_read_retry(uint32_t s)
+{
+#if MB_IMAGE_SEQLOCK_ENABLED > 0
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (__atomic_load_n(&image_seq, __ATOMIC_RELAXED) != s);
+#else
+    (void)s;
+    return 0;
+#endif
+}
+
+
+#if MB_SERVING_TASK_MAX > 0
+/*******************************************************************************
+  * @brief  the id of the running task, the stack keeps the image being
+            served for each task by it.
+  *
+  * @param  none
+  *
+  * @retval the task id, not 0 in a task.
+  *****************************************************************************/
+void *mb_port_task_id(void)
+{
+    return (void *)osThreadGetId();
+}
+#endif
+
+
 /*******************************************************************************
   * @brief  eMBFuncReadInputRegister() call this, 
             this is slave input register callback function. 
@@ -138,11 +253,19 @@ eMBErrorCode eMBRegInputCB(uint8_t * pucRegBuffer, uint16_t usAddress, uint16_t
     uint16_t          REG_INPUT_START;
     uint16_t          REG_INPUT_NREGS;
     uint16_t          usRegInStart;
-
-    pusRegInputBuf  = input_registers;
-    REG_INPUT_START = MB_APP_INPUT_REG_START_ADDR;
-    REG_INPUT_NREGS = MB_APP_INPUT_REG_NUM;
-    usRegInStart    = usSRegInStart;
+    uint16_t          usNRegsAll = usNRegs;
+    uint8_t *         pucRegStart = pucRegBuffer;
+    uint32_t          seq;
+    MB_REG_IMAGE_STRU *img;
+
+    img = mb_get_serving_image();                           //image of the unit being served
+    if(img == 0){
+        img = &app_image;
+    }
+    pusRegInputBuf  = img->p_input;
+    REG_INPUT_START = img->input_start;
+    REG_INPUT_NREGS = img->input_num;
+    usRegInStart    = img->input_start;
 
     /* it already plus one in modbus function method. */
     usAddress--;
@@ -150,14 +273,20 @@ eMBErrorCode eMBRegInputCB(uint8_t * pucRegBuffer, uint16_t usAddress, uint16_t
     if ((usAddress >= REG_INPUT_START)
             && (usAddress + usNRegs <= REG_INPUT_START + REG_INPUT_NREGS))
     {
-        iRegIndex = usAddress - usRegInStart;
-        while (usNRegs > 0)
+        do
         {
-            *pucRegBuffer++ = (uint8_t) (pusRegInputBuf[iRegIndex] >> 8);
-            *pucRegBuffer++ = (uint8_t) (pusRegInputBuf[iRegIndex] & 0xFF);
-            iRegIndex++;
-            usNRegs--;
-        }
+            seq          = mb_image_read_begin();
+            pucRegBuffer = pucRegStart;
+            usNRegs      = usNRegsAll;
+            iRegIndex    = usAddress - usRegInStart;
+            while (usNRegs > 0)
+            {
+                *pucRegBuffer++ = (uint8_t) (pusRegInputBuf[iRegIndex] >> 8);
+                *pucRegBuffer++ = (uint8_t) (pusRegInputBuf[iRegIndex] & 0xFF);
+                iRegIndex++;
+                usNRegs--;
+            }
+        } while (mb_image_read_retry(seq));
     }
     else
     {
@@ -190,13 +319,20 @@ eMBErrorCode eMBRegHoldingCB(uint8_t * pucRegBuffer, uint16_t usAddress, uint16_
     uint16_t          REG_HOLDING_NREGS;
     uint16_t          usRegHoldStart;
     uint16_t          num_to_callback;
+    uint8_t *         pucRegStart = pucRegBuffer;
+    uint32_t          seq;
+    MB_REG_IMAGE_STRU *img;
     
     num_to_callback = usNRegs; /* data transmitted to the callback. */
 
-    pusRegHoldingBuf  = hold_registers;
-    REG_HOLDING_START = MB_APP_HOLDING_REG_START_ADDR;
-    REG_HOLDING_NREGS = MB_APP_HOLDING_REG_NUM;
-    usRegHoldStart    = usSRegHoldStart;
+    img = mb_get_serving_image();                           //image of the unit being served
+    if(img == 0){
+        img = &app_image;
+    }
+    pusRegHoldingBuf  = img->p_hold;
+    REG_HOLDING_START = img->hold_start;
+    REG_HOLDING_NREGS = img->hold_num;
+    usRegHoldStart    = img->hold_start;
 
     /* it already plus one in modbus function method. */
     usAddress--;
@@ -209,27 +345,37 @@ eMBErrorCode eMBRegHoldingCB(uint8_t * pucRegBuffer, uint16_t usAddress, uint16_
         {
         /* read current register values from the protocol stack. */
         case MB_REG_READ:
-            while (usNRegs > 0)
+            do
             {
-                *pucRegBuffer++ = (uint8_t) (pusRegHoldingBuf[iRegIndex] >> 8);
-                *pucRegBuffer++ = (uint8_t) (pusRegHoldingBuf[iRegIndex] & 0xFF);
-                iRegIndex++;
-                usNRegs--;
-            }
+                seq          = mb_image_read_begin();
+                pucRegBuffer = pucRegStart;
+                usNRegs      = num_to_callback;
+                iRegIndex    = usAddress - usRegHoldStart;
+                while (usNRegs > 0)
+                {
+                    *pucRegBuffer++ = (uint8_t) (pusRegHoldingBuf[iRegIndex] >> 8);
+                    *pucRegBuffer++ = (uint8_t) (pusRegHoldingBuf[iRegIndex] & 0xFF);
+                    iRegIndex++;
+                    usNRegs--;
+                }
+            } while (mb_image_read_retry(seq));
             break;
 
         /* write current register values with new values from the protocol stack. */
         case MB_REG_WRITE:
+            mb_image_write_begin();
             while (usNRegs > 0)
             {
-                pusRegHoldingBuf[iRegIndex] = *pucRegBuffer++ << 8;
-                pusRegHoldingBuf[iRegIndex] |= *pucRegBuffer++;
+                pusRegHoldingBuf[iRegIndex] = (uint16_t)((pucRegBuffer[0] << 8) | pucRegBuffer[1]);
+                pucRegBuffer += 2;                          //one store, a reader never sees half of it
                 iRegIndex++;
                 usNRegs--;
             }
+            mb_image_write_end();
             
-            /* updata holdings, call the cb function, [by liq, 2019-10] */
-            if(cb_mb_hold_updated != 0){
+            /* updata holdings, call the cb function, [by liq, 2019-10] 
+            ...only for the default image, a unit's own image is owned by the user. */
+            if(cb_mb_hold_updated != 0 && img == &app_image){
                 /* to here, the usAddress is a num, started from 0, not 1.*/
                 cb_mb_hold_updated(usAddress, num_to_callback);
             }
@@ -263,12 +409,19 @@ eMBErrorCode eMBRegCoilsCB(uint8_t * pucRegBuffer, uint16_t usAddress, uint16_t
     uint16_t          COIL_START;
     uint16_t          COIL_NCOILS;
     uint16_t          usCoilStart;
+    uint8_t *         pucRegStart = pucRegBuffer;
+    uint32_t          seq;
+    MB_REG_IMAGE_STRU *img;
     iNReg =  usNCoils / 8 + 1;
 
-    pucCoilBuf  = ucSCoilBuf;
-    COIL_START  = MB_APP_COIL_START_ADDR;
-    COIL_NCOILS = MB_APP_COIL_NUM;
-    usCoilStart = usSCoilStart;
+    img = mb_get_serving_image();                           //image of the unit being served
+    if(img == 0){
+        img = &app_image;
+    }
+    pucCoilBuf  = img->p_coil;
+    COIL_START  = img->coil_start;
+    COIL_NCOILS = img->coil_num;
+    usCoilStart = img->coil_start;
 
     /* it already plus one in modbus function method. */
     usAddress--;
@@ -282,12 +435,19 @@ eMBErrorCode eMBRegCoilsCB(uint8_t * pucRegBuffer, uint16_t usAddress, uint16_t
         {
         /* read current coil values from the protocol stack. */
         case MB_REG_READ:
-            while (iNReg > 0)
+            do
             {
-                *pucRegBuffer++ = xMBUtilGetBits(&pucCoilBuf[iRegIndex++],
-                        iRegBitIndex, 8);
-                iNReg--;
-            }
+                seq          = mb_image_read_begin();
+                pucRegBuffer = pucRegStart;
+                iNReg        = usNCoils / 8 + 1;
+                iRegIndex    = (uint16_t) (usAddress - usCoilStart) / 8;
+                while (iNReg > 0)
+                {
+                    *pucRegBuffer++ = xMBUtilGetBits(&pucCoilBuf[iRegIndex++],
+                            iRegBitIndex, 8);
+                    iNReg--;
+                }
+            } while (mb_image_read_retry(seq));
             pucRegBuffer--;
             /* last coils */
             usNCoils = usNCoils % 8;
@@ -298,6 +458,7 @@ eMBErrorCode eMBRegCoilsCB(uint8_t * pucRegBuffer, uint16_t usAddress, uint16_t
 
             /* write current coil values with new values from the protocol stack. */
         case MB_REG_WRITE:
+            mb_image_write_begin();                         //the bytes are read-modify-written, the writers take turns
             while (iNReg > 1)
             {
                 xMBUtilSetBits(&pucCoilBuf[iRegIndex++], iRegBitIndex, 8,
@@ -312,6 +473,7 @@ eMBErrorCode eMBRegCoilsCB(uint8_t * pucRegBuffer, uint16_t usAddress, uint16_t
                 xMBUtilSetBits(&pucCoilBuf[iRegIndex++], iRegBitIndex, usNCoils,
                         *pucRegBuffer++);
             }
+            mb_image_write_end();
             break;
         }
     }
@@ -343,12 +505,19 @@ eMBErrorCode eMBRegDiscreteCB( uint8_t * pucRegBuffer, uint16_t usAddress, uint1
     uint16_t          DISCRETE_INPUT_START;
     uint16_t          DISCRETE_INPUT_NDISCRETES;
     uint16_t          usDiscreteInputStart;
+    uint8_t *         pucRegStart = pucRegBuffer;
+    uint32_t          seq;
+    MB_REG_IMAGE_STRU *img;
     iNReg =  usNDiscrete / 8 + 1;
 
-    pucDiscreteInputBuf       = ucSDiscInBuf;
-    DISCRETE_INPUT_START      = MB_APP_DISC_START_ADDR;
-    DISCRETE_INPUT_NDISCRETES = MB_APP_DISC_NUM;
-    usDiscreteInputStart      = usSDiscInStart;
+    img = mb_get_serving_image();                           //image of the unit being served
+    if(img == 0){
+        img = &app_image;
+    }
+    pucDiscreteInputBuf       = img->p_disc;
+    DISCRETE_INPUT_START      = img->disc_start;
+    DISCRETE_INPUT_NDISCRETES = img->disc_num;
+    usDiscreteInputStart      = img->disc_start;
 
     /* it already plus one in modbus function method. */
     usAddress--;
@@ -359,12 +528,19 @@ eMBErrorCode eMBRegDiscreteCB( uint8_t * pucRegBuffer, uint16_t usAddress, uint1
         iRegIndex = (uint16_t) (usAddress - usDiscreteInputStart) / 8;
         iRegBitIndex = (uint16_t) (usAddress - usDiscreteInputStart) % 8;
 
-        while (iNReg > 0)
+        do
         {
-            *pucRegBuffer++ = xMBUtilGetBits(&pucDiscreteInputBuf[iRegIndex++],
-                    iRegBitIndex, 8);
-            iNReg--;
-        }
+            seq          = mb_image_read_begin();
+            pucRegBuffer = pucRegStart;
+            iNReg        = usNDiscrete / 8 + 1;
+            iRegIndex    = (uint16_t) (usAddress - usDiscreteInputStart) / 8;
+            while (iNReg > 0)
+            {
+                *pucRegBuffer++ = xMBUtilGetBits(&pucDiscreteInputBuf[iRegIndex++],
+                        iRegBitIndex, 8);
+                iNReg--;
+            }
+        } while (mb_image_read_retry(seq));
         pucRegBuffer--;
         /* last discrete */
         usNDiscrete = usNDiscrete % 8;
@@ -43,6 +43,10 @@
 extern int32_t      mb_set_holdupdate_callback(MB_HOLD_UPDATE_CB cb);
 extern uint16_t     *mb_get_hold_ptr(void);
 extern uint16_t     *mb_get_input_ptr(void);
+extern void         mb_image_write_begin(void);
+extern void         mb_image_write_end(void);
+extern uint32_t     mb_image_read_begin(void);
+extern int32_t      mb_image_read_retry(uint32_t s);
 
 #endif /* _MB_PRIVATE_METHOD_H */
 
@@ -27,8 +27,8 @@
 #define MB_PORT_SERIAL_NAME                         (huart2)  
 
 #define MB_PORT_SERIAL_BAUD                         (115200)
-                                                            //tx dma (also for ringbuf) size, but rtu do not use ringbuf to send, it send directly, so set it to 1.
-#define MB_PORT_UART_TXDMA_SIZE                          (1)                      
+                                                            //tx dma size, it is also p_ascii_txbuf, the mb lib encodes the frame here and it is sent directly. ':' + 256 bytes in hex + CR LF.
+#define MB_PORT_UART_TXDMA_SIZE                        (515)                      
                                                             //rx dma (also for ringbuf) size, a ascii adu is 513 bytes max, we make it double.
 #define MB_PORT_UART_RXDMA_SIZE                       (1000)                     
                                                             /* tim will use timer's output comapare irq.
@@ -88,7 +88,6 @@ typedef struct
     BSP_SERIAL_STRU serial_handler;                         //serial handler, eg. huart2.
     uint8_t         serial_txdmabuf [MB_PORT_UART_TXDMA_SIZE];//buf for lowlevel bsp serial tx dma.
     uint8_t         serial_rxdmabuf [MB_PORT_UART_RXDMA_SIZE];//buf for lowlevel bsp serial rx dma.
-    uint8_t         ascii_adu[513];
     
 } MBPORT_ASCII_STRU;
 
@@ -441,7 +440,7 @@ MB_SLAVE_STRU  mb_slave_ascii_03=
     .p_serial_check_IDLE   = serial_check_IDLE,
     .p_timer_init          = timer_init,
     .p_timer_enable        = timer_enable,
-    .p_ascii_txbuf         = rtu.ascii_adu,
+    .p_ascii_txbuf         = rtu.serial_txdmabuf,
 };
 
 
@@ -0,0 +1,357 @@
+/**
+  ******************************************************************************
+  * @file    mb_port_gw_linux.c for the serial lines of a gateway on linux ttys
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/12/18
+  * @brief   the line task of mbgw.h, one thread and one tty per line, so the
+             lines work in parallel. a rtu master of one request at a time:
+             1. the tty is opened as in mb_port_rtu_linux.c, termios, low
+                latency and rs485, see mb_port_linux_tty_open().
+             2. the frames from the bus are split by mbrtu_ts.c with the
+                timestamps of read(), the same as the rtu slave.
+             3. a timerfd is armed to the nearest of the answer timeout, the
+                t35 gap and the frame under receiving. the tcp task wakes the
+                line by an eventfd when it queues a request.
+             4. the bytes read while our request is on the bus, and t35 after
+                it, are dropped. they are its echo on a 2-wire bus without
+                rs485 support, the device may not answer before t35.
+             see mb_port_linux.h for how to use.
+  *
+  ******************************************************************************
+  */
+
+/*******************************************************************************
+*******************************   cfg and const    *****************************
+*******************************************************************************/
+                                                            //1=enable 0=disable, only for this file.
+#define MB_PORT_USE_LOG                                  (0)
+                                                            /* added to t35 when splitting frames, 0 for a native uart,
+                                                            a usb adapter with low latency delivers a frame in 1ms chunks. */
+#define MB_PORT_TS_TOL_US                             (1000)
+                                                            /* 1= set TIOCSRS485 if the driver supports it, the kernel drives DE(RTS),
+                                                            0= do not touch, for rs232 or adapters with auto direction. */
+#define MB_PORT_USE_RS485                                (1)
+
+
+/*******************************************************************************
+************************************ Includes **********************************
+*******************************************************************************/
+
+//---call some lib---
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+//---call some task/module---
+#include "mbgw.h"
+#include "mbrtu_ts.h"
+#include "mb_port_linux.h"
+
+#if (MB_RTU_TS_ENABLED == 0)
+    #error "mb_port_gw_linux.c needs MB_RTU_TS_ENABLED = 1"
+#endif
+
+#if (MB_PORT_USE_LOG == 1)
+    #include <stdio.h>
+    #define LOG(level, ...)  do{ fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); }while(0)
+#else
+    #define LOG(...)
+#endif
+
+#if MB_GW_ENABLED > 0
+
+/*******************************************************************************
+******************************** Private typedef *******************************
+*******************************************************************************/
+                                                            // private data of a line
+typedef struct
+{
+    MB_GW_LINE_STRU *ln;                                    //the line of the gateway, 0= not opened
+    int             fd;                                     //the tty
+    int             epfd;                                   //epoll set of the tty, the timer and the eventfd
+    int             evfd;                                   //eventfd, the tcp task queued a request
+    MB_PORT_LINUX_TIMER_STRU tmr;                           //timerfd, armed to the nearest of all deadlines of the line
+    MB_RTU_TS_STRU  ts;                                     //framing by timestamps
+    uint64_t        rx_after_us;                            //the echo of our request is over, bytes before it are dropped
+
+    MB_PORT_LINUX_GW_STAT_STRU stat;
+} MBPORT_GW_LINUX_STRU;
+
+/*******************************************************************************
+******************************* Private variables ******************************
+*******************************************************************************/
+static MBPORT_GW_LINUX_STRU     gl[MB_GW_LINE_MAX];
+
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static void     port_notify     (void *line);
+static int32_t  port_rx         (MBPORT_GW_LINUX_STRU *pl);
+static void     port_check_time (MBPORT_GW_LINUX_STRU *pl, uint64_t now);
+
+/*******************************************************************************
+********************************************************************************
+*                              public functions                                *
+********************************************************************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  open the tty of a line of the gateway
+  *
+  * @param  id = the line, 0 ~ MB_GW_LINE_MAX-1, one thread each
+            ln = the line, mb_gw_init() is done, its baudrate is used
+            dev = the tty, eg. "/dev/ttyUSB0"
+            databits = 8
+            parity = 0 none, 1 odd, 2 even
+  *
+  * @retval 0= OK
+  *
+  * @note   before mb_port_tcp_linux_gateway(), the tcp task may queue a
+            request at once. it sets 'p_notify' and 'p_port' of the line.
+  *****************************************************************************/
+int32_t mb_port_gw_linux_open(int32_t id, MB_GW_LINE_STRU *ln, const char *dev, uint8_t databits, uint8_t parity)
+{
+    MBPORT_GW_LINUX_STRU *pl;
+    struct epoll_event    ev;
+
+    if(id < 0 || id >= MB_GW_LINE_MAX || ln == 0 || gl[id].ln != 0){
+        return __LINE__;
+    }
+    pl = &gl[id];
+    memset(pl, 0, sizeof(*pl));
+
+    pl->fd = mb_port_linux_tty_open(dev, ln->baudrate, databits, parity, MB_PORT_USE_RS485,
+                                    &pl->stat.low_latency, &pl->stat.rs485);
+    if(pl->fd < 0){
+        LOG(CLI_LOG_ERR, "open %s failed, errno=%d.", dev, errno);
+        return __LINE__;
+    }
+    pl->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(pl->epfd < 0){
+        return __LINE__;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLIN;
+    ev.data.fd = pl->fd;
+    if(epoll_ctl(pl->epfd, EPOLL_CTL_ADD, pl->fd, &ev) != 0){
+        return __LINE__;
+    }
+    pl->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(pl->evfd < 0){
+        return __LINE__;
+    }
+    ev.data.fd = pl->evfd;
+    if(epoll_ctl(pl->epfd, EPOLL_CTL_ADD, pl->evfd, &ev) != 0){
+        return __LINE__;
+    }
+    if(mb_port_linux_timer_open(&pl->tmr, pl->epfd) != 0){
+        return __LINE__;
+    }
+    if(mb_rtu_ts_init(&pl->ts, ln->baudrate, MB_PORT_TS_TOL_US) != 0){
+        return __LINE__;
+    }
+
+    ln->p_port   = pl;
+    ln->p_notify = port_notify;
+    pl->ln       = ln;
+    LOG(CLI_LOG_USR, "%s opened, line %d, low_latency=%u rs485=%u.", dev, id, pl->stat.low_latency, pl->stat.rs485);
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  wait for the tty, the timer and the tcp task, then run the line.
+  *
+  * @param  id = the line
+            timeout_ms = how long to wait at most, -1= forever.
+  *
+  * @retval 0= OK, other= the tty is broken, eg. the usb adapter is removed.
+  *
+  * @note   the loop of the thread of the line, nothing else to call.
+  *****************************************************************************/
+int32_t mb_port_gw_linux_wait(int32_t id, int32_t timeout_ms)
+{
+    MBPORT_GW_LINUX_STRU *pl;
+    struct epoll_event    evs[4];
+    uint64_t              dl, t, cnt;
+    int32_t               err = 0;
+    int                   n, i;
+
+    if(id < 0 || id >= MB_GW_LINE_MAX || gl[id].ln == 0){
+        return __LINE__;
+    }
+    pl = &gl[id];
+                                                            //a request may be queued, or sent again, before the wait
+    port_check_time(pl, mb_port_linux_now_us());
+
+                                                            //wake up at the nearest deadline
+    dl = mb_rtu_ts_deadline(&pl->ts);
+    t  = mb_gw_line_deadline(pl->ln);
+    if(t != 0 && (dl == 0 || t < dl)){
+        dl = t;
+    }
+    mb_port_linux_timer_arm(&pl->tmr, dl);
+
+    n = epoll_wait(pl->epfd, evs, sizeof(evs) / sizeof(evs[0]), timeout_ms);
+    if(n < 0 && errno != EINTR){
+        return __LINE__;
+    }
+
+    for(i = 0; i < n; i++){
+        if(evs[i].data.fd == pl->tmr.fd){
+            mb_port_linux_timer_expired(&pl->tmr);
+        }
+        else if(evs[i].data.fd == pl->evfd){
+            if(read(pl->evfd, &cnt, sizeof(cnt)) < 0){
+                ;                                           //EAGAIN, the queue is looked anyway
+            }
+        }
+        else if(evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)){
+            err = port_rx(pl);
+        }
+    }
+
+    port_check_time(pl, mb_port_linux_now_us());
+    return err;
+}
+
+
+/*******************************************************************************
+  * @brief  get the statistics of a line
+  *
+  * @param  id = the line
+            st = output
+  *
+  * @retval none
+  *
+  * @note   the counters are read while the line goes on, a snapshot only.
+  *****************************************************************************/
+void mb_port_gw_linux_get_stat(int32_t id, MB_PORT_LINUX_GW_STAT_STRU *st)
+{
+    MBPORT_GW_LINUX_STRU *pl;
+
+    if(id < 0 || id >= MB_GW_LINE_MAX || st == 0){
+        return;
+    }
+    pl  = &gl[id];
+    *st = pl->stat;
+    if(pl->ln != 0){
+        st->req_cnt     = pl->ln->req_cnt;
+        st->full_cnt    = pl->ln->full_cnt;
+        st->ok_cnt      = pl->ln->ok_cnt;
+        st->timeout_cnt = pl->ln->timeout_cnt;
+        st->junk_cnt    = pl->ln->junk_cnt;
+        st->q_max       = pl->ln->q_max;
+        st->bus_cnt     = pl->ln->bus_cnt;
+        st->merge_cnt   = pl->ln->merge_cnt;
+        st->split_cnt   = pl->ln->split_cnt;
+        st->hit_cnt     = pl->ln->hit_cnt;
+        st->miss_cnt    = pl->ln->miss_cnt;
+        st->busy_us     = pl->ln->busy_us;
+    }
+}
+
+
+/*******************************************************************************
+********************************************************************************
+*                              private functions                               *
+********************************************************************************
+*******************************************************************************/
+
+                                                            //called by the tcp task, a request is queued to the line
+static void port_notify(void *line)
+{
+    MBPORT_GW_LINUX_STRU *pl = (MBPORT_GW_LINUX_STRU *)((MB_GW_LINE_STRU *)line)->p_port;
+    uint64_t one = 1;
+
+    if(write(pl->evfd, &one, sizeof(one)) < 0){
+        ;                                                   //EAGAIN, the counter is full, the line is woken anyway
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  read all that the tty has, and feed it to the framing engine.
+  *
+  * @param  pl = the line
+  *
+  * @retval 0= OK, other= read error, not EAGAIN.
+  *****************************************************************************/
+static int32_t port_rx(MBPORT_GW_LINUX_STRU *pl)
+{
+    uint8_t  buf[MB_RTU_TS_FRAME_MAX];
+    uint64_t now;
+    ssize_t  r;
+
+    for(;;){
+        r = read(pl->fd, buf, sizeof(buf));
+        if(r > 0){
+            now = mb_port_linux_now_us();
+            pl->stat.rx_bytes += (uint32_t)r;
+            if(now >= pl->rx_after_us){
+                mb_rtu_ts_feed(&pl->ts, buf, (uint16_t)r, now);
+            }
+            else{
+                pl->stat.rx_drop_bytes += (uint32_t)r;
+            }
+            continue;
+        }
+        if(r == 0 || errno == EAGAIN || errno == EINTR){
+            return 0;                                       //VMIN=0 VTIME=0 gives 0 when all is read, not EAGAIN
+        }
+        LOG(CLI_LOG_ERR, "read err, errno=%d.", errno);
+        return __LINE__;                                    //eg. EIO, the tty is gone
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  run the line, the answers, the timeout, then the next request.
+  *
+  * @param  pl = the line
+            now = monotonic time now
+  *
+  * @retval none
+  *
+  * @note   the frame is small, the kernel takes it at once. the input queue
+            is flushed before, the bytes of an answer too late are gone.
+  *****************************************************************************/
+static void port_check_time(MBPORT_GW_LINUX_STRU *pl, uint64_t now)
+{
+    uint8_t   f[MB_RTU_TS_FRAME_MAX];
+    uint8_t  *tx;
+    uint16_t  n;
+    ssize_t   r;
+
+    if(mb_rtu_ts_poll(&pl->ts, now) > 0){
+        while((n = mb_rtu_ts_get(&pl->ts, f, sizeof(f))) > 0){
+            mb_gw_line_frame(pl->ln, f, n, now);
+        }
+    }
+    mb_gw_line_poll(pl->ln, now);
+
+    if(mb_gw_line_next(pl->ln, now, &tx, &n) != 0){
+        return;
+    }
+    tcflush(pl->fd, TCIFLUSH);
+    mb_rtu_ts_reset(&pl->ts);
+    r = write(pl->fd, tx, n);
+    if(r != (ssize_t)n){
+        LOG(CLI_LOG_ERR, "write err, r=%d errno=%d.", (int)r, errno);
+        pl->stat.tx_err_cnt++;                              //no answer comes, the timeout sends it again
+    }
+    else{
+        pl->stat.tx_bytes += n;
+    }
+    pl->stat.tx_frames++;
+    pl->rx_after_us = now + (uint64_t)n * pl->ts.char_us + pl->ln->t35_us;
+}
+
+#endif //#if MB_GW_ENABLED > 0
+
+/********************************* end of file ********************************/
@@ -0,0 +1,334 @@
+/**
+  ******************************************************************************
+  * @file    mb_port_linux.c, timer, event and tty for the linux ports
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/11/22
+  * @brief   the stm32 ports use a compare timer and a freertos queue, here
+             they are a timerfd and an eventfd, both go into the epoll set of
+             the port together with the tty or socket, so one epoll_wait()
+             sleeps until a byte, a timeout or an event comes, no busy polling.
+             1. the timerfd is armed to an absolute CLOCK_MONOTONIC time, so
+                t1.5/t3.5 and the ascii char timeout keep us resolution.
+             2. the lateness of each expiry is put into a histogram, it tells
+                how the host (kernel, cpu load, PREEMPT_RT or not) serves t3.5.
+  *
+  ******************************************************************************
+  */
+
+/*******************************************************************************
+************************************ Includes **********************************
+*******************************************************************************/
+
+//---call some lib---
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <linux/serial.h>
+
+//---call some task/module---
+#include "mb_port_linux.h"
+
+/*******************************************************************************
+********************************************************************************
+*                              public functions                                *
+********************************************************************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  monotonic time in us
+  *****************************************************************************/
+uint64_t mb_port_linux_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+
+/*******************************************************************************
+  * @brief  monotonic time in ms, it wraps after 49 days, for 'p_tick_ms' of a
+            master, see mbmaster.h
+  *****************************************************************************/
+uint32_t mb_port_linux_tick_ms(void)
+{
+    return (uint32_t)(mb_port_linux_now_us() / 1000ULL);
+}
+
+
+/*******************************************************************************
+  * @brief  create a timerfd and add it to an epoll set
+  *
+  * @param  t = the timer
+            epfd = the epoll set, data.fd of the epoll event is t->fd
+  *
+  * @retval 0= no error
+  *****************************************************************************/
+int32_t mb_port_linux_timer_open(MB_PORT_LINUX_TIMER_STRU *t, int epfd)
+{
+    struct epoll_event ev;
+
+    memset(t, 0, sizeof(MB_PORT_LINUX_TIMER_STRU));
+    t->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(t->fd < 0){
+        return __LINE__;
+    }
+
+    memset(&ev, 0, sizeof(ev));                             //high bits of data.u64 are 0, the tcp port tags its fds there
+    ev.events  = EPOLLIN;
+    ev.data.fd = t->fd;
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, t->fd, &ev) != 0){
+        close(t->fd);
+        t->fd = -1;
+        return __LINE__;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  arm the timer to an absolute time, or disarm it.
+  *
+  * @param  deadline_us = monotonic time in us, 0= disarm.
+  *
+  * @retval none
+  *
+  * @note   no syscall if the deadline does not change, the ports call it after
+            each wait with the nearest deadline. a deadline in the past
+            expires at once.
+  *****************************************************************************/
+void mb_port_linux_timer_arm(MB_PORT_LINUX_TIMER_STRU *t, uint64_t deadline_us)
+{
+    struct itimerspec its;
+
+    if(t->deadline_us == deadline_us){
+        return;
+    }
+    t->deadline_us = deadline_us;
+
+    memset(&its, 0, sizeof(its));                           //all 0 = disarm
+    if(deadline_us != 0){
+        its.it_value.tv_sec  = (time_t)(deadline_us / 1000000ULL);
+        its.it_value.tv_nsec = (long)(deadline_us % 1000000ULL) * 1000L;
+    }
+    timerfd_settime(t->fd, TFD_TIMER_ABSTIME, &its, 0);
+}
+
+
+/*******************************************************************************
+  * @brief  call it when epoll says the timerfd is readable.
+  *
+  * @param  t = the timer
+  *
+  * @retval 1= expired, and disarmed. 0= not expired, eg. re-armed before read.
+  *
+  * @note   the lateness, time of now minus the deadline, is put into the
+            histogram.
+  *****************************************************************************/
+int32_t mb_port_linux_timer_expired(MB_PORT_LINUX_TIMER_STRU *t)
+{
+    uint64_t ticks;
+    uint64_t now;
+    uint32_t late;
+    uint32_t bin;
+
+    if(read(t->fd, &ticks, sizeof(ticks)) != sizeof(ticks) || t->deadline_us == 0){
+        return 0;
+    }
+
+    now  = mb_port_linux_now_us();
+    late = (now > t->deadline_us) ? (uint32_t)(now - t->deadline_us) : 0;
+    t->deadline_us = 0;
+
+    for(bin = 0; bin < MB_PORT_LINUX_JITTER_BINS - 1 && (late >> bin) != 0; bin++){
+    }
+    t->late_hist[bin]++;
+    if(late > t->late_max_us){
+        t->late_max_us = late;
+    }
+    t->expire_cnt++;
+
+    return 1;
+}
+
+
+/*******************************************************************************
+  * @brief  create an eventfd and add it to an epoll set
+  *
+  * @param  ev = the event
+            epfd = the epoll set, data.fd of the epoll event is ev->fd
+  *
+  * @retval 0= no error
+  *****************************************************************************/
+int32_t mb_port_linux_event_open(MB_PORT_LINUX_EVENT_STRU *ev, int epfd)
+{
+    struct epoll_event e;
+
+    memset(ev, 0, sizeof(MB_PORT_LINUX_EVENT_STRU));
+    ev->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(ev->fd < 0){
+        return __LINE__;
+    }
+
+    memset(&e, 0, sizeof(e));                               //high bits of data.u64 are 0, the tcp port tags its fds there
+    e.events  = EPOLLIN;
+    e.data.fd = ev->fd;
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, ev->fd, &e) != 0){
+        close(ev->fd);
+        ev->fd = -1;
+        return __LINE__;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  send event, the epoll_wait() of the port wakes up.
+  *
+  * @param  e = the event
+  *
+  * @retval 0= no error
+  *
+  * @note   like the 1-item queue of the stm32 ports, a new event overwrites
+            the one not got yet. it can be called from any thread.
+  *****************************************************************************/
+int32_t mb_port_linux_event_post(MB_PORT_LINUX_EVENT_STRU *ev, uint32_t e)
+{
+    uint64_t one = 1;
+
+    ev->value   = e;
+    ev->pending = 1;
+    if(write(ev->fd, &one, sizeof(one)) != sizeof(one)){
+        return -1;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  get event, never blocks, the port blocks in epoll_wait() instead.
+  *
+  * @param  *e = output
+  *
+  * @retval 0= got one, -1= no event.
+  *****************************************************************************/
+int32_t mb_port_linux_event_get(MB_PORT_LINUX_EVENT_STRU *ev, uint32_t *e)
+{
+    uint64_t cnt;
+
+    if(read(ev->fd, &cnt, sizeof(cnt)) != sizeof(cnt)){
+        return -1;                                          //EAGAIN, nothing posted
+    }
+    ev->pending = 0;
+    *e = ev->value;
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  open and config a tty for rtu, non-blocking.
+  *
+  * @param  dev = eg. "/dev/ttyUSB0"
+  * @param  baudrate
+  * @param  databits = 7/8
+  * @param  parity = 0=none, 1=odd, 2=even, same as eMBParity of freemodbus
+  * @param  use_rs485 = 1= set TIOCSRS485 if the driver supports it
+  * @param  is_low_latency, is_rs485 = output 1 if it is set, else not touched
+  *
+  * @retval the fd, -1= error, see errno.
+  *
+  * @note   VMIN=0 VTIME=0, so read() returns at once with what is there. VTIME
+            counts in 100ms, far too coarse for t35, the gap is measured by
+            mbrtu_ts.c instead.
+  *****************************************************************************/
+int mb_port_linux_tty_open(const char *dev, uint32_t baudrate, uint8_t databits, uint8_t parity,
+                           uint32_t use_rs485, uint32_t *is_low_latency, uint32_t *is_rs485)
+{
+    struct termios      tio;
+    speed_t             speed;
+    int                 fd;
+
+    switch(baudrate){
+        case 1200:   speed = B1200;   break;
+        case 2400:   speed = B2400;   break;
+        case 4800:   speed = B4800;   break;
+        case 9600:   speed = B9600;   break;
+        case 19200:  speed = B19200;  break;
+        case 38400:  speed = B38400;  break;
+        case 57600:  speed = B57600;  break;
+        case 115200: speed = B115200; break;
+        case 230400: speed = B230400; break;
+        case 460800: speed = B460800; break;
+        case 921600: speed = B921600; break;
+        default:     return -1;
+    }
+
+    fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(fd < 0){
+        return -1;
+    }
+
+    if(tcgetattr(fd, &tio) != 0){
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+    tio.c_cflag |= CLOCAL | CREAD | ((databits == 7) ? CS7 : CS8);
+    if(parity == 1){
+        tio.c_cflag |= PARENB | PARODD;
+    }
+    else if(parity == 2){
+        tio.c_cflag |= PARENB;
+    }
+    else{
+        tio.c_cflag |= CSTOPB;                              //no parity, 2 stop bits as the spec says
+    }
+    tio.c_cc[VMIN]  = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if(tcsetattr(fd, TCSANOW, &tio) != 0){
+        close(fd);
+        return -1;
+    }
+
+    {                                                       //low latency, not all drivers support it, eg. pty.
+        struct serial_struct ss;
+        if(ioctl(fd, TIOCGSERIAL, &ss) == 0){
+            ss.flags |= ASYNC_LOW_LATENCY;
+            if(ioctl(fd, TIOCSSERIAL, &ss) == 0){
+                *is_low_latency = 1;
+            }
+        }
+    }
+
+#if defined(TIOCSRS485)
+    if(use_rs485){                                          //the kernel drives DE, from the first bit to the last stop bit.
+        struct serial_rs485 rs485;
+        memset(&rs485, 0, sizeof(rs485));
+        rs485.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+        if(ioctl(fd, TIOCSRS485, &rs485) == 0){
+            *is_rs485 = 1;
+        }
+    }
+#else
+    (void)use_rs485;
+#endif
+
+
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+
+/********************************* end of file ********************************/
@@ -0,0 +1,232 @@
+/**
+  ******************************************************************************
+  * @file    HEADER FILE: public info of the linux ports
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/11/21
+  * @brief   the stm32 ports are driven by isr, the linux ports are driven by
+             a wait function, which blocks on the fds of the port and runs the
+             'isr' callbacks of the mb lib when something happens. a task loop
+             looks like:
+
+                mb_init(&mb_slave_rtu_linux);
+                mb_enable(&mb_slave_rtu_linux, 1);
+                for(;;){
+                    mb_port_rtu_linux_wait(100);
+                    mb_poll(&mb_slave_rtu_linux);
+                }
+
+             the tcp server is the same with mb_slave_tcp_linux and
+             mb_port_tcp_linux_wait(), or on io_uring, mb_slave_tcp_uring and
+             mb_port_tcp_uring_wait(), build only one of the two files. on
+             several cores, run a loop in each of some threads, see
+             mb_port_tcp_linux_worker().
+             a gateway to rtu devices, see mbgw.h, is the tcp server plus a
+             thread on each serial line:
+
+                mb_gw_init(&gw);                            //gw.p_lines[] are set, with the baudrates
+                mb_gw_route(&gw, 17, 0);                    //unit id 17 is on the line 0
+                mb_port_gw_linux_open(0, gw.p_lines[0], "/dev/ttyUSB0", 8, 2);
+                mb_init(&mb_slave_tcp_linux);
+                mb_port_tcp_linux_gateway(&gw);
+                mb_enable(&mb_slave_tcp_linux, 1);
+                ...the tcp loop as above, and in the thread of the line 0:
+                for(;;){
+                    mb_port_gw_linux_wait(0, 100);
+                }
+
+             a master, see mbmaster.h, takes a slave of a port as its link, the
+             wait function of the port is its 'p_wait'. on rtu that is
+             mb_slave_rtu_linux, on tcp the client side, mb_link_tcp_master_linux,
+             which connects to MB_PORT_TCP_MASTER_HOST at its port_id:
+
+                m.p_link    = &mb_link_tcp_master_linux;
+                m.p_wait    = mb_port_tcp_master_linux_wait;
+                m.p_tick_ms = mb_port_linux_tick_ms;
+                mb_master_init(&m);
+                mb_master_enable(&m, 1);
+                r = mb_master_read_holding(&m, 1, 0, 10, regs);
+  *
+  ******************************************************************************
+  */
+/*******************************************************************************
+********************* Define to prevent recursive inclusion ********************
+*******************************************************************************/
+
+#ifndef _MB_PORT_LINUX_H
+#define _MB_PORT_LINUX_H
+
+/*******************************************************************************
+************************************ Includes **********************************
+*******************************************************************************/
+#include <stdint.h>
+#include "mb.h"
+#include "mbgw.h"
+
+/*******************************************************************************
+********************************  Cfgs and Consts  *****************************
+*******************************************************************************/
+                                                            //bins of the timer lateness histogram, bin n counts [2^(n-1), 2^n) us, bin 0 counts 0us
+#define MB_PORT_LINUX_JITTER_BINS       (16)
+
+/*******************************************************************************
+********************************* Exported types *******************************
+*******************************************************************************/
+                                                            //a timerfd, armed to an absolute deadline in us
+typedef struct {
+    int             fd;
+    uint64_t        deadline_us;                            //0= disarmed
+
+                                                            //lateness of the expiries, to see the jitter of the host
+    uint32_t        expire_cnt;
+    uint32_t        late_max_us;
+    uint32_t        late_hist[MB_PORT_LINUX_JITTER_BINS];
+} MB_PORT_LINUX_TIMER_STRU;
+
+                                                            //an eventfd with the value of the event, same as the 1-item queue of the stm32 ports
+typedef struct {
+    int             fd;
+    uint32_t        value;
+    volatile int32_t pending;                               //1= posted and not got yet
+} MB_PORT_LINUX_EVENT_STRU;
+
+                                                            //statistics of the linux rtu port
+typedef struct {
+    uint32_t        rx_bytes;
+    uint32_t        rx_drop_bytes;                          //read while rx is disabled, eg. the echo of our response
+    uint32_t        tx_bytes;
+    uint32_t        tx_frames;
+    uint32_t        low_latency;                            //1= ASYNC_LOW_LATENCY is set on the tty
+    uint32_t        rs485;                                  //1= TIOCSRS485 is set, the kernel drives DE
+
+                                                            //turnaround, from the last byte of a request to the first byte of the response
+    uint32_t        turn_last_us;
+    uint32_t        turn_max_us;
+    uint32_t        turn_min_us;
+    uint64_t        turn_sum_us;
+    uint32_t        turn_cnt;
+
+                                                            //the timerfd
+    uint32_t        tim_expire_cnt;
+    uint32_t        tim_late_max_us;
+    uint32_t        tim_late_hist[MB_PORT_LINUX_JITTER_BINS];
+} MB_PORT_LINUX_RTU_STAT_STRU;
+
+                                                            //statistics of the linux tcp port
+typedef struct {
+    uint32_t        conn_num;                               //clients connected now
+    uint32_t        conn_max;                               //the most at the same time
+    uint32_t        accept_cnt;
+    uint32_t        refuse_cnt;                             //MB_TCP_CONN_MAX reached
+    uint32_t        close_cnt;
+    uint32_t        idle_cnt;                               //closed by MB_TCP_IDLE_TIMEOUT_MS
+    uint32_t        drop_bytes;                             //bad MBAP
+    uint64_t        rx_bytes;
+    uint64_t        tx_bytes;
+    uint32_t        rx_adu;
+    uint32_t        tx_adu;
+    uint32_t        zc_adu;                                 //requests served in the buffer recv() wrote
+    uint32_t        copy_bytes;                             //bytes copied in user space, by pipelining or a split adu
+    uint32_t        accept_err_cnt;                         //accept4() failed, eg. out of fds
+    uint32_t        slab_num;                               //receive buffers, MB_TCP_SLAB_NUM
+    uint32_t        slab_used;                              //taken now
+    uint32_t        slab_max;                               //the most taken at the same time
+    uint32_t        slab_wait_cnt;                          //a client found no free buffer
+    uint32_t        pend_num;                               //clients paused now, bytes wait in their sockets
+    uint32_t        mem_bytes;                              //static memory of the port, the conn table and all buffers
+    uint32_t        enter_cnt;                              //io_uring_enter() calls, the uring port only
+    uint32_t        sqe_cnt;
+    uint32_t        cqe_cnt;
+    uint32_t        nobuf_cnt;                              //a recv found no provided buffer
+    uint32_t        tx_drop_cnt;                            //responses dropped, no tx buffer
+    uint32_t        gw_drop_cnt;                            //answers of the gateway dropped, the client is gone
+} MB_PORT_LINUX_TCP_STAT_STRU;
+
+                                                            //statistics of a serial line of the gateway
+typedef struct {
+    uint32_t        rx_bytes;
+    uint32_t        rx_drop_bytes;                          //read while our request is on the bus, its echo
+    uint32_t        tx_bytes;
+    uint32_t        tx_frames;                              //requests sent, the ones sent again too
+    uint32_t        tx_err_cnt;                             //write() failed or was short
+    uint32_t        low_latency;                            //1= ASYNC_LOW_LATENCY is set on the tty
+    uint32_t        rs485;                                  //1= TIOCSRS485 is set, the kernel drives DE
+
+                                                            //of the queue, see MB_GW_LINE_STRU
+    uint32_t        req_cnt;
+    uint32_t        full_cnt;
+    uint32_t        ok_cnt;
+    uint32_t        timeout_cnt;
+    uint32_t        junk_cnt;
+    uint32_t        q_max;
+    uint32_t        bus_cnt;
+    uint32_t        merge_cnt;
+    uint32_t        split_cnt;
+    uint32_t        hit_cnt;                                //reads answered from the cache, see mbgw_cache.h
+    uint32_t        miss_cnt;
+    uint64_t        busy_us;                                //frames on the bus, over the time is the utilization
+} MB_PORT_LINUX_GW_STAT_STRU;
+
+                                                            //statistics of the linux tcp master port
+typedef struct {
+    uint32_t        connect_cnt;
+    uint32_t        close_cnt;                              //by enable(0), an error, or the server
+    uint32_t        drop_bytes;                             //bad MBAP
+    uint64_t        rx_bytes;
+    uint64_t        tx_bytes;
+    uint32_t        rx_adu;
+    uint32_t        tx_adu;
+} MB_PORT_LINUX_TCPM_STAT_STRU;
+
+/*******************************************************************************
+******************************* Exported functions *****************************
+*******************************************************************************/
+                                                            //in mb_port_linux.c, shared by the linux ports
+extern uint64_t mb_port_linux_now_us        (void);
+extern uint32_t mb_port_linux_tick_ms       (void);
+extern int32_t  mb_port_linux_timer_open    (MB_PORT_LINUX_TIMER_STRU *t, int epfd);
+extern void     mb_port_linux_timer_arm     (MB_PORT_LINUX_TIMER_STRU *t, uint64_t deadline_us);
+extern int32_t  mb_port_linux_timer_expired (MB_PORT_LINUX_TIMER_STRU *t);
+extern int32_t  mb_port_linux_event_open    (MB_PORT_LINUX_EVENT_STRU *ev, int epfd);
+extern int32_t  mb_port_linux_event_post    (MB_PORT_LINUX_EVENT_STRU *ev, uint32_t e);
+extern int32_t  mb_port_linux_event_get     (MB_PORT_LINUX_EVENT_STRU *ev, uint32_t *e);
+extern int      mb_port_linux_tty_open      (const char *dev, uint32_t baudrate, uint8_t databits, uint8_t parity,
+                                             uint32_t use_rs485, uint32_t *is_low_latency, uint32_t *is_rs485);
+
+                                                            //in mb_port_rtu_linux.c
+extern MB_SLAVE_STRU    mb_slave_rtu_linux;
+
+extern int32_t  mb_port_rtu_linux_wait      (int32_t timeout_ms);
+extern void     mb_port_rtu_linux_get_stat  (MB_PORT_LINUX_RTU_STAT_STRU *st);
+
+                                                            //in mb_port_tcp_linux.c
+extern MB_SLAVE_STRU    mb_slave_tcp_linux;
+
+extern int32_t  mb_port_tcp_linux_wait      (int32_t timeout_ms);
+extern int32_t  mb_port_tcp_linux_worker    (int32_t id, int32_t cpu);
+extern void     mb_port_tcp_linux_get_stat  (MB_PORT_LINUX_TCP_STAT_STRU *st);
+extern void     mb_port_tcp_linux_get_worker_stat(int32_t id, MB_PORT_LINUX_TCP_STAT_STRU *st);
+#if MB_GW_ENABLED > 0
+extern int32_t  mb_port_tcp_linux_gateway   (MB_GW_STRU *gw);
+
+                                                            //in mb_port_gw_linux.c, the serial lines of the gateway
+extern int32_t  mb_port_gw_linux_open       (int32_t id, MB_GW_LINE_STRU *ln, const char *dev, uint8_t databits, uint8_t parity);
+extern int32_t  mb_port_gw_linux_wait       (int32_t id, int32_t timeout_ms);
+extern void     mb_port_gw_linux_get_stat   (int32_t id, MB_PORT_LINUX_GW_STAT_STRU *st);
+#endif
+
+                                                            //in mb_port_tcp_master_linux.c, the link of a tcp master
+extern MB_SLAVE_STRU    mb_link_tcp_master_linux;
+
+extern int32_t  mb_port_tcp_master_linux_wait(int32_t timeout_ms);
+extern void     mb_port_tcp_master_linux_get_stat(MB_PORT_LINUX_TCPM_STAT_STRU *st);
+
+                                                            //in mb_port_tcp_uring.c
+extern MB_SLAVE_STRU    mb_slave_tcp_uring;
+
+extern int32_t  mb_port_tcp_uring_wait      (int32_t timeout_ms);
+extern void     mb_port_tcp_uring_get_stat  (MB_PORT_LINUX_TCP_STAT_STRU *st);
+
+#endif /* _MB_PORT_LINUX_H */
+
+/********************************* end of file ********************************/
@@ -24,6 +24,12 @@
 
                                                             //this slave's id
 #define MB_PORT_ADDRESS                                  (1)
+                                                            /* 1= this port answers several unit addresses, see 'units[]' below,
+                                                            0= answers MB_PORT_ADDRESS only. */
+#define MB_PORT_MULTI_UNIT                               (0)
+                                                            /* 1= FC03/04 are answered in the t35 isr, see MB_RTU_ISR_FASTPATH_ENABLED,
+                                                            only if the app writes the registers in 16-bit words, so the isr never reads half an update. */
+#define MB_PORT_ISR_FASTPATH                             (0)
 
 #define MB_PORT_SERIAL_NAME                         (huart6)  
 
@@ -106,6 +112,30 @@ typedef struct
                                                             ...the functions in this file, while the functions connect data rtu.*/
 static MBPORT_RTU_STRU      rtu;
 
+#if (MB_PORT_MULTI_UNIT == 1)
+                                                            /* example: unit MB_PORT_ADDRESS uses the default image in mb_method.c,
+                                                            ...unit 2 has its own holding/input registers and default handler set. */
+static uint16_t             unit2_hold [32];
+static uint16_t             unit2_input[32];
+static MB_REG_IMAGE_STRU    unit2_image =
+{
+    .p_hold      = unit2_hold,
+    .hold_num    = sizeof(unit2_hold) / sizeof(unit2_hold[0]),
+    .p_input     = unit2_input,
+    .input_num   = sizeof(unit2_input) / sizeof(unit2_input[0]),
+};
+static MB_UNIT_STRU         units[] =
+{
+    { .address = MB_PORT_ADDRESS },
+    { .address = 2, .p_image = &unit2_image },
+};
+static MB_UNIT_TABLE_STRU   unit_tbl =
+{
+    .p_units = units,
+    .num     = sizeof(units) / sizeof(units[0]),
+};
+#endif
+
 /*******************************************************************************
 ******************************* event for port    ******************************
 *******************************************************************************/
@@ -448,6 +478,10 @@ MB_SLAVE_STRU  mb_slave_rtu_01=
     .address               = MB_PORT_ADDRESS,
     .mode                  = MB_RTU,
     .baudrate              = MB_PORT_SERIAL_BAUD,
+    .isr_fastpath          = MB_PORT_ISR_FASTPATH,
+#if (MB_PORT_MULTI_UNIT == 1)
+    .p_unit_tbl            = &unit_tbl,
+#endif
     .p_event_init          = event_init,
     .p_event_post          = event_post,
     .p_event_get           = event_get,
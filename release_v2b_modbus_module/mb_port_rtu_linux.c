@@ -0,0 +1,633 @@
+/**
+  ******************************************************************************
+  * @file    mb_port_rtu_linux.c for a serial rtu port on a linux tty
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/11/21
+  * @brief   same hooks as mb_port_rtu_01.c, on termios instead of stm32 hal.
+             1. there is no IDLE irq and t35 compare timer on linux, the frames
+                are split by mbrtu_ts.c with the timestamps of read().
+             2. the tty is non-blocking, VMIN=0 VTIME=0, read/write are driven
+                by epoll in mb_port_rtu_linux_wait(), which stands for the isr.
+             3. ASYNC_LOW_LATENCY is set so that usb adapters pass the bytes at
+                once, TIOCSRS485 is set if the driver supports it, then the
+                kernel drives DE.
+             4. the timer and the event are a timerfd and an eventfd in the
+                same epoll set as the tty, see mb_port_linux.c.
+             5. a response is written by writev() from its pieces, addr, pdu
+                and crc, where the lib has them.
+             see mb_port_linux.h for how to use.
+  *
+  ******************************************************************************
+  */
+
+/*******************************************************************************
+*******************************   cfg and const    *****************************
+*******************************************************************************/
+                                                            //1=enable 0=disable, only for this file.
+#define MB_PORT_USE_LOG                                  (0)
+
+                                                            //this slave's id
+#define MB_PORT_ADDRESS                                  (1)
+
+#ifndef MB_PORT_SERIAL_DEVICE
+#define MB_PORT_SERIAL_DEVICE                 "/dev/ttyUSB0"
+#endif
+
+#define MB_PORT_SERIAL_BAUD                         (115200)
+                                                            /* added to t35 when splitting frames, 0 for a native uart,
+                                                            a usb adapter with low latency delivers a frame in 1ms chunks. */
+#define MB_PORT_TS_TOL_US                             (1000)
+                                                            /* 1= set TIOCSRS485 if the driver supports it, the kernel drives DE(RTS),
+                                                            0= do not touch, for rs232 or adapters with auto direction. */
+#define MB_PORT_USE_RS485                                (1)
+                                                            /* 1= FC03/04 are answered in the 'isr', see MB_RTU_ISR_FASTPATH_ENABLED,
+                                                            here the 'isr' is mb_port_rtu_linux_wait(), in the same thread as mb_poll(). */
+#define MB_PORT_ISR_FASTPATH                             (1)
+
+
+/*******************************************************************************
+************************************ Includes **********************************
+*******************************************************************************/
+
+//---call some lib---
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+
+//---call some task/module---
+#include "mb.h"      //data type of slave structure
+#include "mbrtu.h"   //the 'isr' callbacks
+#include "mbrtu_ts.h"
+#include "mb_port_linux.h"
+
+#if (MB_RTU_TS_ENABLED == 0)
+    #error "mb_port_rtu_linux.c needs MB_RTU_TS_ENABLED = 1"
+#endif
+
+#if (MB_PORT_USE_LOG == 1)
+    #include <stdio.h>
+    #define LOG(level, ...)  do{ fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); }while(0)
+#else
+    #define LOG(...)
+#endif
+
+/*******************************************************************************
+******************************** Private typedef *******************************
+*******************************************************************************/
+                                                            // private data of this module
+typedef struct
+{
+    MB_PORT_LINUX_EVENT_STRU ev;                            //eventfd, the event queue
+
+    uint32_t        tim_us;                                 //timeout of the timer, set in timer_init()
+    uint64_t        tim_deadline_us;                        //when the timer expires, 0= disabled
+    MB_PORT_LINUX_TIMER_STRU tmr;                           //timerfd, armed to the nearest of all deadlines of this port
+
+    int             fd;                                     //the tty
+    int             epfd;                                   //epoll set of the tty
+    uint32_t        epmask;                                 //events of the tty in the epoll set
+    uint32_t        rx_en;
+    MB_RTU_TS_STRU  ts;                                     //framing by timestamps
+
+    struct iovec    tx_iov[MB_IOVEC_MAX];                   //frame under sending, the pieces are kept by the lib until tx done
+    int             tx_iovcnt;                              //pieces left, 0= no tx
+    int             tx_iovpos;                              //the first piece left, tx_iov[] is moved on by what is written
+    uint64_t        tx_drain_us;                            //when to check the kernel tx queue is empty, 0=no tx
+    int32_t         tx_done;                                //1=all sent, it is the TC flag
+    uint64_t        t_req_us;                               //last byte of the recent request, for turnaround
+
+    MB_PORT_LINUX_RTU_STAT_STRU stat;
+} MBPORT_RTU_LINUX_STRU;
+
+/*******************************************************************************
+******************************* Private variables ******************************
+*******************************************************************************/
+static MBPORT_RTU_LINUX_STRU    lx = { .fd = -1, .epfd = -1 };
+
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static int32_t  port_rx         (void);
+static void     port_tx         (void);
+static void     serial_start_sendv(const MB_IOVEC_STRU v[], int n);
+static void     port_epoll_mod  (uint32_t mask);
+static void     port_check_time (uint64_t now);
+
+/*******************************************************************************
+******************************* event for port    ******************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  event init
+  *
+  * @param  None
+  *
+  * @retval 0= no error
+  *****************************************************************************/
+static int32_t event_init(void)
+{
+    return mb_port_linux_event_open(&lx.ev, lx.epfd);
+}
+
+
+/*******************************************************************************
+  * @brief  send event
+  *
+  * @param  eEvent
+  *
+  * @retval 0= no error
+  *****************************************************************************/
+static int32_t event_post(uint32_t e)
+{
+    return mb_port_linux_event_post(&lx.ev, e);
+}
+
+
+/*******************************************************************************
+  * @brief  get event
+  *
+  * @param  *e
+  *
+  * @retval 0= no error
+  *
+  * @note   never blocks, mb_port_rtu_linux_wait() blocks instead.
+  *****************************************************************************/
+static int32_t event_get(uint32_t * e)
+{
+    return mb_port_linux_event_get(&lx.ev, e);
+}
+
+/*******************************************************************************
+********************************  tim for port   *******************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  timer init
+  *
+  * @param  n_50us
+  *
+  * @retval 0= no error
+  *****************************************************************************/
+static int32_t timer_init(uint32_t n_50us)
+{
+    lx.tim_us          = n_50us * 50;
+    lx.tim_deadline_us = 0;
+    return mb_port_linux_timer_open(&lx.tmr, lx.epfd);
+}
+
+
+/*******************************************************************************
+  * @brief  Enable the timer with the timeout passed to timer_init( )
+  *
+  * @param  en = 0/1
+  *
+  * @retval none
+  *
+  * @note   the timerfd is armed in mb_port_rtu_linux_wait().
+  *****************************************************************************/
+static void timer_enable(uint32_t en)
+{
+    if(en == 1){
+        lx.tim_deadline_us = mb_port_linux_now_us() + lx.tim_us;
+    }
+    else if(en == 0){
+        lx.tim_deadline_us = 0;
+    }
+}
+
+/*******************************************************************************
+******************************** serial for port *******************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  open and config the tty
+  *
+  * @param  port = not used, the tty is MB_PORT_SERIAL_DEVICE
+  * @param  baudrate
+  * @param  databits = 7/8
+  * @param  parity = 0=none, 1=odd, 2=even, same as eMBParity of freemodbus
+  *
+  * @retval 0= no error.
+  *
+  * @note   see mb_port_linux_tty_open().
+  *****************************************************************************/
+static int32_t serial_init( uint8_t port, uint32_t baudrate, uint8_t databits, uint8_t parity)
+{
+    struct epoll_event  ev;
+    (void)port;
+
+    lx.fd = mb_port_linux_tty_open(MB_PORT_SERIAL_DEVICE, baudrate, databits, parity, MB_PORT_USE_RS485,
+                                   &lx.stat.low_latency, &lx.stat.rs485);
+    if(lx.fd < 0){
+        LOG(CLI_LOG_ERR, "open %s failed, errno=%d.", MB_PORT_SERIAL_DEVICE, errno);
+        return __LINE__;
+    }
+
+    lx.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(lx.epfd < 0){
+        return __LINE__;
+    }
+    lx.epmask   = EPOLLIN;
+    ev.events   = lx.epmask;
+    ev.data.fd  = lx.fd;
+    if(epoll_ctl(lx.epfd, EPOLL_CTL_ADD, lx.fd, &ev) != 0){
+        return __LINE__;
+    }
+
+    if(mb_rtu_ts_init(&lx.ts, baudrate, MB_PORT_TS_TOL_US) != 0){
+        return __LINE__;
+    }
+
+    LOG(CLI_LOG_USR, "%s opened, low_latency=%u rs485=%u.", MB_PORT_SERIAL_DEVICE, lx.stat.low_latency, lx.stat.rs485);
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  serial bus io control
+  *
+  * @param  enrx, entx = 1/0
+  *
+  * @retval none
+  *
+  * @note   bytes read while rx is disabled are dropped, they are the echo of
+            our own response on a 2-wire bus without RS485 support.
+  *****************************************************************************/
+static void serial_enable(uint32_t enrx, uint32_t entx)
+{
+    (void)entx;                                             //tx is started by serial_start_send()
+    lx.rx_en = enrx;
+}
+
+
+/*******************************************************************************
+  * @brief  hand data to the kernel, but DO NOT wait for the end.
+  *
+  * @param  d = data, n = num of data
+  *
+  * @retval none
+  * @notte  the whole frame in one piece, see serial_start_sendv().
+  *****************************************************************************/
+static void serial_start_send(uint8_t d[], int n)
+{
+    MB_IOVEC_STRU v;
+
+    v.p   = d;
+    v.len = (uint16_t)n;
+    serial_start_sendv(&v, 1);
+}
+
+
+/*******************************************************************************
+  * @brief  hand the pieces of a frame to the kernel, but DO NOT wait for the end.
+  *
+  * @param  v = pieces, n = num of pieces
+  *
+  * @retval none
+  * @notte  the lib does not touch the pieces until tx done, so they are not
+            copied, writev() gathers them. what the kernel does not take now
+            is written when the tty is writable again.
+  *****************************************************************************/
+static void serial_start_sendv(const MB_IOVEC_STRU v[], int n)
+{
+    uint64_t now;
+    int      i;
+
+    now = mb_port_linux_now_us();
+    if(lx.t_req_us != 0){                                   //turnaround of this request
+        uint32_t turn = (uint32_t)(now - lx.t_req_us);
+        lx.stat.turn_last_us = turn;
+        lx.stat.turn_sum_us += turn;
+        if(turn > lx.stat.turn_max_us){
+            lx.stat.turn_max_us = turn;
+        }
+        if(lx.stat.turn_cnt == 0 || turn < lx.stat.turn_min_us){
+            lx.stat.turn_min_us = turn;
+        }
+        lx.stat.turn_cnt++;
+        lx.t_req_us = 0;
+    }
+
+    if(n > MB_IOVEC_MAX){
+        n = MB_IOVEC_MAX;
+    }
+    for(i = 0; i < n; i++){
+        lx.tx_iov[i].iov_base = (void *)v[i].p;
+        lx.tx_iov[i].iov_len  = v[i].len;
+    }
+    lx.tx_iovcnt = n;
+    lx.tx_iovpos = 0;
+    lx.tx_done = 0;
+    port_tx();
+}
+
+
+/*******************************************************************************
+  * @brief  fentch one frame from the framing engine.
+  *
+  * @param  d= where to store the rx data
+            n= how many you want to read
+  *
+  * @retval how many you actually got.
+  *****************************************************************************/
+static int32_t serial_read_receive(uint8_t d[], int n)
+{
+    return mb_rtu_ts_get(&lx.ts, d, (uint16_t)n);
+}
+
+
+/*******************************************************************************
+  * @brief  check and clear the 'TC' flag, the kernel tx queue is empty.
+  *
+  * @param  none
+  *
+  * @retval 1= tx done
+  *****************************************************************************/
+static int32_t serail_check_TC(void)
+{
+    if(lx.tx_done){
+        lx.tx_done = 0;
+        return 1;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  there is no IDLE flag, frames are split by mbrtu_ts.c
+  *
+  * @param  none
+  *
+  * @retval 0
+  *****************************************************************************/
+static int32_t serial_check_IDLE(void)
+{
+    return 0;
+}
+
+
+/*******************************************************************************
+********************************************************************************
+*                              public functions                                *
+********************************************************************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  wait for the tty and the timers, then run the 'isr' callbacks.
+  *
+  * @param  timeout_ms = how long to wait at most, -1= forever.
+  *
+  * @retval 0= OK, other= the tty is broken, eg. the usb adapter is removed.
+  *
+  * @note   call mb_poll() after it, in the same thread. it returns at once if
+            an event is posted, as the eventfd is in the epoll set.
+  *****************************************************************************/
+int32_t mb_port_rtu_linux_wait(int32_t timeout_ms)
+{
+    struct epoll_event  evs[4];
+    uint64_t            dl, t;
+    int32_t             err = 0;
+    int                 n, i;
+
+    if(lx.epfd < 0){
+        return __LINE__;
+    }
+                                                            //a frame queued behind the one mb_poll() took, eg. two in one usb
+    if(lx.ts.q_cnt > 0 && lx.ev.pending == 0){              //chunk, it has no deadline, give it now, the eventfd wakes the epoll
+        port_check_time(mb_port_linux_now_us());
+    }
+
+                                                            //wake up at the nearest deadline
+    dl = mb_rtu_ts_deadline(&lx.ts);
+    t  = lx.tim_deadline_us;
+    if(t != 0 && (dl == 0 || t < dl)){
+        dl = t;
+    }
+    t  = lx.tx_drain_us;
+    if(t != 0 && (dl == 0 || t < dl)){
+        dl = t;
+    }
+
+    mb_port_linux_timer_arm(&lx.tmr, dl);
+
+    n = epoll_wait(lx.epfd, evs, sizeof(evs) / sizeof(evs[0]), timeout_ms);
+    if(n < 0 && errno != EINTR){
+        return __LINE__;
+    }
+                                                            //deadlines passed before the new bytes came, eg. tx done.
+    port_check_time(mb_port_linux_now_us());
+
+    for(i = 0; i < n; i++){
+        if(evs[i].data.fd == lx.tmr.fd){
+            mb_port_linux_timer_expired(&lx.tmr);
+            continue;
+        }
+        if(evs[i].data.fd != lx.fd){                        //the eventfd, it is read in mb_poll()
+            continue;
+        }
+        if(evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)){
+            err = port_rx();
+        }
+        if(evs[i].events & EPOLLOUT){
+            port_tx();
+        }
+    }
+
+    port_check_time(mb_port_linux_now_us());
+    return err;
+}
+
+
+/*******************************************************************************
+  * @brief  get the statistics of the port
+  *
+  * @param  st = output
+  *
+  * @retval none
+  *****************************************************************************/
+void mb_port_rtu_linux_get_stat(MB_PORT_LINUX_RTU_STAT_STRU *st)
+{
+    if(st != 0){
+        *st = lx.stat;
+        st->tim_expire_cnt  = lx.tmr.expire_cnt;
+        st->tim_late_max_us = lx.tmr.late_max_us;
+        memcpy(st->tim_late_hist, lx.tmr.late_hist, sizeof(st->tim_late_hist));
+    }
+}
+
+
+/*******************************************************************************
+********************************************************************************
+*                              private functions                               *
+********************************************************************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  read all that the tty has, and feed it to the framing engine.
+  *
+  * @param  none
+  *
+  * @retval 0= OK, other= read error, not EAGAIN.
+  *****************************************************************************/
+static int32_t port_rx(void)
+{
+    uint8_t buf[MB_RTU_TS_FRAME_MAX];
+    ssize_t r;
+
+    for(;;){
+        r = read(lx.fd, buf, sizeof(buf));
+        if(r > 0){
+            lx.stat.rx_bytes += (uint32_t)r;
+            if(lx.rx_en){
+                mb_rtu_ts_feed(&lx.ts, buf, (uint16_t)r, mb_port_linux_now_us());
+            }
+            else{
+                lx.stat.rx_drop_bytes += (uint32_t)r;
+            }
+            continue;
+        }
+        if(r == 0 || errno == EAGAIN || errno == EINTR){
+            return 0;                                       //VMIN=0 VTIME=0 gives 0 when all is read, not EAGAIN
+        }
+        LOG(CLI_LOG_ERR, "read err, errno=%d.", errno);
+        return __LINE__;                                    //eg. EIO, the tty is gone
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  write what is left of the frame under sending.
+  *
+  * @param  none
+  *
+  * @retval none
+  *
+  * @note   when all is written, the kernel still holds it, the drain time is
+            estimated by TIOCOUTQ and checked in port_check_time().
+  *****************************************************************************/
+static void port_tx(void)
+{
+    ssize_t r;
+    int     outq;
+    struct iovec *iov;
+
+    if(lx.tx_iovcnt == 0){
+        return;                                             //no tx
+    }
+
+    while(lx.tx_iovcnt > 0){
+        iov = &lx.tx_iov[lx.tx_iovpos];
+        r = writev(lx.fd, iov, lx.tx_iovcnt);
+        if(r <= 0){
+            break;
+        }
+        lx.stat.tx_bytes += (uint32_t)r;
+        while(lx.tx_iovcnt > 0 && (size_t)r >= iov->iov_len){//step over the pieces written
+            r -= iov->iov_len;
+            iov++;
+            lx.tx_iovpos++;
+            lx.tx_iovcnt--;
+        }
+        if(lx.tx_iovcnt > 0){                               //a piece written in part
+            iov->iov_base = (uint8_t *)iov->iov_base + r;
+            iov->iov_len -= (size_t)r;
+        }
+    }
+
+    if(lx.tx_iovcnt > 0){
+        port_epoll_mod(EPOLLIN | EPOLLOUT);                 //wait for room in the kernel
+        return;
+    }
+
+    port_epoll_mod(EPOLLIN);
+    lx.tx_iovpos = 0;
+    lx.stat.tx_frames++;
+    if(ioctl(lx.fd, TIOCOUTQ, &outq) != 0){
+        outq = 0;
+    }
+    lx.tx_drain_us = mb_port_linux_now_us() + (uint64_t)outq * lx.ts.char_us + 1;
+}
+
+
+static void port_epoll_mod(uint32_t mask)
+{
+    struct epoll_event ev;
+
+    if(lx.epmask == mask){
+        return;
+    }
+    lx.epmask  = mask;
+    ev.events  = mask;
+    ev.data.fd = lx.fd;
+    epoll_ctl(lx.epfd, EPOLL_CTL_MOD, lx.fd, &ev);
+}
+
+
+/*******************************************************************************
+  * @brief  check the deadlines, it stands for the timer and uart isr.
+  *
+  * @param  now = monotonic time now
+  *
+  * @retval none
+  *****************************************************************************/
+static void port_check_time(uint64_t now)
+{
+    int outq;
+
+                                                            //a frame is complete, it is the t35 isr.
+    if(mb_rtu_ts_poll(&lx.ts, now) > 0 && lx.rx_en && lx.ev.pending == 0){
+        lx.t_req_us = lx.ts.t_last_us;
+        mb_rtu_t35_callback(&mb_slave_rtu_linux);
+    }
+                                                            //the timer started by the lib
+    if(lx.tim_deadline_us != 0 && now >= lx.tim_deadline_us){
+        lx.tim_deadline_us = 0;
+        mb_rtu_t35_callback(&mb_slave_rtu_linux);
+    }
+                                                            //tx drained, it is the TC isr.
+    if(lx.tx_drain_us != 0 && now >= lx.tx_drain_us){
+        if(ioctl(lx.fd, TIOCOUTQ, &outq) == 0 && outq > 0){
+            lx.tx_drain_us = now + (uint64_t)outq * lx.ts.char_us;
+        }
+        else{
+            lx.tx_drain_us = 0;
+            lx.tx_done     = 1;
+            mb_rtu_bus_send_done_callback(&mb_slave_rtu_linux);
+        }
+    }
+}
+
+
+
+                                                            //public data of this module
+MB_SLAVE_STRU  mb_slave_rtu_linux=
+{
+                                                            /* cfg all the handler of the slave instance*/
+    .address               = MB_PORT_ADDRESS,
+    .mode                  = MB_RTU,
+    .baudrate              = MB_PORT_SERIAL_BAUD,
+    .databits              = 8,
+    .parity                = 2,                             //even
+    .isr_fastpath          = MB_PORT_ISR_FASTPATH,
+    .p_event_init          = event_init,
+    .p_event_post          = event_post,
+    .p_event_get           = event_get,
+    .p_serial_init         = serial_init,
+    .p_serial_enable       = serial_enable,
+    .p_serial_start_send   = serial_start_send,
+    .p_serial_start_sendv  = serial_start_sendv,
+    .p_serial_read_receive = serial_read_receive,
+    .p_serial_check_TC     = serail_check_TC,
+    .p_serial_check_IDLE   = serial_check_IDLE,
+    .p_timer_init          = timer_init,
+    .p_timer_enable        = timer_enable,
+};
+
+
+/********************************* end of file ********************************/
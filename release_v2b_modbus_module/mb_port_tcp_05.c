@@ -5,7 +5,22 @@
   * @version V1 
   * @date    2020-2-11 
   * @brief   
-             can only accept only one client/master, one file, one port.
+             serves up to MB_TCP_CONN_MAX clients/masters, one file, one port.
+             each client has its own adu buffer in mbtcp_conn.c, the requests
+             are served round robin. nothing blocks on one client, a netconn
+             is read only when its mailbox has something, and the task sleeps
+             on a semaphore given by the netconn callback.
+             a client may pipeline, a netbuf is copied into the buffer of its
+             conn as far as it fits, the rest waits in the netbuf until
+             mb_poll() serves a request.
+             a netbuf is copied once, into the buffer of the conn, the request
+             is parsed and the response is built there, see
+             mb_tcp_conn_next_ref().
+             nothing blocks or sleeps but the semaphore: the listener is made
+             once, even if the link is down, a client which errors, is idle
+             for MB_TCP_IDLE_TIMEOUT_MS or does not read its responses is
+             closed alone, the writes do not block, and a reconnecting client
+             is accepted at the next receiving().
              event is a compatable using, so we do not use os_queue.
 
   ******************************************************************************
@@ -23,6 +38,7 @@
 //---call some task/module---
 #include "mb.h"      //data type of slave structure
 #include "mbtcp.h"  //use define MB_TCP_BUF_SIZE
+#include "mbtcp_conn.h"//the clients
 #include "bsp_tp.h"  // for test only.
 #include "cli_log_mb.h"//for LOG();
 #include "ethernetif.h" //to use netif_is_link_up() in ethernetif_notify_conn_changed()
@@ -34,6 +50,8 @@
 //#define LOG(...)   
 
 #define MB_TCP_SERVER_PORT             (502)                //port for this module, usually 502.
+#define MB_TCP_WAIT_MS                 (100)                //receiving() sleeps at most this long when no client sends anything.
+#define MB_TCP_LISTEN_RETRY_MS         (1000)               //if making the listener failed, eg. no memory, try again after this.
 
 /*******************************************************************************
 ******************************** Private typedef *******************************
@@ -42,24 +60,22 @@
 typedef struct
 {
     struct netconn  *lconn;                                 //listen conn
-    struct netconn  *newconn;                               //modbus client conn, we hold one only.
+    MB_TCP_CONN_TABLE_STRU tbl;                             //modbus client conns, the handle is the netconn pointer
+    osSemaphoreId   sem;                                    //given by the netconn callback when a client or data comes
 
     uint8_t         netif_is_up;                            //1=is up, 0=is down, show for other module
-    uint8_t         is_initing;                             //if init is be initialzing, to avoid re-entering init(), 1 Mar 2020 by liq.
+    uint16_t        port;                                   //the tcp port to listen
+    uint32_t        listen_try_ms;                          //when making the listener was tried last time
     uint32_t        init_enter_cnt;                         //the time which init() is called, not called ok.
+    int32_t         cnt_listen_err;                         //cnt of making the listener failed
     uint32_t        event_value;                            //the value of the message
     int32_t         event_is_valid;                         //0=invalid, 1=valid, whether there is a valid evernt in above 'store'
     int32_t         cnt_conn_changed;                       //cnt of notify_conn_changed() be called.
-    int32_t         cnt_reinit;                             //(not total) cnt of reinit after receive() no work for mb,
-    struct netbuf   *netbuf_rcv;                            //rcv netbuf used in receive function
-    void            *rcvdata;                               //of this time, rcv data pointer, from netbuf_rcv
-    uint16_t        rcvlen;                                 //of this time, rcv data len in rcvdata[]
+    int32_t         cnt_conn_err;                           //cnt of clients closed by a recv/write error or a bad adu.
+    struct netbuf   *rxnb[MB_TCP_CONN_MAX];                 //of each client, the netbuf under copying, NULL= none
+    uint16_t        rxnb_off[MB_TCP_CONN_MAX];              //of each client, bytes of rxnb[] copied already
     uint32_t        rcvlen_total;                           //sum of rcvlen, for showing.
-    uint16_t        rcvbufpos;                              //static store the buf rcv index, from 0 to MB_TCP_BUF_SIZE
-    uint16_t        rcvbufpos_last;                         //last value of rcvbufpos, for showing.
-    uint32_t        rcvadu_total;                           //rcv num of adu, valid rcvbufpos, for showing.
-    uint8_t         rcvbuf[MB_TCP_BUF_SIZE];                //buf to concatenate rcv data in to one complete adu,
-                                                            //... actuall it is not need, we can see it as a copy of adu data.
+    uint32_t        rcvadu_total;                           //rcv num of adu, for showing.
 }MBPORT_TCP_STRU;
 
 
@@ -68,7 +84,13 @@ typedef struct
                                                             the functions in this file, while the functions connect data mts.*/
 //static MBPORT_TCP_STRU     mts;
 MBPORT_TCP_STRU     mts;
-extern struct netif gnetif;                                 //netif in lwip.c the default ethernet_if on LAN8742
+osSemaphoreDef(mb_tcp_sem);
+
+static void tcpserver_netconn_cb(struct netconn *conn, enum netconn_evt evt, u16_t len);
+static int  tcpserver_has_rx    (struct netconn *conn, int is_listen);
+static void tcpserver_service   (void);
+static void tcpserver_close     (int32_t idx);
+static int  tcpserver_listen    (void);
 
 
 /*******************************************************************************
@@ -194,82 +216,40 @@ static char * err_string(int e)
 
 
 /*******************************************************************************
-  * @brief  init tcp server, it listen and accept a new link then return.
+  * @brief  init tcp server, it listens then return, clients are accepted in
+            receiving().
   *
   * @param  portnum, if 0, use default
   *
   * @retval err, 0=no error
-  * @notte  
+  * @notte  it does not wait for the link, lwip listens on any address with the
+            link down, the clients come when it is up. if the listener can not
+            be made now, receiving() tries again, so it is not an error here.
   *****************************************************************************/
 static int tcpserver_init(uint16_t tcpport)
 {
-    int terr;                                               //temp used err
-    char *es;                                               //err string
-
-    mts.is_initing = 1;                                     //prevent reentering
     mts.init_enter_cnt++;
-                                                            //wait until eth-link is up.
-    terr = 0;
-    while(netif_is_link_up(&gnetif) == 0)
-    { 
-        LOG(CLI_LOG_ERR, "netif is not up, check it(n=%d)...", terr++);
-        osDelay(2000);
-    }
-
-    //...build/rebuild listen-conn, only listen onetime,
-    terr = netconn_delete(mts.lconn);                       //..first reset it, (delete = close and free, 'conn' becomes null)
-    if(terr != ERR_OK){
-        es = err_string(terr);
-        LOG(CLI_LOG_ERR, "tcpinit delete conn err=%d, %s", terr, es);
-        return __LINE__;
-    }
-    osDelay(100);
 
-    mts.lconn = netconn_new( NETCONN_TCP );                 //..create/recreate it
-    if(mts.lconn == 0){                                     //if creat failed
-        LOG(CLI_LOG_ERR, "tcpinit creat listen conn error.");
-        return __LINE__;                                    
-    }
-                                                            //..bind to socket, the lconn bind to "LOCAL:tcpport"
     if(tcpport == 0){                                       //if in param is 0, set it as default 502 port num.
         tcpport = MB_TCP_SERVER_PORT;
     }
-    ip_set_option((mts.lconn->pcb.tcp), SOF_REUSEADDR);     //allow local address reuse,
-    terr = netconn_bind(mts.lconn, NULL, tcpport);      
-    if(terr != ERR_OK){
-        es = err_string(terr);
-        LOG(CLI_LOG_ERR, "bind conn error=%d, %s.", terr, es);
-        return __LINE__;
-    }
+    mts.port = tcpport;
 
-    terr = netconn_listen(mts.lconn);                       //..tell the conn to goto listening mode
-    if(terr != ERR_OK){
-        es = err_string(terr);
-        LOG(CLI_LOG_ERR, "listen error=%d, %s.", terr, es);
-        return __LINE__;
+    //...the clients
+    if(mts.sem == NULL){
+        mts.sem = osSemaphoreCreate(osSemaphore(mb_tcp_sem), 1);
     }
+    mb_tcp_conn_init(&mts.tbl);
 
-    //...build/rebuild newconn
-    terr = netconn_delete(mts.newconn);                     //..first reset it, (delete = close and free, 'conn' becomes null)
-    osDelay(100);
-    
-    terr = netconn_accept(mts.lconn, &mts.newconn);         //start grabing a new connection
-    if(terr != ERR_OK){
-        es = err_string(terr);
-        LOG(CLI_LOG_ERR, "asccept err=%d, %s.", terr, es);
-        return __LINE__;
-    }
+    mts.listen_try_ms = osKernelSysTick() - MB_TCP_LISTEN_RETRY_MS;
+    tcpserver_listen();
 
-    mts.newconn->recv_timeout = 1500;                       //set timeout for receive and listen, in ms.
-    mts.rcvbufpos = 0;                                      //reset the buf index for following use
-    mts.newconn->pcb.tcp->keep_idle  = 9000;
-    mts.newconn->pcb.tcp->keep_intvl = 3000;
-    mts.newconn->pcb.tcp->keep_cnt   = 5;
     event_post(EV_FRAME_RECEIVED);                          //post a event, otherwise will not able to go poll().
 
     return 0;                                               //no err. show we are succesful.
 }
 
+
 /*******************************************************************************
   * @brief  port io control
   *
@@ -280,12 +260,11 @@ static int tcpserver_init(uint16_t tcpport)
 static void tcpserver_enable(uint32_t en)
 {
     if(en == 0){
-      int err;
+        int32_t i;
         
-        err = netconn_delete(mts.newconn);
-        if(err != 0){
-            LOG(CLI_LOG_ERR, "netcon del(l=%d), ERR=%d.", __LINE__, err);
-        } 
+        for(i = 0; i < MB_TCP_CONN_MAX; i++){               //close all clients
+            tcpserver_close(i);
+        }
     }
     if(en == 1){
         //...nothing,
@@ -316,128 +295,293 @@ void ethernetif_notify_conn_changed(struct netif *netif)
 }
 
 /*******************************************************************************
-  * @brief  blocking receive data.
+  * @brief  receive the next request of all clients.
   *
-  * @param  d= output ADU pointer
+  * @param  d= the buffer to copy the ADU to, if it can not stay in place
+            adu= output ADU pointer, d or the buffer of the conn
             n= output ADU total len
   *
   * @retval erron code, 0=no error.
   * @notte  called by mbpoll(), pointer by 'p_slave_receive_pdu'
+            1. accept new clients and read the clients which have data, a
+               client with an error or idle too long is closed alone, the
+               others go on.
+            2. one request of one client, round robin, see mbtcp_conn.c.
+            3. if no client has a complete request, it sleeps on the semaphore
+               for MB_TCP_WAIT_MS at most.
   *****************************************************************************/
-static int tcpserver_receving( uint8_t d[], uint16_t *out_dlen )
+static int tcpserver_receive_ref( uint8_t d[], uint8_t **adu, uint16_t *out_dlen )
 {
-    int e; //err_t enum,
+    int32_t idx;
 
-    if(mts.newconn == NULL){
-        LOG(CLI_LOG_ERR, "newconn is NULL in rcv.");
-        osDelay(500);
-        //e = tcpserver_reaccept();
-        //LOG(CLI_LOG_USR, "rcv()/reaccept(),[e=%d].", e);        
+    event_post(EV_FRAME_RECEIVED); //always post it, compatable with rtu/ascii port's event mechanism
+
+    if(mts.lconn == NULL && tcpserver_listen() != 0){
+        osSemaphoreWait(mts.sem, MB_TCP_WAIT_MS);           //no listener yet, it is tried again later.
         return __LINE__;
     }
 
-    event_post(EV_FRAME_RECEIVED); //always post it, compatable with rtu/ascii port's event mechanism
+    while((idx = mb_tcp_conn_idle(&mts.tbl, osKernelSysTick())) != MB_TCP_CONN_NONE){
+        LOG(CLI_LOG_ERR, "client %d is idle, closed.", idx);
+        tcpserver_close(idx);
+    }
 
-    e = netconn_recv(mts.newconn, &(mts.netbuf_rcv));       //blocked before timeout.
-    if(e != ERR_OK){
-        char * es;//pointer for err string lookup,
-        
-        mts.cnt_reinit++;
-        es = err_string(e);
-        LOG(CLI_LOG_ERR, "rcv(), err=%d (%s).", e, es);
-        if(e)
-        {
-            //ERR_TIMEOUT//ERR_ABRT//ERR_RST//ERR_CLSD
-                osDelay(2000);
-                e = tcpserver_init(0);
-            LOG(CLI_LOG_USR, "tcpinit %d-th done, eline=%d.", mts.cnt_reinit, e);
-        }
-        return __LINE__;                                    //err, no data return.
+    tcpserver_service();
+    if(mb_tcp_conn_ready(&mts.tbl) == 0){
+        osSemaphoreWait(mts.sem, MB_TCP_WAIT_MS);           //blocked before a client sends or timeout.
+        tcpserver_service();
+    }
+
+    if(mb_tcp_conn_next_ref(&mts.tbl, d, adu, out_dlen) == MB_TCP_CONN_NONE){
+        return __LINE__;                                    //no request.
+    }
+    mts.rcvadu_total++;                                     //showing the adu cnt
+    return 0;
+}
+
+/*******************************************************************************
+  * @brief  send the pieces of a response to the client of the request
+  *
+  * @param  v = pieces, MBAP and pdu
+  * @param  n = num of pieces
+  *
+  * @retval 0= OK
+  * @notte  the pieces go into one segment, NETCONN_MORE holds back the PSH
+            until the last one. NETCONN_COPY, not NOCOPY, as lwip keeps a
+            NOCOPY piece until it is acked, for retransmission, while the
+            buffer of the conn takes the next request at once. so it is copied
+            once, into the tcp send buffer, and never assembled before.
+            NETCONN_DONTBLOCK, a client which does not read, its window is 0
+            and the send buffer full, would block the task and all the other
+            clients. a response is far less than the send buffer, so if it
+            does not fit whole the client is closed alone.
+  *****************************************************************************/
+static int tcpserver_sendv(const MB_IOVEC_STRU v[], int n)
+{
+    int e;
+    intptr_t        h;                                      //the client, a netconn pointer
+    int32_t         idx;
+    int             i;
+    uint8_t         flags;
+    size_t          written;
+
+    idx = mb_tcp_conn_cur(&mts.tbl, &h);
+    if(idx == MB_TCP_CONN_NONE){
+        return __LINE__;                                    //the client is gone
     }
 
-    //...now received some data in netbuf_rcv, fentch them in below.
-    do{
-        netbuf_data(mts.netbuf_rcv, &(mts.rcvdata), &(mts.rcvlen));
-        mts.rcvlen_total += mts.rcvlen;                     //showing total cnt from port, raw data.
-                                                            //store data to local zone. first check if there is enough space
-        if((mts.rcvbufpos + mts.rcvlen) >= MB_TCP_BUF_SIZE){
-            mts.rcvbufpos = 0;                              //sorry, no space for incoming data, will not copy to buf[SIZE], break and next delete the netbuf.
-            netbuf_delete(mts.netbuf_rcv); 
-            return __LINE__;                                //frame too big, exceed buf[SIZE].
+    for(i = 0; i < n; i++){
+        flags = NETCONN_COPY | NETCONN_DONTBLOCK;
+        if(i < n - 1){
+            flags |= NETCONN_MORE;
         }
-        else{
-            memcpy(&(mts.rcvbuf[mts.rcvbufpos]), mts.rcvdata, mts.rcvlen);  
-            mts.rcvbufpos += mts.rcvlen;
+        written = 0;
+        e = netconn_write_partly( (struct netconn *)h, v[i].p, v[i].len, flags, &written );
+        if(e != ERR_OK || written != v[i].len){               //ERR_WOULDBLOCK, or a part, the rest of the adu cannot follow
+            LOG(CLI_LOG_ERR, "net write err=%d, %u of %u.", e, (unsigned)written, (unsigned)v[i].len);
+            mts.cnt_conn_err++;
+            tcpserver_close(idx);
+            return __LINE__;
         }
-    } 
-    while (netbuf_next(mts.netbuf_rcv) >= 0);
-    netbuf_delete(mts.netbuf_rcv);
+    }
+    return 0;
+}
 
 
-    //...now we get the buf[SIZE], its content is less than SIZE, not overrun, and..let's parse it
-    if(mts.rcvbufpos >= MB_TCP_FUNC)                        //make sure it is > 7 (MBAP len), the minimal len of a total ADU frame
-    {
-        uint16_t   usLength;                                //len in MBAP's LEN nibble.
-        usLength  = mts.rcvbuf[MB_TCP_LEN] << 8U;           //ADU[4],[5], LEN is u16 type, LEN=1+1+N, 1-unit_id, 1-function code, n-data
-        usLength |= mts.rcvbuf[MB_TCP_LEN + 1];
-
-                                                            // Is the frame already complete
-        if( mts.rcvbufpos < ( MB_TCP_UID + usLength ) ){ 
-                                                            //if tatal len in buf[] is not reach 6+LEN, that's the data is not fully filled
-                                                            //...we do nothing, wait next period.
-            LOG(CLI_LOG_ERR, "rcv bytes (%d) not reach 6+LEN(%d).", mts.rcvbufpos, usLength); 
-            return __LINE__;
+
+/*******************************************************************************
+  * @brief  netconn callback, in the tcpip thread, wake up receiving().
+  *
+  * @param  conn, evt, len
+  *
+  * @retval none
+  * @notte  RCVPLUS comes with a new client on the listen conn, with data or
+            a close on a client conn. exit as soon as possible.
+  *****************************************************************************/
+static void tcpserver_netconn_cb(struct netconn *conn, enum netconn_evt evt, u16_t len)
+{
+    (void)conn;
+    (void)len;
+    if(evt == NETCONN_EVT_RCVPLUS && mts.sem != NULL){
+        osSemaphoreRelease(mts.sem);
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  if netconn_accept()/netconn_recv() will return at once
+  *
+  * @param  conn, is_listen = 1 for the listen conn
+  *
+  * @retval 1= something in the mailbox, a client, data, or a close.
+  *****************************************************************************/
+static int tcpserver_has_rx(struct netconn *conn, int is_listen)
+{
+    sys_mbox_t *mbox;
+
+    mbox = is_listen ? &(conn->acceptmbox) : &(conn->recvmbox);
+    if(sys_mbox_valid(mbox) == 0){
+        return 0;
+    }
+    return (osMessageWaiting(*mbox) > 0);
+}
+
+
+/*******************************************************************************
+  * @brief  accept the new clients and read the clients which have data.
+  *
+  * @param  none
+  *
+  * @retval none
+  * @notte  never blocks, see tcpserver_has_rx().
+  *****************************************************************************/
+static void tcpserver_service(void)
+{
+    struct netconn *nc;                                     //a client
+    struct netbuf  *nb;
+    int32_t         idx;
+    int             e;                                      //err_t enum,
+    uint8_t        *p;                                      //where to copy in the buffer of the conn
+    uint16_t        space, n;
+
+    mb_tcp_conn_done(&mts.tbl);                             //the request before is over, its buffer can take new data
+
+                                                            //...new clients
+    while(tcpserver_has_rx(mts.lconn, 1)){
+        e = netconn_accept(mts.lconn, &nc);
+        if(e != ERR_OK){
+            LOG(CLI_LOG_ERR, "asccept err=%d, %s.", e, err_string(e));
+            break;
         }
-        else if(mts.rcvbufpos == (MB_TCP_UID + usLength)){
-            
-            memcpy(d, mts.rcvbuf, mts.rcvbufpos);  
-            *out_dlen = mts.rcvbufpos;
-            mts.rcvbufpos_last = mts.rcvbufpos;             //showing last bufpos
-            mts.rcvadu_total++;                             //showing the adu cnt
-
-            mts.rcvbufpos = 0;                              //reset the buffer
-            //LOG(CLI_LOG_USR, "OK, rcvd a good frame[%d].", mts.rcvadu_total);
-            return 0;
+        idx = mb_tcp_conn_open(&mts.tbl, (intptr_t)nc);
+        if(idx == MB_TCP_CONN_NONE){
+            LOG(CLI_LOG_ERR, "too many clients, refused.");
+            netconn_close(nc);
+            netconn_delete(nc);
+            continue;
         }
-        else
-        {
-            LOG(CLI_LOG_ERR, "rcv too many bytes (%d),drop client.\r\n", mts.rcvbufpos); //this should not happen.
-            mts.rcvbufpos = 0;
-            return __LINE__;
+        ip_set_option(nc->pcb.tcp, SOF_KEEPALIVE);          //finds a dead peer, eg. the link is down
+        nc->pcb.tcp->keep_idle  = 9000;
+        nc->pcb.tcp->keep_intvl = 3000;
+        nc->pcb.tcp->keep_cnt   = 5;
+    }
+
+                                                            //...data of the clients
+    for(idx = 0; idx < MB_TCP_CONN_MAX; idx++){
+        if(mts.tbl.conn[idx].used == 0){
+            continue;
         }
+        nc = (struct netconn *)mts.tbl.conn[idx].handle;
+        while(mts.tbl.conn[idx].used){
+            if(mts.rxnb[idx] == NULL){
+                if(tcpserver_has_rx(nc, 0) == 0){
+                    break;
+                }
+                e = netconn_recv(nc, &(mts.rxnb[idx]));
+                if(e != ERR_OK){                            //ERR_ABRT//ERR_RST//ERR_CLSD, this client only
+                    LOG(CLI_LOG_ERR, "rcv(), err=%d (%s), client %d closed.", e, err_string(e), idx);
+                    mts.rxnb[idx] = NULL;
+                    mts.cnt_conn_err++;
+                    tcpserver_close(idx);
+                    break;
+                }
+                mts.rxnb_off[idx] = 0;
+            }
+            nb = mts.rxnb[idx];
+
+            p = mb_tcp_conn_rxspace(&mts.tbl, idx, &space);
+            if(space == 0){
+                break;                                      //full of requests, or no slab, the rest waits in the netbuf
+            }
+            n = netbuf_len(nb) - mts.rxnb_off[idx];
+            if(n > space){
+                n = space;
+            }
+            netbuf_copy_partial(nb, p, n, mts.rxnb_off[idx]);//over the pbuf chain, a split adu is joined here
+            mts.rxnb_off[idx] += n;
+            mts.rcvlen_total  += n;                         //showing total cnt from port, raw data.
+            if(mb_tcp_conn_rxdone(&mts.tbl, idx, n) != 0){
+                LOG(CLI_LOG_ERR, "bad adu, client %d closed.", idx);
+                mts.cnt_conn_err++;
+                tcpserver_close(idx);
+                break;
+            }
+            if(mts.rxnb_off[idx] >= netbuf_len(nb)){
+                netbuf_delete(nb);
+                mts.rxnb[idx] = NULL;
+            }
+        }
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  make the listener, only once, it is never deleted after.
+  *
+  * @param  none
+  *
+  * @retval 0= it is listening, other= not now, tried again after
+            MB_TCP_LISTEN_RETRY_MS.
+  *****************************************************************************/
+static int tcpserver_listen(void)
+{
+    int terr;                                               //temp used err
+    uint32_t now;
+
+    if(mts.lconn != NULL){
+        return 0;
     }
-    else{
-        return __LINE__;  //adu is not long enought, less than a header size.
+    now = osKernelSysTick();
+    if((uint32_t)(now - mts.listen_try_ms) < MB_TCP_LISTEN_RETRY_MS){
+        return __LINE__;
     }
-    
+    mts.listen_try_ms = now;
+
+    mts.lconn = netconn_new_with_callback( NETCONN_TCP, tcpserver_netconn_cb );//..the accepted conns get the same callback
+    if(mts.lconn == 0){                                     //if creat failed
+        LOG(CLI_LOG_ERR, "tcpinit creat listen conn error.");
+        mts.cnt_listen_err++;
+        return __LINE__;
+    }
+                                                            //..bind to socket, the lconn bind to "LOCAL:tcpport"
+    ip_set_option((mts.lconn->pcb.tcp), SOF_REUSEADDR);     //allow local address reuse,
+    terr = netconn_bind(mts.lconn, NULL, mts.port);
+    if(terr == ERR_OK){
+        terr = netconn_listen(mts.lconn);                   //..tell the conn to goto listening mode
+    }
+    if(terr != ERR_OK){
+        LOG(CLI_LOG_ERR, "bind/listen error=%d, %s.", terr, err_string(terr));
+        netconn_delete(mts.lconn);
+        mts.lconn = NULL;
+        mts.cnt_listen_err++;
+        return __LINE__;
+    }
+    return 0;
 }
 
+
 /*******************************************************************************
-  * @brief  send data to client (the only one client, 'mts.newconn')
+  * @brief  close a client and free its conn
   *
-  * @param  data , to send
-  * @param  len , in bytes
+  * @param  idx = the conn in mts.tbl
   *
   * @retval none
-  * @notte  we use buffer copy in this function, actually we could not use COPY.
-    netconn_write(mts.newconn, mts.pdata, mts.len, NETCONN_COPY);
   *****************************************************************************/
-static int tcpserver_send(uint8_t pucMBTCPFrame[], uint16_t usTCPLength )
+static void tcpserver_close(int32_t idx)
 {
-    int e;
-    struct netbuf   *TCPNetbuf;                             //* the send pbuf */
-                                                            //* creat a new pbuf */
-    TCPNetbuf = netbuf_new();
-                                                            //* cache the reference to the data source */
-    netbuf_ref( TCPNetbuf, pucMBTCPFrame, usTCPLength);
-    
-    e = netconn_write( mts.newconn, (void *)pucMBTCPFrame, usTCPLength, NETCONN_COPY/*NETCONN_NOCOPY*/ );
-    if(e != ERR_OK){
-        LOG(CLI_LOG_ERR, "net write err=%d.", e);
-    }                                                       //* delete cache and data. */
-    netbuf_delete( TCPNetbuf );
+    struct netconn *nc;
 
-    return 0;
+    if(idx < 0 || idx >= MB_TCP_CONN_MAX || mts.tbl.conn[idx].used == 0){
+        return;
+    }
+    nc = (struct netconn *)mts.tbl.conn[idx].handle;
+    if(mts.rxnb[idx] != NULL){
+        netbuf_delete(mts.rxnb[idx]);
+        mts.rxnb[idx] = NULL;
+    }
+    netconn_close(nc);
+    netconn_delete(nc);
+    mb_tcp_conn_close(&mts.tbl, idx);
 }
 
 
@@ -453,8 +597,8 @@ MB_SLAVE_STRU mb_slave_tcp_05 =
     .p_event_get           = event_get,
     .p_tcpsvr_init         = tcpserver_init,
     .p_tcpsvr_enable       = tcpserver_enable,
-    .p_tcpsvr_send         = tcpserver_send,
-    .p_tcpsvr_receiving    = tcpserver_receving,
+    .p_tcpsvr_sendv        = tcpserver_sendv,
+    .p_tcpsvr_receive_ref  = tcpserver_receive_ref,
 };
 
 /********************************* end of file ********************************/
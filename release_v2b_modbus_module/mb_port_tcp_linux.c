@@ -0,0 +1,885 @@
+/**
+  ******************************************************************************
+  * @file    mb_port_tcp_linux.c for a modbus tcp server on linux sockets
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/12/04
+  * @brief   same hooks as mb_port_tcp_05.c, on bsd sockets instead of lwip.
+             1. the listen socket and the clients are non-blocking, in one
+                edge triggered epoll set with the eventfd,
+                mb_port_tcp_linux_wait() accepts and reads them until EAGAIN.
+             2. up to MB_TCP_CONN_MAX clients, each one has its own adu
+                buffer, the requests are served round robin, see mbtcp_conn.c.
+                set MB_TCP_CONN_MAX for the build, eg. -DMB_TCP_CONN_MAX=10240
+                -DMB_TCP_SLAB_NUM=1024, a client costs under 100 bytes then,
+                plus its socket in the kernel.
+             3. a client may pipeline, recv() reads straight into its buffer as
+                much as fits, when it is full of adus, or no buffer is free,
+                it is paused, read again after mb_poll() made room.
+             4. a client which sends nothing for MB_TCP_IDLE_TIMEOUT_MS is
+                closed, keepalive finds a dead one, the listener is made once.
+             5. zero copy, the request is parsed and the response is built in
+                the buffer recv() wrote, see mb_tcp_conn_next_ref(). the
+                response goes by sendmsg() from its pieces, MBAP and pdu.
+             6. sharded, up to MB_PORT_TCP_WORKER_MAX threads, each one calls
+                mb_port_tcp_linux_worker() first, then runs the loop on its
+                own copy of mb_slave_tcp_linux. each worker has its own
+                SO_REUSEPORT listener, epoll set and conn table, the kernel
+                spreads the clients over the listeners, a request is served
+                to the end on the thread which read it. the register image is
+                shared, the readers take no lock, see mb_image_read_begin().
+             7. gateway, the requests of the unit ids routed to a serial line
+                are queued to it instead of mb_poll(), see mbgw.h and
+                mb_port_tcp_linux_gateway(). the answers come back through an
+                eventfd and are sent from mb_port_tcp_linux_wait().
+             see mb_port_linux.h for how to use.
+  *
+  ******************************************************************************
+  */
+
+/*******************************************************************************
+*******************************   cfg and const    *****************************
+*******************************************************************************/
+                                                            //1=enable 0=disable, only for this file.
+#define MB_PORT_USE_LOG                                  (0)
+
+                                                            //this slave's id
+#define MB_PORT_ADDRESS                                  (5)
+
+#ifndef MB_PORT_TCP_LISTEN_PORT
+#define MB_PORT_TCP_LISTEN_PORT                        (502)
+#endif
+                                                            //backlog of listen()
+#define MB_PORT_TCP_BACKLOG                            (128)
+
+                                                            //threads serving the port, each one has its own conn table of MB_TCP_CONN_MAX
+#ifndef MB_PORT_TCP_WORKER_MAX
+#define MB_PORT_TCP_WORKER_MAX                           (8)
+#endif
+
+
+/*******************************************************************************
+************************************ Includes **********************************
+*******************************************************************************/
+
+//---call some lib---
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE                                         //accept4()
+#endif
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+//---call some task/module---
+#include "mb.h"      //data type of slave structure
+#include "mbtcp.h"
+#include "mbtcp_conn.h"
+#include "mbgw.h"
+#include "mb_port_linux.h"
+
+#if (MB_PORT_USE_LOG == 1)
+    #include <stdio.h>
+    #define LOG(level, ...)  do{ fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); }while(0)
+#else
+    #define LOG(...)
+#endif
+
+                                                            //tags in the high bits of epoll data.u64, the eventfd has 0 there.
+#define PORT_EP_LISTEN                          (1ULL << 32)
+#define PORT_EP_CONN                            (2ULL << 32)//low 32 bits = index in the conn table
+#define PORT_EP_GW                              (3ULL << 32)//the eventfd of the gateway, answers are ready
+                                                            //events of a client, edge triggered, read it until EAGAIN
+#define PORT_EP_CONN_EVENTS                     (EPOLLIN | EPOLLRDHUP | EPOLLET)
+#define PORT_EP_EVENT_MAX                              (256)//events taken by one epoll_wait()
+
+/*******************************************************************************
+******************************** Private typedef *******************************
+*******************************************************************************/
+                                                            //a fifo of conns, each one is in it once at most
+typedef struct
+{
+    uint16_t        idx[MB_TCP_CONN_MAX];
+    uint16_t        head;
+    uint16_t        num;
+} PORT_RING_STRU;
+
+                                                            // private data of this module
+typedef struct
+{
+    MB_PORT_LINUX_EVENT_STRU ev;                            //eventfd, the event queue
+
+    uint8_t         opened;                                 //1= the epoll set is made
+    uint8_t         reuseport;                              //1= a worker, its listener shares the port with the others
+    int             lfd;                                    //the listen socket
+    int             epfd;                                   //epoll set of all sockets
+    struct epoll_event evs[PORT_EP_EVENT_MAX];              //taken by one epoll_wait()
+    MB_TCP_CONN_TABLE_STRU tbl;                             //the clients, the handle is the socket fd
+    PORT_RING_STRU  room;                                   //paused, bytes in the socket, the buffer is full, see port_rx()
+    PORT_RING_STRU  slab;                                   //paused, bytes in the socket, no slab for a buffer
+    uint8_t         accept_more;                            //1= accept4() stopped before EAGAIN, eg. EMFILE
+#if MB_GW_ENABLED > 0
+    MB_GW_STRU      *gw;                                    //0= no gateway, all requests go to mb_poll()
+    int             gwfd;                                   //eventfd, the lines tell an answer is ready
+#endif
+
+    MB_PORT_LINUX_TCP_STAT_STRU stat;
+} MBPORT_TCP_LINUX_STRU;
+
+/*******************************************************************************
+******************************* Private variables ******************************
+*******************************************************************************/
+static MBPORT_TCP_LINUX_STRU    lt_worker[MB_PORT_TCP_WORKER_MAX];
+                                                            //the worker of this thread, the first one if it never called mb_port_tcp_linux_worker()
+static MB_THREAD_LOCAL MBPORT_TCP_LINUX_STRU *lt = &lt_worker[0];
+#if MB_GW_ENABLED > 0
+                                                            //the worker which serves the gateway, for port_gw_notify() called by the lines
+static MBPORT_TCP_LINUX_STRU    *lt_gw;
+#endif
+
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static int32_t  port_epoll_open (void);
+static void     port_accept     (void);
+static void     port_rx         (int32_t idx);
+static void     port_rx_pause   (int32_t idx);
+static void     port_rx_resume  (void);
+static void     port_ring_push  (PORT_RING_STRU *r, int32_t idx);
+static int32_t  port_ring_pop   (PORT_RING_STRU *r);
+static void     port_close      (int32_t idx);
+static int32_t  port_send       (int32_t idx, struct iovec iov[], int n, size_t len);
+#if MB_GW_ENABLED > 0
+static void     port_gw_notify  (void *gw);
+static void     port_gw_reply   (void);
+#endif
+
+/*******************************************************************************
+******************************* event for port    ******************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  event init
+  *
+  * @param  None
+  *
+  * @retval 0= no error
+  *
+  * @note   it is called before tcpsvr_init(), so the epoll set is made here.
+  *****************************************************************************/
+static int32_t event_init(void)
+{
+    if(port_epoll_open() != 0){
+        return __LINE__;
+    }
+    return mb_port_linux_event_open(&lt->ev, lt->epfd);
+}
+
+
+/*******************************************************************************
+  * @brief  send event
+  *
+  * @param  eEvent
+  *
+  * @retval 0= no error
+  *****************************************************************************/
+static int32_t event_post(uint32_t e)
+{
+    return mb_port_linux_event_post(&lt->ev, e);
+}
+
+
+/*******************************************************************************
+  * @brief  get event
+  *
+  * @param  *e
+  *
+  * @retval 0= no error
+  *
+  * @note   never blocks, mb_port_tcp_linux_wait() blocks instead.
+  *****************************************************************************/
+static int32_t event_get(uint32_t * e)
+{
+    return mb_port_linux_event_get(&lt->ev, e);
+}
+
+/*******************************************************************************
+******************************** tcp for port  *********************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  init tcp server, it listens then return, clients are accepted in
+            mb_port_tcp_linux_wait().
+  *
+  * @param  tcpport, if 0, use MB_PORT_TCP_LISTEN_PORT
+  *
+  * @retval err, 0=no error
+  *****************************************************************************/
+static int32_t tcpserver_init(uint16_t tcpport)
+{
+    struct sockaddr_in  sa;
+    struct epoll_event  ev;
+    int                 on = 1;
+
+    if(port_epoll_open() != 0){
+        return __LINE__;
+    }
+    if(tcpport == 0){
+        tcpport = MB_PORT_TCP_LISTEN_PORT;
+    }
+
+    lt->lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(lt->lfd < 0){
+        return __LINE__;
+    }
+    setsockopt(lt->lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if(lt->reuseport && setsockopt(lt->lfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0){
+        return __LINE__;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family      = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_ANY);
+    sa.sin_port        = htons(tcpport);
+    if(bind(lt->lfd, (struct sockaddr *)&sa, sizeof(sa)) != 0){
+        LOG(CLI_LOG_ERR, "bind port %u failed, errno=%d.", tcpport, errno);
+        return __LINE__;
+    }
+    if(listen(lt->lfd, MB_PORT_TCP_BACKLOG) != 0){
+        return __LINE__;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN | EPOLLET;
+    ev.data.u64 = PORT_EP_LISTEN;
+    if(epoll_ctl(lt->epfd, EPOLL_CTL_ADD, lt->lfd, &ev) != 0){
+        return __LINE__;
+    }
+
+    mb_tcp_conn_init(&lt->tbl);
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  port io control
+  *
+  * @param  en = 0/1
+  *
+  * @retval none
+  *
+  * @note   0= close all clients, the listen socket is kept.
+  *****************************************************************************/
+static void tcpserver_enable(uint32_t en)
+{
+    int32_t i;
+
+    if(en == 0){
+        for(i = 0; i < MB_TCP_CONN_MAX; i++){
+            port_close(i);
+        }
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  take the next request of all clients.
+  *
+  * @param  d= the buffer to copy the ADU to, if it can not stay in place
+            adu= output ADU pointer, d or the buffer of the conn
+            n= output ADU total len
+  *
+  * @retval erron code, 0=no error.
+  * @notte  called by mbpoll(), pointer by 'p_slave_receive_pdu'. the sockets
+            are read in mb_port_tcp_linux_wait(), here only the table is looked.
+            the requests for the serial lines of the gateway are queued and
+            skipped, so a client may get its answers out of order, each one
+            with its transaction id.
+  *****************************************************************************/
+static int32_t tcpserver_receive_ref(uint8_t d[], uint8_t **adu, uint16_t *out_dlen)
+{
+#if MB_GW_ENABLED > 0
+    struct iovec iov;
+    int32_t r;
+#endif
+    int32_t idx;
+
+    for(;;){
+        idx = mb_tcp_conn_next_ref(&lt->tbl, d, adu, out_dlen);
+        if(idx == MB_TCP_CONN_NONE){
+            return __LINE__;
+        }
+        lt->stat.rx_adu++;
+#if MB_GW_ENABLED == 0
+        break;
+#else
+        if(lt->gw == 0){
+            break;
+        }
+        r = mb_gw_submit(lt->gw, *adu, out_dlen, idx, lt->tbl.conn[idx].open_no, mb_port_linux_now_us());
+        if(r == MB_GW_LOCAL){
+            break;
+        }
+        if(r != 0){                                         //from the cache, or refused, eg. the queue of the line is full
+            iov.iov_base = *adu;
+            iov.iov_len  = (r == MB_GW_CACHED) ? *out_dlen : mb_gw_exception(*adu, (uint8_t)r);
+            port_send(idx, &iov, 1, iov.iov_len);
+        }
+#endif
+    }
+    if(mb_tcp_conn_ready(&lt->tbl) > 0){                     //more clients are waiting, come again
+        event_post(EV_FRAME_RECEIVED);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  send the pieces of a response to the client of the request
+  *
+  * @param  v = pieces, MBAP and pdu
+  * @param  n = num of pieces
+  *
+  * @retval 0= OK
+  * @notte  a response is far smaller than the socket buffer, a short write
+            means the client does not read, it is closed. sendmsg() rather
+            than writev() for MSG_NOSIGNAL.
+  *****************************************************************************/
+static int32_t tcpserver_sendv(const MB_IOVEC_STRU v[], int n)
+{
+    struct iovec  iov[MB_IOVEC_MAX];
+    intptr_t h;
+    int32_t  idx;
+    size_t   len = 0;
+    int      i;
+
+    idx = mb_tcp_conn_cur(&lt->tbl, &h);
+    if(idx == MB_TCP_CONN_NONE){
+        return __LINE__;                                    //the client is gone
+    }
+
+    if(n > MB_IOVEC_MAX){
+        n = MB_IOVEC_MAX;
+    }
+    for(i = 0; i < n; i++){
+        iov[i].iov_base = (void *)v[i].p;
+        iov[i].iov_len  = v[i].len;
+        len += v[i].len;
+    }
+    return port_send(idx, iov, n, len);
+}
+
+
+/*******************************************************************************
+********************************************************************************
+*                              public functions                                *
+********************************************************************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  wait for the sockets, accept new clients and read the requests.
+  *
+  * @param  timeout_ms = how long to wait at most, -1= forever.
+  *
+  * @retval 0= OK, other= epoll error.
+  *
+  * @note   call mb_poll() after it, in the same thread. it returns at once if
+            an event is posted, as the eventfd is in the epoll set.
+            the paused clients are read first, mb_poll() may have made room.
+  *****************************************************************************/
+int32_t mb_port_tcp_linux_wait(int32_t timeout_ms)
+{
+    struct epoll_event  *evs = lt->evs;
+    int                 n, i;
+    int32_t             idx;
+    uint64_t            tag;
+
+    if(lt->opened == 0){
+        return __LINE__;
+    }
+    mb_tcp_conn_done(&lt->tbl);                              //mb_poll() is over, the buffer of a request served in place is free
+    while((idx = mb_tcp_conn_idle(&lt->tbl, (uint32_t)(mb_port_linux_now_us() / 1000))) != MB_TCP_CONN_NONE){
+        LOG(CLI_LOG_ERR, "client %d is idle, closed.", idx);
+        port_close(idx);
+    }
+    port_rx_resume();
+    if(lt->accept_more){
+        port_accept();
+    }
+    if(lt->ev.pending || mb_tcp_conn_ready(&lt->tbl) > 0){
+        timeout_ms = 0;                                     //work is waiting, only look at the sockets
+    }
+
+    n = epoll_wait(lt->epfd, evs, PORT_EP_EVENT_MAX, timeout_ms);
+    if(n < 0 && errno != EINTR){
+        return __LINE__;
+    }
+
+    for(i = 0; i < n; i++){
+        tag = evs[i].data.u64 & ~0xFFFFFFFFULL;
+        if(tag == PORT_EP_LISTEN){
+            port_accept();
+        }
+        else if(tag == PORT_EP_CONN){
+            port_rx((int32_t)(evs[i].data.u64 & 0xFFFFFFFFULL));
+        }
+#if MB_GW_ENABLED > 0
+        else if(tag == PORT_EP_GW){
+            port_gw_reply();
+        }
+#endif
+                                                            //else the eventfd, it is read in mb_poll()
+    }
+
+    if(lt->ev.pending == 0 && mb_tcp_conn_ready(&lt->tbl) > 0){
+        event_post(EV_FRAME_RECEIVED);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  make the calling thread a worker of the port, before mb_init().
+  *
+  * @param  id = the worker, 0 ~ MB_PORT_TCP_WORKER_MAX-1, one thread each
+            cpu = the core to run on, -1= any
+  *
+  * @retval 0= OK
+  *
+  * @note   the thread then runs mb_init(), mb_enable() and the loop of
+            mb_port_tcp_linux_wait() and mb_poll() on a slave of its own, a
+            copy of mb_slave_tcp_linux made before mb_init():
+
+                MB_SLAVE_STRU slave = mb_slave_tcp_linux;
+                mb_port_tcp_linux_worker(id, id);
+                mb_init(&slave);
+                mb_enable(&slave, 1);
+                for(;;){
+                    mb_port_tcp_linux_wait(100);
+                    mb_poll(&slave);
+                }
+
+            a thread which never calls it is the worker 0, without
+            SO_REUSEPORT, the single thread server as before.
+  *****************************************************************************/
+int32_t mb_port_tcp_linux_worker(int32_t id, int32_t cpu)
+{
+    cpu_set_t set;
+
+    if(id < 0 || id >= MB_PORT_TCP_WORKER_MAX){
+        return __LINE__;
+    }
+    if(cpu >= 0){
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0){
+            return __LINE__;
+        }
+    }
+    lt = &lt_worker[id];
+    lt->reuseport = 1;
+    return 0;
+}
+
+
+#if MB_GW_ENABLED > 0
+/*******************************************************************************
+  * @brief  the worker of the calling thread serves a gateway, after mb_init().
+  *
+  * @param  gw = the gateway, mb_gw_init() and mb_gw_route() are done
+  *
+  * @retval 0= OK
+  *
+  * @note   the requests of the routed unit ids go to the queues of the lines,
+            the others to mb_poll() as before. the tasks of the lines start
+            after it, see mb_port_gw_linux_wait(). one worker only, as the
+            queues of the lines are single producer.
+  *****************************************************************************/
+int32_t mb_port_tcp_linux_gateway(MB_GW_STRU *gw)
+{
+    struct epoll_event ev;
+
+    if(gw == 0 || lt_gw != 0 || port_epoll_open() != 0){
+        return __LINE__;
+    }
+    lt->gwfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(lt->gwfd < 0){
+        return __LINE__;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events   = EPOLLIN | EPOLLET;
+    ev.data.u64 = PORT_EP_GW;
+    if(epoll_ctl(lt->epfd, EPOLL_CTL_ADD, lt->gwfd, &ev) != 0){
+        close(lt->gwfd);
+        return __LINE__;
+    }
+    gw->p_notify = port_gw_notify;
+    lt->gw       = gw;
+    lt_gw        = lt;
+    return 0;
+}
+#endif
+
+
+/*******************************************************************************
+  * @brief  get the statistics of the worker of the calling thread
+  *
+  * @param  st = output
+  *
+  * @retval none
+  *****************************************************************************/
+void mb_port_tcp_linux_get_stat(MB_PORT_LINUX_TCP_STAT_STRU *st)
+{
+    mb_port_tcp_linux_get_worker_stat((int32_t)(lt - lt_worker), st);
+}
+
+
+/*******************************************************************************
+  * @brief  get the statistics of a worker
+  *
+  * @param  id = the worker, 0 ~ MB_PORT_TCP_WORKER_MAX-1
+            st = output
+  *
+  * @retval none
+  *
+  * @note   the counters are read while the worker goes on, a snapshot only.
+  *****************************************************************************/
+void mb_port_tcp_linux_get_worker_stat(int32_t id, MB_PORT_LINUX_TCP_STAT_STRU *st)
+{
+    MBPORT_TCP_LINUX_STRU *w;
+
+    if(id < 0 || id >= MB_PORT_TCP_WORKER_MAX){
+        return;
+    }
+    w = &lt_worker[id];
+    if(st != 0){
+        *st = w->stat;
+        st->conn_num   = w->tbl.num;
+        st->accept_cnt = w->tbl.open_cnt;
+        st->refuse_cnt = w->tbl.refuse_cnt;
+        st->close_cnt  = w->tbl.close_cnt;
+        st->drop_bytes = w->tbl.drop_cnt;
+        st->zc_adu     = w->tbl.zc_adu;
+        st->copy_bytes = w->tbl.copy_bytes;
+        st->idle_cnt   = w->tbl.idle_cnt;
+        st->slab_num   = MB_TCP_SLAB_NUM;
+        st->slab_used  = MB_TCP_SLAB_NUM - w->tbl.slab_free_num;
+        st->slab_max   = w->tbl.slab_max;
+        st->slab_wait_cnt = w->tbl.slab_wait_cnt;
+        st->pend_num   = w->room.num + w->slab.num;
+        st->mem_bytes  = sizeof(*w);
+    }
+}
+
+
+/*******************************************************************************
+********************************************************************************
+*                              private functions                               *
+********************************************************************************
+*******************************************************************************/
+
+static int32_t port_epoll_open(void)
+{
+    if(lt->opened == 0){
+        lt->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if(lt->epfd < 0){
+            return __LINE__;
+        }
+        lt->opened = 1;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  accept all the clients in the backlog
+  *
+  * @param  none
+  *
+  * @retval none
+  *
+  * @note   a client over MB_TCP_CONN_MAX is closed at once. the listen socket
+            is edge triggered, so it goes on until EAGAIN, or it tries again
+            in the next mb_port_tcp_linux_wait(), eg. out of fds.
+  *****************************************************************************/
+static void port_accept(void)
+{
+    struct epoll_event  ev;
+    int                 fd, idx;
+    int                 on = 1;
+
+    for(;;){
+        fd = accept4(lt->lfd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0){
+            lt->accept_more = (errno != EAGAIN && errno != EWOULDBLOCK);
+            if(lt->accept_more){
+                lt->stat.accept_err_cnt++;
+            }
+            return;                                         //EAGAIN, no more
+        }
+        idx = mb_tcp_conn_open(&lt->tbl, (intptr_t)fd);
+        if(idx == MB_TCP_CONN_NONE){
+            LOG(CLI_LOG_ERR, "too many clients, refused.");
+            close(fd);
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events   = PORT_EP_CONN_EVENTS;
+        ev.data.u64 = PORT_EP_CONN | (uint32_t)idx;
+        if(epoll_ctl(lt->epfd, EPOLL_CTL_ADD, fd, &ev) != 0){
+            port_close(idx);
+            continue;
+        }
+        if(lt->tbl.num > lt->stat.conn_max){
+            lt->stat.conn_max = lt->tbl.num;
+        }
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  read all that a client has, straight into the buffer of its conn.
+  *
+  * @param  idx = the conn
+  *
+  * @retval none
+  *
+  * @note   eof, a read error or a broken stream closes the client. if the
+            buffer is full, or no buffer is free, the rest stays in the socket
+            and the client is paused. edge triggered, epoll tells no more
+            about these bytes, the paused lists remember them.
+  *****************************************************************************/
+static void port_rx(int32_t idx)
+{
+    uint8_t  *p;
+    uint16_t space;
+    ssize_t  r;
+    int      fd;
+
+    if(idx < 0 || idx >= MB_TCP_CONN_MAX || lt->tbl.conn[idx].used == 0
+    || lt->tbl.conn[idx].rx_paused){
+        return;                                             //paused, it is read from a paused list
+    }
+    fd = (int)lt->tbl.conn[idx].handle;
+
+    for(;;){
+        p = mb_tcp_conn_rxspace(&lt->tbl, idx, &space);
+        if(space == 0){
+            port_rx_pause(idx);
+            return;
+        }
+        r = recv(fd, p, space, 0);
+        if(r > 0){
+            lt->stat.rx_bytes += (uint32_t)r;
+            if(mb_tcp_conn_rxdone(&lt->tbl, idx, (uint16_t)r) != 0){
+                LOG(CLI_LOG_ERR, "bad adu, client %d closed.", idx);
+                port_close(idx);
+                return;
+            }
+            continue;
+        }
+        if(r < 0 && (errno == EAGAIN || errno == EINTR)){
+            return;
+        }
+        port_close(idx);                                    //0= eof, the client is gone
+        return;
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  stop reading a client, put it at the end of a paused list.
+  *
+  * @param  idx = the conn, not paused
+  *
+  * @retval none
+  *
+  * @note   no syscall, the socket stays in the epoll set, an edge comes only
+            with new bytes. rx_paused stays set over a close, so a conn is in
+            a list once at most.
+  *****************************************************************************/
+static void port_rx_pause(int32_t idx)
+{
+    if(lt->tbl.conn[idx].rxbuf != 0){
+        port_ring_push(&lt->room, idx);                      //full, or served in place
+    }
+    else{
+        port_ring_push(&lt->slab, idx);
+    }
+    lt->tbl.conn[idx].rx_paused = 1;
+}
+
+
+/*******************************************************************************
+  * @brief  read the paused clients again, in the order they were paused.
+  *
+  * @param  none
+  *
+  * @retval none
+  *
+  * @note   the ones with a full buffer, MB_TCP_SLAB_NUM at most, are tried
+            each time, one without room yet goes to the end again. the ones
+            waiting for a slab are tried only while a slab is free, so the
+            slabs go in the order they were asked for, and thousands of
+            waiting clients cost nothing. a closed one is dropped.
+  *****************************************************************************/
+static void port_rx_resume(void)
+{
+    uint32_t k;
+    int32_t  idx;
+
+    for(k = lt->room.num; k > 0; k--){
+        idx = port_ring_pop(&lt->room);
+        lt->tbl.conn[idx].rx_paused = 0;
+        port_rx(idx);
+    }
+    while(lt->slab.num > 0 && lt->tbl.slab_free_num > 0){
+        idx = port_ring_pop(&lt->slab);
+        lt->tbl.conn[idx].rx_paused = 0;
+        port_rx(idx);
+    }
+}
+
+
+static void port_ring_push(PORT_RING_STRU *r, int32_t idx)
+{
+    r->idx[(r->head + r->num) % MB_TCP_CONN_MAX] = (uint16_t)idx;
+    r->num++;
+}
+
+
+static int32_t port_ring_pop(PORT_RING_STRU *r)
+{
+    int32_t idx;
+
+    idx     = r->idx[r->head];
+    r->head = (uint16_t)((r->head + 1) % MB_TCP_CONN_MAX);
+    r->num--;
+    return idx;
+}
+
+
+/*******************************************************************************
+  * @brief  send an answer to a client
+  *
+  * @param  idx = the client
+            iov, n = the pieces of it
+            len = the total bytes
+  *
+  * @retval 0= OK
+  *
+  * @note   the socket buffer holds some adus, a short send means the client
+            does not read, it is closed.
+  *****************************************************************************/
+static int32_t port_send(int32_t idx, struct iovec iov[], int n, size_t len)
+{
+    struct msghdr msg;
+    ssize_t r;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = n;
+
+    r = sendmsg((int)lt->tbl.conn[idx].handle, &msg, MSG_NOSIGNAL);
+    if(r != (ssize_t)len){
+        LOG(CLI_LOG_ERR, "send to client %d failed, r=%d errno=%d.", idx, (int)r, errno);
+        port_close(idx);
+        return __LINE__;
+    }
+    lt->stat.tx_bytes += len;
+    lt->stat.tx_adu++;
+    return 0;
+}
+
+
+#if MB_GW_ENABLED > 0
+                                                            //called by the task of a line, an answer is in its queue
+static void port_gw_notify(void *gw)
+{
+    uint64_t one = 1;
+
+    (void)gw;
+    if(write(lt_gw->gwfd, &one, sizeof(one)) < 0){
+        ;                                                   //EAGAIN, the counter is full, the tcp task is woken anyway
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  send the answers of the lines of the gateway back to the clients
+  *
+  * @param  none
+  *
+  * @retval none
+  *
+  * @note   the eventfd is read first, so an answer queued meanwhile wakes the
+            next epoll_wait(). an answer for a client closed, or closed and
+            opened again, since its request is dropped.
+  *****************************************************************************/
+static void port_gw_reply(void)
+{
+    uint8_t      d[MB_TCP_BUF_SIZE];
+    struct iovec iov;
+    uint64_t     cnt;
+    uint16_t     len;
+    int32_t      idx;
+    uint32_t     tag;
+
+    if(read(lt->gwfd, &cnt, sizeof(cnt)) < 0){
+        ;                                                   //EAGAIN, nothing new, look at the queues anyway
+    }
+    while(mb_gw_reply(lt->gw, d, &len, &idx, &tag, mb_port_linux_now_us()) == 0){
+        if(idx < 0 || idx >= MB_TCP_CONN_MAX || lt->tbl.conn[idx].used == 0 || lt->tbl.conn[idx].open_no != tag){
+            lt->stat.gw_drop_cnt++;
+            continue;
+        }
+        iov.iov_base = d;
+        iov.iov_len  = len;
+        port_send(idx, &iov, 1, len);
+    }
+}
+#endif
+
+
+static void port_close(int32_t idx)
+{
+    int fd;
+
+    if(idx < 0 || idx >= MB_TCP_CONN_MAX || lt->tbl.conn[idx].used == 0){
+        return;
+    }
+    fd = (int)lt->tbl.conn[idx].handle;
+    close(fd);                                              //it leaves the epoll set as well
+    mb_tcp_conn_close(&lt->tbl, idx);
+}
+
+
+
+                                                            //public data of this module
+MB_SLAVE_STRU  mb_slave_tcp_linux=
+{
+                                                            /* cfg all the handler of the slave instance*/
+    .address               = MB_PORT_ADDRESS,               //should be a legal value, or will be refused by mb_init()
+    .mode                  = MB_TCP,
+    .p_event_init          = event_init,
+    .p_event_post          = event_post,
+    .p_event_get           = event_get,
+    .p_tcpsvr_init         = tcpserver_init,
+    .p_tcpsvr_enable       = tcpserver_enable,
+    .p_tcpsvr_sendv        = tcpserver_sendv,
+    .p_tcpsvr_receive_ref  = tcpserver_receive_ref,
+};
+
+
+/********************************* end of file ********************************/
@@ -0,0 +1,435 @@
+/**
+  ******************************************************************************
+  * @file    mb_port_tcp_master_linux.c for a modbus tcp master on linux sockets
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/12/27
+  * @brief   the link of a tcp master, see mbmaster.h, the same hooks as the
+             tcp server, mb_port_tcp_linux.c, on the client side of one
+             connection:
+             1. tcpsvr_init() connects to MB_PORT_TCP_MASTER_HOST at the
+                port_id of the link, the enable hook closes it, or connects it
+                again.
+             2. the socket and the eventfd are in one epoll set,
+                mb_port_tcp_master_linux_wait() reads the socket into a buffer
+                and posts EV_FRAME_RECEIVED when an adu is whole, by the LEN of
+                its MBAP.
+             3. the request is sent by send() from ucRTUBuf of the link, it is
+                one piece, the socket blocks on send only, tcp_nodelay is set.
+             see mb_port_linux.h for how to use.
+  *
+  ******************************************************************************
+  */
+
+/*******************************************************************************
+*******************************   cfg and const    *****************************
+*******************************************************************************/
+                                                            //1=enable 0=disable, only for this file.
+#define MB_PORT_USE_LOG                                  (0)
+
+#ifndef MB_PORT_TCP_MASTER_HOST
+#define MB_PORT_TCP_MASTER_HOST                 "127.0.0.1"
+#endif
+
+#ifndef MB_PORT_TCP_MASTER_PORT
+#define MB_PORT_TCP_MASTER_PORT                        (502)
+#endif
+                                                            //the receive buffer, an adu and the next ones if the server sends more
+#define MB_PORT_TCP_MASTER_RX_SIZE           (MB_TCP_BUF_SIZE * 2)
+
+
+/*******************************************************************************
+************************************ Includes **********************************
+*******************************************************************************/
+
+//---call some lib---
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+//---call some task/module---
+#include "mb.h"      //data type of slave structure
+#include "mbtcp.h"
+#include "mb_port_linux.h"
+
+#if (MB_PORT_USE_LOG == 1)
+    #include <stdio.h>
+    #define LOG(level, ...)  do{ fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); }while(0)
+#else
+    #define LOG(...)
+#endif
+
+#define PORT_MBAP_LEN                                    (6)//TID PID LEN, the UID is counted by LEN
+
+/*******************************************************************************
+******************************** Private typedef *******************************
+*******************************************************************************/
+                                                            // private data of this module
+typedef struct
+{
+    MB_PORT_LINUX_EVENT_STRU ev;                            //eventfd, the event queue
+
+    int             epfd;                                   //epoll set of the socket and the eventfd
+    int             fd;                                     //the socket, -1= not connected
+    uint16_t        tcpport;                                //of the server, to connect again
+
+    uint8_t         rx[MB_PORT_TCP_MASTER_RX_SIZE];         //bytes read, the adus not taken yet
+    uint16_t        rx_len;
+
+    MB_PORT_LINUX_TCPM_STAT_STRU stat;
+} MBPORT_TCPM_LINUX_STRU;
+
+/*******************************************************************************
+******************************* Private variables ******************************
+*******************************************************************************/
+static MBPORT_TCPM_LINUX_STRU   lm = { .epfd = -1, .fd = -1 };
+
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static int32_t  port_connect    (void);
+static void     port_close      (void);
+static int32_t  port_rx         (void);
+static uint16_t port_adu_len    (void);
+
+/*******************************************************************************
+******************************* event for port    ******************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  event init, the epoll set is made here, mb_tcp_init() calls it first
+  *
+  * @param  None
+  *
+  * @retval 0= no error
+  *****************************************************************************/
+static int32_t event_init(void)
+{
+    if(lm.epfd < 0){
+        lm.epfd = epoll_create1(EPOLL_CLOEXEC);
+        if(lm.epfd < 0){
+            return __LINE__;
+        }
+    }
+    return mb_port_linux_event_open(&lm.ev, lm.epfd);
+}
+
+
+/*******************************************************************************
+  * @brief  send event
+  *
+  * @param  eEvent
+  *
+  * @retval 0= no error
+  *****************************************************************************/
+static int32_t event_post(uint32_t e)
+{
+    return mb_port_linux_event_post(&lm.ev, e);
+}
+
+
+/*******************************************************************************
+  * @brief  get event
+  *
+  * @param  *e
+  *
+  * @retval 0= no error
+  *
+  * @note   never blocks, mb_port_tcp_master_linux_wait() blocks instead.
+  *****************************************************************************/
+static int32_t event_get(uint32_t * e)
+{
+    return mb_port_linux_event_get(&lm.ev, e);
+}
+
+/*******************************************************************************
+******************************** tcp for port  *********************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  connect to the server
+  *
+  * @param  tcpport, if 0, use MB_PORT_TCP_MASTER_PORT
+  *
+  * @retval err, 0=no error
+  *****************************************************************************/
+static int32_t tcpclient_init(uint16_t tcpport)
+{
+    lm.tcpport = (tcpport != 0) ? tcpport : MB_PORT_TCP_MASTER_PORT;
+    return port_connect();
+}
+
+
+/*******************************************************************************
+  * @brief  port io control
+  *
+  * @param  en = 0/1
+  *
+  * @retval none
+  *
+  * @note   0= close the connection, 1= connect again if it is closed.
+  *****************************************************************************/
+static void tcpclient_enable(uint32_t en)
+{
+    if(en == 0){
+        port_close();
+    }
+    else if(lm.fd < 0){
+        (void)port_connect();
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  take the adu of the answer
+  *
+  * @param  d= where to copy the adu, ucRTUBuf of the link
+            out_dlen= output adu total len
+  *
+  * @retval 0= got one
+  * @notte  called by mb_tcp_receive_pdu(). if one more adu is whole, the
+            event is posted again for it.
+  *****************************************************************************/
+static int32_t tcpclient_receiving(uint8_t d[], uint16_t *out_dlen)
+{
+    uint16_t n;
+
+    n = port_adu_len();
+    if(n == 0){
+        return __LINE__;
+    }
+    memcpy(d, lm.rx, n);
+    lm.rx_len -= n;
+    memmove(lm.rx, &lm.rx[n], lm.rx_len);
+    *out_dlen = n;
+    lm.stat.rx_adu++;
+
+    if(port_adu_len() != 0){
+        mb_port_linux_event_post(&lm.ev, EV_FRAME_RECEIVED);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  send the adu of a request
+  *
+  * @param  d = the adu, n = its len
+  *
+  * @retval 0= sent
+  *****************************************************************************/
+static int32_t tcpclient_send(uint8_t d[], uint16_t n)
+{
+    ssize_t  r;
+    uint16_t done = 0;
+
+    if(lm.fd < 0){
+        return __LINE__;
+    }
+    while(done < n){
+        r = send(lm.fd, &d[done], n - done, MSG_NOSIGNAL);
+        if(r < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            LOG(CLI_LOG_ERR, "send failed, errno=%d.", errno);
+            port_close();
+            return __LINE__;
+        }
+        done += (uint16_t)r;
+    }
+    lm.stat.tx_bytes += n;
+    lm.stat.tx_adu++;
+    return 0;
+}
+
+
+/*******************************************************************************
+********************************************************************************
+*                              public functions                                *
+********************************************************************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  wait for the socket, read it, post the event of a whole adu.
+  *
+  * @param  timeout_ms = how long to wait at most, -1= forever.
+  *
+  * @retval 0= OK, other= not connected, or the server closed it.
+  *
+  * @note   the 'p_wait' of a tcp master, see mbmaster.h. it returns at once if
+            an event is posted, as the eventfd is in the epoll set.
+  *****************************************************************************/
+int32_t mb_port_tcp_master_linux_wait(int32_t timeout_ms)
+{
+    struct epoll_event  evs[2];
+    int                 n, i;
+
+    if(lm.epfd < 0 || lm.fd < 0){
+        return __LINE__;
+    }
+    n = epoll_wait(lm.epfd, evs, sizeof(evs) / sizeof(evs[0]), timeout_ms);
+    if(n < 0 && errno != EINTR){
+        return __LINE__;
+    }
+    for(i = 0; i < n; i++){
+        if(evs[i].data.fd == lm.fd){
+            return port_rx();
+        }
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  get the statistics of the port
+  *
+  * @param  st = output
+  *
+  * @retval none
+  *****************************************************************************/
+void mb_port_tcp_master_linux_get_stat(MB_PORT_LINUX_TCPM_STAT_STRU *st)
+{
+    if(st != 0){
+        *st = lm.stat;
+    }
+}
+
+
+/*******************************************************************************
+******************************* Private functions ******************************
+*******************************************************************************/
+
+static int32_t port_connect(void)
+{
+    struct sockaddr_in  sa;
+    struct epoll_event  ev;
+    int                 on = 1;
+
+    if(lm.epfd < 0){
+        return __LINE__;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port   = htons(lm.tcpport);
+    if(inet_pton(AF_INET, MB_PORT_TCP_MASTER_HOST, &sa.sin_addr) != 1){
+        return __LINE__;
+    }
+
+    lm.fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(lm.fd < 0){
+        return __LINE__;
+    }
+    if(connect(lm.fd, (struct sockaddr *)&sa, sizeof(sa)) != 0){
+        LOG(CLI_LOG_ERR, "connect %s:%u failed, errno=%d.", MB_PORT_TCP_MASTER_HOST, lm.tcpport, errno);
+        port_close();
+        return __LINE__;
+    }
+    setsockopt(lm.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = lm.fd;
+    if(epoll_ctl(lm.epfd, EPOLL_CTL_ADD, lm.fd, &ev) != 0){
+        port_close();
+        return __LINE__;
+    }
+    lm.rx_len = 0;
+    lm.stat.connect_cnt++;
+    return 0;
+}
+
+
+static void port_close(void)
+{
+    if(lm.fd >= 0){
+        close(lm.fd);                                       //it leaves the epoll set too
+        lm.fd = -1;
+        lm.stat.close_cnt++;
+    }
+    lm.rx_len = 0;
+}
+
+
+                                                            //read what is there, level triggered, post the event if an adu is whole
+static int32_t port_rx(void)
+{
+    ssize_t r;
+
+    for(;;){
+        if(lm.rx_len == sizeof(lm.rx)){                     //adus not taken, read the rest after
+            break;
+        }
+        r = recv(lm.fd, &lm.rx[lm.rx_len], sizeof(lm.rx) - lm.rx_len, MSG_DONTWAIT);
+        if(r > 0){
+            lm.rx_len += (uint16_t)r;
+            lm.stat.rx_bytes += (uint32_t)r;
+            continue;
+        }
+        if(r < 0 && errno == EINTR){
+            continue;
+        }
+        if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            break;
+        }
+        LOG(CLI_LOG_ERR, "closed by the server, errno=%d.", errno);
+        port_close();                                       //0, the server closed it, or an error
+        return __LINE__;
+    }
+
+    if(lm.rx_len >= PORT_MBAP_LEN && port_adu_len() == 0){
+        uint16_t len = (uint16_t)((lm.rx[MB_TCP_LEN] << 8) | lm.rx[MB_TCP_LEN + 1]);
+        if(len < 2 || len > MB_TCP_BUF_SIZE - PORT_MBAP_LEN){
+            lm.stat.drop_bytes += lm.rx_len;                //not a MBAP, the stream is lost, drop it all
+            lm.rx_len = 0;
+            return 0;
+        }
+    }
+    if(port_adu_len() != 0 && lm.ev.pending == 0){
+        mb_port_linux_event_post(&lm.ev, EV_FRAME_RECEIVED);
+    }
+    return 0;
+}
+
+
+                                                            //len of the first adu in rx[], 0= not whole yet
+static uint16_t port_adu_len(void)
+{
+    uint16_t len;
+
+    if(lm.rx_len < PORT_MBAP_LEN){
+        return 0;
+    }
+    len = (uint16_t)((lm.rx[MB_TCP_LEN] << 8) | lm.rx[MB_TCP_LEN + 1]);
+    if(len < 2 || len > MB_TCP_BUF_SIZE - PORT_MBAP_LEN || lm.rx_len < PORT_MBAP_LEN + len){
+        return 0;
+    }
+    return (uint16_t)(PORT_MBAP_LEN + len);
+}
+
+
+
+
+                                                            //public data of this module
+MB_SLAVE_STRU  mb_link_tcp_master_linux=
+{
+                                                            /* cfg all the handler of the link, the tcp server hooks on the client side */
+    .mode                  = MB_TCP,
+    .port_id               = MB_PORT_TCP_MASTER_PORT,
+    .p_event_init          = event_init,
+    .p_event_post          = event_post,
+    .p_event_get           = event_get,
+    .p_tcpsvr_init         = tcpclient_init,
+    .p_tcpsvr_enable       = tcpclient_enable,
+    .p_tcpsvr_receiving    = tcpclient_receiving,
+    .p_tcpsvr_send         = tcpclient_send,
+};
+
+
+/********************************* end of file ********************************/
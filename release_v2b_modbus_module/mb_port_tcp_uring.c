@@ -0,0 +1,1227 @@
+/**
+  ******************************************************************************
+  * @file    mb_port_tcp_uring.c for a modbus tcp server on linux io_uring
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/12/04
+  * @brief   same hooks as mb_port_tcp_linux.c, on io_uring instead of epoll,
+             for a busy gateway, far fewer syscalls per request.
+             1. one ring, set up by the raw syscalls, no liburing. a multishot
+                accept takes all the clients, TCP_NODELAY and SO_KEEPALIVE
+                are set on the listen socket once, the clients inherit them.
+             2. receive, a recv of each client takes a buffer of the provided
+                buffer ring when the bytes come, so an idle client holds no
+                buffer. the bytes are copied into the slab of its conn, see
+                mbtcp_conn.c, the recv is armed again when all are taken.
+                a client without room holds its buffer and has no recv, the
+                rest waits in its socket, as in the epoll port.
+             3. send, the responses of a client are put one after the other
+                in a tx buffer, sent by one IORING_OP_SEND when its send
+                before completes, so they go in order and pipelined ones go
+                together. a client with nothing more to serve gets its next
+                recv linked after the send, the send makes no completion, the
+                recv completes after it, so one completion for each request.
+             4. batching, mb_port_tcp_uring_wait() enters the ring only when
+                mb_poll() has nothing to do, or after MB_PORT_URING_BATCH
+                requests. one io_uring_enter() submits all the sends and recvs
+                and takes all the completions, eg. 1 for 1000 requests.
+             5. the events are posted and got in the thread of
+                mb_port_tcp_uring_wait() and mb_poll(), so they are a plain
+                variable here, no eventfd, no syscall.
+             needs linux 6.1 for the provided buffer ring and the multishot
+             accept. see mb_port_linux.h for how to use.
+  *
+  ******************************************************************************
+  */
+
+/*******************************************************************************
+*******************************   cfg and const    *****************************
+*******************************************************************************/
+                                                            //1=enable 0=disable, only for this file.
+#define MB_PORT_USE_LOG                                  (0)
+
+                                                            //this slave's id
+#define MB_PORT_ADDRESS                                  (5)
+
+#ifndef MB_PORT_TCP_LISTEN_PORT
+#define MB_PORT_TCP_LISTEN_PORT                        (502)
+#endif
+                                                            //backlog of listen()
+#define MB_PORT_TCP_BACKLOG                            (128)
+
+#ifndef MB_PORT_URING_SQ_SIZE                               //submission queue entries
+#define MB_PORT_URING_SQ_SIZE                          (256)
+#endif
+#ifndef MB_PORT_URING_CQ_SIZE                               //completion queue entries, it never drops, more are kept by the kernel
+#define MB_PORT_URING_CQ_SIZE                         (1024)
+#endif
+#ifndef MB_PORT_URING_RXBUF_NUM                             //provided buffers for receive, a power of 2
+#define MB_PORT_URING_RXBUF_NUM                        (256)
+#endif
+#ifndef MB_PORT_URING_RXBUF_SIZE
+#define MB_PORT_URING_RXBUF_SIZE                       (512)
+#endif
+#ifndef MB_PORT_URING_TXBUF_NUM                             //one per client, and one more for a pipelining one
+#define MB_PORT_URING_TXBUF_NUM     (MB_TCP_CONN_MAX + MB_TCP_SLAB_NUM)
+#endif
+#ifndef MB_PORT_URING_TXBUF_SIZE                            //responses of a client in one send, MB_TCP_BUF_SIZE at least
+#define MB_PORT_URING_TXBUF_SIZE                       (512)
+#endif
+#ifndef MB_PORT_URING_BATCH                                 //requests served at most between two io_uring_enter()
+#define MB_PORT_URING_BATCH                             (64)
+#endif
+
+
+/*******************************************************************************
+************************************ Includes **********************************
+*******************************************************************************/
+
+//---call some lib---
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/io_uring.h>
+
+//---call some task/module---
+#include "mb.h"      //data type of slave structure
+#include "mbtcp.h"
+#include "mbtcp_conn.h"
+#include "mb_port_linux.h"
+
+#if (MB_PORT_USE_LOG == 1)
+    #include <stdio.h>
+    #define LOG(level, ...)  do{ fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); }while(0)
+#else
+    #define LOG(...)
+#endif
+
+#if (MB_PORT_URING_RXBUF_NUM & (MB_PORT_URING_RXBUF_NUM - 1)) != 0
+#error "MB_PORT_URING_RXBUF_NUM must be a power of 2."
+#endif
+#if MB_PORT_URING_TXBUF_SIZE < MB_TCP_BUF_SIZE
+#error "MB_PORT_URING_TXBUF_SIZE must hold a response, MB_TCP_BUF_SIZE."
+#endif
+
+#define PORT_NONE                               (0xFFFFU)   //no buffer
+                                                            //user_data of an sqe: op, generation of the conn, buffer, conn
+#define PORT_OP_ACCEPT                                   (1)
+#define PORT_OP_RECV                                     (2)
+#define PORT_OP_SEND                                     (3)
+#define PORT_OP_SEND_LINK                                (4)//a recv is linked after it, it completes only on error
+#define PORT_UD(op, gen, buf, idx)  (((uint64_t)(op) << 56) | ((uint64_t)(gen) << 40) | ((uint64_t)(buf) << 24) | (uint64_t)(idx))
+#define PORT_UD_OP(ud)              ((uint32_t)((ud) >> 56))
+#define PORT_UD_GEN(ud)             ((uint16_t)((ud) >> 40))
+#define PORT_UD_BUF(ud)             ((uint16_t)((ud) >> 24))
+#define PORT_UD_IDX(ud)             ((int32_t)((ud) & 0xFFFFFFU))
+
+/*******************************************************************************
+******************************** Private typedef *******************************
+*******************************************************************************/
+                                                            //a fifo of conns, each one is in it once at most
+typedef struct
+{
+    uint16_t        idx[MB_TCP_CONN_MAX];
+    uint16_t        head;
+    uint16_t        num;
+} PORT_RING_STRU;
+
+                                                            //the port side of a conn
+typedef struct
+{
+    uint16_t        gen;                                    //+1 at close, a completion of the client before is known by it
+    uint16_t        rx_bid;                                 //provided buffer not all copied, PORT_NONE= none
+    uint16_t        rx_off;
+    uint16_t        rx_len;
+    uint16_t        tx_q;                                   //tx buffer being filled, PORT_NONE= none
+    uint16_t        tx_qlen;
+    uint16_t        tx_fly;                                 //tx buffer being sent, PORT_NONE= none
+    uint8_t         rx_armed;                               //1= a recv is in the ring
+    uint8_t         rx_want;                                //1= all is copied, a recv is to be armed
+    uint8_t         in_arm;                                 //1= in the list arm, kept over a close as rx_paused
+    uint8_t         in_flush;                               //1= in the list flush, kept over a close as rx_paused
+} PORT_URING_CONN_STRU;
+
+                                                            // private data of this module
+typedef struct
+{
+    MB_PORT_LINUX_EVENT_STRU ev;                            //the event, fd is not used
+
+    int             lfd;                                    //the listen socket
+    int             rfd;                                    //the ring
+    uint8_t         accept_arm;                             //1= the multishot accept is over, arm it again
+    uint32_t        served;                                 //requests since the last io_uring_enter()
+
+                                                            //submission queue, mapped
+    uint32_t        *sq_khead;
+    uint32_t        *sq_ktail;
+    uint32_t        sq_mask;
+    uint32_t        sq_entries;
+    uint32_t        sq_tail;                                //local, given to the kernel at io_uring_enter()
+    uint32_t        sq_todo;                                //sqes not submitted yet
+    struct io_uring_sqe *sqes;
+                                                            //completion queue, mapped
+    uint32_t        *cq_khead;
+    uint32_t        *cq_ktail;
+    uint32_t        cq_mask;
+    struct io_uring_cqe *cqes;
+                                                            //provided buffer ring, group 0
+    struct io_uring_buf_ring *br;
+    uint16_t        br_tail;
+    uint16_t        rxbuf_free;                             //buffers in the ring
+
+    MB_TCP_CONN_TABLE_STRU tbl;                             //the clients, the handle is the socket fd
+    PORT_URING_CONN_STRU   pc[MB_TCP_CONN_MAX];
+    PORT_RING_STRU  room;                                   //paused, the buffer of the conn is full, see port_rx_copy()
+    PORT_RING_STRU  slab;                                   //paused, no slab for the conn
+    PORT_RING_STRU  arm;                                    //a recv is to be armed, before the next io_uring_enter()
+    PORT_RING_STRU  flush;                                  //a response is in its tx buffer
+
+    uint8_t         rxpool[MB_PORT_URING_RXBUF_NUM][MB_PORT_URING_RXBUF_SIZE];
+    uint8_t         txpool[MB_PORT_URING_TXBUF_NUM][MB_PORT_URING_TXBUF_SIZE];
+    uint16_t        txlen[MB_PORT_URING_TXBUF_NUM];         //bytes of a tx buffer being sent
+    uint16_t        txfree[MB_PORT_URING_TXBUF_NUM];        //stack of the free tx buffers
+    uint16_t        txfree_num;
+
+    MB_PORT_LINUX_TCP_STAT_STRU stat;
+} MBPORT_TCP_URING_STRU;
+
+/*******************************************************************************
+******************************* Private variables ******************************
+*******************************************************************************/
+static MBPORT_TCP_URING_STRU    lu = { .lfd = -1, .rfd = -1 };
+
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static int32_t  port_ring_open  (void);
+static int32_t  port_enter      (uint32_t wait_nr, int32_t timeout_ms);
+static struct io_uring_sqe *port_sqe(void);
+static void     port_reap       (void);
+static void     port_accept_arm (void);
+static void     port_accept_done(int32_t res, uint32_t flags);
+static void     port_recv_want  (int32_t idx);
+static void     port_recv_arm   (int32_t idx, uint16_t txbuf);
+static void     port_recv_done  (uint64_t ud, int32_t res, uint32_t flags);
+static void     port_rx_copy    (int32_t idx);
+static void     port_rx_pause   (int32_t idx);
+static void     port_rx_resume  (void);
+static int32_t  port_tx_submit  (int32_t idx);
+static void     port_send_done  (uint64_t ud, int32_t res);
+static void     port_tx_hold    (int32_t idx);
+static void     port_rxbuf_put  (uint16_t bid);
+static void     port_close      (int32_t idx);
+static void     port_list_push  (PORT_RING_STRU *r, int32_t idx);
+static int32_t  port_list_pop   (PORT_RING_STRU *r);
+
+/*******************************************************************************
+******************************* event for port    ******************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  event init
+  *
+  * @param  None
+  *
+  * @retval 0= no error
+  *****************************************************************************/
+static int32_t event_init(void)
+{
+    memset(&lu.ev, 0, sizeof(lu.ev));
+    lu.ev.fd = -1;
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  send event
+  *
+  * @param  eEvent
+  *
+  * @retval 0= no error
+  *
+  * @note   like the 1-item queue of the stm32 ports, a new event overwrites
+            the one not got yet. only in the thread of the port, it does not
+            wake io_uring_enter().
+  *****************************************************************************/
+static int32_t event_post(uint32_t e)
+{
+    lu.ev.value   = e;
+    lu.ev.pending = 1;
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  get event
+  *
+  * @param  *e
+  *
+  * @retval 0= got one, -1= no event.
+  *****************************************************************************/
+static int32_t event_get(uint32_t * e)
+{
+    if(lu.ev.pending == 0){
+        return -1;
+    }
+    lu.ev.pending = 0;
+    *e = lu.ev.value;
+    return 0;
+}
+
+/*******************************************************************************
+******************************** tcp for port  *********************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  init tcp server, it listens, sets up the ring and arms the accept,
+            then return, clients are accepted in mb_port_tcp_uring_wait().
+  *
+  * @param  tcpport, if 0, use MB_PORT_TCP_LISTEN_PORT
+  *
+  * @retval err, 0=no error
+  *****************************************************************************/
+static int32_t tcpserver_init(uint16_t tcpport)
+{
+    struct sockaddr_in  sa;
+    int                 on = 1;
+    int32_t             i;
+
+    if(tcpport == 0){
+        tcpport = MB_PORT_TCP_LISTEN_PORT;
+    }
+    mb_tcp_conn_init(&lu.tbl);
+    for(i = 0; i < MB_TCP_CONN_MAX; i++){
+        lu.pc[i].rx_bid = PORT_NONE;
+        lu.pc[i].tx_q   = PORT_NONE;
+        lu.pc[i].tx_fly = PORT_NONE;
+    }
+    for(i = 0; i < MB_PORT_URING_TXBUF_NUM; i++){
+        lu.txfree[i] = (uint16_t)i;
+    }
+    lu.txfree_num = MB_PORT_URING_TXBUF_NUM;
+
+    lu.lfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(lu.lfd < 0){
+        return __LINE__;
+    }
+    setsockopt(lu.lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(lu.lfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));//the clients inherit them, no syscall for each
+    setsockopt(lu.lfd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family      = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_ANY);
+    sa.sin_port        = htons(tcpport);
+    if(bind(lu.lfd, (struct sockaddr *)&sa, sizeof(sa)) != 0){
+        LOG(CLI_LOG_ERR, "bind port %u failed, errno=%d.", tcpport, errno);
+        return __LINE__;
+    }
+    if(listen(lu.lfd, MB_PORT_TCP_BACKLOG) != 0){
+        return __LINE__;
+    }
+
+    if(port_ring_open() != 0){
+        LOG(CLI_LOG_ERR, "io_uring setup failed, errno=%d.", errno);
+        return __LINE__;
+    }
+    port_accept_arm();
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  port io control
+  *
+  * @param  en = 0/1
+  *
+  * @retval none
+  *
+  * @note   0= close all clients, the listen socket is kept.
+  *****************************************************************************/
+static void tcpserver_enable(uint32_t en)
+{
+    int32_t i;
+
+    if(en == 0){
+        for(i = 0; i < MB_TCP_CONN_MAX; i++){
+            port_close(i);
+        }
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  take the next request of all clients.
+  *
+  * @param  d= the buffer to copy the ADU to, if it can not stay in place
+            adu= output ADU pointer, d or the buffer of the conn
+            n= output ADU total len
+  *
+  * @retval erron code, 0=no error.
+  * @notte  called by mbpoll(), pointer by 'p_slave_receive_pdu'.
+  *****************************************************************************/
+static int32_t tcpserver_receive_ref(uint8_t d[], uint8_t **adu, uint16_t *out_dlen)
+{
+    if(mb_tcp_conn_next_ref(&lu.tbl, d, adu, out_dlen) == MB_TCP_CONN_NONE){
+        return __LINE__;
+    }
+    lu.stat.rx_adu++;
+    lu.served++;
+    if(mb_tcp_conn_ready(&lu.tbl) > 0){                     //more clients are waiting, come again
+        event_post(EV_FRAME_RECEIVED);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  put the pieces of a response into the tx buffer of the client of
+            the request, it is sent in mb_port_tcp_uring_wait().
+  *
+  * @param  v = pieces, MBAP and pdu
+  * @param  n = num of pieces
+  *
+  * @retval 0= OK
+  * @notte  a pipelining client fills its tx buffer while its send is not
+            over, then it is held, port_tx_hold(), its requests wait until
+            the send completes, so a response always has room. no free tx
+            buffer, the response is dropped, the client asks again after its
+            timeout.
+  *****************************************************************************/
+static int32_t tcpserver_sendv(const MB_IOVEC_STRU v[], int n)
+{
+    PORT_URING_CONN_STRU *pc;
+    intptr_t h;
+    int32_t  idx;
+    uint16_t len = 0;
+    int      i;
+
+    idx = mb_tcp_conn_cur(&lu.tbl, &h);
+    if(idx == MB_TCP_CONN_NONE){
+        return __LINE__;                                    //the client is gone
+    }
+    pc = &lu.pc[idx];
+
+    if(n > MB_IOVEC_MAX){
+        n = MB_IOVEC_MAX;
+    }
+    for(i = 0; i < n; i++){
+        len += v[i].len;
+    }
+    if(pc->tx_q != PORT_NONE && pc->tx_qlen + len > MB_PORT_URING_TXBUF_SIZE){
+        if(pc->tx_fly != PORT_NONE){                        //not if it was held
+            lu.stat.tx_drop_cnt++;
+            return __LINE__;
+        }
+        port_tx_submit(idx);
+    }
+    if(pc->tx_q == PORT_NONE){
+        if(lu.txfree_num == 0){
+            lu.stat.tx_drop_cnt++;
+            return __LINE__;
+        }
+        pc->tx_q    = lu.txfree[--lu.txfree_num];
+        pc->tx_qlen = 0;
+    }
+    for(i = 0; i < n; i++){
+        memcpy(&lu.txpool[pc->tx_q][pc->tx_qlen], v[i].p, v[i].len);
+        pc->tx_qlen += v[i].len;
+    }
+    if(pc->in_flush == 0){
+        pc->in_flush = 1;
+        port_list_push(&lu.flush, idx);
+    }
+    lu.stat.tx_bytes += len;
+    lu.stat.tx_adu++;
+    port_tx_hold(idx);
+    return 0;
+}
+
+
+/*******************************************************************************
+********************************************************************************
+*                              public functions                                *
+********************************************************************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  submit the sends and recvs, wait for the completions, accept new
+            clients and read the requests.
+  *
+  * @param  timeout_ms = how long to wait at most, -1= forever.
+  *
+  * @retval 0= OK, other= io_uring error.
+  *
+  * @note   call mb_poll() after it, in the same thread. while mb_poll() has a
+            request to serve, it returns at once without a syscall, up to
+            MB_PORT_URING_BATCH requests.
+  *****************************************************************************/
+int32_t mb_port_tcp_uring_wait(int32_t timeout_ms)
+{
+    int32_t  idx, busy;
+
+    if(lu.rfd < 0){
+        return __LINE__;
+    }
+    mb_tcp_conn_done(&lu.tbl);                              //mb_poll() is over, the buffer of a request served in place is free
+    while((idx = mb_tcp_conn_idle(&lu.tbl, (uint32_t)(mb_port_linux_now_us() / 1000))) != MB_TCP_CONN_NONE){
+        LOG(CLI_LOG_ERR, "client %d is idle, closed.", idx);
+        port_close(idx);
+    }
+    port_rx_resume();
+
+    busy = (lu.ev.pending || mb_tcp_conn_ready(&lu.tbl) > 0);
+    if(busy && lu.served < MB_PORT_URING_BATCH){
+        return 0;                                           //serve more, then one syscall for all
+    }
+
+    while(lu.flush.num > 0){
+        idx = port_list_pop(&lu.flush);
+        lu.pc[idx].in_flush = 0;
+        if(lu.tbl.conn[idx].used && lu.pc[idx].tx_fly == PORT_NONE && lu.pc[idx].tx_q != PORT_NONE){
+            port_tx_submit(idx);
+        }
+    }
+    while(lu.arm.num > 0 && lu.rxbuf_free > 0){             //after the sends, some are armed linked to them
+        idx = port_list_pop(&lu.arm);
+        lu.pc[idx].in_arm = 0;
+        port_recv_arm(idx, PORT_NONE);
+    }
+    if(lu.accept_arm){
+        port_accept_arm();
+    }
+
+    if(port_enter(busy ? 0 : 1, timeout_ms) != 0){
+        return __LINE__;
+    }
+    lu.served = 0;
+    port_reap();
+
+    if(lu.ev.pending == 0 && mb_tcp_conn_ready(&lu.tbl) > 0){
+        event_post(EV_FRAME_RECEIVED);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  get the statistics of the port
+  *
+  * @param  st = output
+  *
+  * @retval none
+  *****************************************************************************/
+void mb_port_tcp_uring_get_stat(MB_PORT_LINUX_TCP_STAT_STRU *st)
+{
+    if(st != 0){
+        *st = lu.stat;
+        st->conn_num   = lu.tbl.num;
+        st->accept_cnt = lu.tbl.open_cnt;
+        st->refuse_cnt = lu.tbl.refuse_cnt;
+        st->close_cnt  = lu.tbl.close_cnt;
+        st->drop_bytes = lu.tbl.drop_cnt;
+        st->zc_adu     = lu.tbl.zc_adu;
+        st->copy_bytes = lu.tbl.copy_bytes;
+        st->idle_cnt   = lu.tbl.idle_cnt;
+        st->slab_num   = MB_TCP_SLAB_NUM;
+        st->slab_used  = MB_TCP_SLAB_NUM - lu.tbl.slab_free_num;
+        st->slab_max   = lu.tbl.slab_max;
+        st->slab_wait_cnt = lu.tbl.slab_wait_cnt;
+        st->pend_num   = lu.room.num + lu.slab.num;
+        st->mem_bytes  = sizeof(lu);
+    }
+}
+
+
+/*******************************************************************************
+********************************************************************************
+*                              private functions                               *
+********************************************************************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  set up the ring and the provided buffer ring.
+  *
+  * @param  none
+  *
+  * @retval 0= OK
+  *
+  * @note   single issuer and deferred task run if the kernel has them, the
+            completions are made in io_uring_enter() only, all in one go.
+  *****************************************************************************/
+static int32_t port_ring_open(void)
+{
+    struct io_uring_params  p;
+    struct io_uring_buf_reg reg;
+    uint8_t                *sq, *cq;
+    size_t                  sq_sz, cq_sz;
+    uint32_t               *sq_array, i;
+
+    memset(&p, 0, sizeof(p));
+    p.flags      = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    p.cq_entries = MB_PORT_URING_CQ_SIZE;
+    lu.rfd = (int)syscall(__NR_io_uring_setup, MB_PORT_URING_SQ_SIZE, &p);
+    if(lu.rfd < 0 && errno == EINVAL){                      //an older kernel
+        memset(&p, 0, sizeof(p));
+        p.flags      = IORING_SETUP_CQSIZE;
+        p.cq_entries = MB_PORT_URING_CQ_SIZE;
+        lu.rfd = (int)syscall(__NR_io_uring_setup, MB_PORT_URING_SQ_SIZE, &p);
+    }
+    if(lu.rfd < 0 || (p.features & IORING_FEAT_EXT_ARG) == 0){
+        return __LINE__;
+    }
+
+    sq_sz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        if(cq_sz > sq_sz){
+            sq_sz = cq_sz;
+        }
+        cq_sz = sq_sz;
+    }
+    sq = mmap(0, sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, lu.rfd, IORING_OFF_SQ_RING);
+    if(sq == MAP_FAILED){
+        return __LINE__;
+    }
+    cq = sq;
+    if((p.features & IORING_FEAT_SINGLE_MMAP) == 0){
+        cq = mmap(0, cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, lu.rfd, IORING_OFF_CQ_RING);
+        if(cq == MAP_FAILED){
+            return __LINE__;
+        }
+    }
+    lu.sqes = mmap(0, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, lu.rfd, IORING_OFF_SQES);
+    if(lu.sqes == MAP_FAILED){
+        return __LINE__;
+    }
+
+    lu.sq_khead   = (uint32_t *)(sq + p.sq_off.head);
+    lu.sq_ktail   = (uint32_t *)(sq + p.sq_off.tail);
+    lu.sq_mask    = *(uint32_t *)(sq + p.sq_off.ring_mask);
+    lu.sq_entries = p.sq_entries;
+    lu.sq_tail    = *lu.sq_ktail;
+    sq_array      = (uint32_t *)(sq + p.sq_off.array);
+    for(i = 0; i < p.sq_entries; i++){                      //sqe i is always in slot i
+        sq_array[i] = i;
+    }
+    lu.cq_khead   = (uint32_t *)(cq + p.cq_off.head);
+    lu.cq_ktail   = (uint32_t *)(cq + p.cq_off.tail);
+    lu.cq_mask    = *(uint32_t *)(cq + p.cq_off.ring_mask);
+    lu.cqes       = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    lu.br = mmap(0, MB_PORT_URING_RXBUF_NUM * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(lu.br == MAP_FAILED){
+        return __LINE__;
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)lu.br;
+    reg.ring_entries = MB_PORT_URING_RXBUF_NUM;
+    reg.bgid         = 0;
+    if(syscall(__NR_io_uring_register, lu.rfd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0){
+        return __LINE__;
+    }
+    for(i = 0; i < MB_PORT_URING_RXBUF_NUM; i++){
+        port_rxbuf_put((uint16_t)i);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  submit the sqes, and wait for completions.
+  *
+  * @param  wait_nr = completions to wait for, 0= do not block
+            timeout_ms = how long to wait at most, -1= forever
+  *
+  * @retval 0= OK, other= io_uring error
+  *****************************************************************************/
+static int32_t port_enter(uint32_t wait_nr, int32_t timeout_ms)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec      ts;
+    uint32_t flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    long     r;
+
+    __atomic_store_n(lu.sq_ktail, lu.sq_tail, __ATOMIC_RELEASE);
+
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if(wait_nr > 0 && timeout_ms >= 0){
+        ts.tv_sec  = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000LL;
+        arg.ts     = (uint64_t)(uintptr_t)&ts;
+    }
+    r = syscall(__NR_io_uring_enter, lu.rfd, lu.sq_todo, wait_nr, flags, &arg, sizeof(arg));
+    lu.stat.enter_cnt++;
+    if(r >= 0){
+        lu.sq_todo -= ((uint32_t)r < lu.sq_todo) ? (uint32_t)r : lu.sq_todo;
+        return 0;
+    }
+    if(errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY){
+        return 0;                                           //timeout, or the sqes go next time
+    }
+    return __LINE__;
+}
+
+
+/*******************************************************************************
+  * @brief  get a free sqe, cleared.
+  *
+  * @param  none
+  *
+  * @retval the sqe, 0= the queue is full even after a submit.
+  *****************************************************************************/
+static struct io_uring_sqe *port_sqe(void)
+{
+    struct io_uring_sqe *sqe;
+
+    if(lu.sq_tail - __atomic_load_n(lu.sq_khead, __ATOMIC_ACQUIRE) >= lu.sq_entries){
+        port_enter(0, 0);
+        if(lu.sq_tail - __atomic_load_n(lu.sq_khead, __ATOMIC_ACQUIRE) >= lu.sq_entries){
+            return 0;
+        }
+    }
+    sqe = &lu.sqes[lu.sq_tail & lu.sq_mask];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    lu.sq_tail++;
+    lu.sq_todo++;
+    lu.stat.sqe_cnt++;
+    return sqe;
+}
+
+
+/*******************************************************************************
+  * @brief  take all the completions in the queue.
+  *
+  * @param  none
+  *
+  * @retval none
+  *****************************************************************************/
+static void port_reap(void)
+{
+    struct io_uring_cqe *cqe;
+    uint32_t head, tail;
+    uint64_t ud;
+    int32_t  res;
+    uint32_t flags;
+
+    head = *lu.cq_khead;
+    tail = __atomic_load_n(lu.cq_ktail, __ATOMIC_ACQUIRE);
+    while(head != tail){
+        cqe   = &lu.cqes[head & lu.cq_mask];
+        ud    = cqe->user_data;
+        res   = cqe->res;
+        flags = cqe->flags;
+        head++;
+        __atomic_store_n(lu.cq_khead, head, __ATOMIC_RELEASE);
+        lu.stat.cqe_cnt++;
+
+        switch(PORT_UD_OP(ud)){
+            case PORT_OP_ACCEPT:
+                port_accept_done(res, flags);
+                break;
+            case PORT_OP_RECV:
+                port_recv_done(ud, res, flags);
+                break;
+            case PORT_OP_SEND:
+            case PORT_OP_SEND_LINK:
+                port_send_done(ud, res);
+                break;
+            default:
+                break;
+        }
+        if(head == tail){
+            tail = __atomic_load_n(lu.cq_ktail, __ATOMIC_ACQUIRE);
+        }
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  arm the multishot accept, one sqe for all the clients to come.
+  *****************************************************************************/
+static void port_accept_arm(void)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = port_sqe();
+    if(sqe == 0){
+        lu.accept_arm = 1;
+        return;
+    }
+    sqe->opcode    = IORING_OP_ACCEPT;
+    sqe->fd        = lu.lfd;
+    sqe->ioprio    = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = PORT_UD(PORT_OP_ACCEPT, 0, 0, 0);
+    lu.accept_arm  = 0;
+}
+
+
+/*******************************************************************************
+  * @brief  a client is accepted, give it a conn and arm its recv.
+  *
+  * @param  res = the socket, <0= error
+            flags = of the cqe, no IORING_CQE_F_MORE= the accept is over
+  *
+  * @retval none
+  *
+  * @note   a client over MB_TCP_CONN_MAX is closed at once.
+  *****************************************************************************/
+static void port_accept_done(int32_t res, uint32_t flags)
+{
+    int32_t idx;
+
+    if((flags & IORING_CQE_F_MORE) == 0){
+        lu.accept_arm = 1;                                  //eg. out of fds, arm it in the next wait
+    }
+    if(res < 0){
+        lu.stat.accept_err_cnt++;
+        return;
+    }
+    idx = mb_tcp_conn_open(&lu.tbl, (intptr_t)res);
+    if(idx == MB_TCP_CONN_NONE){
+        LOG(CLI_LOG_ERR, "too many clients, refused.");
+        close(res);
+        return;
+    }
+    lu.pc[idx].rx_armed = 0;
+    lu.pc[idx].rx_want  = 1;
+    port_recv_arm(idx, PORT_NONE);
+    if(lu.tbl.num > lu.stat.conn_max){
+        lu.stat.conn_max = lu.tbl.num;
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  all of a client is copied, arm its recv before the next
+            io_uring_enter(), maybe linked after the send of its response.
+  *
+  * @param  idx = the conn
+  *
+  * @retval none
+  *****************************************************************************/
+static void port_recv_want(int32_t idx)
+{
+    PORT_URING_CONN_STRU *pc = &lu.pc[idx];
+
+    pc->rx_want = 1;
+    if(pc->in_arm == 0){
+        pc->in_arm = 1;
+        port_list_push(&lu.arm, idx);
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  arm the recv of a client, it takes a provided buffer.
+  *
+  * @param  idx = the conn
+            txbuf = the tx buffer of the send it is linked after, PORT_NONE=
+                    not linked. its completion frees the tx buffer.
+  *
+  * @retval none
+  *
+  * @note   one recv at a time, so a client holds one buffer at most.
+  *****************************************************************************/
+static void port_recv_arm(int32_t idx, uint16_t txbuf)
+{
+    struct io_uring_sqe  *sqe;
+    PORT_URING_CONN_STRU *pc = &lu.pc[idx];
+
+    if(lu.tbl.conn[idx].used == 0 || pc->rx_want == 0 || pc->rx_armed || pc->rx_bid != PORT_NONE
+    || lu.tbl.conn[idx].rx_paused){
+        return;
+    }
+    sqe = port_sqe();
+    if(sqe == 0){
+        port_recv_want(idx);                                //try in the next wait
+        return;
+    }
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = (int)lu.tbl.conn[idx].handle;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = PORT_UD(PORT_OP_RECV, pc->gen, txbuf, idx);
+    pc->rx_armed   = 1;
+    pc->rx_want    = 0;
+}
+
+
+/*******************************************************************************
+  * @brief  a recv is complete.
+  *
+  * @param  ud = its user_data
+            res = bytes, 0= eof, <0= error
+            flags = of the cqe, the provided buffer
+  *
+  * @retval none
+  *
+  * @note   no provided buffer was free, the recv is armed again when one is
+            back. eof or an error closes the client. linked after a send, the
+            send is over, its tx buffer is free.
+  *****************************************************************************/
+static void port_recv_done(uint64_t ud, int32_t res, uint32_t flags)
+{
+    PORT_URING_CONN_STRU *pc;
+    int32_t  idx = PORT_UD_IDX(ud);
+    uint16_t bid = PORT_NONE;
+    uint16_t txbuf = PORT_UD_BUF(ud);
+    uint8_t  stale;
+
+    if(flags & IORING_CQE_F_BUFFER){
+        bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+        lu.rxbuf_free--;
+    }
+    pc    = &lu.pc[idx];
+    stale = (lu.tbl.conn[idx].used == 0 || pc->gen != PORT_UD_GEN(ud));
+    if(txbuf != PORT_NONE){
+        lu.txfree[lu.txfree_num++] = txbuf;
+        if(stale == 0){
+            pc->tx_fly = PORT_NONE;
+            if(pc->tx_q != PORT_NONE && pc->in_flush == 0){
+                pc->in_flush = 1;
+                port_list_push(&lu.flush, idx);
+            }
+            port_tx_hold(idx);
+        }
+    }
+    if(stale){
+        if(bid != PORT_NONE){                               //of a client closed meanwhile
+            port_rxbuf_put(bid);
+        }
+        return;
+    }
+    pc->rx_armed = 0;
+
+    if(res > 0 && bid != PORT_NONE){
+        lu.stat.rx_bytes += (uint32_t)res;
+        pc->rx_bid = bid;
+        pc->rx_off = 0;
+        pc->rx_len = (uint16_t)res;
+        port_rx_copy(idx);
+        return;
+    }
+    if(bid != PORT_NONE){
+        port_rxbuf_put(bid);
+    }
+    if(res == -ENOBUFS){
+        lu.stat.nobuf_cnt++;
+        port_recv_want(idx);
+        return;
+    }
+    port_close(idx);                                        //0= eof, the client is gone, -ECANCELED= its send failed
+}
+
+
+/*******************************************************************************
+  * @brief  copy the provided buffer of a client into the buffer of its conn.
+  *
+  * @param  idx = the conn
+  *
+  * @retval none
+  *
+  * @note   all copied, the provided buffer goes back to the ring and the recv
+            is armed again. no room, the client is paused with the rest.
+            a broken stream closes the client.
+  *****************************************************************************/
+static void port_rx_copy(int32_t idx)
+{
+    PORT_URING_CONN_STRU *pc = &lu.pc[idx];
+    uint8_t  *p;
+    uint16_t space, n;
+
+    if(lu.tbl.conn[idx].used == 0 || lu.tbl.conn[idx].rx_paused){
+        return;                                             //paused, it is copied from a paused list
+    }
+    while(pc->rx_len > 0){
+        p = mb_tcp_conn_rxspace(&lu.tbl, idx, &space);
+        if(space == 0){
+            port_rx_pause(idx);
+            return;
+        }
+        n = (pc->rx_len < space) ? pc->rx_len : space;
+        memcpy(p, &lu.rxpool[pc->rx_bid][pc->rx_off], n);
+        pc->rx_off += n;
+        pc->rx_len -= n;
+        if(mb_tcp_conn_rxdone(&lu.tbl, idx, n) != 0){
+            LOG(CLI_LOG_ERR, "bad adu, client %d closed.", idx);
+            port_close(idx);
+            return;
+        }
+    }
+    if(pc->rx_bid != PORT_NONE){
+        port_rxbuf_put(pc->rx_bid);
+        pc->rx_bid = PORT_NONE;
+    }
+    port_recv_want(idx);
+}
+
+
+/*******************************************************************************
+  * @brief  stop copying a client, put it at the end of a paused list.
+  *
+  * @param  idx = the conn, not paused
+  *
+  * @retval none
+  *
+  * @note   rx_paused stays set over a close, so a conn is in a list once at
+            most.
+  *****************************************************************************/
+static void port_rx_pause(int32_t idx)
+{
+    if(lu.tbl.conn[idx].rxbuf != 0){
+        port_list_push(&lu.room, idx);                      //full, or served in place
+    }
+    else{
+        port_list_push(&lu.slab, idx);
+    }
+    lu.tbl.conn[idx].rx_paused = 1;
+}
+
+
+/*******************************************************************************
+  * @brief  copy the paused clients again, in the order they were paused.
+  *
+  * @param  none
+  *
+  * @retval none
+  *
+  * @note   the same as the epoll port, the ones with a full buffer are tried
+            each time, the ones waiting for a slab only while a slab is free.
+  *****************************************************************************/
+static void port_rx_resume(void)
+{
+    uint32_t k;
+    int32_t  idx;
+
+    for(k = lu.room.num; k > 0; k--){
+        idx = port_list_pop(&lu.room);
+        lu.tbl.conn[idx].rx_paused = 0;
+        port_rx_copy(idx);
+    }
+    while(lu.slab.num > 0 && lu.tbl.slab_free_num > 0){
+        idx = port_list_pop(&lu.slab);
+        lu.tbl.conn[idx].rx_paused = 0;
+        port_rx_copy(idx);
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  send the tx buffer of a client.
+  *
+  * @param  idx = the conn, no send in the ring
+  *
+  * @retval 0= OK
+  *
+  * @note   MSG_WAITALL, the kernel sends it all, a short one is an error.
+            the recv of the client is linked after it if all the client sent
+            is served, no more response can come before the recv completes.
+  *****************************************************************************/
+static int32_t port_tx_submit(int32_t idx)
+{
+    struct io_uring_sqe  *sqe;
+    PORT_URING_CONN_STRU *pc = &lu.pc[idx];
+    uint8_t               link;
+
+    link = (pc->rx_want && pc->rx_armed == 0 && pc->rx_bid == PORT_NONE
+         && lu.tbl.conn[idx].rx_paused == 0 && lu.tbl.conn[idx].rxpos == 0);
+    if(link && lu.sq_tail - __atomic_load_n(lu.sq_khead, __ATOMIC_ACQUIRE) + 2 > lu.sq_entries){
+        port_enter(0, 0);                                   //the send and its recv go in the same submit
+    }
+    sqe = port_sqe();
+    if(sqe == 0){
+        if(pc->in_flush == 0){                              //try in the next wait
+            pc->in_flush = 1;
+            port_list_push(&lu.flush, idx);
+        }
+        return __LINE__;
+    }
+    sqe->opcode    = IORING_OP_SEND;
+    sqe->fd        = (int)lu.tbl.conn[idx].handle;
+    sqe->addr      = (uint64_t)(uintptr_t)lu.txpool[pc->tx_q];
+    sqe->len       = pc->tx_qlen;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = PORT_UD(PORT_OP_SEND, pc->gen, pc->tx_q, idx);
+    lu.txlen[pc->tx_q] = pc->tx_qlen;
+    pc->tx_fly  = pc->tx_q;
+    pc->tx_q    = PORT_NONE;
+    pc->tx_qlen = 0;
+    if(link){
+        sqe->flags    |= IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = PORT_UD(PORT_OP_SEND_LINK, pc->gen, pc->tx_fly, idx);
+        port_recv_arm(idx, pc->tx_fly);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  a send is complete, free its buffer, send the responses queued
+            meanwhile. a linked one completes only on error.
+  *
+  * @param  ud = its user_data
+            res = bytes sent, <0= error
+  *
+  * @retval none
+  *****************************************************************************/
+static void port_send_done(uint64_t ud, int32_t res)
+{
+    PORT_URING_CONN_STRU *pc;
+    int32_t  idx = PORT_UD_IDX(ud);
+    uint16_t buf = PORT_UD_BUF(ud);
+
+    if(PORT_UD_OP(ud) == PORT_OP_SEND){
+        lu.txfree[lu.txfree_num++] = buf;                   //linked, the recv after it frees it
+    }
+    pc = &lu.pc[idx];
+    if(lu.tbl.conn[idx].used == 0 || pc->gen != PORT_UD_GEN(ud)){
+        return;                                             //of a client closed meanwhile
+    }
+    if(PORT_UD_OP(ud) == PORT_OP_SEND){
+        pc->tx_fly = PORT_NONE;
+    }
+    if(res != (int32_t)lu.txlen[buf]){
+        LOG(CLI_LOG_ERR, "send to client %d failed, r=%d.", idx, res);
+        port_close(idx);
+        return;
+    }
+    if(pc->tx_q != PORT_NONE){
+        port_tx_submit(idx);
+    }
+    port_tx_hold(idx);                                      //the responses queued meanwhile are sent, there is room again
+}
+
+
+/*******************************************************************************
+  * @brief  hold the requests of a client while one more response may not fit
+            its tx buffer, or let them go.
+  *
+  * @param  idx = the conn
+  *
+  * @retval none
+  *
+  * @note   a send is in flight, the next one waits in tx_q, it has no room
+            for a response of MB_TCP_BUF_SIZE. the conn table skips the
+            client until the send completes, see mb_tcp_conn_hold(). the
+            wait posts EV_FRAME_RECEIVED again if it is ready then.
+  *****************************************************************************/
+static void port_tx_hold(int32_t idx)
+{
+    PORT_URING_CONN_STRU *pc = &lu.pc[idx];
+
+    mb_tcp_conn_hold(&lu.tbl, idx, pc->tx_fly != PORT_NONE && pc->tx_q != PORT_NONE
+                     && pc->tx_qlen + MB_TCP_BUF_SIZE > MB_PORT_URING_TXBUF_SIZE);
+}
+
+
+/*******************************************************************************
+  * @brief  give a provided buffer back to the ring.
+  *
+  * @param  bid = the buffer
+  *
+  * @retval none
+  *****************************************************************************/
+static void port_rxbuf_put(uint16_t bid)
+{
+    struct io_uring_buf *b;
+
+    b       = &lu.br->bufs[lu.br_tail & (MB_PORT_URING_RXBUF_NUM - 1)];
+    b->addr = (uint64_t)(uintptr_t)lu.rxpool[bid];
+    b->len  = MB_PORT_URING_RXBUF_SIZE;
+    b->bid  = bid;
+    lu.br_tail++;
+    __atomic_store_n(&lu.br->tail, lu.br_tail, __ATOMIC_RELEASE);
+    lu.rxbuf_free++;
+}
+
+
+/*******************************************************************************
+  * @brief  close a client.
+  *
+  * @param  idx = the conn
+  *
+  * @retval none
+  *
+  * @note   shutdown() ends its recv and send in the ring, they complete later
+            with the generation before, and only give their buffers back.
+  *****************************************************************************/
+static void port_close(int32_t idx)
+{
+    PORT_URING_CONN_STRU *pc;
+    int fd;
+
+    if(idx < 0 || idx >= MB_TCP_CONN_MAX || lu.tbl.conn[idx].used == 0){
+        return;
+    }
+    pc = &lu.pc[idx];
+    fd = (int)lu.tbl.conn[idx].handle;
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+    if(pc->rx_bid != PORT_NONE){
+        port_rxbuf_put(pc->rx_bid);
+    }
+    if(pc->tx_q != PORT_NONE){
+        lu.txfree[lu.txfree_num++] = pc->tx_q;
+    }
+    pc->rx_bid   = PORT_NONE;
+    pc->rx_len   = 0;
+    pc->tx_q     = PORT_NONE;
+    pc->tx_qlen  = 0;
+    pc->tx_fly   = PORT_NONE;                               //freed by its completion
+    pc->rx_armed = 0;
+    pc->gen++;
+    mb_tcp_conn_close(&lu.tbl, idx);
+}
+
+
+static void port_list_push(PORT_RING_STRU *r, int32_t idx)
+{
+    r->idx[(r->head + r->num) % MB_TCP_CONN_MAX] = (uint16_t)idx;
+    r->num++;
+}
+
+
+static int32_t port_list_pop(PORT_RING_STRU *r)
+{
+    int32_t idx;
+
+    idx     = r->idx[r->head];
+    r->head = (uint16_t)((r->head + 1) % MB_TCP_CONN_MAX);
+    r->num--;
+    return idx;
+}
+
+
+
+                                                            //public data of this module
+MB_SLAVE_STRU  mb_slave_tcp_uring=
+{
+                                                            /* cfg all the handler of the slave instance*/
+    .address               = MB_PORT_ADDRESS,               //should be a legal value, or will be refused by mb_init()
+    .mode                  = MB_TCP,
+    .p_event_init          = event_init,
+    .p_event_post          = event_post,
+    .p_event_get           = event_get,
+    .p_tcpsvr_init         = tcpserver_init,
+    .p_tcpsvr_enable       = tcpserver_enable,
+    .p_tcpsvr_sendv        = tcpserver_sendv,
+    .p_tcpsvr_receive_ref  = tcpserver_receive_ref,
+};
+
+
+/********************************* end of file ********************************/
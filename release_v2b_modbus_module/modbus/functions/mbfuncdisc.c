@@ -36,7 +36,6 @@
 #define MB_PDU_FUNC_READ_ADDR_OFF           ( MB_PDU_DATA_OFF )
 #define MB_PDU_FUNC_READ_DISCCNT_OFF        ( MB_PDU_DATA_OFF + 2 )
 #define MB_PDU_FUNC_READ_SIZE               ( 4 )
-#define MB_PDU_FUNC_READ_DISCCNT_MAX        ( 0x07D0 )
 
 /* ----------------------- Static functions ---------------------------------*/
 extern eMBException    prveMBError2Exception( eMBErrorCode eErrorCode );
@@ -70,7 +69,7 @@ eMBFuncReadDiscreteInputs( uint8_t * pucFrame, uint16_t * usLen )
          * return Modbus illegal data value exception. 
          */
         if( ( usDiscreteCnt >= 1 ) &&
-            ( usDiscreteCnt < MB_PDU_FUNC_READ_DISCCNT_MAX ) )
+            ( usDiscreteCnt <= MB_PDU_FUNC_READ_DISCCNT_MAX ) )
         {
             /* Set the current PDU data pointer to the beginning. */
             pucFrameCur = &pucFrame[MB_PDU_FUNC_OFF];
@@ -31,6 +31,8 @@
 #define _MB_H
 
 #include <stdint.h>
+#include "mbproto.h" /* for xMBFunctionHandler and MB_ADDRESS_MAX */
+#include "mbconfig.h" /* for MB_SERVING_TASK_MAX */
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,6 +44,9 @@ extern "C" {
 /*brief Use the default Modbus TCP port (502) */
 #define MB_TCP_PORT_USE_DEFAULT         ( 0 )   
 
+/* value in MB_UNIT_TABLE_STRU.idx[] for an address not served by the slave */
+#define MB_UNIT_IDX_NONE                ( 0xFF )
+
 
 
 /* ----------------------- Type definitions ---------------------------------*/
@@ -97,6 +102,28 @@ typedef enum
 } eMBEventType;
 
 
+/* how the response reuses the request still in ucRTUBuf, set in mb_execute(),
+used by rtu/ascii send_pdu() to skip building the response. */
+typedef enum
+{
+    MB_TX_ECHO_NONE,            /*!< build the response. */
+    MB_TX_ECHO_FULL,            /*!< FC05/06, the response is the request, crc/lrc included. */
+    MB_TX_ECHO_HEAD             /*!< FC15/16, the response is addr, fc, start, cnt of the request. */
+} MB_TX_ECHO_ENUM;
+
+
+/* a piece of a frame to send, a response goes out as header, payload and
+trailer, each one where it is, the port gathers them (writev, dma...), so a
+payload in register memory or a cache is not copied into ucRTUBuf. */
+typedef struct
+{
+    const uint8_t   *p;
+    uint16_t        len;
+} MB_IOVEC_STRU;
+
+#define MB_IOVEC_MAX            (3)     /*!< header, payload, trailer. */
+
+
 /* port funtion type defintion, 
 used in 'MB_SLAVE_STRU' below, [by liq, 2019-11] */
 /* below is in port/event */
@@ -107,6 +134,7 @@ typedef int32_t (* tp_event_get)(uint32_t * e);
 typedef int32_t (* tp_serial_init)( uint8_t port, uint32_t baudrate, uint8_t databits, uint8_t parity);
 typedef void    (* tp_serial_enable)(uint32_t enrx, uint32_t entx);
 typedef void    (* tp_serial_start_send)(uint8_t d[], int n);
+typedef void    (* tp_serial_start_sendv)(const MB_IOVEC_STRU v[], int n);
 typedef int32_t (* tp_serial_read_receive)(uint8_t d[], int n);
 typedef int32_t (* tp_serail_check_TC)(void);
 typedef int32_t (* tp_serial_check_IDLE)(void);
@@ -115,7 +143,9 @@ typedef int32_t (* tp_serial_check_IDLE)(void);
 typedef int32_t (* tp_tcpsvr_init)(uint16_t tcpport);
 typedef void    (* tp_tcpsvr_enable)(uint32_t en);
 typedef int32_t (* tp_tcpsvr_receiving)(uint8_t d[], uint16_t * len);
+typedef int32_t (* tp_tcpsvr_receive_ref)(uint8_t d[], uint8_t ** adu, uint16_t * len);
 typedef int32_t (* tp_tcpsvr_send)(uint8_t d[], uint16_t len);
+typedef int32_t (* tp_tcpsvr_sendv)(const MB_IOVEC_STRU v[], int n);
 
 /* below is in port/timer */
 typedef int32_t (* tp_timer_init)(uint32_t n_50us);
@@ -127,6 +157,45 @@ typedef int32_t (* tp_slave_receive_pdu)(void *slave, uint8_t * pucRcvAddress, u
 typedef int32_t (* tp_slave_send_pdu)(void *slave, uint8_t ucSlaveAddress, const uint8_t * pucFrame, uint16_t usLength );
 
 
+/* register image of a unit, the 'start' is the first register address (from 0)
+held in the array, 'num' is the size of the array. [multi-unit, 2021] */
+typedef struct
+{
+    uint16_t                *p_hold;                        //holding registers
+    uint16_t                hold_start;
+    uint16_t                hold_num;
+    uint16_t                *p_input;                       //input registers
+    uint16_t                input_start;
+    uint16_t                input_num;
+    uint8_t                 *p_coil;                        //coils, 8 coils in one byte
+    uint16_t                coil_start;
+    uint16_t                coil_num;
+    uint8_t                 *p_disc;                        //discretes, 8 discretes in one byte
+    uint16_t                disc_start;
+    uint16_t                disc_num;
+} MB_REG_IMAGE_STRU;
+
+
+/* a unit is one slave address answered by a slave instance, so one serial port 
+can stand in for several devices. [multi-unit, 2021] */
+typedef struct
+{
+    uint8_t                 address;                        //unit's address, 1~247
+    MB_REG_IMAGE_STRU       *p_image;                       //register image, 0=the default image in mb_method.c
+    xMBFunctionHandler      *p_handlers;                    //handler set [MB_FUNC_HANDLERS_MAX], 0=the default set in mb.c
+    uint32_t                receive_ok_cnt;                 //receive good function code for this unit
+} MB_UNIT_STRU;
+
+
+/* address-indexed lookup of units, only 'p_units' and 'num' need to be set by 
+the user, 'idx[]' is built in mb_init(). [multi-unit, 2021] */
+typedef struct
+{
+    MB_UNIT_STRU            *p_units;                       //the units
+    uint8_t                 num;                            //how many units in p_units[]
+    uint8_t                 idx[MB_ADDRESS_MAX + 1];        //address -> index in p_units[], MB_UNIT_IDX_NONE = not served
+} MB_UNIT_TABLE_STRU;
+
 
 /* this is a data asmembly of a slave */
 typedef struct 
@@ -139,6 +208,9 @@ typedef struct
     uint32_t                baudrate;                       //eg. 115200
     uint8_t                 databits;
     uint8_t                 parity;
+    MB_UNIT_TABLE_STRU      *p_unit_tbl;                    //units served by this slave, 0=only 'address' is served. tcp: by the unit id, 0/255= the unit of 'address'
+    uint8_t                 isr_fastpath;                   //1= rtu FC03/04 are answered in the t35 isr, the registers must be readable in isr
+    uint16_t                ascii_timeout_ms;               //ascii char timeout, 0= from baudrate, mb_ascii_init() writes the one in use
     
     /* below is in port/event */
     tp_event_init           p_event_init; 
@@ -149,6 +221,7 @@ typedef struct
     tp_serial_init          p_serial_init;
     tp_serial_enable        p_serial_enable;
     tp_serial_start_send    p_serial_start_send;
+    tp_serial_start_sendv   p_serial_start_sendv;           //0= not used, else it is used instead of p_serial_start_send, the pieces are kept until tx done
     tp_serial_read_receive  p_serial_read_receive;
     tp_serail_check_TC      p_serial_check_TC;
     tp_serial_check_IDLE    p_serial_check_IDLE;
@@ -157,7 +230,9 @@ typedef struct
     tp_tcpsvr_init          p_tcpsvr_init;
     tp_tcpsvr_enable        p_tcpsvr_enable;
     tp_tcpsvr_receiving     p_tcpsvr_receiving;
+    tp_tcpsvr_receive_ref   p_tcpsvr_receive_ref;           //0= not used, else it is used instead of p_tcpsvr_receiving, the adu stays in the port's buffer
     tp_tcpsvr_send          p_tcpsvr_send;
+    tp_tcpsvr_sendv         p_tcpsvr_sendv;                 //0= not used, else it is used instead of p_tcpsvr_send
 
     /* below is in port/timer */
     tp_timer_init           p_timer_init;
@@ -172,17 +247,39 @@ typedef struct
 
     /* below is the processing data. */
     uint8_t*                p_pdu;                          //pointer to store the pdu, actuall point to ucRTUBuf[1]
+    uint8_t*                p_tcp_adu;                      //tcp only, the adu of p_pdu, ucRTUBuf or the rx buffer of the port
     uint8_t                 function_code;                  //store the recent rx pdu's function code
     uint16_t                pdu_len;                        //store the recent rx pdu's length, also the tx pdu's length, it is multi-used, not for cnt up use in parse().
     uint8_t                 targetaddr;                     //store the recent rx pdu's target address
+    MB_UNIT_STRU            *p_unit;                        //the unit of the recent rx pdu, 0 if no unit table
+    uint8_t                 tx_echo;                        //MB_TX_ECHO_ENUM, how the response reuses the request
+    uint8_t                 tx_addr;                        //rtu vectored send, the header piece, kept until tx done
+    uint8_t                 tx_crc[2];                      //rtu vectored send, the trailer piece, kept until tx done
     uint8_t                 ucRTUBuf[256 + 8];              //pdu buf for rx and tx, the real data pool, the adu(addr, func-code, data, err-check), and 8 byte for tcp's MBAP (need 7 byte only).
 
     /* below is for ascii only */
-    uint8_t                 *p_ascii_txbuf;                 //frame buf for ascii tx.
+    uint8_t                 *p_ascii_txbuf;                 //frame buf for ascii tx, 515 bytes, the tx (dma) buf of the port.
     //uint16_t                ascii_txbuf_len;                //valid data len in ascii_txbuf.
     uint8_t                 ascii_rcv_state;                //receive byte parse state
     uint16_t                idx_rtubuf;                     //receive byte index, in ucRTUBuf.
     uint8_t                 e_nibble;                       //the high or low part of a byte
+    uint8_t                 ascii_lrc;                      //sum of the rx bytes, 0 at the end of a good frame
+    uint16_t                ascii_raw_len;                  //chars of the rx frame kept in p_ascii_txbuf, for echo response, 0=not kept
+    uint32_t                ascii_frame_cnt;                //frames got, ':' to LF
+    uint32_t                ascii_lrc_err_cnt;              //frames with bad length or LRC
+    uint32_t                ascii_abort_cnt;                //frames dropped at an invalid char or overflow
+    uint32_t                ascii_timeout_cnt;              //frames dropped at char timeout
+    uint32_t                ascii_skip_chars;               //chars dropped outside a frame, waiting for ':'
+    uint32_t                ascii_skip_run;                 //chars dropped since the last frame
+    uint32_t                ascii_skip_max;                 //the longest run, x char time = the longest resync
+    uint8_t                 ascii_tail[MB_ASCII_RX_CHUNK];  //chars read after the LF of the last frame, from a ':', decoded first by the next receive
+    uint8_t                 ascii_tail_len;
+
+    /* below is for rtu isr fast path only */
+    uint8_t                 isr_rx_ready;                   //1= the frame is read into ucRTUBuf in isr, mb_poll() uses it
+    uint16_t                isr_rx_len;                     //its length
+    uint32_t                isr_fast_cnt;                   //requests answered in isr
+    uint32_t                isr_defer_cnt;                  //requests left to mb_poll()
 
     //..below is statistics data for a slave
     uint32_t                receive_ok_cnt;                 //receive good function code from master, addup in mbpoll()
@@ -198,6 +295,17 @@ int32_t mb_init  ( MB_SLAVE_STRU *slave );
 int32_t mb_enable( MB_SLAVE_STRU *slave , int newstate);
 int32_t mb_poll  ( MB_SLAVE_STRU *slave );
 
+/* for the register callbacks, the image of the unit being served, 0=default image */
+MB_REG_IMAGE_STRU *mb_get_serving_image( void );
+
+#if MB_SERVING_TASK_MAX > 0
+/* from the port, the id of the running task, not 0, eg. osThreadGetId() */
+void *mb_port_task_id( void );
+#endif
+
+/* for the rtu isr fast path, answer a read request in isr */
+int32_t mb_execute_isr( MB_SLAVE_STRU *slave );
+
 
 
 #ifdef __cplusplus
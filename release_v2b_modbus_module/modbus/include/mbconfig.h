@@ -47,7 +47,9 @@ extern "C" {
  *  @{
  */
 /*! \brief If Modbus ASCII support is enabled. */
+#ifndef MB_ASCII_ENABLED
 #define MB_ASCII_ENABLED                        (  0 )
+#endif
 
 /*! \brief If Modbus RTU support is enabled. */
 #define MB_RTU_ENABLED                          (  1 )
@@ -55,13 +57,191 @@ extern "C" {
 /*! \brief If Modbus TCP support is enabled. */
 #define MB_TCP_ENABLED                          (  1 )
 
+/*! \brief Number of Modbus TCP clients served at the same time.
+ *
+ * Each one has a small entry in the connection table of the tcp port, see
+ * mbtcp_conn.h, the receive buffers are MB_TCP_SLAB_NUM slabs shared by all.
+ */
+#ifndef MB_TCP_CONN_MAX
+#define MB_TCP_CONN_MAX                         (  4 )
+#endif
+
+/*! \brief Number of receive buffers (frame slabs) of the Modbus TCP clients.
+ *
+ * A client holds a slab of MB_TCP_BUF_SIZE bytes only while it has bytes not
+ * served, so a server of many clients, mostly idle, needs far fewer slabs
+ * than clients. A client which finds no slab waits in the socket.
+ */
+#ifndef MB_TCP_SLAB_NUM
+#define MB_TCP_SLAB_NUM                         ( MB_TCP_CONN_MAX )
+#endif
+
+/*! \brief A Modbus TCP client which sends nothing for this long is closed, in ms.
+ *
+ * Only that connection is closed, the listener and the others go on. 0= never,
+ * a dead peer is still found by tcp keepalive.
+ */
+#ifndef MB_TCP_IDLE_TIMEOUT_MS
+#define MB_TCP_IDLE_TIMEOUT_MS                  ( 60000 )
+#endif
+
+/*! \brief If the Modbus TCP to RTU gateway is enabled.
+ *
+ * A TCP server forwards the requests of the routed unit ids to the RTU
+ * devices on its serial lines, see mbgw.h.
+ */
+#ifndef MB_GW_ENABLED
+#define MB_GW_ENABLED                           (  1 )
+#endif
+
+/*! \brief Number of serial lines of a gateway. */
+#ifndef MB_GW_LINE_MAX
+#define MB_GW_LINE_MAX                          (  4 )
+#endif
+
+/*! \brief Requests queued for one serial line of a gateway, a power of 2, at most 128.
+ *
+ * A request over it is answered at once with the exception gateway path
+ * unavailable, so a slow line does not hold the clients of the others.
+ */
+#ifndef MB_GW_QUEUE_LEN
+#define MB_GW_QUEUE_LEN                         (  8 )
+#endif
+
+/*! \brief If a gateway coalesces the reads of its clients.
+ *
+ * Reads 01 ~ 04 queued for the same unit and function, whose ranges overlap
+ * or touch, are one transaction on the bus, the answer is shared out.
+ */
+#ifndef MB_GW_COALESCE_ENABLED
+#define MB_GW_COALESCE_ENABLED                  (  1 )
+#endif
+
+/*! \brief Entries of the read cache of a gateway, a power of 2, 0= no cache.
+ *
+ * The answers of the reads are kept for the 'cache_ttl_ms' of their line, see
+ * mbgw_cache.h. Each entry holds a whole answer, about 280 bytes.
+ */
+#ifndef MB_GW_CACHE_NUM
+#define MB_GW_CACHE_NUM                         ( 64 )
+#endif
+
+/*! \brief Default quantum of the fair scheduler of a gateway line, in bytes on the bus.
+ *
+ * The clients of a line take turns by deficit round robin, each turn a client
+ * may use this many bytes of bus time, its requests and their answers.
+ */
+#ifndef MB_GW_DRR_QUANTUM
+#define MB_GW_DRR_QUANTUM                       ( 64 )
+#endif
+
+/*! \brief Default time a gateway waits for the answer of a RTU device, in ms. */
+#ifndef MB_GW_TIMEOUT_MS
+#define MB_GW_TIMEOUT_MS                        ( 200 )
+#endif
+
+/*! \brief If the Modbus master (client) is enabled.
+ *
+ * A master sends requests through a MB_SLAVE_STRU of its port, on the same
+ * port hooks and RTU/ASCII/TCP framing as a slave, see mbmaster.h.
+ */
+#ifndef MB_MASTER_ENABLED
+#define MB_MASTER_ENABLED                       (  1 )
+#endif
+
+/*! \brief Default time a master waits for an answer, in ms. */
+#ifndef MB_MASTER_TIMEOUT_MS
+#define MB_MASTER_TIMEOUT_MS                    ( 1000 )
+#endif
+
+/*! \brief Storage class of the state the stack keeps for the slave being served.
+ *
+ * On a host where several threads each run mb_poll( ) on their own slave, eg.
+ * the sharded linux tcp server, it must be thread local. A single task, or
+ * tasks which never preempt each other in mb_poll( ), leave it empty.
+ */
+#ifndef MB_THREAD_LOCAL
+#if defined( __linux__ )
+#define MB_THREAD_LOCAL                         __thread
+#else
+#define MB_THREAD_LOCAL
+#endif
+#endif
+
+/*! \brief Number of tasks which run mb_poll( ), without MB_THREAD_LOCAL.
+ *
+ * The rtos has no thread local storage, so the image of the unit being served
+ * is kept in a table of this many entries, one for each task, looked up by
+ * mb_port_task_id( ). eg. task_mb1/3/5 preempt each other in mb_poll( ), a
+ * single image pointer for all would give the register callbacks of one task
+ * the image of another. 0= MB_THREAD_LOCAL keeps it.
+ */
+#ifndef MB_SERVING_TASK_MAX
+#if defined( __linux__ )
+#define MB_SERVING_TASK_MAX                     (  0 )
+#else
+#define MB_SERVING_TASK_MAX                     (  4 )
+#endif
+#endif
+
+/*! \brief If the register image is guarded by a sequence lock.
+ *
+ * Readers never block, they copy the registers and copy again if a writer was
+ * in the middle, the writers take turns. For threads on several cores; on a
+ * single core rtos a reader which preempts a writer would spin forever.
+ */
+#ifndef MB_IMAGE_SEQLOCK_ENABLED
+#if defined( __linux__ )
+#define MB_IMAGE_SEQLOCK_ENABLED                (  1 )
+#else
+#define MB_IMAGE_SEQLOCK_ENABLED                (  0 )
+#endif
+#endif
+
+/*! \brief If the RTU framing by receive timestamps is enabled.
+ *
+ * For hosts which have no uart IDLE irq and t35 timer, eg. a linux tty. The
+ * port feeds timestamped chunks to mbrtu_ts.c, which splits the frames.
+ */
+#ifndef MB_RTU_TS_ENABLED
+#define MB_RTU_TS_ENABLED                       (  0 )
+#endif
+
+/*! \brief If the RTU isr fast path is enabled.
+ *
+ * FC03/FC04 requests are answered in mb_rtu_t35_callback( ), without the trip
+ * through the event queue and mb_poll( ). It is used only by the slaves with
+ * 'isr_fastpath' set, whose registers can be read in the isr.
+ */
+#ifndef MB_RTU_ISR_FASTPATH_ENABLED
+#define MB_RTU_ISR_FASTPATH_ENABLED             (  0 )
+#endif
+
 /*! \brief The character timeout value for Modbus ASCII.
  *
  * The character timeout value is not fixed for Modbus ASCII and is therefore
  * a configuration option. It should be set to the maximum expected delay
- * time of the network.
+ * time of the network. A slave uses its 'ascii_timeout_ms', if that is 0 the
+ * timeout is the time of a max frame (515 chars) and MB_ASCII_TIMEOUT_CHARS
+ * char times more at the baudrate, but not less than MB_ASCII_TIMEOUT_MS_MIN.
+ * The timer is restarted once per received chunk, not per char.
  */
-#define MB_ASCII_TIMEOUT_SEC                    (  1 )
+#ifndef MB_ASCII_TIMEOUT_CHARS
+#define MB_ASCII_TIMEOUT_CHARS                  ( 20 )
+#endif
+
+#ifndef MB_ASCII_TIMEOUT_MS_MIN
+#define MB_ASCII_TIMEOUT_MS_MIN                 ( 10 )
+#endif
+
+/*! \brief Chars an ascii slave reads from the port at a time.
+ *
+ * On the stack of mb_poll( ), and the size of the 'ascii_tail' of a slave,
+ * which keeps the chars after the end of a frame for the next one.
+ */
+#ifndef MB_ASCII_RX_CHUNK
+#define MB_ASCII_RX_CHUNK                       ( 64 )
+#endif
 
 
 /*! \brief Timeout to wait in ASCII prior to enabling transmitter.
@@ -32,6 +32,7 @@
 #define _MB_CRC_H
 
 uint16_t          usMBCRC16( uint8_t * pucFrame, uint16_t usLen );
+uint16_t          usMBCRC16Continue( uint16_t usCRC, const uint8_t * pucFrame, uint16_t usLen );
 
 #endif
 
@@ -0,0 +1,173 @@
+/**
+  ******************************************************************************
+  * @file    HEADER FILE, modbus tcp to rtu gateway
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/12/18
+  * @brief   a tcp server stands for the rtu devices of its serial lines. a
+             request whose unit id is routed to a line is queued to that line
+             instead of mb_poll(), the line sends it on the bus as an rtu
+             frame, and the answer goes back to the client with the MBAP, so
+             the transaction id, of its request.
+             each line has its own queue and its own task, so the lines work
+             in parallel, one request on the bus of a line at a time, the
+             next one right after the t35 of the answer. the clients of a line
+             take turns by deficit round robin, the bus time of a request is
+             its cost, a write goes before the reads of the other clients.
+             two sides, each one is a single task:
+                the tcp task    -> mb_gw_submit(), a request of a client
+                                -> mb_gw_reply(), an answer to send back
+                the line task   -> mb_gw_line_next(), a frame to send
+                                -> mb_gw_line_frame(), a frame from the bus
+                                -> mb_gw_line_poll(), the response timeout
+             the queues between them are single producer single consumer
+             rings, no lock. 'p_notify' of each side wakes the task of the
+             other side, eg. an eventfd or an os signal.
+             reads queued at the same time, of the same unit and function,
+             whose ranges overlap or touch, go on the bus as one read of the
+             whole range, each client gets its own part with its own MBAP.
+             an exception to the whole range, eg. a gap the device does not
+             map, is not given to them, each one goes on the bus by itself.
+             see MB_GW_COALESCE_ENABLED.
+             the answers of the reads may be kept for a while, a read of the
+             same range is answered at once by mb_gw_submit(), see
+             mbgw_cache.h.
+  *
+  ******************************************************************************
+  */
+
+#ifndef _MB_GW_H
+#define _MB_GW_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "mbconfig.h"
+#include "mbproto.h"
+#include "mbtcp.h"
+#include "mbgw_cache.h"
+
+#if MB_GW_ENABLED > 0
+
+/* ----------------------- Defines ------------------------------------------*/
+#define MB_GW_LINE_NONE         ( 0xFF )    /*!< unit id not routed, served by mb_poll(). */
+#define MB_GW_LOCAL             ( -1 )      /*!< mb_gw_submit(), not routed, give it to mb_poll(). */
+#define MB_GW_CACHED            ( -2 )      /*!< mb_gw_submit(), answered from the cache, send it. */
+#define MB_GW_FRAME_MAX         ( 256 )     /*!< biggest rtu frame, addr + pdu + crc. */
+
+/* ----------------------- Type definitions ---------------------------------*/
+typedef struct
+{
+    int32_t         conn;                                   //the client
+    int32_t         deficit;                                //bus bytes it may still use in its turn
+    uint8_t         fresh;                                  //1= its turn starts, the quantum is added
+} MB_GW_FLOW_STRU;
+
+typedef struct
+{
+    uint8_t         adu[MB_TCP_BUF_SIZE];                   //the request, MBAP + pdu, then its answer
+    uint16_t        len;
+    int32_t         conn;                                   //the client, given by the tcp port
+    uint32_t        tag;                                    //...and which opening of it, a closed one is not answered
+    uint8_t         rd_fc;                                  //the read to keep in the cache, 0= not kept
+    uint8_t         wr_fc;                                  //a write, the read of its range, rd_addr and rd_num, dropped again at its answer, 0= not a write
+    uint16_t        rd_addr;
+    uint16_t        rd_num;
+    uint32_t        wr_gen;                                 //'wr_gen' of the line when it was queued, a write since makes it old
+    uint8_t         alone;                                  //1= its coalesced read got an exception, it goes on the bus by itself
+} MB_GW_REQ_STRU;
+
+typedef struct
+{
+    /* below is cfg, set by the user before mb_gw_init() */
+    uint32_t        baudrate;                               //of the line, for the char time and t35
+    uint32_t        timeout_ms;                             //for the answer, after the request is on the bus, 0= MB_GW_TIMEOUT_MS
+    uint8_t         retries;                                //sent again after a timeout, then MB_EX_GATEWAY_TGT_FAILED
+    uint32_t        cache_ttl_ms;                           //the answers of the reads are kept for it, 0= not kept
+    uint16_t        quantum;                                //bus bytes of a client in its turn, 0= MB_GW_DRR_QUANTUM
+    void            (* p_notify)( void *line );             //a request is queued, wake the line task, 0= it polls
+    void            *p_port;                                //of the port of the line, eg. for p_notify
+    void            *p_gw;                                  //the gateway of the line, set by mb_gw_init()
+
+    /* below is the queue, the slots are owned by the tcp task while free */
+    MB_GW_REQ_STRU  slot[MB_GW_QUEUE_LEN];
+    uint8_t         slot_free[MB_GW_QUEUE_LEN];             //stack of the free slots, the tcp task only
+    uint8_t         slot_free_num;
+    uint8_t         rq[MB_GW_QUEUE_LEN];                    //tcp -> line, the slots of the queued requests
+    uint32_t        rq_head;                                //taken by the line task
+    uint32_t        rq_tail;                                //put by the tcp task
+    uint8_t         dq[MB_GW_QUEUE_LEN];                    //line -> tcp, the slots of the answers
+    uint32_t        dq_head;                                //taken by the tcp task
+    uint32_t        dq_tail;                                //put by the line task
+    uint32_t        wr_gen;                                 //writes queued or answered, the tcp task only
+
+    /* below is the bus, the line task only */
+    uint8_t         pend[MB_GW_QUEUE_LEN];                  //the slots taken from rq[], not on the bus yet, in order
+    uint8_t         pend_num;
+    MB_GW_FLOW_STRU flow[MB_GW_QUEUE_LEN];                  //the clients with requests in pend[], the ring of the turns
+    uint8_t         flow_num;
+    uint8_t         flow_next;                              //whose turn it is
+    uint8_t         grp[MB_GW_QUEUE_LEN];                   //the slots answered by the frame on the bus, grp[0]= cur
+    uint8_t         grp_num;
+    uint16_t        rd_addr;                                //the range read by the frame on the bus, rd_num= 0 if not a coalesced read
+    uint16_t        rd_num;
+    int32_t         cur;                                    //the slot on the bus, -1= idle
+    uint8_t         sent;                                   //1= it is on the bus, waiting for the answer
+    uint8_t         tries;                                  //sends of it so far
+    uint8_t         tx[MB_GW_FRAME_MAX];                    //the rtu frame of it, addr + pdu + crc
+    uint16_t        tx_len;
+    uint32_t        char_us;
+    uint32_t        t35_us;
+    uint64_t        deadline_us;                            //of the answer, or the bus is free again after t35
+    uint64_t        free_us;                                //no frame on the bus before it, the gap after the last one
+
+    /* below is statistics */
+    uint32_t        req_cnt;                                //requests queued
+    uint32_t        full_cnt;                               //...refused, the queue is full
+    uint32_t        ok_cnt;                                 //answers, an exception of the device counts too
+    uint32_t        timeout_cnt;                            //no answer, sent again or MB_EX_GATEWAY_TGT_FAILED
+    uint32_t        junk_cnt;                               //frames from the bus which are not the answer
+    uint32_t        bus_cnt;                                //transactions on the bus, a coalesced read counts once
+    uint32_t        merge_cnt;                              //requests answered by the read of another one, no bus transaction
+    uint32_t        split_cnt;                              //coalesced reads answered by an exception, each request is sent again alone
+    uint64_t        busy_us;                                //time of the frames on the bus, both ways, for the utilization
+    uint32_t        hit_cnt;                                //reads answered from the cache
+    uint32_t        miss_cnt;                               //...not, queued
+    uint32_t        q_max;                                  //the most requests queued at the same time
+} MB_GW_LINE_STRU;
+
+typedef struct
+{
+    /* below is cfg, set by the user before mb_gw_init() */
+    MB_GW_LINE_STRU *p_lines[MB_GW_LINE_MAX];
+    uint8_t         num;                                    //lines in p_lines[]
+    void            (* p_notify)( void *gw );               //an answer is ready, wake the tcp task, 0= it polls
+
+    /* below is built by mb_gw_init() and mb_gw_route() */
+    uint8_t         line_of[MB_TCP_PSEUDO_ADDRESS + 1];     //unit id -> line, MB_GW_LINE_NONE= local
+    uint8_t         reply_next;                             //the line to look first in mb_gw_reply(), round robin
+#if MB_GW_CACHE_NUM > 0
+    MB_GW_CACHE_STRU cache;                                 //the answers of the reads of all lines, the tcp task only
+#endif
+} MB_GW_STRU;
+
+/* ----------------------- Function prototypes ------------------------------*/
+int32_t mb_gw_init      ( MB_GW_STRU *gw );
+int32_t mb_gw_route     ( MB_GW_STRU *gw, uint8_t uid, uint8_t line );
+int32_t mb_gw_submit    ( MB_GW_STRU *gw, uint8_t adu[], uint16_t *len, int32_t conn, uint32_t tag, uint64_t now_us );
+int32_t mb_gw_reply     ( MB_GW_STRU *gw, uint8_t d[], uint16_t *len, int32_t *conn, uint32_t *tag, uint64_t now_us );
+uint16_t mb_gw_exception( uint8_t adu[], uint8_t exception );
+
+int32_t mb_gw_line_next ( MB_GW_LINE_STRU *ln, uint64_t now_us, uint8_t **frame, uint16_t *len );
+void    mb_gw_line_frame( MB_GW_LINE_STRU *ln, const uint8_t f[], uint16_t n, uint64_t now_us );
+void    mb_gw_line_poll ( MB_GW_LINE_STRU *ln, uint64_t now_us );
+uint64_t mb_gw_line_deadline( MB_GW_LINE_STRU *ln );
+
+#endif //#if MB_GW_ENABLED > 0
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,88 @@
+/**
+  ******************************************************************************
+  * @file    HEADER FILE, read cache of the modbus tcp to rtu gateway
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/12/22
+  * @brief   the answers of the reads 01 ~ 04 forwarded to the rtu devices are
+             kept for the ttl of their line, a read of the same key within it
+             is answered from here, without the bus. the key is (line, unit,
+             fc, address, count), the same read only, not a part of it.
+             a write to a unit drops the entries of that unit it overlaps,
+             when it is queued and again when it is answered, a read queued
+             after it may have gone on the bus before it:
+                05 15       -> the coils, 01
+                06 16 23    -> the holding registers, 03
+             the entries are MB_GW_CACHE_NUM fixed slots, an arena with no
+             heap, found by a hash, and the least recently used one is evicted
+             when a new answer finds none free.
+             the tcp task only, mb_gw_submit() and mb_gw_reply(), no lock.
+  *
+  ******************************************************************************
+  */
+
+#ifndef _MB_GW_CACHE_H
+#define _MB_GW_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "mbconfig.h"
+#include "mbtcp.h"
+
+#if MB_GW_ENABLED > 0 && MB_GW_CACHE_NUM > 0
+
+/* ----------------------- Defines ------------------------------------------*/
+#define MB_GW_CACHE_NONE        ( 0xFFFF )  /*!< no entry, end of a list. */
+#define MB_GW_CACHE_PDU_MAX     ( MB_TCP_BUF_SIZE - MB_TCP_FUNC )   /*!< the answer, fc + byte count + data. */
+
+/* ----------------------- Type definitions ---------------------------------*/
+typedef struct
+{
+    uint8_t         line;                                   //the key
+    uint8_t         uid;
+    uint8_t         fc;
+    uint8_t         used;                                   //1= in the hash and the lru list, 0= in the free list
+    uint16_t        addr;
+    uint16_t        num;
+    uint64_t        expire_us;                              //not answered from after it, monotonic time
+    uint16_t        hnext;                                  //next of the same bucket, or of the free list
+    uint16_t        prev;                                   //lru list, toward the most recent
+    uint16_t        next;                                   //...toward the least recent
+    uint16_t        len;                                    //of pdu
+    uint8_t         pdu[MB_GW_CACHE_PDU_MAX];               //the answer, without the MBAP
+} MB_GW_CACHE_ENTRY_STRU;
+
+typedef struct
+{
+    MB_GW_CACHE_ENTRY_STRU e[MB_GW_CACHE_NUM];              //the arena
+    uint16_t        bucket[MB_GW_CACHE_NUM];                //the first entry of each hash bucket
+    uint16_t        lru_head;                               //the most recently used
+    uint16_t        lru_tail;                               //the least recently used, evicted first
+    uint16_t        free_head;
+    uint16_t        num;                                    //entries used
+
+    /* below is statistics */
+    uint32_t        hit_cnt;
+    uint32_t        miss_cnt;                               //no entry, or expired
+    uint32_t        expire_cnt;                             //...found expired, dropped
+    uint32_t        evict_cnt;                              //dropped for a new one, the arena is full
+    uint32_t        inval_cnt;                              //dropped by a write
+} MB_GW_CACHE_STRU;
+
+/* ----------------------- Function prototypes ------------------------------*/
+void    mb_gw_cache_init        ( MB_GW_CACHE_STRU *c );
+int32_t mb_gw_cache_get         ( MB_GW_CACHE_STRU *c, uint8_t line, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num,
+                                  uint64_t now_us, uint8_t pdu[], uint16_t *len );
+void    mb_gw_cache_put         ( MB_GW_CACHE_STRU *c, uint8_t line, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num,
+                                  uint64_t expire_us, const uint8_t pdu[], uint16_t len );
+void    mb_gw_cache_invalidate  ( MB_GW_CACHE_STRU *c, uint8_t line, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num );
+
+#endif //#if MB_GW_ENABLED > 0 && MB_GW_CACHE_NUM > 0
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,108 @@
+/**
+  ******************************************************************************
+  * @file    HEADER FILE, modbus master (client)
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/12/27
+  * @brief   the master sends a request and waits for its answer, through a
+             MB_SLAVE_STRU which is the port, the 'link'. the link is set up
+             as for a slave, mode, port_id, baudrate and the port hooks, so
+             the same ports and the same rtu/ascii/tcp framing, crc and lrc
+             serve both sides, its address and unit table are not used.
+             one request at a time, each call blocks until the answer, the
+             timeout or the last retry:
+
+                mb_master_init(&m);                         //m.p_link = &mb_slave_rtu_linux, m.p_wait, m.p_tick_ms
+                mb_master_enable(&m, 1);
+                r = mb_master_read_holding(&m, 17, 0, 10, regs);
+
+             the answers are decoded into the buffers of the caller, the
+             registers to uint16_t in host order, the coils and discretes 8
+             in one byte, the first one in bit 0, as in MB_REG_IMAGE_STRU.
+             the return value tells the three cases apart:
+                0               -> the answer, decoded
+                > 0             -> the exception code of the device, eMBException
+                < 0             -> MB_MASTER_Exxx below, no answer to use
+             on a serial line the unit id 0 is a broadcast, a write only, it
+             returns once it is sent, no answer. on tcp it is a unit as any
+             other, the server itself.
+  *
+  ******************************************************************************
+  */
+
+#ifndef _MB_MASTER_H
+#define _MB_MASTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "mb.h"
+#include "mbconfig.h"
+#include "mbframe.h"
+
+#if MB_MASTER_ENABLED > 0
+
+/* ----------------------- Defines ------------------------------------------*/
+#define MB_MASTER_ETIMEOUT      ( -1 )      /*!< no answer, after the retries. */
+#define MB_MASTER_EFRAME        ( -2 )      /*!< an answer which does not fit the request. */
+#define MB_MASTER_EARG          ( -3 )      /*!< bad argument, eg. a count over the limit of the function. */
+#define MB_MASTER_EPORT         ( -4 )      /*!< the port failed to send, or to wait. */
+#define MB_MASTER_ESTATE        ( -5 )      /*!< not initialized or not enabled. */
+
+/* ----------------------- Type definitions ---------------------------------*/
+typedef int32_t  (* tp_master_wait)( int32_t timeout_ms );  //block until the port has something or the timeout, it runs the 'isr' of the port
+typedef uint32_t (* tp_master_tick_ms)( void );             //a monotonic time in ms, it may wrap
+
+typedef struct
+{
+    /* below is cfg, set by the user before mb_master_init() */
+    MB_SLAVE_STRU       *p_link;                            //the port, set as for a slave, its hooks and framing are used
+    uint32_t            timeout_ms;                         //for an answer, after the request is sent, 0= MB_MASTER_TIMEOUT_MS
+    uint8_t             retries;                            //sent again after a timeout, then MB_MASTER_ETIMEOUT
+    tp_master_wait      p_wait;                             //eg. mb_port_rtu_linux_wait(), or an os delay on a mcu
+    tp_master_tick_ms   p_tick_ms;
+
+    /* below is the processing data */
+    uint8_t             state;
+    uint8_t             uid;                                //of the request
+    uint16_t            tid;                                //tcp transaction id of the request
+    uint8_t             req[MB_PDU_SIZE_MAX];               //the request pdu, kept to be sent again, the link's buffer gets the answer
+    uint16_t            req_len;
+    uint8_t             *p_ans;                             //the answer pdu, in the link's buffer, valid until the next request
+    uint16_t            ans_len;
+    uint8_t             exception;                          //of the recent answer, 0= none
+
+    /* below is statistics */
+    uint32_t            req_cnt;                            //requests, a retry does not count
+    uint32_t            ok_cnt;                             //answers, an exception does not count
+    uint32_t            ex_cnt;                             //exceptions
+    uint32_t            timeout_cnt;                        //no answer in time, each try counts
+    uint32_t            retry_cnt;                          //requests sent again
+    uint32_t            drop_cnt;                           //frames dropped while waiting, bad crc, other unit or tid, stale
+    uint32_t            bad_cnt;                            //answers of the request which do not fit it, MB_MASTER_EFRAME
+} MB_MASTER_STRU;
+
+/* ----------------------- Function prototypes ------------------------------*/
+int32_t mb_master_init      ( MB_MASTER_STRU *m );
+int32_t mb_master_enable    ( MB_MASTER_STRU *m, int newstate );
+int32_t mb_master_request   ( MB_MASTER_STRU *m, uint8_t uid, const uint8_t pdu[], uint16_t len );
+
+int32_t mb_master_read_coils        ( MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t num, uint8_t bits[] );
+int32_t mb_master_read_discrete     ( MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t num, uint8_t bits[] );
+int32_t mb_master_read_holding      ( MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t num, uint16_t regs[] );
+int32_t mb_master_read_input        ( MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t num, uint16_t regs[] );
+int32_t mb_master_write_coil        ( MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint8_t on );
+int32_t mb_master_write_register    ( MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t val );
+int32_t mb_master_write_coils       ( MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t num, const uint8_t bits[] );
+int32_t mb_master_write_registers   ( MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t num, const uint16_t regs[] );
+int32_t mb_master_readwrite_registers( MB_MASTER_STRU *m, uint8_t uid, uint16_t rd_addr, uint16_t rd_num, uint16_t rd[],
+                                       uint16_t wr_addr, uint16_t wr_num, const uint16_t wr[] );
+
+#endif //#if MB_MASTER_ENABLED > 0
+
+#ifdef __cplusplus
+}
+#endif
+#endif
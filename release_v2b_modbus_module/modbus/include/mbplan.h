@@ -0,0 +1,127 @@
+/**
+  ******************************************************************************
+  * @file    HEADER FILE, poll list planner of the modbus master
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2022/01/04
+  * @brief   a device has hundreds of tags, a tag is a value at a unit, a
+             table and an address, one register, or two for a float, or a
+             coil. read one by one, each tag pays a whole request on the bus,
+             the frames, two t35 and the answer delay of the device. the
+             planner makes of the tag list the fewest reads, 01 02 03 04:
+                - the tags of one unit and table are sorted by address, and
+                  the ones which overlap or touch go in one read.
+                - a gap between two tags is read too, if its bytes cost less
+                  bus time than a request of its own, at the baudrate.
+                - a read is not longer than MB_PDU_FUNC_READ_REGCNT_MAX or
+                  MB_PDU_FUNC_READ_COILCNT_MAX, or the less of the device.
+                - a gap is not read if it has a hole, a range the device
+                  does not map, it would answer an exception for the read.
+             once built, the plan is read as a whole, or one request at a
+             time, through a MB_MASTER_STRU:
+
+                p.baudrate = 19200;  p.turnaround_us = 5000;
+                p.p_reqs = reqs;  p.req_max = 64;
+                p.p_regs = regs;  p.reg_size = 1024;
+                p.p_bits = bits;  p.bit_size = 64;
+                mb_plan_build(&p, tags, n);                 //once, tags[] is sorted
+                mb_plan_scan(&p, &m);                       //each scan
+                v = mb_plan_tag_reg(&p, &tags[i], 0);       //if p.p_reqs[tags[i].req].result == 0
+
+             the registers of the reads go in p_regs[], the bits in p_bits[],
+             8 in one byte as mb_master_read_coils() gives them, a read starts
+             in a byte of its own. 'pos' of a tag is where its value is.
+  *
+  ******************************************************************************
+  */
+
+#ifndef _MB_PLAN_H
+#define _MB_PLAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "mbconfig.h"
+#include "mbproto.h"
+#include "mbmaster.h"
+
+#if MB_MASTER_ENABLED > 0
+
+/* ----------------------- Type definitions ---------------------------------*/
+typedef struct
+{
+    uint8_t             uid;
+    uint8_t             fc;                                 //the table, by its read, MB_FUNC_READ_COILS/_DISCRETE_INPUTS/_HOLDING_REGISTER/_INPUT_REGISTER
+    uint16_t            addr;
+    uint16_t            width;                              //registers, or bits, eg. 2 for a float
+    uint16_t            id;                                 //of the user, it goes with the tag when sorted
+
+    /* below is set by mb_plan_build() */
+    uint16_t            req;                                //the read of the tag, in p_reqs[]
+    uint16_t            pos;                                //its first register in p_regs[], or its first bit in p_bits[]
+} MB_PLAN_TAG_STRU;
+
+typedef struct
+{
+    uint8_t             uid;
+    uint8_t             fc;
+    uint16_t            addr;
+    uint16_t            num;
+    uint16_t            pos;                                //its first register in p_regs[], or its first byte in p_bits[]
+    uint32_t            cost_us;                            //bus time, mb_plan_read_us()
+    int32_t             result;                             //of its recent read, as mb_master_read_holding(), 0= the values are fresh
+} MB_PLAN_REQ_STRU;
+
+typedef struct
+{
+    uint8_t             uid;
+    uint8_t             fc;
+    uint16_t            addr;
+    uint16_t            num;
+} MB_PLAN_HOLE_STRU;                                        //a range the device does not map, a read over it fails
+
+typedef struct
+{
+    /* below is cfg, set by the user before mb_plan_build() */
+    uint32_t            baudrate;                           //of the rtu line, 0= tcp, no bus time by the byte
+    uint32_t            turnaround_us;                      //from the request sent to the answer, of the device, on tcp the round trip
+    uint16_t            reg_max;                            //registers of a read, 0= MB_PDU_FUNC_READ_REGCNT_MAX, a device may take less
+    uint16_t            bit_max;                            //bits of a read, 0= MB_PDU_FUNC_READ_COILCNT_MAX
+    const MB_PLAN_HOLE_STRU *p_holes;
+    uint16_t            hole_num;
+    MB_PLAN_REQ_STRU    *p_reqs;                            //the reads of the plan
+    uint16_t            req_max;
+    uint16_t            *p_regs;                            //the values of the reads
+    uint16_t            reg_size;
+    uint8_t             *p_bits;
+    uint16_t            bit_size;                           //in bytes
+
+    /* below is set by mb_plan_build() */
+    uint16_t            req_num;
+    uint16_t            reg_num;                            //used of p_regs[]
+    uint16_t            bit_num;                            //used of p_bits[], in bytes
+    uint32_t            scan_us;                            //bus time of the reads of one scan
+    uint32_t            naive_num;                          //reads of one scan, a read for each tag
+    uint32_t            naive_us;                           //...and its bus time, to compare
+
+    /* below is statistics */
+    uint32_t            scan_cnt;
+    uint32_t            fail_cnt;                           //reads which did not get the values
+} MB_PLAN_STRU;
+
+/* ----------------------- Function prototypes ------------------------------*/
+int32_t  mb_plan_build      ( MB_PLAN_STRU *p, MB_PLAN_TAG_STRU tags[], uint16_t num );
+uint32_t mb_plan_read_us    ( const MB_PLAN_STRU *p, uint8_t fc, uint16_t num );
+int32_t  mb_plan_read       ( MB_PLAN_STRU *p, MB_MASTER_STRU *m, uint16_t i );
+int32_t  mb_plan_scan       ( MB_PLAN_STRU *p, MB_MASTER_STRU *m );
+uint16_t mb_plan_tag_reg    ( const MB_PLAN_STRU *p, const MB_PLAN_TAG_STRU *t, uint16_t i );
+uint8_t  mb_plan_tag_bit    ( const MB_PLAN_STRU *p, const MB_PLAN_TAG_STRU *t, uint16_t i );
+
+#endif //#if MB_MASTER_ENABLED > 0
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -57,6 +57,11 @@ extern "C" {
 #define MB_FUNC_OTHER_REPORT_SLAVEID          ( 17 )
 #define MB_FUNC_ERROR                         ( 128 )
 
+/* limits of the reads, of both sides, the slave's functions and the master */
+#define MB_PDU_FUNC_READ_COILCNT_MAX          ( 0x07D0 )    /*! coils of a 01, 2000. */
+#define MB_PDU_FUNC_READ_DISCCNT_MAX          ( 0x07D0 )    /*! discretes of a 02, 2000. */
+#define MB_PDU_FUNC_READ_REGCNT_MAX           ( 0x007D )    /*! registers of a 03 04, 125. */
+
 /* ----------------------- Type definitions ---------------------------------*/
 /* used by all the mb lib files, [by liq, 2019-11] */
 typedef enum
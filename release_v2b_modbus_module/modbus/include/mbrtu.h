@@ -20,6 +20,9 @@ void    mb_rtu_t35_callback(MB_SLAVE_STRU *slave);
 void    mb_rtu_bus_idle_callback(MB_SLAVE_STRU *slave);
 void    mb_rtu_bus_send_done_callback(MB_SLAVE_STRU *slave);
 
+uint32_t mb_rtu_char_us(uint32_t baudrate);
+uint32_t mb_rtu_t35_us(uint32_t baudrate);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,74 @@
+/**
+  ******************************************************************************
+  * @file    HEADER FILE, rtu framing by receive timestamps
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/11/20
+  * @brief   for hosts without uart IDLE irq and compare timer, eg. a linux tty
+             or a usb-serial adapter. the port reads chunks of bytes, stamps
+             each chunk with a monotonic time, and feeds them here. frames are
+             split by the measured gaps, and by the frame length when frames
+             are back-to-back in one chunk.
+  *
+  ******************************************************************************
+  */
+
+#ifndef _MB_RTU_TS_H
+#define _MB_RTU_TS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "mbconfig.h"
+
+#if MB_RTU_TS_ENABLED > 0
+
+/* ----------------------- Defines ------------------------------------------*/
+#define MB_RTU_TS_FRAME_MAX     256     /*!< biggest rtu frame. */
+#define MB_RTU_TS_QUEUE_NUM     4       /*!< completed frames waiting to be read. */
+
+/* ----------------------- Type definitions ---------------------------------*/
+typedef struct
+{
+    /* below is cfg, set in mb_rtu_ts_init() */
+    uint32_t        char_us;                                //time of one char on the line, 11 bits
+    uint32_t        t35_us;                                 //inter-frame gap, fixed 1750us if baud > 19200
+    uint32_t        tol_us;                                 //added to t35, for the latency of usb adapters
+
+    /* below is the frame under receiving */
+    uint8_t         cur[MB_RTU_TS_FRAME_MAX];
+    uint16_t        cur_len;
+    uint8_t         cur_overrun;                            //1= frame too long, drop bytes until a gap
+    uint64_t        t_last_us;                              //when the last byte was received
+
+    /* below is completed frames */
+    uint8_t         q[MB_RTU_TS_QUEUE_NUM][MB_RTU_TS_FRAME_MAX];
+    uint16_t        q_len[MB_RTU_TS_QUEUE_NUM];
+    uint8_t         q_head;
+    uint8_t         q_cnt;
+
+    /* below is statistics */
+    uint32_t        frame_cnt;                              //frames completed
+    uint32_t        split_gap_cnt;                          //...closed by a gap
+    uint32_t        split_len_cnt;                          //...closed by length and crc, no wait for the gap
+    uint32_t        overrun_cnt;                            //frames dropped, too long
+    uint32_t        qfull_cnt;                              //frames dropped, queue full
+    uint32_t        gap_max_us;                             //biggest gap seen inside a frame, for tuning tol_us
+} MB_RTU_TS_STRU;
+
+/* ----------------------- Function declaration -----------------------------*/
+extern int32_t  mb_rtu_ts_init      (MB_RTU_TS_STRU *ts, uint32_t baudrate, uint32_t tol_us);
+extern void     mb_rtu_ts_feed      (MB_RTU_TS_STRU *ts, const uint8_t d[], uint16_t n, uint64_t t_us);
+extern int32_t  mb_rtu_ts_poll      (MB_RTU_TS_STRU *ts, uint64_t now_us);
+extern uint64_t mb_rtu_ts_deadline  (MB_RTU_TS_STRU *ts);
+extern uint16_t mb_rtu_ts_get       (MB_RTU_TS_STRU *ts, uint8_t d[], uint16_t n);
+extern void     mb_rtu_ts_reset     (MB_RTU_TS_STRU *ts);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,107 @@
+/**
+  ******************************************************************************
+  * @file    HEADER FILE, scan scheduler of the modbus master
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2022/01/06
+  * @brief   the tags of a line do not all need the same rate, a 10 ms group,
+             a 100 ms group, a 1 s group. each group is a plan, mbplan.h, with
+             its period and its deadline. the scheduler sends the reads of
+             the groups through one master, earliest deadline first:
+                - a scan of a group is released each period, and is due its
+                  deadline after.
+                - one read at a time, of the released scan due first, so a
+                  10 ms group goes in between the reads of a long 1 s scan.
+                - the bus time of a scan is known by its plan, baudrate and
+                  frames, mb_plan_read_us(), 'load_pm' is the sum over the
+                  groups of scan time / period, more than 1000 is overload.
+             overload degrades gently, a scan which passes its deadline is
+             counted as missed and goes on as the scan of the next period,
+             with its deadline, one period skipped. so a late slow group
+             does not hold the fast ones back, each group gets its rate cut
+             as needed, none stops.
+             a read is not cut, so a scan may wait for one read of another
+             group, on rtu a read of 125 registers is near 30 ms at 115200.
+             a fast group wants the plans of the slow ones built with a
+             smaller 'reg_max', shorter reads.
+             one instance for a line or a connection, with its own master:
+
+                s.p_master = &m;  s.p_groups = grp;  s.group_num = 3;
+                mb_sched_init(&s);
+                for(;;){
+                    n = mb_sched_poll(&s);                  //one read, or ms to sleep
+                    if(n > 0) osDelay(n);
+                }
+
+             the task sleeps the time the scheduler gives until the next
+             scan, instead of a fixed CFG_TASK_MBPOLL_PERIOD_MS as the slave
+             task loops do.
+  *
+  ******************************************************************************
+  */
+
+#ifndef _MB_SCHED_H
+#define _MB_SCHED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "mbconfig.h"
+#include "mbmaster.h"
+#include "mbplan.h"
+
+#if MB_MASTER_ENABLED > 0
+
+/* ----------------------- Type definitions ---------------------------------*/
+typedef struct
+{
+    /* below is cfg, set by the user before mb_sched_init() */
+    MB_PLAN_STRU        *p_plan;                            //built, mb_plan_build()
+    uint32_t            period_ms;
+    uint32_t            deadline_ms;                        //after the release, 0= the period
+
+    /* below is the processing data */
+    uint8_t             active;                             //1= its scan is released and not done
+    uint16_t            next;                               //the next read of the scan, in the plan
+    uint32_t            release_ms;                         //of the scan, or of the next one
+    uint32_t            due_ms;
+    uint32_t            done_ms;                            //end of the recent scan
+
+    /* below is statistics */
+    uint32_t            scan_cnt;                           //scans done
+    uint32_t            miss_cnt;                           //deadlines passed
+    uint32_t            skip_cnt;                           //periods without a scan of their own, after a miss
+    uint32_t            lat_max_ms;                         //release to the first read
+    uint32_t            resp_max_ms;                        //release to done
+    uint32_t            jitter_max_ms;                      //of the time between two scans done, against the period
+    uint32_t            jitter_sum_ms;                      //...over scan_cnt - 1, for the mean
+} MB_SCHED_GROUP_STRU;
+
+typedef struct
+{
+    /* below is cfg, set by the user before mb_sched_init() */
+    MB_MASTER_STRU      *p_master;                          //of the line or connection, enabled
+    MB_SCHED_GROUP_STRU *p_groups;
+    uint16_t            group_num;
+
+    /* below is the processing data */
+    uint8_t             state;
+    uint32_t            load_pm;                            //bus load of the groups, per mille, > 1000 overload
+
+    /* below is statistics */
+    uint32_t            read_cnt;
+    uint32_t            idle_cnt;                           //polls with no scan released
+} MB_SCHED_STRU;
+
+/* ----------------------- Function prototypes ------------------------------*/
+int32_t mb_sched_init   ( MB_SCHED_STRU *s );
+int32_t mb_sched_poll   ( MB_SCHED_STRU *s );
+
+#endif //#if MB_MASTER_ENABLED > 0
+
+#ifdef __cplusplus
+}
+#endif
+#endif
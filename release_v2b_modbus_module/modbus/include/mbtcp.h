@@ -10,6 +10,7 @@ extern "C" {
 
 /* Defines */
 #define MB_TCP_PSEUDO_ADDRESS   255 //id, compatable with rtu's slave id
+#define MB_TCP_LOCAL_ADDRESS    0   //id of the server itself, as MB_TCP_PSEUDO_ADDRESS, not a broadcast on tcp
 //add by liq 23Feb2020
 #define MB_TCP_LEN              4
 #define MB_TCP_UID              6
@@ -0,0 +1,109 @@
+/**
+  ******************************************************************************
+  * @file    HEADER FILE, connections of a modbus tcp server
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/12/04
+  * @brief   a tcp port serves up to MB_TCP_CONN_MAX clients at the same time.
+             the port accepts and reads the sockets, opens a connection here
+             for each client and puts what it reads into the receive buffer of
+             the connection, a stream of pipelined adus. mb_poll() takes the
+             requests one by one, round robin over the connections, and the
+             response goes back to the connection the request came from.
+             the lib is not touched, the port hooks do it all:
+                p_tcpsvr_receive_ref() -> mb_tcp_conn_next_ref(), or
+                p_tcpsvr_receiving()   -> mb_tcp_conn_next() to copy it
+                p_tcpsvr_send()        -> the handle of mb_tcp_conn_cur()
+                after mb_poll()        -> mb_tcp_conn_done()
+                now and then           -> mb_tcp_conn_idle(), close the idle ones
+                its responses can not go -> mb_tcp_conn_hold(), until they can
+  *
+  ******************************************************************************
+  */
+
+#ifndef _MB_TCP_CONN_H
+#define _MB_TCP_CONN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "mbconfig.h"
+#include "mbtcp.h"
+
+#if MB_TCP_ENABLED > 0
+
+/* ----------------------- Defines ------------------------------------------*/
+#define MB_TCP_CONN_NONE        (-1)    /*!< no connection, eg. the table is full. */
+
+/* ----------------------- Type definitions ---------------------------------*/
+typedef struct
+{
+    uint8_t         used;                                   //1= a client is connected
+    uint8_t         in_rq;                                  //1= it is in the ready queue, once at most
+    uint8_t         rx_paused;                              //1= the port stopped reading, no space, see mb_tcp_conn_rxspace(), the port owns it
+    uint8_t         tx_hold;                                //1= its requests wait, the port has no room for a response, see mb_tcp_conn_hold()
+    intptr_t        handle;                                 //of the port, eg. a netconn pointer or a socket fd
+    uint32_t        open_no;                                //open_cnt of the table when it was opened, tells a reused entry, eg. for an answer which comes later
+
+    uint8_t         *rxbuf;                                 //a slab of the table, MB_TCP_BUF_SIZE, held while there are bytes, 0= none
+    uint16_t        rxhead;                                 //the first byte not served in rxbuf[]
+    uint16_t        rxpos;                                  //bytes in rxbuf[]
+    uint16_t        zc_len;                                 //>0= the adu at rxbuf[0] is served in place, its length
+    uint32_t        last_ms;                                //when it was opened or sent something, for the idle timeout
+
+    uint32_t        rx_bytes;
+    uint32_t        rx_adu;
+    uint32_t        tx_adu;
+} MB_TCP_CONN_STRU;
+
+typedef struct
+{
+    MB_TCP_CONN_STRU conn[MB_TCP_CONN_MAX];
+    uint16_t        conn_free[MB_TCP_CONN_MAX];             //stack of the free connections
+    uint16_t        conn_free_num;
+    uint16_t        rq[MB_TCP_CONN_MAX];                    //ready queue, the connections with a complete request, fifo for fairness
+    uint16_t        rq_head;
+    uint16_t        rq_num;
+    uint8_t         slab[MB_TCP_SLAB_NUM][MB_TCP_BUF_SIZE]; //the receive buffers
+    uint16_t        slab_free[MB_TCP_SLAB_NUM];             //stack of the free slabs
+    uint16_t        slab_free_num;
+
+    uint16_t        num;                                    //connections used
+    int32_t         cur;                                    //connection of the request being served, MB_TCP_CONN_NONE= none
+    uint32_t        now_ms;                                 //time of the port, given by mb_tcp_conn_idle()
+    uint32_t        sweep_ms;                               //when the last idle sweep ended
+    uint16_t        sweep_idx;                              //where the idle sweep goes on, 0= a new sweep
+
+    uint32_t        open_cnt;
+    uint32_t        close_cnt;
+    uint32_t        refuse_cnt;                             //clients refused, the table is full
+    uint32_t        idle_cnt;                               //clients closed by the idle timeout
+    uint32_t        drop_cnt;                               //bytes dropped, bad MBAP
+    uint32_t        zc_adu;                                 //adus served in place
+    uint32_t        copy_bytes;                             //bytes copied, adus not served in place, and moving a split adu to the front
+    uint32_t        slab_max;                               //the most slabs used at the same time
+    uint32_t        slab_wait_cnt;                          //a client found no slab, it waits
+} MB_TCP_CONN_TABLE_STRU;
+
+/* ----------------------- Function prototypes ------------------------------*/
+void    mb_tcp_conn_init ( MB_TCP_CONN_TABLE_STRU *tbl );
+int32_t mb_tcp_conn_open ( MB_TCP_CONN_TABLE_STRU *tbl, intptr_t handle );
+void    mb_tcp_conn_close( MB_TCP_CONN_TABLE_STRU *tbl, int32_t idx );
+uint8_t *mb_tcp_conn_rxspace( MB_TCP_CONN_TABLE_STRU *tbl, int32_t idx, uint16_t *space );
+int32_t mb_tcp_conn_rxdone( MB_TCP_CONN_TABLE_STRU *tbl, int32_t idx, uint16_t n );
+int32_t mb_tcp_conn_next ( MB_TCP_CONN_TABLE_STRU *tbl, uint8_t d[], uint16_t *len );
+int32_t mb_tcp_conn_next_ref( MB_TCP_CONN_TABLE_STRU *tbl, uint8_t d[], uint8_t **adu, uint16_t *len );
+void    mb_tcp_conn_done ( MB_TCP_CONN_TABLE_STRU *tbl );
+void    mb_tcp_conn_hold ( MB_TCP_CONN_TABLE_STRU *tbl, int32_t idx, uint8_t on );
+int32_t mb_tcp_conn_idle ( MB_TCP_CONN_TABLE_STRU *tbl, uint32_t now_ms );
+int32_t mb_tcp_conn_ready( MB_TCP_CONN_TABLE_STRU *tbl );
+int32_t mb_tcp_conn_cur  ( MB_TCP_CONN_TABLE_STRU *tbl, intptr_t *handle );
+
+#endif //#if MB_TCP_ENABLED > 0
+
+#ifdef __cplusplus
+}
+#endif
+#endif
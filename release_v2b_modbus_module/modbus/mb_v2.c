@@ -46,6 +46,23 @@ typedef enum
 ******************************* Private variables ******************************
 *******************************************************************************/
 
+/* image of the unit which is being served in mb_execute(), read by the register 
+callbacks through mb_get_serving_image(), 0= the default image. one for each
+thread which runs mb_poll(), see MB_THREAD_LOCAL. */
+#if MB_SERVING_TASK_MAX > 0
+typedef struct
+{
+    void                    *task;                          //mb_port_task_id() of the task, 0= free
+    MB_REG_IMAGE_STRU       *p_image;
+} MB_SERVING_STRU;
+
+static MB_SERVING_STRU      mb_serving[MB_SERVING_TASK_MAX];//a task takes an entry at its first mb_init() or mb_execute(), and keeps it
+static MB_REG_IMAGE_STRU    *p_image_serving_isr;           //of the isr fast path, no task runs while it
+static volatile uint8_t     mb_serving_in_isr;
+#else
+static MB_THREAD_LOCAL MB_REG_IMAGE_STRU *p_image_serving;
+#endif
+
 /* An array of Modbus functions handlers which associates Modbus function
 codes with implementing functions. */
 static xMBFunctionHandler mb_function_handlers[MB_FUNC_HANDLERS_MAX] = 
@@ -90,6 +107,16 @@ static xMBFunctionHandler mb_function_handlers[MB_FUNC_HANDLERS_MAX] =
 #endif
 };
 
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static int32_t      mb_unit_table_init  (MB_UNIT_TABLE_STRU *tbl);
+static int32_t      mb_unit_lookup      (MB_SLAVE_STRU *slave);
+static eMBException mb_execute          (MB_SLAVE_STRU *slave);
+static void         mb_exception_pdu    (MB_SLAVE_STRU *slave, eMBException exception);
+static uint8_t      mb_echo_kind        (pxMBFunctionHandler handler);
+static MB_REG_IMAGE_STRU **mb_serving_ref(uint8_t take);
+
 
 /*******************************************************************************
   * @brief  mb slave init
@@ -111,10 +138,18 @@ int32_t mb_init(MB_SLAVE_STRU *slave)
         return __LINE__; 
     }
 
-    /* check slave address */
-    if( ( slave->address == MB_ADDRESS_BROADCAST ) ||
-        ( slave->address < MB_ADDRESS_MIN ) || ( slave->address > MB_ADDRESS_MAX ) )
-    {
+    /* check slave address, or the addresses of all units */
+    if(slave->p_unit_tbl == 0){
+        if( ( slave->address == MB_ADDRESS_BROADCAST ) ||
+            ( slave->address < MB_ADDRESS_MIN ) || ( slave->address > MB_ADDRESS_MAX ) )
+        {
+            return __LINE__;
+        }
+    }
+    else if(mb_unit_table_init(slave->p_unit_tbl) != 0){
+        return __LINE__;
+    }
+    else if(mb_serving_ref(1) == 0){                        //the units have images, but no entry is left for this task
         return __LINE__;
     }
     
@@ -211,8 +246,7 @@ int32_t mb_enable( MB_SLAVE_STRU *slave , int newstate)
   *****************************************************************************/
 int32_t mb_poll( MB_SLAVE_STRU *slave )
 {
-    static eMBException exception;
-    
+    eMBException exception;
     uint32_t get_event;
 
     /* Check if the protocol stack is ready. */
@@ -236,55 +270,47 @@ int32_t mb_poll( MB_SLAVE_STRU *slave )
                 return __LINE__; /* we has the 'received' message, but not got the pdu */
             }
 
-            /* check if the new received frame is for this slave. */
-            if(slave->targetaddr != slave->address
-            && slave->targetaddr != MB_ADDRESS_BROADCAST ){
+            /* check if the new received frame is for this slave, and find its unit. */
+            if(mb_unit_lookup(slave) != 0){
+#if MB_TCP_ENABLED > 0
+                if(slave->mode == MB_TCP){                  //no such unit behind this server, the tcp client waits for an answer
+                    slave->function_code = slave->p_pdu[MB_PDU_FUNC_OFF];
+                    mb_exception_pdu(slave, MB_EX_GATEWAY_TGT_FAILED);
+                    (void)slave->p_slave_send_pdu(slave, slave->targetaddr, slave->p_pdu, slave->pdu_len);
+                }
+#endif
                 return __LINE__;                            //* the pdu is not for this slave or broadcasting */
             }
 
             
             /* here, the frame is for this slave, prepare the response or exception. */
             slave->function_code = slave->p_pdu[MB_PDU_FUNC_OFF];
-            exception = MB_EX_ILLEGAL_FUNCTION;
-            for( i = 0; i < MB_FUNC_HANDLERS_MAX; i++ )
+
+            /* a broadcast reaches every unit on the line, execute it once for each unit, no reply. */
+            if( slave->targetaddr == MB_ADDRESS_BROADCAST && slave->p_unit_tbl != 0 )
             {
-                /* seek to table's end, and No more function handlers registered. Abort seeking. */
-                if( mb_function_handlers[i].ucFunctionCode == 0 ){
-                    break;
-                }
-                else if( mb_function_handlers[i].ucFunctionCode == (slave->function_code))
+                uint16_t req_len = slave->pdu_len;          //handler may change pdu_len, restore it for next unit
+
+                for( i = 0; i < slave->p_unit_tbl->num; i++ )
                 {
-                    //we have found the target function code
-                    slave->receive_ok_cnt++;
-                    if(slave->function_code==MB_FUNC_READ_INPUT_REGISTER){//func=04
-                        slave->receive_input_cnt++;
-                    }
-                    else if(slave->function_code==MB_FUNC_READ_HOLDING_REGISTER ||  //func=03
-                            slave->function_code==MB_FUNC_WRITE_REGISTER||//func=06
-                            slave->function_code==MB_FUNC_WRITE_MULTIPLE_REGISTERS){//func=16
-                        slave->receive_hold_cnt++;
-                    }else{
-                        slave->receive_other_cnt++;
-                    }
-                    
-                    //here, the handle may call eg. eMBRegHoldingCB(), which will modify p_pdu and pdu_len 
-                    exception = mb_function_handlers[i].pxHandler( slave->p_pdu, &(slave->pdu_len) );
-                    break;
+                    slave->p_unit  = &(slave->p_unit_tbl->p_units[i]);
+                    slave->pdu_len = req_len;
+                    (void)mb_execute(slave);
                 }
+                return 0;
             }
 
+            exception = mb_execute(slave);
+
             /* defaulty, If the request was not sent to the broadcast address we return a reply. */
             if( slave->targetaddr != MB_ADDRESS_BROADCAST )
             {
                 if( exception != MB_EX_NONE )
                 {
-                    /* An exception occured. Build an error frame. */
-                    slave->pdu_len = 0;
-                    slave->p_pdu[slave->pdu_len++] = ( uint8_t )( (slave->function_code) | MB_FUNC_ERROR );
-                    slave->p_pdu[slave->pdu_len++] = exception;
+                    mb_exception_pdu(slave, exception);     //An exception occured. Build an error frame.
                 }
-                                
-                e = slave->p_slave_send_pdu(slave, slave->address, slave->p_pdu, slave->pdu_len ); 
+                                                            //reply with the address it was asked by, it is a unit's address if multi-unit
+                e = slave->p_slave_send_pdu(slave, slave->targetaddr, slave->p_pdu, slave->pdu_len ); 
                 return 0;
             }
             
@@ -294,10 +320,334 @@ int32_t mb_poll( MB_SLAVE_STRU *slave )
 }
 
 
+/*******************************************************************************
+  * @brief  for the register callbacks, get the image of the unit being served.
+  *
+  * @param  none
+  *
+  * @retval the image, 0= the default image of the application.
+  *
+  * @note   only valid during a function handler is called by mb_poll().
+  *****************************************************************************/
+MB_REG_IMAGE_STRU *mb_get_serving_image( void )
+{
+    MB_REG_IMAGE_STRU **pp = mb_serving_ref(0);
+
+    return (pp != 0) ? *pp : 0;
+}
+
+
+/*******************************************************************************
+  * @brief  answer a read request in isr, for the rtu isr fast path.
+  *
+  * @param  slave, its targetaddr, p_pdu, pdu_len is the request.
+  *
+  * @retval 0= served, p_pdu and pdu_len is the response or exception to send.
+            other= not served, leave it to mb_poll().
+  *
+  * @note   only FC03/04 with the built-in handlers are served, writes and the
+            handlers set by user or by a unit are left to the task. the
+            register callbacks are called in isr, so the registers must be
+            readable there, eg. written by the app in 16-bit words only.
+  *****************************************************************************/
+int32_t mb_execute_isr( MB_SLAVE_STRU *slave )
+{
+    pxMBFunctionHandler builtin = 0;
+    eMBException        exception;
+    MB_REG_IMAGE_STRU   **pp, *p_saved;
+    int32_t             i;
+
+    if( slave->state != STATE_ENABLED || slave->targetaddr == MB_ADDRESS_BROADCAST ){
+        return __LINE__;
+    }
+
+    slave->function_code = slave->p_pdu[MB_PDU_FUNC_OFF];
+#if MB_FUNC_READ_HOLDING_ENABLED > 0
+    if( slave->function_code == MB_FUNC_READ_HOLDING_REGISTER ){
+        builtin = eMBFuncReadHoldingRegister;
+    }
+#endif
+#if MB_FUNC_READ_INPUT_ENABLED > 0
+    if( slave->function_code == MB_FUNC_READ_INPUT_REGISTER ){
+        builtin = eMBFuncReadInputRegister;
+    }
+#endif
+    if( builtin == 0 ){
+        return __LINE__;
+    }
+
+    if( mb_unit_lookup(slave) != 0 ){                       //not for this slave, mb_poll() drops it
+        return __LINE__;
+    }
+    if( slave->p_unit != 0 && slave->p_unit->p_handlers != 0 ){
+        return __LINE__;
+    }
+    for( i = 0; i < MB_FUNC_HANDLERS_MAX; i++ ){            //not replaced by mb_register_function()
+        if( mb_function_handlers[i].ucFunctionCode == slave->function_code ){
+            break;
+        }
+    }
+    if( i == MB_FUNC_HANDLERS_MAX || mb_function_handlers[i].pxHandler != builtin ){
+        return __LINE__;
+    }
+
+#if MB_SERVING_TASK_MAX > 0
+    mb_serving_in_isr++;                                    //the isr has its own image, the task it cut keeps its one
+#endif
+    pp = mb_serving_ref(0);                                 //an isr of a higher priority may have cut another one in
+    p_saved = *pp;                                          //...a register callback, give it back its image
+    exception = mb_execute(slave);
+    *pp = p_saved;
+#if MB_SERVING_TASK_MAX > 0
+    mb_serving_in_isr--;
+#endif
+    if( exception != MB_EX_NONE ){
+        mb_exception_pdu(slave, exception);
+    }
+    return 0;
+}
+
+
 /*******************************************************************************
 ******************************* Private functions ******************************
 *******************************************************************************/
 
+/*******************************************************************************
+  * @brief  build the address-indexed lookup of a unit table
+  *
+  * @param  tbl, its 'p_units' and 'num' are set by user.
+  *
+  * @retval 0= OK, other= error.
+  *
+  * @note   a unit address must be legal and used only once.
+  *****************************************************************************/
+static int32_t mb_unit_table_init(MB_UNIT_TABLE_STRU *tbl)
+{
+    int32_t  i;
+    uint8_t  addr;
+
+    if(tbl->p_units == 0 || tbl->num == 0 || tbl->num >= MB_UNIT_IDX_NONE){
+        return __LINE__;
+    }
+
+    for( i = 0; i <= MB_ADDRESS_MAX; i++ ){
+        tbl->idx[i] = MB_UNIT_IDX_NONE;
+    }
+
+    for( i = 0; i < tbl->num; i++ ){
+        addr = tbl->p_units[i].address;
+        if( ( addr < MB_ADDRESS_MIN ) || ( addr > MB_ADDRESS_MAX ) ){
+            return __LINE__;
+        }
+        if(tbl->idx[addr] != MB_UNIT_IDX_NONE){
+            return __LINE__;                                //same address used twice
+        }
+        tbl->idx[addr] = (uint8_t)i;
+    }
+
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  check the target address of the recent rx pdu, and find its unit.
+  *
+  * @param  slave
+  *
+  * @retval 0= the pdu is for this slave, other= not for this slave.
+  *
+  * @note   slave->p_unit is set to the unit, 0 if no unit table or broadcast.
+  *****************************************************************************/
+static int32_t mb_unit_lookup(MB_SLAVE_STRU *slave)
+{
+    uint8_t n;
+
+    slave->p_unit = 0;
+
+    if(slave->targetaddr == MB_ADDRESS_BROADCAST){
+        return 0;
+    }
+
+    if(slave->p_unit_tbl == 0){                             //single address slave
+        return (slave->targetaddr == slave->address) ? 0 : __LINE__;
+    }
+
+    if(slave->targetaddr > MB_ADDRESS_MAX){
+        return __LINE__;
+    }
+    n = slave->p_unit_tbl->idx[slave->targetaddr];
+    if(n == MB_UNIT_IDX_NONE){
+        return __LINE__;
+    }
+    slave->p_unit = &(slave->p_unit_tbl->p_units[n]);
+
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  execute the recent rx pdu with the handler set of its unit
+  *
+  * @param  slave, its p_pdu and pdu_len is the request, and the response when return.
+  *
+  * @retval the modbus exception, MB_EX_NONE if OK.
+  *
+  * @note   the register callbacks get the unit's image by mb_get_serving_image().
+  *****************************************************************************/
+static eMBException mb_execute(MB_SLAVE_STRU *slave)
+{
+    xMBFunctionHandler  *handlers = mb_function_handlers;
+    eMBException        exception = MB_EX_ILLEGAL_FUNCTION;
+    MB_REG_IMAGE_STRU   **pp, *img;
+    int32_t             i;
+
+    if(slave->p_unit != 0 && slave->p_unit->p_handlers != 0){
+        handlers = slave->p_unit->p_handlers;
+    }
+    img = (slave->p_unit != 0) ? slave->p_unit->p_image : 0;
+    pp  = mb_serving_ref(1);
+    if(pp == 0){                                            //no entry for this task, only the default image can be served
+        if(img != 0){
+            return MB_EX_SLAVE_DEVICE_FAILURE;
+        }
+        pp = &img;
+    }
+    *pp = img;                                              //always, not the one left by another
+
+    for( i = 0; i < MB_FUNC_HANDLERS_MAX; i++ )
+    {
+        /* seek to table's end, and No more function handlers registered. Abort seeking. */
+        if( handlers[i].ucFunctionCode == 0 ){
+            break;
+        }
+        else if( handlers[i].ucFunctionCode == (slave->function_code))
+        {
+            //we have found the target function code
+            slave->receive_ok_cnt++;
+            if(slave->p_unit != 0){
+                slave->p_unit->receive_ok_cnt++;
+            }
+            if(slave->function_code==MB_FUNC_READ_INPUT_REGISTER){//func=04
+                slave->receive_input_cnt++;
+            }
+            else if(slave->function_code==MB_FUNC_READ_HOLDING_REGISTER ||  //func=03
+                    slave->function_code==MB_FUNC_WRITE_REGISTER||//func=06
+                    slave->function_code==MB_FUNC_WRITE_MULTIPLE_REGISTERS){//func=16
+                slave->receive_hold_cnt++;
+            }else{
+                slave->receive_other_cnt++;
+            }
+            
+            //here, the handle may call eg. eMBRegHoldingCB(), which will modify p_pdu and pdu_len 
+            exception = handlers[i].pxHandler( slave->p_pdu, &(slave->pdu_len) );
+            break;
+        }
+    }
+
+    *pp = 0;
+
+    slave->tx_echo = MB_TX_ECHO_NONE;
+    if( exception == MB_EX_NONE && i < MB_FUNC_HANDLERS_MAX ){
+        slave->tx_echo = mb_echo_kind( handlers[i].pxHandler );
+    }
+    return exception;
+}
+
+
+/*******************************************************************************
+  * @brief  if the response of a handler is an echo of the request
+  *
+  * @param  handler = the handler which has served the request
+  *
+  * @retval MB_TX_ECHO_ENUM
+  *
+  * @note   only the built-in handlers are known to leave the request as it
+            is, a handler set by user or by a unit always builds the response.
+  *****************************************************************************/
+static uint8_t mb_echo_kind(pxMBFunctionHandler handler)
+{
+#if MB_FUNC_WRITE_HOLDING_ENABLED > 0
+    if( handler == eMBFuncWriteHoldingRegister ){
+        return MB_TX_ECHO_FULL;
+    }
+#endif
+#if MB_FUNC_WRITE_COIL_ENABLED > 0
+    if( handler == eMBFuncWriteCoil ){
+        return MB_TX_ECHO_FULL;
+    }
+#endif
+#if MB_FUNC_WRITE_MULTIPLE_HOLDING_ENABLED > 0
+    if( handler == eMBFuncWriteMultipleHoldingRegister ){
+        return MB_TX_ECHO_HEAD;
+    }
+#endif
+#if MB_FUNC_WRITE_MULTIPLE_COILS_ENABLED > 0
+    if( handler == eMBFuncWriteMultipleCoils ){
+        return MB_TX_ECHO_HEAD;
+    }
+#endif
+    (void)handler;
+    return MB_TX_ECHO_NONE;
+}
+
+
+/*******************************************************************************
+  * @brief  where the image being served is kept, for the running task.
+  *
+  * @param  take = 1, take a free entry if the task has none.
+  *
+  * @retval the place of the image, 0= the task has no entry.
+  *
+  * @note   with MB_THREAD_LOCAL it is the one of the thread. on the rtos it
+            is the entry of mb_port_task_id(), or the one of the isr fast
+            path in isr. a free entry is taken by a compare and swap, the
+            tasks may take their ones at the same time. the entries are never
+            given back, the tasks run for ever.
+  *****************************************************************************/
+static MB_REG_IMAGE_STRU **mb_serving_ref(uint8_t take)
+{
+#if MB_SERVING_TASK_MAX > 0
+    void     *task, *free_task;
+    int32_t  i;
+
+    if( mb_serving_in_isr != 0 ){
+        return &p_image_serving_isr;
+    }
+    task = mb_port_task_id();
+    for( i = 0; i < MB_SERVING_TASK_MAX; i++ ){
+        if( __atomic_load_n(&mb_serving[i].task, __ATOMIC_ACQUIRE) == task ){
+            return &mb_serving[i].p_image;
+        }
+    }
+    for( i = 0; take != 0 && i < MB_SERVING_TASK_MAX; i++ ){
+        free_task = 0;
+        if( __atomic_compare_exchange_n(&mb_serving[i].task, &free_task, task, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) ){
+            return &mb_serving[i].p_image;
+        }
+    }
+    return 0;
+#else
+    (void)take;
+    return &p_image_serving;
+#endif
+}
+
+
+/*******************************************************************************
+  * @brief  build the exception response in p_pdu
+  *
+  * @param  slave, exception
+  *
+  * @retval none
+  *****************************************************************************/
+static void mb_exception_pdu(MB_SLAVE_STRU *slave, eMBException exception)
+{
+    slave->pdu_len = 0;
+    slave->p_pdu[slave->pdu_len++] = ( uint8_t )( (slave->function_code) | MB_FUNC_ERROR );
+    slave->p_pdu[slave->pdu_len++] = exception;
+}
+
+
 
 /*******************************************************************************
   * @brief  register function to xFucnHandlers
@@ -34,6 +34,16 @@
 #define MB_SER_PDU_SIZE_LRC     1                           // Size of LRC field in PDU. */
 #define MB_SER_PDU_ADDR_OFF     0                           // Offset of slave address in Ser-PDU. */
 #define MB_SER_PDU_PDU_OFF      1                           // Offset of Modbus-PDU in Ser-PDU. */
+#define MB_SER_RAW_SIZE_MAX     (MB_SER_PDU_SIZE_MAX * 2 + 1)// size of p_ascii_txbuf, the rx frame is kept there. */
+#define MB_SER_TX_SIZE_MAX      (MB_SER_RAW_SIZE_MAX + 2)   // ':' + 256 bytes in hex + CR LF, size of p_ascii_txbuf. */
+#define MB_SER_RAW_HEAD_LEN     13                          // ':' + addr, fc, start, cnt in hex, the head of a FC15/16 echo. */
+#define MB_ASCII_TIMEOUT_MS_MAX 3000                        // p_timer_init() takes 50us ticks, of a 16 bits compare. */
+
+                                                            // codes in mb_ascii_char_lut[] which are not a hex nibble. */
+#define MB_ASCII_LUT_COLON      0x10
+#define MB_ASCII_LUT_CR         0x11
+#define MB_ASCII_LUT_LF         0x12
+#define MB_ASCII_LUT_INVALID    0xFF
 
 /* ----------------------- Type definitions ---------------------------------*/
 typedef enum
@@ -50,16 +60,57 @@ typedef enum
     BYTE_LOW_NIBBLE                                         // Character for low nibble of byte. */
 } eMBBytePos;
 
-/* ----------------------- Static functions ---------------------------------*/
-static uint8_t    prvucMBCHAR2BIN( uint8_t c );
-
-static uint8_t    prvucMBBIN2CHAR( uint8_t b );
+/* ----------------------- Static variables ---------------------------------*/
+                                                            // rx char to nibble 0x0~0xF, or a MB_ASCII_LUT_xxx code. */
+static const uint8_t mb_ascii_char_lut[256] =
+{
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x12, 0xFF, 0xFF, 0x11, 0xFF, 0xFF,  //0x0_, LF CR
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0x1_
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0x2_
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x10, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0x3_, '0'~'9' ':'
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0x4_, 'A'~'F'
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0x5_
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0x6_
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0x7_
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0x8_
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0x9_
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0xA_
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0xB_
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0xC_
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0xD_
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,  //0xE_
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF   //0xF_
+};
+
+                                                            // byte to two hex chars, high nibble first. */
+static const uint8_t mb_ascii_hex_lut[256][2] =
+{
+    "00", "01", "02", "03", "04", "05", "06", "07", "08", "09", "0A", "0B", "0C", "0D", "0E", "0F",
+    "10", "11", "12", "13", "14", "15", "16", "17", "18", "19", "1A", "1B", "1C", "1D", "1E", "1F",
+    "20", "21", "22", "23", "24", "25", "26", "27", "28", "29", "2A", "2B", "2C", "2D", "2E", "2F",
+    "30", "31", "32", "33", "34", "35", "36", "37", "38", "39", "3A", "3B", "3C", "3D", "3E", "3F",
+    "40", "41", "42", "43", "44", "45", "46", "47", "48", "49", "4A", "4B", "4C", "4D", "4E", "4F",
+    "50", "51", "52", "53", "54", "55", "56", "57", "58", "59", "5A", "5B", "5C", "5D", "5E", "5F",
+    "60", "61", "62", "63", "64", "65", "66", "67", "68", "69", "6A", "6B", "6C", "6D", "6E", "6F",
+    "70", "71", "72", "73", "74", "75", "76", "77", "78", "79", "7A", "7B", "7C", "7D", "7E", "7F",
+    "80", "81", "82", "83", "84", "85", "86", "87", "88", "89", "8A", "8B", "8C", "8D", "8E", "8F",
+    "90", "91", "92", "93", "94", "95", "96", "97", "98", "99", "9A", "9B", "9C", "9D", "9E", "9F",
+    "A0", "A1", "A2", "A3", "A4", "A5", "A6", "A7", "A8", "A9", "AA", "AB", "AC", "AD", "AE", "AF",
+    "B0", "B1", "B2", "B3", "B4", "B5", "B6", "B7", "B8", "B9", "BA", "BB", "BC", "BD", "BE", "BF",
+    "C0", "C1", "C2", "C3", "C4", "C5", "C6", "C7", "C8", "C9", "CA", "CB", "CC", "CD", "CE", "CF",
+    "D0", "D1", "D2", "D3", "D4", "D5", "D6", "D7", "D8", "D9", "DA", "DB", "DC", "DD", "DE", "DF",
+    "E0", "E1", "E2", "E3", "E4", "E5", "E6", "E7", "E8", "E9", "EA", "EB", "EC", "ED", "EE", "EF",
+    "F0", "F1", "F2", "F3", "F4", "F5", "F6", "F7", "F8", "F9", "FA", "FB", "FC", "FD", "FE", "FF" 
+};
 
+/* ----------------------- Static functions ---------------------------------*/
 static uint8_t    prvucMBLRC( uint8_t * p, uint16_t l );
 
-static uint8_t    mb_ascii_parse_char(MB_SLAVE_STRU *slave,  uint16_t *p_rx_pos );
+static uint8_t    mb_ascii_decode(MB_SLAVE_STRU *slave, const uint8_t d[], uint16_t n, uint16_t *o_used );
+
+static uint16_t   mb_ascii_encode(MB_SLAVE_STRU *slave, const uint8_t d[], uint16_t n);
 
-static int        mb_ascii_convert_to_ascii_frame(MB_SLAVE_STRU *slave, uint8_t d[], int n);
+static void       mb_ascii_keep_raw( MB_SLAVE_STRU *slave, const uint8_t d[], uint16_t n, uint8_t restart );
 
 /*******************************************************************************
   * @brief  ascii init, it calls and init bsp serial and timer reload value.
@@ -68,11 +119,21 @@ static int        mb_ascii_convert_to_ascii_frame(MB_SLAVE_STRU *slave, uint8_t
   *
   * @retval 0=no error
   *
-  * @note   The timer reload value is ONE second.
+  * @note   The timer reload value is slave->ascii_timeout_ms, if it is 0
+            it is the time of a max frame, MB_SER_TX_SIZE_MAX chars, and
+            MB_ASCII_TIMEOUT_CHARS chars more (10 bits each) at the baudrate,
+            but not less than MB_ASCII_TIMEOUT_MS_MIN. eg. 47ms at 115200,
+            558ms at 9600, capped at 3s below about 1800 baud.
+            the timer is restarted once per chunk, not per char, the rest of
+            a frame after a chunk may come in one run, as a dma with IDLE
+            or a usb adapter does, so the timeout covers the rest of the
+            longest frame. a lost frame end does not wait for it, the next
+            ':' starts the next frame.
   *****************************************************************************/
 int32_t mb_ascii_init(MB_SLAVE_STRU *slave)
 {
     int32_t  r;
+    uint32_t ms;                                            //char timeout
 
     //ENTER_CRITICAL_SECTION();
                                                             //* serial init, ascii use 7 bits, (while rtu use 8 bits). */
@@ -81,7 +142,22 @@ int32_t mb_ascii_init(MB_SLAVE_STRU *slave)
         return -1;
     }
     
-    if( slave->p_timer_init(MB_ASCII_TIMEOUT_SEC * 20000) != 0 ) {
+    ms = slave->ascii_timeout_ms;
+    if( ms == 0 ){
+        ms = MB_ASCII_TIMEOUT_MS_MIN;
+        if( slave->baudrate > 0 ){
+            ms = ((MB_SER_TX_SIZE_MAX + MB_ASCII_TIMEOUT_CHARS) * 10UL * 1000UL + slave->baudrate - 1) / slave->baudrate;
+        }
+        if( ms < MB_ASCII_TIMEOUT_MS_MIN ){
+            ms = MB_ASCII_TIMEOUT_MS_MIN;
+        }
+    }
+    if( ms > MB_ASCII_TIMEOUT_MS_MAX ){
+        ms = MB_ASCII_TIMEOUT_MS_MAX;
+    }
+    slave->ascii_timeout_ms = (uint16_t)ms;
+
+    if( slave->p_timer_init(ms * 20) != 0 ) {
         return -2;
     }
                                                             //init event
@@ -119,6 +195,7 @@ void mb_ascii_enable(MB_SLAVE_STRU *slave, int32_t en)
         slave->p_serial_enable( 1, 0 );             
         //slave->p_timer_enable(1);
         slave->ascii_rcv_state = STATE_RX_IDLE;
+        slave->ascii_tail_len  = 0;
         //EXIT_CRITICAL_SECTION( );
     }
     else{
@@ -143,25 +220,60 @@ void mb_ascii_enable(MB_SLAVE_STRU *slave, int32_t en)
             the poll() will check address.
             when to call?
             when in poll(), get a event EV_FRAME_RECEIVED(meaning a completed frame), call this.
+            2. the chars after LF in the last chunk are kept in ascii_tail
+               from the next ':', and decoded first by the next call, which
+               comes by the event posted here. eg. a broadcast and the next
+               request in one IDLE, or the request to another slave and its
+               response.
   *****************************************************************************/
 int32_t mb_ascii_receive_pdu(MB_SLAVE_STRU *slave, uint8_t * oaddr, uint8_t ** opdu, uint16_t * opdulen)
 {
+    uint8_t  chunk[MB_ASCII_RX_CHUNK];                      //rx chars, read from the port a chunk at a time
+    int32_t  n;                                             //chars in chunk
+    uint16_t used = 0;                                      //chars of chunk parsed
+    uint8_t  is_found = 0;                                  //1= got ':' to LF
     uint16_t readnum;                                       //the adu(addr, func-code, data, err-check) frame len
+    const uint8_t *p_colon;
     //ENTER_CRITICAL_SECTION();
 
-                                                            // receive data to array ucRTUBuf[]*/
-    while(mb_ascii_parse_char(slave, &readnum) == 0){
-        ;
+                                                            // receive data to array ucRTUBuf[], until the port is empty or the frame ends */
+    do{
+        if(slave->ascii_tail_len > 0){                      //the chars after the last frame first
+            n = slave->ascii_tail_len;
+            memcpy(chunk, slave->ascii_tail, (size_t)n);
+            slave->ascii_tail_len = 0;
+        }
+        else{
+            n = slave->p_serial_read_receive(chunk, MB_ASCII_RX_CHUNK);
+        }
+        if(n <= 0){
+            break;
+        }
+        is_found = mb_ascii_decode(slave, chunk, (uint16_t)n, &used);
+    }while(is_found == 0);
+    if(is_found == 0){
+        return -2;                                          //not the end yet, go on when the next IDLE comes
+    }
+
+    if(used < n){                                           //keep the rest from a ':', the chars before it are skipped anyway
+        p_colon = (const uint8_t *)memchr(&chunk[used], ':', (size_t)(n - used));
+        if(p_colon != 0){
+            slave->ascii_tail_len = (uint8_t)(&chunk[n] - p_colon);
+            memcpy(slave->ascii_tail, p_colon, slave->ascii_tail_len);
+            slave->p_event_post( EV_FRAME_RECEIVED );       //no IDLE may come for it
+        }
+        n = (p_colon != 0) ? (int32_t)(p_colon - chunk) : n;
+        slave->ascii_skip_chars += (uint32_t)(n - used);
+        slave->ascii_skip_run   += (uint32_t)(n - used);
     }
 
-    
+    readnum = slave->idx_rtubuf;
     if(readnum > MB_SER_PDU_SIZE_MAX){
         return -1;
     }
 
-                                                            // Length and CRC check */
-    if((readnum >= MB_SER_PDU_SIZE_MIN)
-    && (prvucMBLRC((uint8_t *) slave->ucRTUBuf, readnum) == 0 ) )
+                                                            // Length and LRC check, the LRC is summed while decoding, the sum of all bytes plus LRC is 0 */
+    if((readnum >= MB_SER_PDU_SIZE_MIN) && (slave->ascii_lrc == 0) )
     {
         *oaddr = slave->ucRTUBuf[MB_SER_PDU_ADDR_OFF];
                                                             //pdu size in rtu format, not ascii adu len
@@ -170,6 +282,7 @@ int32_t mb_ascii_receive_pdu(MB_SLAVE_STRU *slave, uint8_t * oaddr, uint8_t ** o
         *opdu = (uint8_t *) & (slave->ucRTUBuf[MB_SER_PDU_PDU_OFF]);
     }
     else {                                                  //length too short, in rtu. maybe serial io level error. */
+        slave->ascii_lrc_err_cnt++;
         return -2;
     }
 
@@ -190,16 +303,22 @@ int32_t mb_ascii_receive_pdu(MB_SLAVE_STRU *slave, uint8_t * oaddr, uint8_t ** o
   * @note   1. only start sending, do not know when sending is done.
             2. call port/ serial enable() and serial send().
             3. called by poll()
+            4. p_ascii_txbuf is the tx (dma) buf of the port, the frame is
+               encoded there and sent from there.
+            5. the rx frame is kept in p_ascii_txbuf as it is received, so
+               a FC05/06 response is sent as it is, and a FC15/16 response
+               is the head of it with a new LRC, no encoding at all.
   *****************************************************************************/
 int32_t mb_ascii_send_pdu(MB_SLAVE_STRU *slave, uint8_t addr, const uint8_t * pdu, uint16_t pdulen )
 {
     uint8_t *     padu;                                     //ptr to slave.ucRTUBuf header
     uint16_t      adulen;                                   //len of adu
-    uint16_t      lrc8;
+    uint8_t       lrc8;
                                                             /* Check if the receiver is still in idle state. If not we where too
                                                              * slow with processing the received frame and the master sent another
-                                                             * frame on the network. We have to abort sending the frame.*/
-    if( slave->ascii_rcv_state != STATE_RX_IDLE )
+                                                             * frame on the network, or its start is in ascii_tail. We have to abort
+                                                             * sending the frame.*/
+    if( slave->ascii_rcv_state != STATE_RX_IDLE || slave->ascii_tail_len != 0 )
         return -1;
 
     //ENTER_CRITICAL_SECTION(  );
@@ -214,16 +333,34 @@ int32_t mb_ascii_send_pdu(MB_SLAVE_STRU *slave, uint8_t addr, const uint8_t * pd
     padu[MB_SER_PDU_ADDR_OFF] = addr;
     adulen += pdulen;
 
-                                                            //Calculate LRC checksum
-    lrc8 = prvucMBLRC((uint8_t *) padu, adulen );
-    slave->ucRTUBuf[adulen++] = lrc8;
-    
-    slave->p_serial_enable(0 /*RX*/, 1 /*TX*/); 
+                                                            //the echo response, when the rx frame is kept and its length fits.
+    if( slave->tx_echo == MB_TX_ECHO_FULL && slave->ascii_raw_len == (adulen + 1) * 2 + 3 ){
+        slave->tx_echo = MB_TX_ECHO_NONE;
+        slave->p_serial_enable(0 /*RX*/, 1 /*TX*/);
+        slave->p_serial_start_send(slave->p_ascii_txbuf, slave->ascii_raw_len);
+        return 0;
+    }
+    if( slave->tx_echo == MB_TX_ECHO_HEAD && slave->ascii_raw_len > MB_SER_RAW_HEAD_LEN && adulen * 2 + 1 == MB_SER_RAW_HEAD_LEN ){
+        slave->tx_echo = MB_TX_ECHO_NONE;
+        lrc8 = prvucMBLRC((uint8_t *) padu, adulen );
+        slave->p_ascii_txbuf[MB_SER_RAW_HEAD_LEN + 0] = mb_ascii_hex_lut[lrc8][0];
+        slave->p_ascii_txbuf[MB_SER_RAW_HEAD_LEN + 1] = mb_ascii_hex_lut[lrc8][1];
+        slave->p_ascii_txbuf[MB_SER_RAW_HEAD_LEN + 2] = MB_ASCII_DEFAULT_CR;
+        slave->p_ascii_txbuf[MB_SER_RAW_HEAD_LEN + 3] = MB_ASCII_DEFAULT_LF;
+        slave->p_serial_enable(0 /*RX*/, 1 /*TX*/);
+        slave->p_serial_start_send(slave->p_ascii_txbuf, MB_SER_RAW_HEAD_LEN + 4);
+        return 0;
+    }
+    slave->tx_echo = MB_TX_ECHO_NONE;
 
-                                                            
-    mb_ascii_convert_to_ascii_frame(slave, padu, adulen);   //convert array to ascii
-    
-    slave->p_serial_start_send(slave->p_ascii_txbuf, adulen*2 +3);
+                                                            //convert array to ascii, with LRC and CR LF, right in the tx buf of the port
+    adulen = mb_ascii_encode(slave, padu, adulen);
+    if(adulen == 0){
+        return __LINE__;
+    }
+
+    slave->p_serial_enable(0 /*RX*/, 1 /*TX*/); 
+    slave->p_serial_start_send(slave->p_ascii_txbuf, adulen);
 
     //EXIT_CRITICAL_SECTION(  );
     return 0;
@@ -232,160 +369,257 @@ int32_t mb_ascii_send_pdu(MB_SLAVE_STRU *slave, uint8_t addr, const uint8_t * pd
 
 
 /*******************************************************************************
-  * @brief  parse ONE received byte, when have a total frame, return 1.
+  * @brief  parse a chunk of received chars, when have a total frame, return 1.
   *
-  * @param  none   
-  * @retval 0=go on parse, 1=found a frame or data empty
+  * @param  d = the chars, n = num of chars
+            o_used = output, chars parsed, less than n when a frame ends.
   *
-  * @note   A new character is received. If the character is a ':' the input
-            buffer is cleared. A CR-character signals the end of the data block. 
-            Other characters are part of the data block and their ASCII value 
-            is converted back to a binary representation.
-            when to call this?
+  * @retval 0=go on parse with the next chunk, 1=found a frame
+  *
+  * @note   A ':' clears the input buffer. A CR-character signals the end of
+            the data block. Other characters are part of the data block and
+            their ASCII value is converted back to a binary representation.
+            1. all the state is in the slave, so a frame can be split into
+               chunks anywhere, even between the two chars of a byte.
+            2. in the data block two hex chars are taken at a time by the
+               table, the LRC is summed as the bytes come, no pass at the end.
+            3. the char timeout timer is restarted once per chunk, so it
+               is of the rest of a max frame, see mb_ascii_init().
+            4. a char which is not hex, ':' or CR in the data block drops the
+               frame at once, the chars till the next ':' are skipped by
+               memchr(), no wait for the char timeout.
             in offical v1.5 edition, this is 'pxMBFrameCBByteReceived' and call
             in rx byte isr when every byte received.
   *****************************************************************************/
-static uint8_t mb_ascii_parse_char(MB_SLAVE_STRU *slave,  uint16_t *p_rx_pos )
+static uint8_t mb_ascii_decode(MB_SLAVE_STRU *slave, const uint8_t d[], uint16_t n, uint16_t *o_used )
 {
     uint8_t    is_found = 0;                                //return value, if a completed frame is found
-    uint8_t    ucByte;                                      //the char to be parsed
+    uint16_t   i = 0;                                       //index of d[]
+    uint16_t   raw_from = 0;                                //d[raw_from] on are kept for the echo response
+    uint8_t    restart = 0;                                 //1= d[raw_from] is ':'
+    uint16_t   idx;
+    uint8_t    lrc;
+    uint8_t    hi, lo;                                      //nibbles, or MB_ASCII_LUT_xxx codes
     uint8_t    ucResult;                                    //result of combine two char into a bin value.
-    uint8_t    serial_num;                                  //0 or 1, return from p_serial_read_receive()
+    const uint8_t *p_colon;
+    uint16_t   skip;
 
-                                                            //read bsp ring buffer, get one byte
-    serial_num = slave->p_serial_read_receive(&ucByte, 1);
-    if(serial_num == 0){
-        return 1;                                           //return, data empty.
-    }
-    
-    switch ( slave->ascii_rcv_state )
+    while( i < n && is_found == 0 )
     {
-    case STATE_RX_RCV:
-                                                            //* Enable timer for character timeout. */
-        slave->p_timer_enable(1);
-        if( ucByte == ':' ){                                //* Empty receive buffer. */
-            slave->e_nibble = BYTE_HIGH_NIBBLE;
-            slave->idx_rtubuf = 0;
-        }
-        else if( ucByte == MB_ASCII_DEFAULT_CR ){
-            slave->ascii_rcv_state = STATE_RX_WAIT_EOF;
+                                                            //out of a frame, skip all till ':'
+        if( slave->ascii_rcv_state == STATE_RX_IDLE ){
+            p_colon = (const uint8_t *)memchr(&d[i], ':', n - i);
+            skip = (p_colon != 0) ? (uint16_t)(p_colon - &d[i]) : (uint16_t)(n - i);
+            slave->ascii_skip_chars += skip;
+            slave->ascii_skip_run   += skip;
+            i += skip;
+            if( i >= n ){
+                break;
+            }
         }
-        else{
-            ucResult = prvucMBCHAR2BIN( ucByte );
-            switch (slave->e_nibble)
-            {
-                                                            //* High nibble of the byte comes first. We check for a buffer overflow here. */
-            case BYTE_HIGH_NIBBLE:
-                if( slave->idx_rtubuf < MB_SER_PDU_SIZE_MAX ){
-                    slave->ucRTUBuf[slave->idx_rtubuf] = ( uint8_t )( ucResult << 4 );
-                    slave->e_nibble = BYTE_LOW_NIBBLE;
+                                                            //data block at a byte boundary, two chars a byte till a non-hex char
+        if( slave->ascii_rcv_state == STATE_RX_RCV && slave->e_nibble == BYTE_HIGH_NIBBLE ){
+            idx = slave->idx_rtubuf;
+            lrc = slave->ascii_lrc;
+            while( i + 1 < n && idx < MB_SER_PDU_SIZE_MAX ){
+                hi = mb_ascii_char_lut[d[i]];
+                lo = mb_ascii_char_lut[d[i + 1]];
+                if( (hi | lo) > 0x0F ){
                     break;
                 }
-                else {                                      //*overflowed. not handled in Modbus specification but seems a resonable implementation. */
-                    slave->ascii_rcv_state = STATE_RX_IDLE;
-                                                            //* Disable previously activated timer because of error state. */
-                    slave->p_timer_enable(0);
-                }
+                ucResult = ( uint8_t )( (hi << 4) | lo );
+                slave->ucRTUBuf[idx++] = ucResult;
+                lrc += ucResult;
+                i += 2;
+            }
+            slave->idx_rtubuf = idx;
+            slave->ascii_lrc  = lrc;
+            if( i >= n ){
                 break;
+            }
+        }
+
+        hi = mb_ascii_char_lut[d[i]];
+        if( hi == MB_ASCII_LUT_COLON ){
+            raw_from = i;
+            restart  = 1;
+        }
+        i++;
 
-            case BYTE_LOW_NIBBLE:
-                slave->ucRTUBuf[slave->idx_rtubuf] |= ucResult;
-                slave->idx_rtubuf++;
+        switch ( slave->ascii_rcv_state )
+        {
+        case STATE_RX_RCV:
+            if( hi == MB_ASCII_LUT_COLON ){                 //* Empty receive buffer. */
                 slave->e_nibble = BYTE_HIGH_NIBBLE;
-                break;
+                slave->idx_rtubuf = 0;
+                slave->ascii_lrc = 0;
             }
-        }
-        break;
+            else if( hi == MB_ASCII_LUT_CR ){
+                slave->ascii_rcv_state = STATE_RX_WAIT_EOF;
+            }
+            else if( hi > 0x0F ){                           //* Not a hex char, drop the frame and wait for ':'. */
+                slave->ascii_rcv_state = STATE_RX_IDLE;
+                slave->ascii_abort_cnt++;
+                slave->p_timer_enable(0);
+            }
+            else{
+                switch (slave->e_nibble)
+                {
+                                                            //* High nibble of the byte comes first. We check for a buffer overflow here. */
+                case BYTE_HIGH_NIBBLE:
+                    if( slave->idx_rtubuf < MB_SER_PDU_SIZE_MAX ){
+                        slave->ucRTUBuf[slave->idx_rtubuf] = ( uint8_t )( hi << 4 );
+                        slave->e_nibble = BYTE_LOW_NIBBLE;
+                        break;
+                    }
+                    else {                                  //*overflowed. not handled in Modbus specification but seems a resonable implementation. */
+                        slave->ascii_rcv_state = STATE_RX_IDLE;
+                        slave->ascii_abort_cnt++;
+                                                            //* Disable previously activated timer because of error state. */
+                        slave->p_timer_enable(0);
+                    }
+                    break;
 
-    case STATE_RX_WAIT_EOF:
-        if( ucByte == MB_ASCII_DEFAULT_LF ){
+                case BYTE_LOW_NIBBLE:
+                    ucResult = slave->ucRTUBuf[slave->idx_rtubuf] | hi;
+                    slave->ucRTUBuf[slave->idx_rtubuf] = ucResult;
+                    slave->ascii_lrc += ucResult;
+                    slave->idx_rtubuf++;
+                    slave->e_nibble = BYTE_HIGH_NIBBLE;
+                    break;
+                }
+            }
+            break;
+
+        case STATE_RX_WAIT_EOF:
+            if( hi == MB_ASCII_LUT_LF ){
                                                             //* Disable character timeout timer because all characters are received. */
-            slave->p_timer_enable(0);
+                slave->p_timer_enable(0);
                                                             //* Receiver is again in idle state. */
-            slave->ascii_rcv_state = STATE_RX_IDLE;
+                slave->ascii_rcv_state = STATE_RX_IDLE;
                                                             //* Notify the caller of eMBASCIIReceive that a new frame was received. */
-            is_found = 1;                                   //xMBPortEventPost( EV_FRAME_RECEIVED );
-        }
-        else if( ucByte == ':' ) {
+                is_found = 1;                               //xMBPortEventPost( EV_FRAME_RECEIVED );
+                slave->ascii_frame_cnt++;
+            }
+            else if( hi == MB_ASCII_LUT_COLON ) {
                                                             //* Empty receive buffer and back to receive state. */
-            slave->idx_rtubuf = 0;
-            slave->e_nibble = BYTE_HIGH_NIBBLE;
-            slave->ascii_rcv_state = STATE_RX_RCV;
-                                                            //* Enable timer for character timeout. */
-            slave->p_timer_enable(1);
-        }
-        else {                                              //* Frame is not okay. Delete entire frame. */
-            slave->ascii_rcv_state = STATE_RX_IDLE;
-        }
-        break;
+                slave->idx_rtubuf = 0;
+                slave->ascii_lrc = 0;
+                slave->e_nibble = BYTE_HIGH_NIBBLE;
+                slave->ascii_rcv_state = STATE_RX_RCV;
+            }
+            else {                                          //* Frame is not okay. Delete entire frame. */
+                slave->ascii_rcv_state = STATE_RX_IDLE;
+                slave->ascii_abort_cnt++;
+                slave->p_timer_enable(0);
+            }
+            break;
 
-    case STATE_RX_IDLE:
-        if( ucByte == ':' ){
-                                                            //* Enable timer for character timeout. */
-            slave->p_timer_enable(1);
+        case STATE_RX_IDLE:
+            if( hi == MB_ASCII_LUT_COLON ){
+                if( slave->ascii_skip_run > slave->ascii_skip_max ){
+                    slave->ascii_skip_max = slave->ascii_skip_run;
+                }
+                slave->ascii_skip_run = 0;
                                                             //* Reset the input buffers to store the frame. */
-            slave->idx_rtubuf = 0;
-            slave->e_nibble = BYTE_HIGH_NIBBLE;
-            slave->ascii_rcv_state = STATE_RX_RCV;
+                slave->idx_rtubuf = 0;
+                slave->ascii_lrc = 0;
+                slave->e_nibble = BYTE_HIGH_NIBBLE;
+                slave->ascii_rcv_state = STATE_RX_RCV;
+            }
+            break;
         }
-        break;
     }
 
-    *p_rx_pos = slave->idx_rtubuf;
+    if( is_found == 0 && slave->ascii_rcv_state != STATE_RX_IDLE ){
+        slave->p_timer_enable(1);                           //* Enable timer for character timeout. */
+    }
+    mb_ascii_keep_raw(slave, &d[raw_from], (uint16_t)(i - raw_from), restart);
+
+    *o_used = i;
     return is_found;
 }
 
 
 
 /*******************************************************************************
-  * @brief  convert tx array to tx ascii 
+  * @brief  keep the rx chars in p_ascii_txbuf, for the echo response
+  *
+  * @param  slave, d = the rx chars, n = num of chars
+            restart = 1, d[0] is ':' and the frame starts again.
+  *
+  * @retval none
+  *
+  * @note   ':' starts the frame again, as the parser does. p_ascii_txbuf is
+            free while receiving, the bus is half duplex.
+  *****************************************************************************/
+static void mb_ascii_keep_raw( MB_SLAVE_STRU *slave, const uint8_t d[], uint16_t n, uint8_t restart )
+{
+    if( slave->p_ascii_txbuf == 0 ){
+        return;
+    }
+    if( restart ){
+        slave->ascii_raw_len = 0;
+    }
+    else if( slave->ascii_raw_len == 0 ){
+        return;                                             //not kept
+    }
+    if( slave->ascii_raw_len + n > MB_SER_RAW_SIZE_MAX ){
+        slave->ascii_raw_len = 0;                           //too long
+        return;
+    }
+    memcpy(&slave->p_ascii_txbuf[slave->ascii_raw_len], d, n);
+    slave->ascii_raw_len += n;
+}
+
+
+/*******************************************************************************
+  * @brief  encode the tx adu to an ascii frame in p_ascii_txbuf
   *
-  * @param  slave stru
+  * @param  slave stru, d = the adu without LRC, n = its len
   *
-  * @retval error, 0=no err.
+  * @retval num of chars, ':' to LF. 0= error.
   *
-  * @note   none
+  * @note   The start of a frame is defined by sending the character ':'.
+            Each data byte is encoded as a character hex stream, the high
+            nibble first, low nibble last, two chars by one read of the
+            table. the LRC is summed on the way and sent after the data,
+            then a '\r' '\n' ends the transmission.
   *****************************************************************************/
-static int mb_ascii_convert_to_ascii_frame(MB_SLAVE_STRU *slave, uint8_t d[], int n)
+static uint16_t mb_ascii_encode(MB_SLAVE_STRU *slave, const uint8_t d[], uint16_t n)
 {
-    int i, j;
+    uint8_t *  o;                                           //output char
+    uint8_t    lrc = 0;
+    uint16_t   i;
 
     if(slave->p_ascii_txbuf == 0){
-        return -1;                                          //buf not inited
-    }
-    if(n > MB_SER_PDU_SIZE_MAX){
-        return -2;                                          //size not right
-    }
-                                                            //* Start of transmission. The start of a frame is defined by sending  the character ':'. */
-    slave->p_ascii_txbuf[0] = ':';
-                                                            /* Send the data block. Each data byte is encoded as a character hex stream,
-                                                            ...the high nibble first,low nibble last. If all data bytes are exhausted 
-                                                            ...we send a '\r' character to end the transmission. */
-    for(i=0; i< n; i++){
-        uint8_t db;                                         //data in bin
-        uint8_t dc;                                         //data in char
-
-        db = d[i] >> 4;
-        dc = prvucMBBIN2CHAR(db);
-        j = 2*i + 1;
-        slave->p_ascii_txbuf[j] = dc;
-
-        db = d[i] & 0x0F;
-        dc = prvucMBBIN2CHAR(db);
-        j = 2*i + 2;
-        slave->p_ascii_txbuf[j] = dc;
-    }
-    j++;
-    slave->p_ascii_txbuf[j] = MB_ASCII_DEFAULT_CR;
-    j++;
-    slave->p_ascii_txbuf[j] = MB_ASCII_DEFAULT_LF;
-    //slave->ascii_txbuf_len = j+1;                           //store the len, for ascii_send_pdu() to use.
+        return 0;                                           //buf not inited
+    }
+    if(n > MB_SER_PDU_SIZE_MAX - MB_SER_PDU_SIZE_LRC){
+        return 0;                                           //size not right
+    }
 
-    return 0;
+    o = slave->p_ascii_txbuf;
+    *o++ = ':';
+    for(i = 0; i < n; i++){
+        lrc += d[i];
+        o[0] = mb_ascii_hex_lut[d[i]][0];
+        o[1] = mb_ascii_hex_lut[d[i]][1];
+        o += 2;
+    }
+    lrc = ( uint8_t ) ( -( ( int8_t ) lrc ) );              //* twos complement */
+    o[0] = mb_ascii_hex_lut[lrc][0];
+    o[1] = mb_ascii_hex_lut[lrc][1];
+    o[2] = MB_ASCII_DEFAULT_CR;
+    o[3] = MB_ASCII_DEFAULT_LF;
+    o += 4;
+
+    return (uint16_t)(o - slave->p_ascii_txbuf);
 }
 
 /*******************************************************************************
-  * @brief  If we have a timeout we go back to the idle state and wait for the next frame.
+  * @brief  If we have a char timeout (slave->ascii_timeout_ms) we go back to
+            the idle state and wait for the next frame.
   *
   * @param  none     
   * @retval none
@@ -402,6 +636,9 @@ void mb_ascii_t1s_callback(MB_SLAVE_STRU *slave)
 {
     //slave->p_event_post( EV_FRAME_RECEIVED );
 
+    if( slave->ascii_rcv_state != STATE_RX_IDLE ){
+        slave->ascii_timeout_cnt++;
+    }
     slave->ascii_rcv_state = STATE_RX_IDLE;
     slave->p_timer_enable(0);
 
@@ -438,43 +675,6 @@ void mb_ascii_bus_send_done_callback(MB_SLAVE_STRU *slave)
 
 
 
-/*******************************************************************************
-  * @brief  input '0'~'9' and 'A' to "F', convert to 0x0~0xf number
-  *
-  * @param  '0'~'9' and 'A' to "F'
-  *
-  * @retval the number, error return 0xff
-  *
-  * @note   none
-  *****************************************************************************/
-static uint8_t prvucMBCHAR2BIN( uint8_t ucCharacter )
-{
-    if( ( ucCharacter >= '0' ) && ( ucCharacter <= '9' ) ){
-        return ( uint8_t )( ucCharacter - '0' );
-    }
-    else if( ( ucCharacter >= 'A' ) && ( ucCharacter <= 'F' ) ){
-        return ( uint8_t )( ucCharacter - 'A' + 0x0A );
-    }
-    else{
-        return 0xFF;
-    }
-}
-
-static uint8_t prvucMBBIN2CHAR( uint8_t ucByte )
-{
-    if( ucByte <= 0x09 ){
-        return ( uint8_t )( '0' + ucByte );
-    }
-    else if( ( ucByte >= 0x0A ) && ( ucByte <= 0x0F ) ){
-        return ( uint8_t )( ucByte - 0x0A + 'A' );
-    }
-    else{
-        /* Programming error. */
-        return ' ';
-    }
-}
-
-
 /*******************************************************************************
   * @brief  calculate a array's LRC
   *
@@ -97,3 +97,21 @@ usMBCRC16( uint8_t * pucFrame, uint16_t usLen )
     return ( uint16_t )( ucCRCHi << 8 | ucCRCLo );
 }
 
+/* crc of a frame in pieces, start with usCRC = 0xFFFF, then feed the result
+ * of a piece to the next one, the last result is the same as usMBCRC16(). */
+uint16_t
+usMBCRC16Continue( uint16_t usCRC, const uint8_t * pucFrame, uint16_t usLen )
+{
+    uint8_t           ucCRCHi = ( uint8_t )( usCRC >> 8 );
+    uint8_t           ucCRCLo = ( uint8_t )( usCRC & 0xFF );
+    int             iIndex;
+
+    while( usLen-- )
+    {
+        iIndex = ucCRCLo ^ *( pucFrame++ );
+        ucCRCLo = ( uint8_t )( ucCRCHi ^ aucCRCHi[iIndex] );
+        ucCRCHi = aucCRCLo[iIndex];
+    }
+    return ( uint16_t )( ucCRCHi << 8 | ucCRCLo );
+}
+
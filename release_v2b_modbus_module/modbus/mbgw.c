@@ -0,0 +1,916 @@
+/**
+  ******************************************************************************
+  * @file    module of modbus tcp to rtu gateway
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/12/18
+  * @brief   the tcp task queues a request to the line of its unit id, the
+             line task sends it as an rtu frame, addr + pdu + crc, the same
+             frame mbrtu_v2.c sends, and turns the answer back into the adu of
+             the request, MBAP kept, LEN set. one request on the bus at a time,
+             the next one goes after the t35 gap.
+             the request lives in a slot of the line from mb_gw_submit() to
+             mb_gw_reply(), the rings carry only the slot numbers:
+                tcp task:  free slot -> rq[]      line task:  rq[] -> bus
+                tcp task:  dq[] -> free slot      line task:  bus  -> dq[]
+             each ring has one writer and one reader, the index is stored
+             with release after the slot, and loaded with acquire before it.
+             a ring can not overflow, it has as many entries as the slots.
+             the line task moves the requests of rq[] to its own pend[], so
+             it can take them out of order: a read on the bus takes with it
+             the reads of pend[] in its range, or next to it, see
+             mb_gw_line_group(), and shares the answer, see mb_gw_line_share().
+             which request goes next is deficit round robin over the clients
+             in pend[], see mb_gw_line_pick(). the requests of a client go in
+             the order they came, a write at the head of a client goes first.
+  *
+  ******************************************************************************
+  */
+
+/* ----------------------- System includes ----------------------------------*/
+#include <stdint.h>
+#include "string.h"
+
+/* ----------------------- Modbus includes ----------------------------------*/
+#include "mbgw.h"
+#include "mbrtu.h"
+#include "mbcrc.h"
+
+#if MB_GW_ENABLED > 0
+
+/*******************************************************************************
+******************************** Private define ********************************
+*******************************************************************************/
+#define MB_GW_PDU_MAX           ( MB_GW_FRAME_MAX - 3 ) /*!< addr and crc around it. */
+#define MB_GW_ANSWER_MIN        ( 5 )                   /*!< addr, fc, exception, crc. */
+#define MB_GW_READ_PDU_LEN      ( 5 )                   /*!< fc, addr, num. */
+#define MB_GW_READ_REG_MAX      ( 0x007D )              /*!< registers of a read, 03 04. */
+#define MB_GW_READ_BIT_MAX      ( 0x07D0 )              /*!< coils or inputs of a read, 01 02. */
+#define MB_GW_GAP_BYTES         ( 7 )                   /*!< t35 after the request and after the answer, in chars. */
+
+#if (MB_GW_QUEUE_LEN & (MB_GW_QUEUE_LEN - 1)) != 0 || MB_GW_QUEUE_LEN > 128
+    #error "MB_GW_QUEUE_LEN must be a power of 2, at most 128, the ring indexes run over 2^32"
+#endif
+
+#define MB_GW_LOAD(p)           __atomic_load_n( (p), __ATOMIC_ACQUIRE )
+#define MB_GW_STORE(p, v)       __atomic_store_n( (p), (v), __ATOMIC_RELEASE )
+
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static void     mb_gw_line_init (MB_GW_LINE_STRU *ln, void *gw);
+static void     mb_gw_line_done (MB_GW_LINE_STRU *ln, uint64_t now_us);
+static void     mb_gw_line_take (MB_GW_LINE_STRU *ln);
+static void     mb_gw_line_flow (MB_GW_LINE_STRU *ln, int32_t conn);
+static void     mb_gw_line_group(MB_GW_LINE_STRU *ln);
+static int32_t  mb_gw_line_pick (MB_GW_LINE_STRU *ln);
+static int32_t  mb_gw_line_head (MB_GW_LINE_STRU *ln, int32_t conn);
+static void     mb_gw_line_sweep(MB_GW_LINE_STRU *ln);
+static uint32_t mb_gw_cost      (const MB_GW_REQ_STRU *r);
+static int32_t  mb_gw_is_write  (const uint8_t adu[]);
+#if MB_GW_COALESCE_ENABLED > 0 || MB_GW_CACHE_NUM > 0
+static int32_t  mb_gw_read_range(const uint8_t adu[], uint16_t len, uint16_t *addr, uint16_t *num);
+#endif
+#if MB_GW_CACHE_NUM > 0
+static int32_t  mb_gw_write_range(const uint8_t adu[], uint16_t len, uint8_t *fc, uint16_t *addr, uint16_t *num);
+#endif
+#if MB_GW_COALESCE_ENABLED > 0
+static void     mb_gw_line_share(MB_GW_LINE_STRU *ln, const uint8_t f[]);
+static void     mb_gw_line_split(MB_GW_LINE_STRU *ln, uint64_t now_us);
+#endif
+
+/*******************************************************************************
+  * @brief  init the gateway and its lines, no unit id is routed.
+  *
+  * @param  gw = the gateway, 'p_lines', 'num' and 'p_notify' are set
+  *
+  * @retval 0= OK
+  *
+  * @note   before the tasks of both sides run.
+  *****************************************************************************/
+int32_t mb_gw_init(MB_GW_STRU *gw)
+{
+    int32_t i;
+
+    if(gw == 0 || gw->num == 0 || gw->num > MB_GW_LINE_MAX){
+        return __LINE__;
+    }
+    for(i = 0; i < gw->num; i++){
+        if(gw->p_lines[i] == 0 || gw->p_lines[i]->baudrate == 0){
+            return __LINE__;
+        }
+        mb_gw_line_init(gw->p_lines[i], gw);
+    }
+    memset(gw->line_of, MB_GW_LINE_NONE, sizeof(gw->line_of));
+    gw->reply_next = 0;
+#if MB_GW_CACHE_NUM > 0
+    mb_gw_cache_init(&gw->cache);
+#endif
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  route a unit id to a line
+  *
+  * @param  gw = the gateway
+            uid = 1~247
+            line = index in p_lines[], MB_GW_LINE_NONE= served by mb_poll()
+  *
+  * @retval 0= OK
+  *
+  * @note   0 and 255 are the tcp server itself, they are never routed.
+  *****************************************************************************/
+int32_t mb_gw_route(MB_GW_STRU *gw, uint8_t uid, uint8_t line)
+{
+    if(uid < MB_ADDRESS_MIN || uid > MB_ADDRESS_MAX){
+        return __LINE__;
+    }
+    if(line != MB_GW_LINE_NONE && line >= gw->num){
+        return __LINE__;
+    }
+    gw->line_of[uid] = line;
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  the tcp task has a request, queue it to its line if it is routed.
+  *
+  * @param  gw = the gateway
+            adu = the request, MBAP + pdu, copied. the answer of the cache
+                  is put here, MB_TCP_BUF_SIZE at least
+            len = in the len of adu, out that of the answer
+            conn, tag = the client, given back by mb_gw_reply()
+            now_us = monotonic time, for the cache
+  *
+  * @retval 0= queued, MB_GW_LOCAL= not routed, give it to mb_poll(),
+            MB_GW_CACHED= adu is the answer, other= the exception to answer at
+            once, see mb_gw_exception().
+  *****************************************************************************/
+int32_t mb_gw_submit(MB_GW_STRU *gw, uint8_t adu[], uint16_t *len, int32_t conn, uint32_t tag, uint64_t now_us)
+{
+    MB_GW_LINE_STRU *ln;
+    MB_GW_REQ_STRU  *r;
+    uint8_t          line, n, rd_fc = 0, wr_fc = 0;
+    uint16_t         addr = 0, cnt = 0;
+    uint32_t         tail, num;
+
+    line = gw->line_of[adu[MB_TCP_UID]];
+    if(line == MB_GW_LINE_NONE){
+        return MB_GW_LOCAL;
+    }
+    if(*len <= MB_TCP_FUNC || *len - MB_TCP_FUNC > MB_GW_PDU_MAX){
+        return MB_EX_ILLEGAL_DATA_VALUE;
+    }
+    ln = gw->p_lines[line];
+#if MB_GW_CACHE_NUM > 0
+    if(ln->cache_ttl_ms != 0 && mb_gw_read_range(adu, *len, &addr, &cnt) == 0){
+        rd_fc = adu[MB_TCP_FUNC];
+        if(mb_gw_cache_get(&gw->cache, line, adu[MB_TCP_UID], rd_fc, addr, cnt, now_us, &adu[MB_TCP_FUNC], len) == 0){
+            adu[MB_TCP_LEN]     = (uint8_t)((*len + 1) >> 8);
+            adu[MB_TCP_LEN + 1] = (uint8_t)((*len + 1) & 0xFF);
+            *len += MB_TCP_FUNC;
+            ln->hit_cnt++;
+            return MB_GW_CACHED;
+        }
+        ln->miss_cnt++;
+    }
+    else if(mb_gw_write_range(adu, *len, &wr_fc, &addr, &cnt) == 0){
+        ln->wr_gen++;                                       //the reads on the way are old, not kept
+        mb_gw_cache_invalidate(&gw->cache, line, adu[MB_TCP_UID], wr_fc, addr, cnt);
+    }
+#endif
+    if(ln->slot_free_num == 0){
+        ln->full_cnt++;
+        return MB_EX_GATEWAY_PATH_FAILED;                   //the bound of the queue, the device is too slow for its clients
+    }
+
+    n = ln->slot_free[--ln->slot_free_num];
+    r = &ln->slot[n];
+    memcpy(r->adu, adu, *len);
+    r->len     = *len;
+    r->conn    = conn;
+    r->tag     = tag;
+    r->rd_fc   = rd_fc;
+    r->wr_fc   = wr_fc;
+    r->rd_addr = addr;
+    r->rd_num  = cnt;
+    r->wr_gen  = ln->wr_gen;
+    r->alone   = 0;
+
+    tail = ln->rq_tail;
+    ln->rq[tail % MB_GW_QUEUE_LEN] = n;
+    MB_GW_STORE(&ln->rq_tail, tail + 1);
+    ln->req_cnt++;
+    num = MB_GW_QUEUE_LEN - ln->slot_free_num;
+    if(num > ln->q_max){
+        ln->q_max = num;
+    }
+    if(ln->p_notify != 0){
+        ln->p_notify(ln);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  the tcp task takes an answer of any line, round robin.
+  *
+  * @param  gw = the gateway
+            d = output the answer, the adu of the request with its MBAP,
+                MB_TCP_BUF_SIZE at least
+            len = output the len of d
+            conn, tag = output the client, as given to mb_gw_submit()
+            now_us = monotonic time, for the cache
+  *
+  * @retval 0= an answer, other= none
+  *
+  * @note   the client may be gone, the port checks conn and tag. the answer
+            of a read is kept in the cache, if no write was queued since.
+            a read queued after a write may go on the bus before it, the
+            write of another client waits for its turn, so the answer of the
+            write drops its range again, and the reads on the way are old.
+            the answers come in the order of the bus.
+  *****************************************************************************/
+int32_t mb_gw_reply(MB_GW_STRU *gw, uint8_t d[], uint16_t *len, int32_t *conn, uint32_t *tag, uint64_t now_us)
+{
+    MB_GW_LINE_STRU *ln;
+    MB_GW_REQ_STRU  *r;
+    int32_t          i;
+    uint8_t          n, line;
+
+    for(i = 0; i < gw->num; i++){
+        line = (uint8_t)((gw->reply_next + i) % gw->num);
+        ln   = gw->p_lines[line];
+        if(ln->dq_head == MB_GW_LOAD(&ln->dq_tail)){
+            continue;
+        }
+        n = ln->dq[ln->dq_head % MB_GW_QUEUE_LEN];
+        r = &ln->slot[n];
+        memcpy(d, r->adu, r->len);
+        *len  = r->len;
+        *conn = r->conn;
+        *tag  = r->tag;
+#if MB_GW_CACHE_NUM > 0
+        if(r->rd_fc != 0 && r->adu[MB_TCP_FUNC] == r->rd_fc && r->wr_gen == ln->wr_gen){
+            mb_gw_cache_put(&gw->cache, line, r->adu[MB_TCP_UID], r->rd_fc, r->rd_addr, r->rd_num,
+                            now_us + (uint64_t)ln->cache_ttl_ms * 1000U, &r->adu[MB_TCP_FUNC], r->len - MB_TCP_FUNC);
+        }
+        if(r->wr_fc != 0){                                  //done, or failed, the device may have it anyway
+            ln->wr_gen++;
+            mb_gw_cache_invalidate(&gw->cache, line, r->adu[MB_TCP_UID], r->wr_fc, r->rd_addr, r->rd_num);
+        }
+#endif
+        ln->dq_head++;
+        ln->slot_free[ln->slot_free_num++] = n;
+        gw->reply_next = (uint8_t)((gw->reply_next + i + 1) % gw->num);
+        return 0;
+    }
+    return __LINE__;
+}
+
+
+/*******************************************************************************
+  * @brief  turn a request adu into its exception answer, in place
+  *
+  * @param  adu = the request, MBAP + pdu
+            exception = eg. MB_EX_GATEWAY_PATH_FAILED
+  *
+  * @retval the len of the answer
+  *****************************************************************************/
+uint16_t mb_gw_exception(uint8_t adu[], uint8_t exception)
+{
+    adu[MB_TCP_FUNC]     |= MB_FUNC_ERROR;
+    adu[MB_TCP_FUNC + 1]  = exception;
+    adu[MB_TCP_LEN]       = 0;
+    adu[MB_TCP_LEN + 1]   = 3;                              //uid, fc, exception
+    return MB_TCP_FUNC + 2;
+}
+
+
+/*******************************************************************************
+  * @brief  the line task takes the frame to send, the next request or the
+            one to send again.
+  *
+  * @param  ln = the line
+            now_us = monotonic time
+            frame = output the rtu frame, kept until the answer
+            len = output the len of frame
+  *
+  * @retval 0= send it now, other= nothing to send yet.
+  *
+  * @note   the port sends it at once, the timeout counts from now plus the
+            time of the frame on the bus.
+  *****************************************************************************/
+int32_t mb_gw_line_next(MB_GW_LINE_STRU *ln, uint64_t now_us, uint8_t **frame, uint16_t *len)
+{
+    uint32_t        timeout_ms;
+
+    mb_gw_line_take(ln);
+    if(ln->sent || now_us < ln->free_us){
+        return __LINE__;                                    //one on the bus, or the gap after the last frame
+    }
+    if(ln->cur < 0){
+        if(ln->pend_num == 0){
+            return __LINE__;
+        }
+        mb_gw_line_group(ln);
+        mb_gw_line_sweep(ln);
+        ln->tries = 0;
+        ln->bus_cnt++;
+    }
+
+    timeout_ms      = (ln->timeout_ms != 0) ? ln->timeout_ms : MB_GW_TIMEOUT_MS;
+    ln->deadline_us = now_us + (uint64_t)ln->tx_len * ln->char_us + (uint64_t)timeout_ms * 1000U;
+    ln->sent        = 1;
+    ln->busy_us    += (uint64_t)ln->tx_len * ln->char_us;
+    ln->tries++;
+    *frame = ln->tx;
+    *len   = ln->tx_len;
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  the line task has a frame from the bus, see if it is the answer.
+  *
+  * @param  ln = the line
+            f = the rtu frame, addr + pdu + crc
+            n = len of f
+            now_us = monotonic time
+  *
+  * @retval none
+  *
+  * @note   the answer has the address and the function code, or its
+            exception, of the request, and a good crc. others are counted and
+            dropped, eg. a late answer of a timed out request.
+            a coalesced read is shared out, the byte count must be that of
+            the range read. its exception may be of a part which no request
+            asked, its requests go again one by one, see mb_gw_line_split().
+  *****************************************************************************/
+void mb_gw_line_frame(MB_GW_LINE_STRU *ln, const uint8_t f[], uint16_t n, uint64_t now_us)
+{
+    MB_GW_REQ_STRU *r;
+    uint16_t        plen;
+
+    ln->busy_us += (uint64_t)n * ln->char_us;              //on the bus, the answer or not
+    if(ln->sent == 0 || n < MB_GW_ANSWER_MIN || n > MB_GW_FRAME_MAX
+    || f[0] != ln->tx[0] || (f[1] & ~MB_FUNC_ERROR) != ln->tx[1]
+    || usMBCRC16((uint8_t *)f, n) != 0){
+        ln->junk_cnt++;
+        return;
+    }
+#if MB_GW_COALESCE_ENABLED > 0
+    if(ln->grp_num > 1 && (f[1] & MB_FUNC_ERROR) != 0){     //the exception of a coalesced read, not theirs yet
+        ln->ok_cnt++;
+        mb_gw_line_split(ln, now_us);
+        return;
+    }
+    if(ln->rd_num > 0 && (f[1] & MB_FUNC_ERROR) == 0){
+        plen = (f[1] <= MB_FUNC_READ_DISCRETE_INPUTS) ? (ln->rd_num + 7) / 8 : ln->rd_num * 2;
+        if(f[2] != plen || n != plen + 5){
+            ln->junk_cnt++;
+            return;
+        }
+        mb_gw_line_take(ln);
+        mb_gw_line_group(ln);                               //the reads queued meanwhile in the range, the answer is fresh for them too
+        mb_gw_line_sweep(ln);
+        if(ln->grp_num > 1){
+            mb_gw_line_share(ln, f);
+            ln->ok_cnt++;
+            mb_gw_line_done(ln, now_us);
+            return;
+        }
+    }
+#endif
+
+    r    = &ln->slot[ln->cur];
+    plen = n - 3;
+    memcpy(&r->adu[MB_TCP_FUNC], &f[1], plen);              //MBAP of the request, TID and UID kept
+    r->adu[MB_TCP_LEN]     = (uint8_t)((plen + 1) >> 8);
+    r->adu[MB_TCP_LEN + 1] = (uint8_t)((plen + 1) & 0xFF);
+    r->len = MB_TCP_FUNC + plen;
+    ln->ok_cnt++;
+    mb_gw_line_done(ln, now_us);
+}
+
+
+/*******************************************************************************
+  * @brief  the line task checks the timeout of the answer
+  *
+  * @param  ln = the line
+            now_us = monotonic time
+  *
+  * @retval none
+  *
+  * @note   call it at mb_gw_line_deadline(). after 'retries' sends again the
+            client gets MB_EX_GATEWAY_TGT_FAILED.
+  *****************************************************************************/
+void mb_gw_line_poll(MB_GW_LINE_STRU *ln, uint64_t now_us)
+{
+    MB_GW_REQ_STRU *r;
+    int32_t         i;
+
+    if(ln->sent == 0 || now_us < ln->deadline_us){
+        return;
+    }
+    ln->timeout_cnt++;
+    ln->sent    = 0;
+    ln->free_us = now_us + ln->t35_us;
+    if(ln->tries <= ln->retries){
+        return;                                             //mb_gw_line_next() gives it again
+    }
+    for(i = 0; i < ln->grp_num; i++){
+        r      = &ln->slot[ln->grp[i]];
+        r->len = mb_gw_exception(r->adu, MB_EX_GATEWAY_TGT_FAILED);
+    }
+    mb_gw_line_done(ln, now_us);
+}
+
+
+/*******************************************************************************
+  * @brief  when the line task should look again
+  *
+  * @param  ln = the line
+  *
+  * @retval monotonic time in us, 0= nothing to wait for, only a new request.
+  *****************************************************************************/
+uint64_t mb_gw_line_deadline(MB_GW_LINE_STRU *ln)
+{
+    if(ln->sent){
+        return ln->deadline_us;
+    }
+    if(ln->cur >= 0 || ln->pend_num > 0 || ln->rq_head != MB_GW_LOAD(&ln->rq_tail)){
+        return (ln->free_us != 0) ? ln->free_us : 1;        //the gap, or at once
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+*******************************************************************************/
+
+static void mb_gw_line_init(MB_GW_LINE_STRU *ln, void *gw)
+{
+    int32_t i;
+
+    for(i = 0; i < MB_GW_QUEUE_LEN; i++){
+        ln->slot_free[i] = (uint8_t)(MB_GW_QUEUE_LEN - 1 - i);
+    }
+    ln->slot_free_num = MB_GW_QUEUE_LEN;
+    ln->rq_head = ln->rq_tail = 0;
+    ln->dq_head = ln->dq_tail = 0;
+    ln->pend_num = 0;
+    ln->grp_num  = 0;
+    ln->flow_num = 0;
+    ln->flow_next = 0;
+    ln->cur     = -1;
+    ln->sent    = 0;
+    ln->free_us = 0;
+    ln->p_gw    = gw;
+    ln->char_us = mb_rtu_char_us(ln->baudrate);             //the timing of mb_rtu_init()
+    ln->t35_us  = mb_rtu_t35_us(ln->baudrate);
+}
+
+
+                                                            //the answers of the group of 'cur' are in their slots, give them to the tcp task
+static void mb_gw_line_done(MB_GW_LINE_STRU *ln, uint64_t now_us)
+{
+    MB_GW_STRU *gw = (MB_GW_STRU *)ln->p_gw;
+    uint32_t    tail;
+    int32_t     i;
+
+    tail = ln->dq_tail;
+    for(i = 0; i < ln->grp_num; i++){
+        ln->dq[(tail + i) % MB_GW_QUEUE_LEN] = ln->grp[i];
+    }
+    MB_GW_STORE(&ln->dq_tail, tail + ln->grp_num);
+    ln->grp_num = 0;
+    ln->cur     = -1;
+    ln->sent    = 0;
+    ln->free_us = now_us + ln->t35_us;
+    if(gw->p_notify != 0){
+        gw->p_notify(gw);
+    }
+}
+
+
+                                                            //move the requests of rq[] to pend[], the line task may take them out of order then
+                                                            //...and a client new in pend[] joins the ring of the turns, at the end, so just before whose turn it is
+static void mb_gw_line_take(MB_GW_LINE_STRU *ln)
+{
+    uint32_t head, tail;
+
+    head = ln->rq_head;
+    tail = MB_GW_LOAD(&ln->rq_tail);
+    while(head != tail){
+        ln->pend[ln->pend_num++] = ln->rq[head % MB_GW_QUEUE_LEN];
+        mb_gw_line_flow(ln, ln->slot[ln->rq[head % MB_GW_QUEUE_LEN]].conn);
+        head++;
+    }
+    MB_GW_STORE(&ln->rq_head, head);
+}
+
+
+                                                            //a client not in the ring of the turns joins it, at the end
+static void mb_gw_line_flow(MB_GW_LINE_STRU *ln, int32_t conn)
+{
+    MB_GW_FLOW_STRU *f;
+    int32_t          i;
+
+    for(i = 0; i < ln->flow_num && ln->flow[i].conn != conn; i++){
+        ;
+    }
+    if(i < ln->flow_num){
+        return;
+    }
+    i = ln->flow_next;                                      //at most one for each slot, it can not overflow
+    memmove(&ln->flow[i + 1], &ln->flow[i], (ln->flow_num - i) * sizeof(MB_GW_FLOW_STRU));
+    ln->flow_num++;
+    if(ln->flow_num > 1){
+        ln->flow_next++;
+    }
+    f = &ln->flow[i];
+    f->conn    = conn;
+    f->deficit = 0;
+    f->fresh   = 1;
+}
+
+
+/*******************************************************************************
+  * @brief  the request to send next, deficit round robin over the clients
+  *
+  * @param  ln = the line, pend[] is not empty
+  *
+  * @retval the index in pend[]
+  *
+  * @note   only the oldest request of a client may go, so its requests keep
+            their order. a client whose oldest one is a write goes first, it
+            does not wait for its turn. else the client of the turn gets its
+            quantum once, and sends while the cost, the bus bytes of the
+            request and the answer, fits its deficit, then the next one.
+  *****************************************************************************/
+static int32_t mb_gw_line_pick(MB_GW_LINE_STRU *ln)
+{
+    MB_GW_FLOW_STRU *f;
+    uint32_t quantum, cost;
+    int32_t  i, k;
+
+    for(k = 0; k < ln->flow_num; k++){
+        i = mb_gw_line_head(ln, ln->flow[(ln->flow_next + k) % ln->flow_num].conn);
+        if(mb_gw_is_write(ln->slot[ln->pend[i]].adu)){
+            return i;
+        }
+    }
+
+    quantum = (ln->quantum != 0) ? ln->quantum : MB_GW_DRR_QUANTUM;
+    for(;;){                                                //each round adds a quantum, it ends
+        f = &ln->flow[ln->flow_next];
+        if(f->fresh){
+            f->deficit += (int32_t)quantum;
+            f->fresh    = 0;
+        }
+        i    = mb_gw_line_head(ln, f->conn);
+        cost = mb_gw_cost(&ln->slot[ln->pend[i]]);
+        if(cost <= (uint32_t)f->deficit){
+            f->deficit -= (int32_t)cost;
+            return i;
+        }
+        f->fresh      = 1;                                  //the turn is over, the deficit is kept for the next one
+        ln->flow_next = (uint8_t)((ln->flow_next + 1) % ln->flow_num);
+    }
+}
+
+
+                                                            //the oldest request of a client in pend[], -1= none
+static int32_t mb_gw_line_head(MB_GW_LINE_STRU *ln, int32_t conn)
+{
+    int32_t i;
+
+    for(i = 0; i < ln->pend_num; i++){
+        if(ln->slot[ln->pend[i]].conn == conn){
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+                                                            //the clients with nothing left in pend[] leave the ring, the deficit is gone
+static void mb_gw_line_sweep(MB_GW_LINE_STRU *ln)
+{
+    int32_t i;
+
+    for(i = 0; i < ln->flow_num; ){
+        if(mb_gw_line_head(ln, ln->flow[i].conn) >= 0){
+            i++;
+            continue;
+        }
+        ln->flow_num--;
+        memmove(&ln->flow[i], &ln->flow[i + 1], (ln->flow_num - i) * sizeof(MB_GW_FLOW_STRU));
+        if(i < ln->flow_next){
+            ln->flow_next--;
+        }
+    }
+    if(ln->flow_next >= ln->flow_num){
+        ln->flow_next = 0;
+    }
+}
+
+
+                                                            //bus bytes of a request, the frame, its answer and the gaps
+static uint32_t mb_gw_cost(const MB_GW_REQ_STRU *r)
+{
+    const uint8_t *p = &r->adu[MB_TCP_FUNC];
+    uint32_t       ans, num;
+
+    num = (uint32_t)((p[3] << 8) | p[4]);
+    switch(p[0]){
+    case MB_FUNC_READ_COILS:
+    case MB_FUNC_READ_DISCRETE_INPUTS:
+        ans = 5 + (num + 7) / 8;
+        break;
+    case MB_FUNC_READ_HOLDING_REGISTER:
+    case MB_FUNC_READ_INPUT_REGISTER:
+    case MB_FUNC_READWRITE_MULTIPLE_REGISTERS:
+        ans = 5 + num * 2;
+        break;
+    case MB_FUNC_WRITE_SINGLE_COIL:
+    case MB_FUNC_WRITE_REGISTER:
+    case MB_FUNC_WRITE_MULTIPLE_COILS:
+    case MB_FUNC_WRITE_MULTIPLE_REGISTERS:
+        ans = 8;
+        break;
+    default:
+        ans = r->len - MB_TCP_FUNC + 3;                     //not known, as long as the request
+        break;
+    }
+    return (uint32_t)(r->len - MB_TCP_FUNC + 3) + ans + MB_GW_GAP_BYTES;
+}
+
+
+static int32_t mb_gw_is_write(const uint8_t adu[])
+{
+    switch(adu[MB_TCP_FUNC]){
+    case MB_FUNC_WRITE_SINGLE_COIL:
+    case MB_FUNC_WRITE_REGISTER:
+    case MB_FUNC_WRITE_MULTIPLE_COILS:
+    case MB_FUNC_WRITE_MULTIPLE_REGISTERS:
+    case MB_FUNC_READWRITE_MULTIPLE_REGISTERS:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  make the group of the frame on the bus
+  *
+  * @param  ln = the line
+  *
+  * @retval none
+  *
+  * @note   idle, the first of pend[] is 'cur', the reads of pend[] for the
+            same unit and function whose ranges overlap or touch it join it,
+            the range grows to hold them, then its frame is made.
+            on the bus, only the reads inside the range join it.
+  *****************************************************************************/
+static void mb_gw_line_group(MB_GW_LINE_STRU *ln)
+{
+    MB_GW_REQ_STRU *r;
+    uint16_t        plen, crc;
+    int32_t         grow, i;
+#if MB_GW_COALESCE_ENABLED > 0
+    MB_GW_REQ_STRU *c;
+    uint16_t        addr, num, max;
+    uint32_t        lo, hi, end;
+    int32_t         more;
+#endif
+
+    grow = (ln->cur < 0);
+    if(grow){
+        i = mb_gw_line_pick(ln);
+        ln->cur    = ln->pend[i];
+        ln->grp[0] = ln->pend[i];
+        ln->grp_num = 1;
+        ln->pend_num--;
+        memmove(&ln->pend[i], &ln->pend[i + 1], ln->pend_num - i);
+        ln->rd_num = 0;
+    }
+    r = &ln->slot[ln->cur];
+
+#if MB_GW_COALESCE_ENABLED > 0
+    if(grow && (r->alone || mb_gw_read_range(r->adu, r->len, &ln->rd_addr, &ln->rd_num) != 0)){
+        ln->rd_num = 0;
+    }
+    if(ln->rd_num > 0){
+        max = (r->adu[MB_TCP_FUNC] <= MB_FUNC_READ_DISCRETE_INPUTS) ? MB_GW_READ_BIT_MAX : MB_GW_READ_REG_MAX;
+        do{                                                 //again, a grown range may reach the ones passed
+            more = 0;
+            for(i = 0; i < ln->pend_num; ){
+                c = &ln->slot[ln->pend[i]];
+                if(c->adu[MB_TCP_UID] != r->adu[MB_TCP_UID]){
+                    i++;
+                    continue;
+                }
+                if(mb_gw_read_range(c->adu, c->len, &addr, &num) != 0){
+                    break;                                  //eg. a write of the unit, the reads behind it wait for it
+                }
+                if(c->adu[MB_TCP_FUNC] != r->adu[MB_TCP_FUNC] || c->alone || mb_gw_line_head(ln, c->conn) != i){
+                    i++;
+                    continue;                               //another read, one to go alone, or behind a request of its client
+                }
+                end = (uint32_t)ln->rd_addr + ln->rd_num;
+                lo  = (addr < ln->rd_addr) ? addr : ln->rd_addr;
+                hi  = ((uint32_t)addr + num > end) ? (uint32_t)addr + num : end;
+                if(addr > end || (uint32_t)addr + num < ln->rd_addr
+                || hi - lo > max || (grow == 0 && hi - lo > ln->rd_num)){
+                    i++;
+                    continue;                               //apart, too big, or out of the range on the bus
+                }
+                ln->rd_addr = (uint16_t)lo;
+                ln->rd_num  = (uint16_t)(hi - lo);
+                ln->grp[ln->grp_num++] = ln->pend[i];
+                ln->pend_num--;
+                memmove(&ln->pend[i], &ln->pend[i + 1], ln->pend_num - i);
+                ln->merge_cnt++;
+                more = 1;
+            }
+        }while(more && grow);
+    }
+    if(grow == 0){
+        return;
+    }
+    if(ln->rd_num > 0){                                     //the read of the whole range
+        ln->tx[0] = r->adu[MB_TCP_UID];
+        ln->tx[1] = r->adu[MB_TCP_FUNC];
+        ln->tx[2] = (uint8_t)(ln->rd_addr >> 8);
+        ln->tx[3] = (uint8_t)(ln->rd_addr & 0xFF);
+        ln->tx[4] = (uint8_t)(ln->rd_num >> 8);
+        ln->tx[5] = (uint8_t)(ln->rd_num & 0xFF);
+        crc = usMBCRC16(ln->tx, 6);
+        ln->tx[6] = (uint8_t)(crc & 0xFF);
+        ln->tx[7] = (uint8_t)(crc >> 8);
+        ln->tx_len = 8;
+        return;
+    }
+#endif
+
+    plen = r->len - MB_TCP_FUNC;
+    ln->tx[0] = r->adu[MB_TCP_UID];
+    memcpy(&ln->tx[1], &r->adu[MB_TCP_FUNC], plen);
+    crc = usMBCRC16(ln->tx, plen + 1);
+    ln->tx[plen + 1] = (uint8_t)(crc & 0xFF);               //low byte first, as mb_rtu_send_pdu()
+    ln->tx[plen + 2] = (uint8_t)(crc >> 8);
+    ln->tx_len = plen + 3;
+}
+
+
+#if MB_GW_COALESCE_ENABLED > 0 || MB_GW_CACHE_NUM > 0
+                                                            //the range of a read 01 ~ 04, 0= it can be coalesced or cached
+static int32_t mb_gw_read_range(const uint8_t adu[], uint16_t len, uint16_t *addr, uint16_t *num)
+{
+    const uint8_t *p = &adu[MB_TCP_FUNC];
+    uint16_t       max;
+
+    if(len != MB_TCP_FUNC + MB_GW_READ_PDU_LEN || p[0] < MB_FUNC_READ_COILS || p[0] > MB_FUNC_READ_INPUT_REGISTER
+    || adu[MB_TCP_UID] == MB_ADDRESS_BROADCAST){
+        return __LINE__;
+    }
+    max   = (p[0] <= MB_FUNC_READ_DISCRETE_INPUTS) ? MB_GW_READ_BIT_MAX : MB_GW_READ_REG_MAX;
+    *addr = (uint16_t)((p[1] << 8) | p[2]);
+    *num  = (uint16_t)((p[3] << 8) | p[4]);
+    if(*num == 0 || *num > max || (uint32_t)*addr + *num > 0x10000UL){
+        return __LINE__;                                    //the device answers the exception, alone
+    }
+    return 0;
+}
+#endif
+
+
+#if MB_GW_CACHE_NUM > 0
+                                                            //the range of a write, fc= the read of it, 01 or 03. 0= it is a write
+static int32_t mb_gw_write_range(const uint8_t adu[], uint16_t len, uint8_t *fc, uint16_t *addr, uint16_t *num)
+{
+    const uint8_t *p = &adu[MB_TCP_FUNC];
+
+    if(len < MB_TCP_FUNC + MB_GW_READ_PDU_LEN){
+        return __LINE__;
+    }
+    *addr = (uint16_t)((p[1] << 8) | p[2]);
+    *num  = 1;
+    switch(p[0]){
+    case MB_FUNC_WRITE_SINGLE_COIL:
+        *fc = MB_FUNC_READ_COILS;
+        break;
+    case MB_FUNC_WRITE_MULTIPLE_COILS:
+        *fc  = MB_FUNC_READ_COILS;
+        *num = (uint16_t)((p[3] << 8) | p[4]);
+        break;
+    case MB_FUNC_WRITE_REGISTER:
+        *fc = MB_FUNC_READ_HOLDING_REGISTER;
+        break;
+    case MB_FUNC_WRITE_MULTIPLE_REGISTERS:
+        *fc  = MB_FUNC_READ_HOLDING_REGISTER;
+        *num = (uint16_t)((p[3] << 8) | p[4]);
+        break;
+    case MB_FUNC_READWRITE_MULTIPLE_REGISTERS:              //read addr, read num, write addr, write num
+        if(len < MB_TCP_FUNC + 9){
+            return __LINE__;
+        }
+        *fc   = MB_FUNC_READ_HOLDING_REGISTER;
+        *addr = (uint16_t)((p[5] << 8) | p[6]);
+        *num  = (uint16_t)((p[7] << 8) | p[8]);
+        break;
+    default:
+        return __LINE__;
+    }
+    return 0;
+}
+#endif
+
+#if MB_GW_COALESCE_ENABLED > 0
+
+
+/*******************************************************************************
+  * @brief  share the answer of a coalesced read out to the group
+  *
+  * @param  ln = the line
+            f = the rtu frame of the answer, the byte count is checked
+  *
+  * @retval none
+  *
+  * @note   each request gets its part, the registers or the bits from its
+            own address, in its slot with its MBAP.
+  *****************************************************************************/
+static void mb_gw_line_share(MB_GW_LINE_STRU *ln, const uint8_t f[])
+{
+    MB_GW_REQ_STRU *r;
+    const uint8_t  *d = &f[3];
+    uint8_t        *o;
+    uint16_t        addr, num, off, bc, k;
+    int32_t         i;
+
+    for(i = 0; i < ln->grp_num; i++){
+        r = &ln->slot[ln->grp[i]];
+        mb_gw_read_range(r->adu, r->len, &addr, &num);      //all of the group are reads in the range
+        off = addr - ln->rd_addr;
+        o   = &r->adu[MB_TCP_FUNC + 2];
+        if(f[1] <= MB_FUNC_READ_DISCRETE_INPUTS){
+            bc = (num + 7) / 8;
+            memset(o, 0, bc);
+            for(k = 0; k < num; k++){
+                if(d[(off + k) >> 3] & (1U << ((off + k) & 7))){
+                    o[k >> 3] |= (uint8_t)(1U << (k & 7));
+                }
+            }
+        }
+        else{
+            bc = num * 2;
+            memcpy(o, &d[off * 2], bc);
+        }
+        r->adu[MB_TCP_FUNC + 1] = (uint8_t)bc;
+        r->adu[MB_TCP_LEN]      = (uint8_t)((bc + 3) >> 8); //uid, fc, byte count
+        r->adu[MB_TCP_LEN + 1]  = (uint8_t)((bc + 3) & 0xFF);
+        r->len = MB_TCP_FUNC + 2 + bc;
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  a coalesced read got an exception, its requests go back to pend[]
+            to be sent one by one.
+  *
+  * @param  ln = the line
+            now_us = monotonic time
+  *
+  * @retval none
+  *
+  * @note   the exception may be of the gap between the reads, or of one of
+            them, so it is not given to all. each one is the oldest of its
+            client, they go in front of pend[] in their order, and none of
+            them is coalesced again, each client gets the answer of its own.
+  *****************************************************************************/
+static void mb_gw_line_split(MB_GW_LINE_STRU *ln, uint64_t now_us)
+{
+    int32_t i;
+
+    memmove(&ln->pend[ln->grp_num], &ln->pend[0], ln->pend_num);
+    for(i = 0; i < ln->grp_num; i++){
+        ln->pend[i] = ln->grp[i];
+        ln->slot[ln->grp[i]].alone = 1;
+        mb_gw_line_flow(ln, ln->slot[ln->grp[i]].conn);
+    }
+    ln->pend_num += ln->grp_num;
+    ln->split_cnt++;
+    ln->grp_num = 0;
+    ln->rd_num  = 0;
+    ln->cur     = -1;
+    ln->sent    = 0;
+    ln->free_us = now_us + ln->t35_us;
+}
+#endif
+
+#endif //#if MB_GW_ENABLED > 0
@@ -0,0 +1,262 @@
+/**
+  ******************************************************************************
+  * @file    module of the read cache of the modbus tcp to rtu gateway
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/12/22
+  * @brief   a hash of fixed entries with a lru list, see mbgw_cache.h.
+             the entries are linked by index, not pointer, 0xFFFF is the end.
+             get, put and drop are O(1) but for the walk of a bucket, the
+             invalidation by a write looks at all entries, writes are few.
+  *
+  ******************************************************************************
+  */
+
+/* ----------------------- System includes ----------------------------------*/
+#include <stdint.h>
+#include "string.h"
+
+/* ----------------------- Modbus includes ----------------------------------*/
+#include "mbgw_cache.h"
+
+#if MB_GW_ENABLED > 0 && MB_GW_CACHE_NUM > 0
+
+/*******************************************************************************
+******************************** Private define ********************************
+*******************************************************************************/
+#if (MB_GW_CACHE_NUM & (MB_GW_CACHE_NUM - 1)) != 0 || MB_GW_CACHE_NUM >= MB_GW_CACHE_NONE
+    #error "MB_GW_CACHE_NUM must be a power of 2, below 0xFFFF, the buckets are masked"
+#endif
+
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static uint16_t mb_gw_cache_hash    (uint8_t line, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num);
+static uint16_t mb_gw_cache_find    (MB_GW_CACHE_STRU *c, uint8_t line, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num);
+static void     mb_gw_cache_drop    (MB_GW_CACHE_STRU *c, uint16_t i);
+static void     mb_gw_cache_lru_cut (MB_GW_CACHE_STRU *c, uint16_t i);
+static void     mb_gw_cache_lru_push(MB_GW_CACHE_STRU *c, uint16_t i);
+
+/*******************************************************************************
+  * @brief  init the cache, all entries free
+  *
+  * @param  c = the cache
+  *
+  * @retval none
+  *****************************************************************************/
+void mb_gw_cache_init(MB_GW_CACHE_STRU *c)
+{
+    uint16_t i;
+
+    memset(c, 0, sizeof(*c));
+    for(i = 0; i < MB_GW_CACHE_NUM; i++){
+        c->bucket[i]  = MB_GW_CACHE_NONE;
+        c->e[i].hnext = (i + 1 < MB_GW_CACHE_NUM) ? (uint16_t)(i + 1) : MB_GW_CACHE_NONE;
+    }
+    c->free_head = 0;
+    c->lru_head  = MB_GW_CACHE_NONE;
+    c->lru_tail  = MB_GW_CACHE_NONE;
+}
+
+
+/*******************************************************************************
+  * @brief  look for the answer of a read
+  *
+  * @param  c = the cache
+            line, uid, fc, addr, num = the key
+            now_us = monotonic time
+            pdu = output the answer, MB_GW_CACHE_PDU_MAX bytes
+            len = output the len of pdu
+  *
+  * @retval 0= hit, other= miss.
+  *
+  * @note   an expired entry is dropped, a hit becomes the most recent.
+  *****************************************************************************/
+int32_t mb_gw_cache_get(MB_GW_CACHE_STRU *c, uint8_t line, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num,
+                        uint64_t now_us, uint8_t pdu[], uint16_t *len)
+{
+    MB_GW_CACHE_ENTRY_STRU *e;
+    uint16_t i;
+
+    i = mb_gw_cache_find(c, line, uid, fc, addr, num);
+    if(i == MB_GW_CACHE_NONE){
+        c->miss_cnt++;
+        return __LINE__;
+    }
+    e = &c->e[i];
+    if(now_us >= e->expire_us){
+        mb_gw_cache_drop(c, i);
+        c->expire_cnt++;
+        c->miss_cnt++;
+        return __LINE__;
+    }
+    memcpy(pdu, e->pdu, e->len);
+    *len = e->len;
+    mb_gw_cache_lru_cut(c, i);
+    mb_gw_cache_lru_push(c, i);
+    c->hit_cnt++;
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  keep the answer of a read
+  *
+  * @param  c = the cache
+            line, uid, fc, addr, num = the key
+            expire_us = the end of its ttl
+            pdu, len = the answer, without the MBAP
+  *
+  * @retval none
+  *
+  * @note   the entry of the same key is replaced, else a free one is taken,
+            else the least recently used one is evicted.
+  *****************************************************************************/
+void mb_gw_cache_put(MB_GW_CACHE_STRU *c, uint8_t line, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num,
+                     uint64_t expire_us, const uint8_t pdu[], uint16_t len)
+{
+    MB_GW_CACHE_ENTRY_STRU *e;
+    uint16_t i, h;
+
+    if(len > MB_GW_CACHE_PDU_MAX){
+        return;
+    }
+    i = mb_gw_cache_find(c, line, uid, fc, addr, num);
+    if(i != MB_GW_CACHE_NONE){
+        mb_gw_cache_lru_cut(c, i);
+    }
+    else{
+        if(c->free_head == MB_GW_CACHE_NONE){
+            mb_gw_cache_drop(c, c->lru_tail);
+            c->evict_cnt++;
+        }
+        i            = c->free_head;
+        e            = &c->e[i];
+        c->free_head = e->hnext;
+        e->line = line;
+        e->uid  = uid;
+        e->fc   = fc;
+        e->addr = addr;
+        e->num  = num;
+        e->used = 1;
+        h = mb_gw_cache_hash(line, uid, fc, addr, num);
+        e->hnext     = c->bucket[h];
+        c->bucket[h] = i;
+        c->num++;
+    }
+    e = &c->e[i];
+    memcpy(e->pdu, pdu, len);
+    e->len       = len;
+    e->expire_us = expire_us;
+    mb_gw_cache_lru_push(c, i);
+}
+
+
+/*******************************************************************************
+  * @brief  drop the entries a write makes old
+  *
+  * @param  c = the cache
+            line, uid = the unit written
+            fc = the read of what is written, 01 coils or 03 holding registers
+            addr, num = the range written
+  *
+  * @retval none
+  *****************************************************************************/
+void mb_gw_cache_invalidate(MB_GW_CACHE_STRU *c, uint8_t line, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num)
+{
+    MB_GW_CACHE_ENTRY_STRU *e;
+    uint16_t i;
+
+    for(i = 0; i < MB_GW_CACHE_NUM; i++){
+        e = &c->e[i];
+        if(e->used && e->line == line && e->uid == uid && e->fc == fc
+        && (uint32_t)e->addr < (uint32_t)addr + num && (uint32_t)addr < (uint32_t)e->addr + e->num){
+            mb_gw_cache_drop(c, i);
+            c->inval_cnt++;
+        }
+    }
+}
+
+
+/*******************************************************************************
+*******************************************************************************/
+
+static uint16_t mb_gw_cache_hash(uint8_t line, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num)
+{
+    uint32_t h;
+
+    h  = ((uint32_t)line << 24) ^ ((uint32_t)uid << 16) ^ ((uint32_t)fc << 8);
+    h ^= ((uint32_t)addr << 16 | num) * 0x9E3779B1UL;       //golden ratio, the low bits of addr spread over the buckets
+    return (uint16_t)((h ^ (h >> 16)) & (MB_GW_CACHE_NUM - 1));
+}
+
+
+static uint16_t mb_gw_cache_find(MB_GW_CACHE_STRU *c, uint8_t line, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num)
+{
+    MB_GW_CACHE_ENTRY_STRU *e;
+    uint16_t i;
+
+    for(i = c->bucket[mb_gw_cache_hash(line, uid, fc, addr, num)]; i != MB_GW_CACHE_NONE; i = e->hnext){
+        e = &c->e[i];
+        if(e->line == line && e->uid == uid && e->fc == fc && e->addr == addr && e->num == num){
+            return i;
+        }
+    }
+    return MB_GW_CACHE_NONE;
+}
+
+
+                                                            //out of its bucket and the lru list, into the free list
+static void mb_gw_cache_drop(MB_GW_CACHE_STRU *c, uint16_t i)
+{
+    MB_GW_CACHE_ENTRY_STRU *e = &c->e[i];
+    uint16_t *p;
+
+    p = &c->bucket[mb_gw_cache_hash(e->line, e->uid, e->fc, e->addr, e->num)];
+    while(*p != i){
+        p = &c->e[*p].hnext;
+    }
+    *p = e->hnext;
+    mb_gw_cache_lru_cut(c, i);
+    e->used      = 0;
+    e->hnext     = c->free_head;
+    c->free_head = i;
+    c->num--;
+}
+
+
+static void mb_gw_cache_lru_cut(MB_GW_CACHE_STRU *c, uint16_t i)
+{
+    MB_GW_CACHE_ENTRY_STRU *e = &c->e[i];
+
+    if(e->prev != MB_GW_CACHE_NONE){
+        c->e[e->prev].next = e->next;
+    }
+    else{
+        c->lru_head = e->next;
+    }
+    if(e->next != MB_GW_CACHE_NONE){
+        c->e[e->next].prev = e->prev;
+    }
+    else{
+        c->lru_tail = e->prev;
+    }
+}
+
+
+static void mb_gw_cache_lru_push(MB_GW_CACHE_STRU *c, uint16_t i)
+{
+    MB_GW_CACHE_ENTRY_STRU *e = &c->e[i];
+
+    e->prev = MB_GW_CACHE_NONE;
+    e->next = c->lru_head;
+    if(c->lru_head != MB_GW_CACHE_NONE){
+        c->e[c->lru_head].prev = i;
+    }
+    else{
+        c->lru_tail = i;
+    }
+    c->lru_head = i;
+}
+
+#endif //#if MB_GW_ENABLED > 0 && MB_GW_CACHE_NUM > 0
@@ -0,0 +1,644 @@
+/**
+  ******************************************************************************
+  * @file    module of modbus master (client)
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/12/27
+  * @brief   the request pdu is built in m->req[], copied into the buffer of
+             the link where its send_pdu() wants it, ucRTUBuf[1] for rtu and
+             ascii, after the MBAP for tcp, and sent by the framing of the
+             mode, mb_rtu_send_pdu(), mb_ascii_send_pdu(), mb_tcp_send_pdu().
+             the answer comes as on a slave, the port posts EV_FRAME_RECEIVED
+             and receive_pdu() checks the crc/lrc, or the MBAP, and gives the
+             pdu. a frame of another unit, of another tid or with a bad crc is
+             dropped and the master waits on, so a late answer of a request
+             which timed out does not pass for the answer of the next one.
+             then the answer is checked against the request, and decoded.
+  *
+  ******************************************************************************
+  */
+
+/* ----------------------- System includes ----------------------------------*/
+#include <stdint.h>
+#include "string.h"
+
+/* ----------------------- Modbus includes ----------------------------------*/
+#include "mb.h"
+#include "mbconfig.h"
+#include "mbframe.h"
+#include "mbproto.h"
+#include "mbmaster.h"
+
+#if MB_RTU_ENABLED == 1
+    #include "mbrtu.h"
+#endif
+#if MB_ASCII_ENABLED == 1
+    #include "mbascii.h"
+#endif
+#if MB_TCP_ENABLED == 1
+    #include "mbtcp.h"
+#endif
+
+#if MB_MASTER_ENABLED > 0
+
+/*******************************************************************************
+******************************** Private define ********************************
+*******************************************************************************/
+#define MB_MASTER_WRITE_BIT_MAX     ( 0x07B0 )  /*!< coils of a write, 15. */
+#define MB_MASTER_WRITE_REG_MAX     ( 0x007B )  /*!< registers of a write, 16. */
+#define MB_MASTER_RW_WRITE_REG_MAX  ( 0x0079 )  /*!< registers written by a 23. */
+#define MB_MASTER_PDU_OFF_SER       ( 1 )       /*!< the pdu in ucRTUBuf, after the address. */
+#define MB_MASTER_TID               ( 0 )       /*!< offsets in the MBAP, see mbtcp_v2.c. */
+#define MB_MASTER_PID               ( 2 )
+
+/* master's state, as the one of a slave in mb_v2.c */
+typedef enum
+{
+    STATE_NOT_INITIALIZED,
+    STATE_ENABLED,
+    STATE_DISABLED,
+} MB_MASTER_STATE_ENUM;
+
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static int32_t  mb_master_send      (MB_MASTER_STRU *m);
+static int32_t  mb_master_receive   (MB_MASTER_STRU *m);
+static void     mb_master_flush     (MB_MASTER_STRU *m);
+static int32_t  mb_master_read_bits (MB_MASTER_STRU *m, uint8_t fc, uint8_t uid, uint16_t addr, uint16_t num, uint8_t bits[]);
+static int32_t  mb_master_read_regs (MB_MASTER_STRU *m, uint8_t fc, uint8_t uid, uint16_t addr, uint16_t num, uint16_t regs[]);
+static int32_t  mb_master_echo      (MB_MASTER_STRU *m, uint16_t n);
+static void     mb_master_put16     (uint8_t *p, uint16_t v);
+static uint16_t mb_master_get16     (const uint8_t *p);
+
+
+/*******************************************************************************
+  * @brief  init the master, and the port of its link
+  *
+  * @param  m, its cfg is set
+  *
+  * @retval 0= OK, other= error.
+  *
+  * @note   the framing of the link is set by its mode as mb_init() does, the
+            isr fast path and the unit table of a slave are turned off, the
+            answers must all go to the master.
+  *****************************************************************************/
+int32_t mb_master_init(MB_MASTER_STRU *m)
+{
+    MB_SLAVE_STRU *link;
+
+    if(m == 0 || m->p_link == 0 || m->p_wait == 0 || m->p_tick_ms == 0){
+        return __LINE__;
+    }
+    if(m->state != STATE_NOT_INITIALIZED){
+        return __LINE__;
+    }
+    link = m->p_link;
+
+    switch(link->mode){
+#if MB_RTU_ENABLED > 0
+        case MB_RTU:
+            link->p_slave_init        = (tp_slave_init)mb_rtu_init;
+            link->p_slave_enable      = (tp_slave_enable)mb_rtu_enable;
+            link->p_slave_send_pdu    = (tp_slave_send_pdu)mb_rtu_send_pdu;
+            link->p_slave_receive_pdu = (tp_slave_receive_pdu)mb_rtu_receive_pdu;
+            break;
+#endif
+#if MB_ASCII_ENABLED > 0
+        case MB_ASCII:
+            link->p_slave_init        = (tp_slave_init)mb_ascii_init;
+            link->p_slave_enable      = (tp_slave_enable)mb_ascii_enable;
+            link->p_slave_send_pdu    = (tp_slave_send_pdu)mb_ascii_send_pdu;
+            link->p_slave_receive_pdu = (tp_slave_receive_pdu)mb_ascii_receive_pdu;
+            break;
+#endif
+#if MB_TCP_ENABLED > 0
+        case MB_TCP:
+            link->p_slave_init        = (tp_slave_init)mb_tcp_init;
+            link->p_slave_enable      = (tp_slave_enable)mb_tcp_enable;
+            link->p_slave_send_pdu    = (tp_slave_send_pdu)mb_tcp_send_pdu;
+            link->p_slave_receive_pdu = (tp_slave_receive_pdu)mb_tcp_receive_pdu;
+            break;
+#endif
+        default:
+            return __LINE__;
+    }
+    link->isr_fastpath = 0;
+    link->p_unit_tbl   = 0;
+
+    if(link->p_slave_init(link) != 0){
+        return __LINE__;
+    }
+    m->state = STATE_DISABLED;
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  master enable/disable, the port of its link
+  *
+  * @param  m, and newstate(0/1)
+  *
+  * @retval 0= OK.
+  *****************************************************************************/
+int32_t mb_master_enable(MB_MASTER_STRU *m, int newstate)
+{
+    if(newstate != 0 && newstate != 1){
+        return __LINE__;
+    }
+    if(m->state == STATE_NOT_INITIALIZED){
+        return __LINE__;
+    }
+    if(newstate == 1){
+        if(m->state != STATE_DISABLED){
+            return __LINE__;
+        }
+        m->p_link->p_slave_enable(m->p_link, 1);
+        m->state = STATE_ENABLED;
+    }
+    else{
+        if(m->state == STATE_DISABLED){
+            return __LINE__;
+        }
+        m->p_link->p_slave_enable(m->p_link, 0);
+        m->state = STATE_DISABLED;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  send a request and wait for its answer, any function
+  *
+  * @param  m
+            uid = the unit, 0= broadcast on a serial line
+            pdu, len = the request, fc + data
+  *
+  * @retval 0= answered, m->p_ans and m->ans_len is the answer pdu.
+            > 0= the exception code of the device. < 0= MB_MASTER_Exxx.
+  *
+  * @note   only the function code of the answer is checked here, the data
+            is left to the caller. the answer is in the buffer of the link,
+            until the next request.
+  *****************************************************************************/
+int32_t mb_master_request(MB_MASTER_STRU *m, uint8_t uid, const uint8_t pdu[], uint16_t len)
+{
+    uint32_t timeout_ms, t0, dt;
+    int32_t  r, tries;
+
+    if(m->state != STATE_ENABLED){
+        return MB_MASTER_ESTATE;
+    }
+    if(len < MB_PDU_SIZE_MIN || len > MB_PDU_SIZE_MAX){
+        return MB_MASTER_EARG;
+    }
+    if(pdu != m->req){
+        memcpy(m->req, pdu, len);
+    }
+    m->req_len   = len;
+    m->uid       = uid;
+    m->p_ans     = 0;
+    m->ans_len   = 0;
+    m->exception = MB_EX_NONE;
+    m->req_cnt++;
+    timeout_ms = (m->timeout_ms != 0) ? m->timeout_ms : MB_MASTER_TIMEOUT_MS;
+
+    for(tries = 0; ; tries++){
+        mb_master_flush(m);
+        m->tid++;                                           //a new tid for a retry too, the late answer of the last try is dropped
+        if(mb_master_send(m) != 0){
+            return MB_MASTER_EPORT;
+        }
+        if(uid == MB_ADDRESS_BROADCAST && m->p_link->mode != MB_TCP){
+            return 0;                                       //no answer, the caller leaves the devices the time to do it
+        }
+
+        t0 = m->p_tick_ms();
+        for(;;){
+            r = mb_master_receive(m);
+            if(r <= 0){
+                break;                                      //the answer, or an exception
+            }
+            dt = m->p_tick_ms() - t0;
+            if(dt >= timeout_ms){
+                break;
+            }
+            if(m->p_wait((int32_t)(timeout_ms - dt)) != 0){
+                return MB_MASTER_EPORT;
+            }
+        }
+        if(r == 0){
+            m->ok_cnt++;
+            return 0;
+        }
+        if(r < 0){
+            m->exception = (uint8_t)(-r);
+            m->ex_cnt++;
+            return -r;
+        }
+
+        m->timeout_cnt++;
+        if(tries >= m->retries){
+            return MB_MASTER_ETIMEOUT;
+        }
+        m->retry_cnt++;
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  FC01, read coils
+  *
+  * @param  m
+            uid = the unit, 1~247, or any on tcp
+            addr, num = the first coil, from 0, and how many, 1~2000
+            bits = output, (num + 7) / 8 bytes, the first coil in bit 0
+  *
+  * @retval 0= OK, > 0= the exception code, < 0= MB_MASTER_Exxx.
+  *****************************************************************************/
+int32_t mb_master_read_coils(MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t num, uint8_t bits[])
+{
+    return mb_master_read_bits(m, MB_FUNC_READ_COILS, uid, addr, num, bits);
+}
+
+
+/*******************************************************************************
+  * @brief  FC02, read discrete inputs, as mb_master_read_coils()
+  *****************************************************************************/
+int32_t mb_master_read_discrete(MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t num, uint8_t bits[])
+{
+    return mb_master_read_bits(m, MB_FUNC_READ_DISCRETE_INPUTS, uid, addr, num, bits);
+}
+
+
+/*******************************************************************************
+  * @brief  FC03, read holding registers
+  *
+  * @param  m
+            uid = the unit, 1~247, or any on tcp
+            addr, num = the first register, from 0, and how many, 1~125
+            regs = output, num registers in host order
+  *
+  * @retval 0= OK, > 0= the exception code, < 0= MB_MASTER_Exxx.
+  *****************************************************************************/
+int32_t mb_master_read_holding(MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t num, uint16_t regs[])
+{
+    return mb_master_read_regs(m, MB_FUNC_READ_HOLDING_REGISTER, uid, addr, num, regs);
+}
+
+
+/*******************************************************************************
+  * @brief  FC04, read input registers, as mb_master_read_holding()
+  *****************************************************************************/
+int32_t mb_master_read_input(MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t num, uint16_t regs[])
+{
+    return mb_master_read_regs(m, MB_FUNC_READ_INPUT_REGISTER, uid, addr, num, regs);
+}
+
+
+/*******************************************************************************
+  * @brief  FC05, write a coil
+  *
+  * @param  m
+            uid = the unit, 0= broadcast on a serial line
+            addr = the coil
+            on = 1/0
+  *
+  * @retval 0= OK, > 0= the exception code, < 0= MB_MASTER_Exxx.
+  *
+  * @note   the answer is the request as it is.
+  *****************************************************************************/
+int32_t mb_master_write_coil(MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint8_t on)
+{
+    int32_t r;
+
+    m->req[0] = MB_FUNC_WRITE_SINGLE_COIL;
+    mb_master_put16(&m->req[1], addr);
+    mb_master_put16(&m->req[3], on ? 0xFF00 : 0x0000);
+    r = mb_master_request(m, uid, m->req, 5);
+    return (r != 0) ? r : mb_master_echo(m, 5);
+}
+
+
+/*******************************************************************************
+  * @brief  FC06, write a holding register, as mb_master_write_coil()
+  *****************************************************************************/
+int32_t mb_master_write_register(MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t val)
+{
+    int32_t r;
+
+    m->req[0] = MB_FUNC_WRITE_REGISTER;
+    mb_master_put16(&m->req[1], addr);
+    mb_master_put16(&m->req[3], val);
+    r = mb_master_request(m, uid, m->req, 5);
+    return (r != 0) ? r : mb_master_echo(m, 5);
+}
+
+
+/*******************************************************************************
+  * @brief  FC15, write coils
+  *
+  * @param  m
+            uid = the unit, 0= broadcast on a serial line
+            addr, num = the first coil and how many, 1~1968
+            bits = (num + 7) / 8 bytes, the first coil in bit 0
+  *
+  * @retval 0= OK, > 0= the exception code, < 0= MB_MASTER_Exxx.
+  *
+  * @note   the answer is fc, addr, num of the request.
+  *****************************************************************************/
+int32_t mb_master_write_coils(MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t num, const uint8_t bits[])
+{
+    uint16_t n;
+    int32_t  r;
+
+    if(num == 0 || num > MB_MASTER_WRITE_BIT_MAX){
+        return MB_MASTER_EARG;
+    }
+    n = (uint16_t)((num + 7) / 8);
+    m->req[0] = MB_FUNC_WRITE_MULTIPLE_COILS;
+    mb_master_put16(&m->req[1], addr);
+    mb_master_put16(&m->req[3], num);
+    m->req[5] = (uint8_t)n;
+    memcpy(&m->req[6], bits, n);
+    if(num % 8){                                            //the bits over num are sent as 0
+        m->req[5 + n] &= (uint8_t)((1U << (num % 8)) - 1);
+    }
+    r = mb_master_request(m, uid, m->req, (uint16_t)(6 + n));
+    return (r != 0) ? r : mb_master_echo(m, 5);
+}
+
+
+/*******************************************************************************
+  * @brief  FC16, write holding registers
+  *
+  * @param  m
+            uid = the unit, 0= broadcast on a serial line
+            addr, num = the first register and how many, 1~123
+            regs = num registers in host order
+  *
+  * @retval 0= OK, > 0= the exception code, < 0= MB_MASTER_Exxx.
+  *****************************************************************************/
+int32_t mb_master_write_registers(MB_MASTER_STRU *m, uint8_t uid, uint16_t addr, uint16_t num, const uint16_t regs[])
+{
+    uint16_t i;
+    int32_t  r;
+
+    if(num == 0 || num > MB_MASTER_WRITE_REG_MAX){
+        return MB_MASTER_EARG;
+    }
+    m->req[0] = MB_FUNC_WRITE_MULTIPLE_REGISTERS;
+    mb_master_put16(&m->req[1], addr);
+    mb_master_put16(&m->req[3], num);
+    m->req[5] = (uint8_t)(num * 2);
+    for(i = 0; i < num; i++){
+        mb_master_put16(&m->req[6 + i * 2], regs[i]);
+    }
+    r = mb_master_request(m, uid, m->req, (uint16_t)(6 + num * 2));
+    return (r != 0) ? r : mb_master_echo(m, 5);
+}
+
+
+/*******************************************************************************
+  * @brief  FC23, write then read holding registers in one transaction
+  *
+  * @param  m
+            uid = the unit, 1~247, or any on tcp
+            rd_addr, rd_num = the registers to read, 1~125
+            rd = output, rd_num registers in host order
+            wr_addr, wr_num = the registers to write, 1~121
+            wr = wr_num registers in host order
+  *
+  * @retval 0= OK, > 0= the exception code, < 0= MB_MASTER_Exxx.
+  *
+  * @note   the device writes first, so a read of the same registers gets
+            the new values.
+  *****************************************************************************/
+int32_t mb_master_readwrite_registers(MB_MASTER_STRU *m, uint8_t uid, uint16_t rd_addr, uint16_t rd_num, uint16_t rd[],
+                                      uint16_t wr_addr, uint16_t wr_num, const uint16_t wr[])
+{
+    uint16_t i;
+    int32_t  r;
+
+    if(rd_num == 0 || rd_num > MB_PDU_FUNC_READ_REGCNT_MAX || wr_num == 0 || wr_num > MB_MASTER_RW_WRITE_REG_MAX){
+        return MB_MASTER_EARG;
+    }
+    if(uid == MB_ADDRESS_BROADCAST && m->p_link->mode != MB_TCP){
+        return MB_MASTER_EARG;                              //a read, no one answers a broadcast
+    }
+    m->req[0] = MB_FUNC_READWRITE_MULTIPLE_REGISTERS;
+    mb_master_put16(&m->req[1], rd_addr);
+    mb_master_put16(&m->req[3], rd_num);
+    mb_master_put16(&m->req[5], wr_addr);
+    mb_master_put16(&m->req[7], wr_num);
+    m->req[9] = (uint8_t)(wr_num * 2);
+    for(i = 0; i < wr_num; i++){
+        mb_master_put16(&m->req[10 + i * 2], wr[i]);
+    }
+    r = mb_master_request(m, uid, m->req, (uint16_t)(10 + wr_num * 2));
+    if(r != 0){
+        return r;
+    }
+    if(m->ans_len != 2 + rd_num * 2 || m->p_ans[1] != rd_num * 2){
+        m->bad_cnt++;
+        return MB_MASTER_EFRAME;
+    }
+    for(i = 0; i < rd_num; i++){
+        rd[i] = mb_master_get16(&m->p_ans[2 + i * 2]);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+******************************* Private functions ******************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  put m->req[] into the buffer of the link, and send it
+  *
+  * @param  m
+  *
+  * @retval 0= sent, other= the port failed.
+  *
+  * @note   the send_pdu() of rtu and ascii wants the pdu in ucRTUBuf[1], the
+            one of tcp wants it after p_tcp_adu, whose MBAP is built here as a
+            slave keeps the one of the request.
+  *****************************************************************************/
+static int32_t mb_master_send(MB_MASTER_STRU *m)
+{
+    MB_SLAVE_STRU *link = m->p_link;
+    uint8_t       *pdu;
+
+    link->tx_echo = MB_TX_ECHO_NONE;
+#if MB_TCP_ENABLED > 0
+    if(link->mode == MB_TCP){
+        link->p_tcp_adu = link->ucRTUBuf;
+        mb_master_put16(&link->ucRTUBuf[MB_MASTER_TID], m->tid);
+        mb_master_put16(&link->ucRTUBuf[MB_MASTER_PID], 0);
+        link->ucRTUBuf[MB_TCP_UID] = m->uid;
+        pdu = &link->ucRTUBuf[MB_TCP_FUNC];
+    }
+    else
+#endif
+    {
+        pdu = &link->ucRTUBuf[MB_MASTER_PDU_OFF_SER];
+    }
+    memcpy(pdu, m->req, m->req_len);
+    return link->p_slave_send_pdu(link, m->uid, pdu, m->req_len);
+}
+
+
+/*******************************************************************************
+  * @brief  take a frame from the link, if one is there, and see if it is the
+            answer of the request
+  *
+  * @param  m
+  *
+  * @retval 0= the answer, in m->p_ans, m->ans_len. < 0= an exception, -code.
+            > 0= not yet, no frame or it is dropped.
+  *****************************************************************************/
+static int32_t mb_master_receive(MB_MASTER_STRU *m)
+{
+    MB_SLAVE_STRU *link = m->p_link;
+    uint32_t       e;
+    uint8_t        addr;
+    uint8_t       *pdu;
+    uint16_t       len;
+
+    if(link->p_event_get(&e) != 0 || e != EV_FRAME_RECEIVED){
+        return __LINE__;
+    }
+    if(link->p_slave_receive_pdu(link, &addr, &pdu, &len) != 0 || len < MB_PDU_SIZE_MIN){
+        m->drop_cnt++;
+        return __LINE__;
+    }
+#if MB_TCP_ENABLED > 0
+    if(link->mode == MB_TCP){                               //addr is not the unit id on tcp, see mb_tcp_receive_pdu()
+        if(mb_master_get16(&link->p_tcp_adu[MB_MASTER_TID]) != m->tid){
+            m->drop_cnt++;                                  //the late answer of a try before
+            return __LINE__;
+        }
+        addr = link->p_tcp_adu[MB_TCP_UID];
+    }
+#endif
+    if(addr != m->uid){
+        m->drop_cnt++;
+        return __LINE__;
+    }
+
+    if(pdu[MB_PDU_FUNC_OFF] == (m->req[MB_PDU_FUNC_OFF] | MB_FUNC_ERROR) && len == 2){
+        return (pdu[MB_PDU_DATA_OFF] != MB_EX_NONE) ? -(int32_t)pdu[MB_PDU_DATA_OFF] : -(int32_t)MB_EX_SLAVE_DEVICE_FAILURE;
+    }
+    if(pdu[MB_PDU_FUNC_OFF] != m->req[MB_PDU_FUNC_OFF]){
+        m->drop_cnt++;
+        return __LINE__;
+    }
+    m->p_ans   = pdu;
+    m->ans_len = len;
+    return 0;
+}
+
+
+                                                            //drop the frames which came before the request, eg. the late answer of the last one
+static void mb_master_flush(MB_MASTER_STRU *m)
+{
+    MB_SLAVE_STRU *link = m->p_link;
+    uint32_t       e;
+    uint8_t        addr;
+    uint8_t       *pdu;
+    uint16_t       len;
+
+    while(link->p_event_get(&e) == 0){
+        if(e == EV_FRAME_RECEIVED){
+            (void)link->p_slave_receive_pdu(link, &addr, &pdu, &len);
+            m->drop_cnt++;
+        }
+    }
+}
+
+
+static int32_t mb_master_read_bits(MB_MASTER_STRU *m, uint8_t fc, uint8_t uid, uint16_t addr, uint16_t num, uint8_t bits[])
+{
+    uint16_t n;
+    int32_t  r;
+
+    if(num == 0 || num > MB_PDU_FUNC_READ_COILCNT_MAX){
+        return MB_MASTER_EARG;
+    }
+    if(uid == MB_ADDRESS_BROADCAST && m->p_link->mode != MB_TCP){
+        return MB_MASTER_EARG;
+    }
+    m->req[0] = fc;
+    mb_master_put16(&m->req[1], addr);
+    mb_master_put16(&m->req[3], num);
+    r = mb_master_request(m, uid, m->req, 5);
+    if(r != 0){
+        return r;
+    }
+    n = (uint16_t)((num + 7) / 8);
+    if(m->ans_len != 2 + n || m->p_ans[1] != n){
+        m->bad_cnt++;
+        return MB_MASTER_EFRAME;
+    }
+    memcpy(bits, &m->p_ans[2], n);
+    return 0;
+}
+
+
+static int32_t mb_master_read_regs(MB_MASTER_STRU *m, uint8_t fc, uint8_t uid, uint16_t addr, uint16_t num, uint16_t regs[])
+{
+    uint16_t i;
+    int32_t  r;
+
+    if(num == 0 || num > MB_PDU_FUNC_READ_REGCNT_MAX){
+        return MB_MASTER_EARG;
+    }
+    if(uid == MB_ADDRESS_BROADCAST && m->p_link->mode != MB_TCP){
+        return MB_MASTER_EARG;
+    }
+    m->req[0] = fc;
+    mb_master_put16(&m->req[1], addr);
+    mb_master_put16(&m->req[3], num);
+    r = mb_master_request(m, uid, m->req, 5);
+    if(r != 0){
+        return r;
+    }
+    if(m->ans_len != 2 + num * 2 || m->p_ans[1] != num * 2){
+        m->bad_cnt++;
+        return MB_MASTER_EFRAME;
+    }
+    for(i = 0; i < num; i++){
+        regs[i] = mb_master_get16(&m->p_ans[2 + i * 2]);
+    }
+    return 0;
+}
+
+
+                                                            //the answer of a write, the first n bytes of the request, 0 if there is none, a broadcast
+static int32_t mb_master_echo(MB_MASTER_STRU *m, uint16_t n)
+{
+    if(m->p_ans == 0){
+        return 0;
+    }
+    if(m->ans_len != n || memcmp(m->p_ans, m->req, n) != 0){
+        m->bad_cnt++;
+        return MB_MASTER_EFRAME;
+    }
+    return 0;
+}
+
+
+static void mb_master_put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)(v & 0xFF);
+}
+
+
+static uint16_t mb_master_get16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+#endif //#if MB_MASTER_ENABLED > 0
@@ -0,0 +1,342 @@
+/**
+  ******************************************************************************
+  * @file    module of the poll list planner of the modbus master
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2022/01/04
+  * @brief   the tags are sorted by unit, table and address, then taken one
+             by one, the read in hand grows over the next tag if it can:
+                - the tag is in it, or overlaps or touches its end, the read
+                  gets only the bytes of the tag, it does always.
+                - there is a gap before the tag, it is read if the bus time
+                  of the longer read is not more than the one of two reads,
+                  mb_plan_read_us(), so the gap is cheaper than the request
+                  and its answer, the two t35 and the turnaround.
+                - no read longer than the limit, no gap over a hole.
+             else the tag starts a new read. one pass, at start, the scans
+             then only send the reads.
+             the bus time of a read, in chars of 11 bits at the baudrate:
+                request 8 + answer 5 + data, then 2 x t35 + turnaround_us
+             as the rtu line of the gateway counts it, mbgw.c.
+  *
+  ******************************************************************************
+  */
+
+/* ----------------------- System includes ----------------------------------*/
+#include <stdint.h>
+#include "string.h"
+
+/* ----------------------- Modbus includes ----------------------------------*/
+#include "mb.h"
+#include "mbconfig.h"
+#include "mbproto.h"
+#include "mbrtu.h"
+#include "mbmaster.h"
+#include "mbplan.h"
+
+#if MB_MASTER_ENABLED > 0
+
+/*******************************************************************************
+******************************** Private define ********************************
+*******************************************************************************/
+#define MB_PLAN_REQ_BYTES       ( 8 )       /*!< addr, fc, start, count, crc. */
+#define MB_PLAN_ANS_BYTES       ( 5 )       /*!< addr, fc, byte count, crc, then the data. */
+
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static int32_t  mb_plan_is_bits     (uint8_t fc);
+static int32_t  mb_plan_cmp         (const MB_PLAN_TAG_STRU *a, const MB_PLAN_TAG_STRU *b);
+static void     mb_plan_sort        (MB_PLAN_TAG_STRU tags[], uint16_t num);
+static int32_t  mb_plan_has_hole    (const MB_PLAN_STRU *p, uint8_t uid, uint8_t fc, uint32_t from, uint32_t to);
+static int32_t  mb_plan_close       (MB_PLAN_STRU *p, MB_PLAN_REQ_STRU *r);
+
+
+/*******************************************************************************
+  * @brief  make the reads of the tags
+  *
+  * @param  p, its cfg is set
+            tags[], num, the tags, sorted here by unit, table and address
+  *
+  * @retval 0= OK, other= error, eg. a bad tag, or p_reqs[], p_regs[] or
+            p_bits[] too small.
+  *
+  * @note   each tag gets 'req' and 'pos', so its value is found after a scan.
+  *****************************************************************************/
+int32_t mb_plan_build(MB_PLAN_STRU *p, MB_PLAN_TAG_STRU tags[], uint16_t num)
+{
+    MB_PLAN_REQ_STRU *r = 0;
+    MB_PLAN_TAG_STRU *t;
+    uint16_t          i, max;
+    uint32_t          end, span, cur;
+
+    if(p == 0 || p->p_reqs == 0 || (num > 0 && tags == 0)){
+        return __LINE__;
+    }
+    p->req_num   = 0;
+    p->reg_num   = 0;
+    p->bit_num   = 0;
+    p->scan_us   = 0;
+    p->naive_num = 0;
+    p->naive_us  = 0;
+
+    for(i = 0; i < num; i++){                               //check the tags first
+        t   = &tags[i];
+        max = mb_plan_is_bits(t->fc) ? (p->bit_max ? p->bit_max : MB_PDU_FUNC_READ_COILCNT_MAX)
+                                     : (p->reg_max ? p->reg_max : MB_PDU_FUNC_READ_REGCNT_MAX);
+        if(t->fc < MB_FUNC_READ_COILS || t->fc > MB_FUNC_READ_INPUT_REGISTER){
+            return __LINE__;
+        }
+        if(t->width == 0 || t->width > max || (uint32_t)t->addr + t->width > 0x10000UL){
+            return __LINE__;
+        }
+        p->naive_num++;
+        p->naive_us += mb_plan_read_us(p, t->fc, t->width);
+    }
+    mb_plan_sort(tags, num);
+
+    for(i = 0; i < num; i++){
+        t   = &tags[i];
+        end = (uint32_t)t->addr + t->width;
+        max = mb_plan_is_bits(t->fc) ? (p->bit_max ? p->bit_max : MB_PDU_FUNC_READ_COILCNT_MAX)
+                                     : (p->reg_max ? p->reg_max : MB_PDU_FUNC_READ_REGCNT_MAX);
+
+        if(r != 0 && r->uid == t->uid && r->fc == t->fc){
+            cur = (uint32_t)r->addr + r->num;
+            if(end <= cur){                                 //in the read already
+                goto in_read;
+            }
+            span = end - r->addr;
+            if(span <= max
+               && (t->addr <= cur || !mb_plan_has_hole(p, t->uid, t->fc, cur, t->addr))
+               && (t->addr <= cur
+                   || mb_plan_read_us(p, t->fc, (uint16_t)span)
+                      <= mb_plan_read_us(p, t->fc, r->num) + mb_plan_read_us(p, t->fc, t->width))){
+                r->num = (uint16_t)span;                    //grows over the gap and the tag
+                goto in_read;
+            }
+        }
+        if(r != 0 && mb_plan_close(p, r) != 0){
+            return __LINE__;
+        }
+        if(p->req_num >= p->req_max){
+            return __LINE__;
+        }
+        r = &p->p_reqs[p->req_num++];                       //a new read from this tag
+        r->uid    = t->uid;
+        r->fc     = t->fc;
+        r->addr   = t->addr;
+        r->num    = t->width;
+        r->result = MB_MASTER_ESTATE;                       //not read yet
+        r->pos    = mb_plan_is_bits(t->fc) ? p->bit_num : p->reg_num;
+
+in_read:
+        t->req = (uint16_t)(r - p->p_reqs);
+        t->pos = (uint16_t)(mb_plan_is_bits(t->fc) ? r->pos * 8 : r->pos) + (t->addr - r->addr);
+    }
+    if(r != 0 && mb_plan_close(p, r) != 0){
+        return __LINE__;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  bus time of a read
+  *
+  * @param  p, its baudrate and turnaround_us
+            fc, num, the read
+  *
+  * @retval in us, the request, the answer, two t35 and the turnaround.
+  *
+  * @note   on tcp, baudrate 0, only the turnaround counts, the bytes cost
+            nothing, so any gap is read that the limit and the holes allow.
+  *****************************************************************************/
+uint32_t mb_plan_read_us(const MB_PLAN_STRU *p, uint8_t fc, uint16_t num)
+{
+    uint32_t bytes;
+
+    if(p->baudrate == 0){
+        return p->turnaround_us;
+    }
+    bytes = MB_PLAN_REQ_BYTES + MB_PLAN_ANS_BYTES;
+    bytes += mb_plan_is_bits(fc) ? (num + 7U) / 8U : num * 2U;
+    return bytes * mb_rtu_char_us(p->baudrate) + 2U * mb_rtu_t35_us(p->baudrate) + p->turnaround_us;
+}
+
+
+/*******************************************************************************
+  * @brief  send one read of the plan, and wait its answer
+  *
+  * @param  p, m, the plan and the master of its line
+            i, the read, in p_reqs[]
+  *
+  * @retval as mb_master_read_holding(), also kept in its 'result'.
+  *****************************************************************************/
+int32_t mb_plan_read(MB_PLAN_STRU *p, MB_MASTER_STRU *m, uint16_t i)
+{
+    MB_PLAN_REQ_STRU *r;
+
+    if(p == 0 || m == 0 || i >= p->req_num){
+        return MB_MASTER_EARG;
+    }
+    r = &p->p_reqs[i];
+    switch(r->fc){
+        case MB_FUNC_READ_COILS:
+            r->result = mb_master_read_coils(m, r->uid, r->addr, r->num, &p->p_bits[r->pos]);
+            break;
+        case MB_FUNC_READ_DISCRETE_INPUTS:
+            r->result = mb_master_read_discrete(m, r->uid, r->addr, r->num, &p->p_bits[r->pos]);
+            break;
+        case MB_FUNC_READ_HOLDING_REGISTER:
+            r->result = mb_master_read_holding(m, r->uid, r->addr, r->num, &p->p_regs[r->pos]);
+            break;
+        default:
+            r->result = mb_master_read_input(m, r->uid, r->addr, r->num, &p->p_regs[r->pos]);
+            break;
+    }
+    if(r->result != 0){
+        p->fail_cnt++;
+    }
+    return r->result;
+}
+
+
+/*******************************************************************************
+  * @brief  one scan, all the reads of the plan
+  *
+  * @param  p, m
+  *
+  * @retval the reads which failed, 0= all the values are fresh.
+  *
+  * @note   a read which fails does not stop the scan, its tags keep the
+            values of before, see 'result' of their read.
+  *****************************************************************************/
+int32_t mb_plan_scan(MB_PLAN_STRU *p, MB_MASTER_STRU *m)
+{
+    uint16_t i;
+    int32_t  n = 0;
+
+    if(p == 0 || m == 0){
+        return MB_MASTER_EARG;
+    }
+    for(i = 0; i < p->req_num; i++){
+        if(mb_plan_read(p, m, i) != 0){
+            n++;
+        }
+    }
+    p->scan_cnt++;
+    return n;
+}
+
+
+/*******************************************************************************
+  * @brief  a register of a tag, after a scan
+  *
+  * @param  p, t, the tag, of a 03 or 04
+            i, its register, 0.. width-1
+  *
+  * @retval the value.
+  *****************************************************************************/
+uint16_t mb_plan_tag_reg(const MB_PLAN_STRU *p, const MB_PLAN_TAG_STRU *t, uint16_t i)
+{
+    return p->p_regs[t->pos + i];
+}
+
+
+/*******************************************************************************
+  * @brief  a bit of a tag, after a scan
+  *
+  * @param  p, t, the tag, of a 01 or 02
+            i, its bit, 0.. width-1
+  *
+  * @retval 0/1.
+  *****************************************************************************/
+uint8_t mb_plan_tag_bit(const MB_PLAN_STRU *p, const MB_PLAN_TAG_STRU *t, uint16_t i)
+{
+    uint32_t n = (uint32_t)t->pos + i;
+
+    return (uint8_t)((p->p_bits[n / 8] >> (n % 8)) & 0x01);
+}
+
+
+/*******************************************************************************
+******************************* Private functions ******************************
+*******************************************************************************/
+static int32_t mb_plan_is_bits(uint8_t fc)
+{
+    return fc == MB_FUNC_READ_COILS || fc == MB_FUNC_READ_DISCRETE_INPUTS;
+}
+
+
+                                                            //by unit, table, address, the wider one first
+static int32_t mb_plan_cmp(const MB_PLAN_TAG_STRU *a, const MB_PLAN_TAG_STRU *b)
+{
+    if(a->uid != b->uid){
+        return (int32_t)a->uid - b->uid;
+    }
+    if(a->fc != b->fc){
+        return (int32_t)a->fc - b->fc;
+    }
+    if(a->addr != b->addr){
+        return (int32_t)a->addr - b->addr;
+    }
+    return (int32_t)b->width - a->width;
+}
+
+
+                                                            //shell sort, in place, no heap, once at start
+static void mb_plan_sort(MB_PLAN_TAG_STRU tags[], uint16_t num)
+{
+    MB_PLAN_TAG_STRU tmp;
+    uint16_t         gap, i, j;
+
+    for(gap = num / 2; gap > 0; gap /= 2){
+        for(i = gap; i < num; i++){
+            tmp = tags[i];
+            for(j = i; j >= gap && mb_plan_cmp(&tags[j - gap], &tmp) > 0; j -= gap){
+                tags[j] = tags[j - gap];
+            }
+            tags[j] = tmp;
+        }
+    }
+}
+
+
+                                                            //1 if a hole of the unit and table is in [from, to)
+static int32_t mb_plan_has_hole(const MB_PLAN_STRU *p, uint8_t uid, uint8_t fc, uint32_t from, uint32_t to)
+{
+    const MB_PLAN_HOLE_STRU *h;
+    uint16_t                 i;
+
+    for(i = 0; i < p->hole_num; i++){
+        h = &p->p_holes[i];
+        if(h->uid == uid && h->fc == fc && h->addr < to && (uint32_t)h->addr + h->num > from){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+                                                            //the read is done, it takes its room in p_regs[] or p_bits[]
+static int32_t mb_plan_close(MB_PLAN_STRU *p, MB_PLAN_REQ_STRU *r)
+{
+    r->cost_us  = mb_plan_read_us(p, r->fc, r->num);
+    p->scan_us += r->cost_us;
+    if(mb_plan_is_bits(r->fc)){
+        if((uint32_t)p->bit_num + (r->num + 7U) / 8U > p->bit_size
+           || (uint32_t)p->bit_num + (r->num + 7U) / 8U > 0x2000UL){   //'pos' of a tag counts bits in 16 bits
+            return __LINE__;
+        }
+        p->bit_num += (uint16_t)((r->num + 7U) / 8U);
+    }else{
+        if((uint32_t)p->reg_num + r->num > p->reg_size){
+            return __LINE__;
+        }
+        p->reg_num += r->num;
+    }
+    return 0;
+}
+
+#endif //#if MB_MASTER_ENABLED > 0
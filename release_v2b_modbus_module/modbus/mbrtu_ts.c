@@ -0,0 +1,309 @@
+/**
+  ******************************************************************************
+  * @file    module of modbus rtu framing by receive timestamps
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/11/20
+  * @brief   the stm32 ports frame by the uart IDLE irq plus a t35 compare timer,
+             a linux tty has neither. here the port feeds chunks from read()
+             with a monotonic timestamp, and we split frames by:
+             1. the gap between chunks, a gap > t35 + tol closes the frame.
+             2. the frame length, known from the function code, when the crc
+                also matches at that length. so back-to-back frames which land
+                in one read() are separated, and a frame is ready at once
+                without waiting for the gap.
+  *
+  ******************************************************************************
+  */
+
+/* ----------------------- System includes ----------------------------------*/
+#include <stdint.h>
+#include "string.h"
+
+/* ----------------------- Modbus includes ----------------------------------*/
+#include "mbrtu_ts.h"
+#include "mbrtu.h"
+#include "mbcrc.h"
+
+#if MB_RTU_TS_ENABLED > 0
+
+/*******************************************************************************
+******************************** Private define ********************************
+*******************************************************************************/
+#define MB_SER_PDU_SIZE_MIN     4       /*!< Minimum size of a Modbus RTU frame. */
+#define MB_SER_PDU_FUNC_OFF     1       /*!< Offset of function code in Ser-PDU. */
+
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static void     mb_rtu_ts_commit    (MB_RTU_TS_STRU *ts);
+static void     mb_rtu_ts_expect    (const uint8_t f[], uint16_t len, uint16_t *req, uint16_t *rsp);
+
+/*******************************************************************************
+  * @brief  init the framing engine
+  *
+  * @param  ts = the engine
+            baudrate = of the line
+            tol_us = tolerance added to t35, eg. 0 for a native uart,
+                     1000~2000 for a usb adapter with low_latency set.
+  *
+  * @retval 0=no error
+  *
+  * @note   the t35 of mb_rtu_t35_us(), the same as mb_rtu_init().
+  *****************************************************************************/
+int32_t mb_rtu_ts_init(MB_RTU_TS_STRU *ts, uint32_t baudrate, uint32_t tol_us)
+{
+    if(ts == 0 || baudrate == 0){
+        return -1;
+    }
+
+    memset(ts, 0, sizeof(MB_RTU_TS_STRU));
+    ts->char_us = mb_rtu_char_us(baudrate);
+    ts->t35_us  = mb_rtu_t35_us(baudrate);
+    ts->tol_us  = tol_us;
+
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  drop the frame under receiving and all the completed frames.
+  *
+  * @param  ts = the engine
+  *
+  * @retval none
+  *****************************************************************************/
+void mb_rtu_ts_reset(MB_RTU_TS_STRU *ts)
+{
+    ts->cur_len     = 0;
+    ts->cur_overrun = 0;
+    ts->q_head      = 0;
+    ts->q_cnt       = 0;
+}
+
+
+/*******************************************************************************
+  * @brief  feed a chunk of received bytes
+  *
+  * @param  d, n = the chunk
+            t_us = monotonic time when the chunk was read, in us.
+  *
+  * @retval none
+  *
+  * @note   the chunk's last byte arrived at about t_us, so its first byte
+            arrived n chars before, the gap is measured from there.
+  *****************************************************************************/
+void mb_rtu_ts_feed(MB_RTU_TS_STRU *ts, const uint8_t d[], uint16_t n, uint64_t t_us)
+{
+    uint64_t t_first;                                       //when the first byte of the chunk arrived
+    uint64_t chunk_us;                                      //time of the chunk on the line
+    uint32_t gap;
+    uint16_t req, rsp;                                      //expected length as a request and as a response
+    uint16_t i;
+
+    if(n == 0){
+        return;
+    }
+
+    chunk_us = (uint64_t)n * ts->char_us;
+    t_first  = (t_us > chunk_us) ? (t_us - chunk_us) : 0;
+
+    if(ts->cur_len > 0 || ts->cur_overrun){
+        gap = (t_first > ts->t_last_us) ? (uint32_t)(t_first - ts->t_last_us) : 0;
+        if(gap > ts->t35_us + ts->tol_us){                  //the old frame is over
+            ts->split_gap_cnt += (ts->cur_len > 0);
+            mb_rtu_ts_commit(ts);
+        }
+        else if(gap > ts->gap_max_us){
+            ts->gap_max_us = gap;
+        }
+    }
+
+    for(i = 0; i < n; i++){
+        if(ts->cur_overrun){                                //drop until a gap
+            continue;
+        }
+        if(ts->cur_len >= MB_RTU_TS_FRAME_MAX){
+            ts->cur_overrun = 1;
+            ts->cur_len     = 0;
+            ts->overrun_cnt++;
+            continue;
+        }
+        ts->cur[ts->cur_len++] = d[i];
+
+                                                            //is it a whole frame? the length must fit and the crc must pass.
+        mb_rtu_ts_expect(ts->cur, ts->cur_len, &req, &rsp);
+        if( ts->cur_len >= MB_SER_PDU_SIZE_MIN
+        && ( ts->cur_len == req || ts->cur_len == rsp )
+        && usMBCRC16(ts->cur, ts->cur_len) == 0 ){
+            ts->split_len_cnt++;
+            mb_rtu_ts_commit(ts);
+        }
+    }
+
+    ts->t_last_us = t_us;
+}
+
+
+/*******************************************************************************
+  * @brief  check the gap with time now, close the frame if the gap is over.
+  *
+  * @param  now_us = monotonic time now
+  *
+  * @retval how many completed frames are waiting to be read.
+  *
+  * @note   call it when the timer armed to mb_rtu_ts_deadline() expires.
+  *****************************************************************************/
+int32_t mb_rtu_ts_poll(MB_RTU_TS_STRU *ts, uint64_t now_us)
+{
+    if(ts->cur_len > 0 || ts->cur_overrun){
+        if(now_us >= ts->t_last_us + ts->t35_us + ts->tol_us){
+            ts->split_gap_cnt += (ts->cur_len > 0);
+            mb_rtu_ts_commit(ts);
+        }
+    }
+    return ts->q_cnt;
+}
+
+
+/*******************************************************************************
+  * @brief  when the frame under receiving will be closed by the gap.
+  *
+  * @param  ts = the engine
+  *
+  * @retval monotonic time in us, 0= no frame under receiving.
+  *****************************************************************************/
+uint64_t mb_rtu_ts_deadline(MB_RTU_TS_STRU *ts)
+{
+    if(ts->cur_len > 0 || ts->cur_overrun){
+        return ts->t_last_us + ts->t35_us + ts->tol_us;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  fentch one completed frame
+  *
+  * @param  d= where to store the frame
+            n= size of d[]
+  *
+  * @retval length of the frame, 0= no frame.
+  *****************************************************************************/
+uint16_t mb_rtu_ts_get(MB_RTU_TS_STRU *ts, uint8_t d[], uint16_t n)
+{
+    uint16_t len;
+
+    if(ts->q_cnt == 0){
+        return 0;
+    }
+
+    len = ts->q_len[ts->q_head];
+    if(len > n){
+        len = n;
+    }
+    memcpy(d, ts->q[ts->q_head], len);
+
+    ts->q_head = (ts->q_head + 1) % MB_RTU_TS_QUEUE_NUM;
+    ts->q_cnt--;
+
+    return len;
+}
+
+
+/*******************************************************************************
+******************************* Private functions ******************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  move the frame under receiving to the completed queue.
+  *
+  * @param  ts = the engine
+  *
+  * @retval none
+  *****************************************************************************/
+static void mb_rtu_ts_commit(MB_RTU_TS_STRU *ts)
+{
+    uint8_t tail;
+
+    if(ts->cur_len > 0){
+        if(ts->q_cnt >= MB_RTU_TS_QUEUE_NUM){
+            ts->qfull_cnt++;                                //nobody reads, drop the new one
+        }
+        else{
+            tail = (ts->q_head + ts->q_cnt) % MB_RTU_TS_QUEUE_NUM;
+            memcpy(ts->q[tail], ts->cur, ts->cur_len);
+            ts->q_len[tail] = ts->cur_len;
+            ts->q_cnt++;
+            ts->frame_cnt++;
+        }
+    }
+
+    ts->cur_len     = 0;
+    ts->cur_overrun = 0;
+}
+
+
+/*******************************************************************************
+  * @brief  the frame length, known from the function code and the byte count.
+  *
+  * @param  f, len = the received bytes so far
+            req = output, the length if it is a request, 0=unknown yet
+            rsp = output, the length if it is a response, 0=unknown yet
+  *
+  * @retval none
+  *
+  * @note   the engine does not know if it is on a slave or a master, so both
+            are given, the caller checks the crc at these lengths.
+  *****************************************************************************/
+static void mb_rtu_ts_expect(const uint8_t f[], uint16_t len, uint16_t *req, uint16_t *rsp)
+{
+    uint8_t fc;
+
+    *req = 0;
+    *rsp = 0;
+    if(len <= MB_SER_PDU_FUNC_OFF){
+        return;
+    }
+
+    fc = f[MB_SER_PDU_FUNC_OFF];
+    if(fc & 0x80){                                          //exception, addr+fc+code+crc
+        *rsp = 5;
+        return;
+    }
+
+    switch(fc){
+    case 1: case 2: case 3: case 4:                         //read: addr+fc+start+cnt+crc, resp: addr+fc+bytecnt+data+crc
+        *req = 8;
+        *rsp = (len > 2) ? (5 + f[2]) : 0;
+        break;
+    case 5: case 6: case 8:                                 //echo: addr+fc+4 bytes+crc
+        *req = 8;
+        *rsp = 8;
+        break;
+    case 7:
+        *req = 4;
+        *rsp = 5;
+        break;
+    case 11:
+        *req = 4;
+        *rsp = 8;
+        break;
+    case 12: case 17:
+        *req = 4;
+        *rsp = (len > 2) ? (5 + f[2]) : 0;
+        break;
+    case 15: case 16:                                       //addr+fc+start+cnt+bytecnt+data+crc, resp: addr+fc+start+cnt+crc
+        *req = (len > 6) ? (9 + f[6]) : 0;
+        *rsp = 8;
+        break;
+    case 23:                                                //addr+fc+rstart+rcnt+wstart+wcnt+bytecnt+data+crc
+        *req = (len > 10) ? (13 + f[10]) : 0;
+        *rsp = (len > 2) ? (5 + f[2]) : 0;
+        break;
+    default:
+        break;
+    }
+}
+
+#endif //#if MB_RTU_TS_ENABLED > 0
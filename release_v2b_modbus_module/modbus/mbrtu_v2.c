@@ -16,6 +16,7 @@
 
 /* ----------------------- Modbus includes ----------------------------------*/
 #include "mb.h"
+#include "mbconfig.h"
 #include "mbrtu.h"
 #include "mbframe.h"
 #include "mbcrc.h"
@@ -29,6 +30,12 @@
 #define MB_SER_PDU_SIZE_CRC     2       /*!< Size of CRC field in PDU. */
 #define MB_SER_PDU_ADDR_OFF     0       /*!< Offset of slave address in Ser-PDU. */
 #define MB_SER_PDU_PDU_OFF      1       /*!< Offset of Modbus-PDU in Ser-PDU. */
+#define MB_SER_PDU_SIZE_READ    8       /*!< Size of a FC03/04 request. */
+
+static int32_t mb_rtu_send_pdu_v(MB_SLAVE_STRU *slave, uint8_t addr, const uint8_t * pdu, uint16_t pdulen );
+#if MB_RTU_ISR_FASTPATH_ENABLED > 0
+static int32_t mb_rtu_isr_fastpath(MB_SLAVE_STRU *slave);
+#endif
 
 
 /*******************************************************************************
@@ -61,12 +68,7 @@ int32_t mb_rtu_init(MB_SLAVE_STRU *slave)
         return -1;
     }
     
-    if( slave->baudrate > 19200 ){
-        n_50us = 35;                                        //* 1,750us. */
-    }
-    else{
-        n_50us = ( 7UL * 220000UL ) / ( 2UL * (slave->baudrate) );
-    }
+    n_50us = mb_rtu_t35_us(slave->baudrate) / 50;           //* 1,750us= 35 if baud > 19200. */
                                                             //set timer's period
     if( slave->p_timer_init(( uint16_t ) n_50us) != 0 ) {
         return -2;
@@ -80,6 +82,38 @@ int32_t mb_rtu_init(MB_SLAVE_STRU *slave)
     return 0;                                               //init successfully
 }
 
+/*******************************************************************************
+  * @brief  time of one char on the line, 11 bits, start + 8 data + parity + stop
+  *
+  * @param  baudrate
+  *
+  * @retval in us
+  *****************************************************************************/
+uint32_t mb_rtu_char_us(uint32_t baudrate)
+{
+    return ( 11UL * 1000000UL ) / baudrate;
+}
+
+
+/*******************************************************************************
+  * @brief  the t35 gap between frames, see mb_rtu_init()
+  *
+  * @param  baudrate
+  *
+  * @retval in us, 1750 fixed if baud > 19200, else 3.5 chars.
+  *
+  * @note   the one timing of the rtu line, for the timer of the slave, the
+            framing by timestamps and the lines of the gateway.
+  *****************************************************************************/
+uint32_t mb_rtu_t35_us(uint32_t baudrate)
+{
+    if( baudrate > 19200 ){
+        return 1750;
+    }
+    return ( 7UL * 11UL * 1000000UL ) / ( 2UL * baudrate );
+}
+
+
 /*******************************************************************************
   * @brief  rtu enable or disable, by en/disable the serial and timer.
   *
@@ -140,8 +174,14 @@ int32_t mb_rtu_receive_pdu(MB_SLAVE_STRU *slave, uint8_t * oaddr, uint8_t ** opd
     uint16_t crc_err;
 
     //ENTER_CRITICAL_SECTION();
-                                                            // receive data to array ucRTUBuf[]*/
-    readnum = slave->p_serial_read_receive((uint8_t *)(slave->ucRTUBuf), MB_SER_PDU_SIZE_MAX);
+                                                            // receive data to array ucRTUBuf[], unless the isr has done it */
+    if(slave->isr_rx_ready){
+        slave->isr_rx_ready = 0;
+        readnum = slave->isr_rx_len;
+    }
+    else{
+        readnum = slave->p_serial_read_receive((uint8_t *)(slave->ucRTUBuf), MB_SER_PDU_SIZE_MAX);
+    }
     if(readnum > MB_SER_PDU_SIZE_MAX){
         return -1;
     }
@@ -182,6 +222,11 @@ int32_t mb_rtu_receive_pdu(MB_SLAVE_STRU *slave, uint8_t * oaddr, uint8_t ** opd
   * @note   what's doing? 
   			...1. only start sending, do not know when sending is done.
             ...2. call port/ serial enable() and serial send().
+            ...3. a FC05/06 response is the request as it is, its crc is still in
+                  ucRTUBuf, so it is not calculated again.
+            ...4. if the port has p_serial_start_sendv, the adu goes as 3 pieces,
+                  the pdu is not moved, so it may be anywhere, not only in
+                  ucRTUBuf, see mb_rtu_send_pdu_v().
             ...adu: [ addr(1B) |  pdu(function code 1B + data NB)  | CRC(2B) ]
                     -----------  ---------------------------------   --------
   *****************************************************************************/
@@ -193,6 +238,10 @@ int32_t mb_rtu_send_pdu(MB_SLAVE_STRU *slave, uint8_t addr, const uint8_t * pdu,
 
     //ENTER_CRITICAL_SECTION(  );
 
+    if(slave->p_serial_start_sendv != 0){
+        return mb_rtu_send_pdu_v(slave, addr, pdu, pdulen);
+    }
+
     padu = ( uint8_t * ) pdu - 1;                           //adu = pdu - 1
     if(slave->ucRTUBuf != padu){                            //check if padu is right, actuall padu is slave->ucRTUBuf[], there is no need to calculate
         return __LINE__;
@@ -202,10 +251,15 @@ int32_t mb_rtu_send_pdu(MB_SLAVE_STRU *slave, uint8_t addr, const uint8_t * pdu,
     padu[MB_SER_PDU_ADDR_OFF] = addr;                       //adu[0] is addr
     adulen += pdulen;
 
-                                                            //Calculate CRC16 checksum
-    val_crc16 = usMBCRC16( ( uint8_t * ) padu, adulen );
-    slave->ucRTUBuf[adulen++] = ( uint8_t )( val_crc16 & 0xFF);
-    slave->ucRTUBuf[adulen++] = ( uint8_t )( val_crc16 >> 8);
+    if( slave->tx_echo == MB_TX_ECHO_FULL ){                //the request's crc is the response's crc
+        adulen += MB_SER_PDU_SIZE_CRC;
+    }
+    else{                                                   //Calculate CRC16 checksum
+        val_crc16 = usMBCRC16( ( uint8_t * ) padu, adulen );
+        slave->ucRTUBuf[adulen++] = ( uint8_t )( val_crc16 & 0xFF);
+        slave->ucRTUBuf[adulen++] = ( uint8_t )( val_crc16 >> 8);
+    }
+    slave->tx_echo = MB_TX_ECHO_NONE;
     
     slave->p_serial_enable(0 , 1 /*TX*/ ); 
     slave->p_serial_start_send((uint8_t*)padu, adulen);     //adulen = 1 + pdulen + 2
@@ -215,6 +269,49 @@ int32_t mb_rtu_send_pdu(MB_SLAVE_STRU *slave, uint8_t addr, const uint8_t * pdu,
 }
 
 
+/*******************************************************************************
+  * @brief  rtu start send a frame by pieces, header/payload/trailer.
+  *
+  * @param  addr = slave's address
+            pdu = pdu pointer, anywhere, kept by the caller until tx done
+            pdulen = length of pdu
+  *
+  * @retval 0=OK
+  *
+  * @note   the addr and crc pieces are in slave->tx_addr/tx_crc, the crc runs
+            over the pieces. for a FC05/06 echo the crc of the request is sent
+            where it is, after the pdu in ucRTUBuf.
+  *****************************************************************************/
+static int32_t mb_rtu_send_pdu_v(MB_SLAVE_STRU *slave, uint8_t addr, const uint8_t * pdu, uint16_t pdulen )
+{
+    MB_IOVEC_STRU v[MB_IOVEC_MAX];
+    uint16_t      val_crc16;                                //value of crc16
+
+    slave->tx_addr = addr;
+    v[0].p   = &slave->tx_addr;
+    v[0].len = 1;
+    v[1].p   = pdu;
+    v[1].len = pdulen;
+
+    if( slave->tx_echo == MB_TX_ECHO_FULL && pdu == &slave->ucRTUBuf[MB_SER_PDU_PDU_OFF] ){
+        v[2].p = pdu + pdulen;                              //the request's crc is the response's crc
+    }
+    else{
+        val_crc16 = usMBCRC16Continue( 0xFFFF, &slave->tx_addr, 1 );
+        val_crc16 = usMBCRC16Continue( val_crc16, pdu, pdulen );
+        slave->tx_crc[0] = ( uint8_t )( val_crc16 & 0xFF);
+        slave->tx_crc[1] = ( uint8_t )( val_crc16 >> 8);
+        v[2].p = slave->tx_crc;
+    }
+    v[2].len = MB_SER_PDU_SIZE_CRC;
+    slave->tx_echo = MB_TX_ECHO_NONE;
+
+    slave->p_serial_enable(0 , 1 /*TX*/ );
+    slave->p_serial_start_sendv(v, MB_IOVEC_MAX);           //the port keeps the pieces, not the array
+    return 0;
+}
+
+
 /*******************************************************************************
   * @brief  Notify the listener that a new frame was received.
   *
@@ -223,6 +320,8 @@ int32_t mb_rtu_send_pdu(MB_SLAVE_STRU *slave, uint8_t addr, const uint8_t * pdu,
   *
   * @note   [2019.1017 by liq]
             this function is reenterable , it's called in isr.
+            if MB_RTU_ISR_FASTPATH_ENABLED and slave->isr_fastpath, a FC03/04
+            request is answered here, others are posted to mb_poll().
 
 void TIM4_IRQHandler(void)
 {
@@ -235,6 +334,16 @@ void TIM4_IRQHandler(void)
  ******************************************************************************/
 void mb_rtu_t35_callback(MB_SLAVE_STRU *slave)
 {
+#if MB_RTU_ISR_FASTPATH_ENABLED > 0
+    if(slave->isr_fastpath){
+        slave->p_timer_enable(0);
+        if(mb_rtu_isr_fastpath(slave) != 0){
+            slave->isr_defer_cnt++;
+            slave->p_event_post( EV_FRAME_RECEIVED );
+        }
+        return;
+    }
+#endif
 
     slave->p_event_post( EV_FRAME_RECEIVED );
     
@@ -271,5 +380,47 @@ void mb_rtu_bus_send_done_callback(MB_SLAVE_STRU *slave)
 }
 
 
+#if MB_RTU_ISR_FASTPATH_ENABLED > 0
+/*******************************************************************************
+  * @brief  read the frame in isr, and answer it at once if it is a FC03/04.
+  *
+  * @param  slave
+  *
+  * @retval 0= answered, other= left to mb_poll(), the frame is kept in
+            ucRTUBuf, mb_rtu_receive_pdu() does not read it again.
+  *
+  * @note   no frame comes during mb_poll() is working on ucRTUBuf, the master
+            waits for the answer of the last request.
+  *****************************************************************************/
+static int32_t mb_rtu_isr_fastpath(MB_SLAVE_STRU *slave)
+{
+    int32_t readnum;
+
+    readnum = slave->p_serial_read_receive((uint8_t *)(slave->ucRTUBuf), MB_SER_PDU_SIZE_MAX);
+    slave->isr_rx_len   = (readnum > 0) ? (uint16_t)readnum : 0;
+    slave->isr_rx_ready = 1;
+
+    if(readnum != MB_SER_PDU_SIZE_READ){
+        return __LINE__;
+    }
+    if(usMBCRC16((uint8_t *)(slave->ucRTUBuf), MB_SER_PDU_SIZE_READ) != 0){
+        return __LINE__;
+    }
+
+    slave->targetaddr = slave->ucRTUBuf[MB_SER_PDU_ADDR_OFF];
+    slave->p_pdu      = (uint8_t *) & (slave->ucRTUBuf[MB_SER_PDU_PDU_OFF]);
+    slave->pdu_len    = MB_SER_PDU_SIZE_READ - MB_SER_PDU_PDU_OFF - MB_SER_PDU_SIZE_CRC;
+    if(mb_execute_isr(slave) != 0){
+        return __LINE__;
+    }
+
+    slave->isr_rx_ready = 0;
+    slave->isr_fast_cnt++;
+    mb_rtu_send_pdu(slave, slave->targetaddr, slave->p_pdu, slave->pdu_len);
+    return 0;
+}
+#endif
+
+
 /********************************* end of file ********************************/
 
@@ -0,0 +1,223 @@
+/**
+  ******************************************************************************
+  * @file    module of the scan scheduler of the modbus master
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2022/01/06
+  * @brief   each poll:
+                - a group whose release time came gets its scan released,
+                  due 'deadline_ms' after.
+                - a released scan past its due time is missed, it goes on as
+                  the scan of the next period, release and due one period
+                  later, so it does not take the bus from the groups which
+                  are in time.
+                - the released scan due first sends its next read, the one
+                  of the shorter period first on a tie. a read is not cut,
+                  so a scan waits at most one read of another group.
+             the times are of m->p_tick_ms(), in ms, compared by the signed
+             difference so the tick may wrap.
+  *
+  ******************************************************************************
+  */
+
+/* ----------------------- System includes ----------------------------------*/
+#include <stdint.h>
+#include "string.h"
+
+/* ----------------------- Modbus includes ----------------------------------*/
+#include "mb.h"
+#include "mbconfig.h"
+#include "mbmaster.h"
+#include "mbplan.h"
+#include "mbsched.h"
+
+#if MB_MASTER_ENABLED > 0
+
+/*******************************************************************************
+******************************** Private define ********************************
+*******************************************************************************/
+#define MB_SCHED_BEFORE(a, b)   ( (int32_t)((a) - (b)) < 0 )    /*!< time a is before b, over a wrap. */
+
+/* scheduler's state, as the one of the master */
+typedef enum
+{
+    STATE_NOT_INITIALIZED,
+    STATE_READY,
+} MB_SCHED_STATE_ENUM;
+
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static void     mb_sched_release    (MB_SCHED_GROUP_STRU *g, uint32_t now);
+static void     mb_sched_done       (MB_SCHED_GROUP_STRU *g, uint32_t now);
+static uint32_t mb_sched_diff       (uint32_t a, uint32_t b);
+
+
+/*******************************************************************************
+  * @brief  init the scheduler, all the groups are released at once
+  *
+  * @param  s, its cfg is set, the plans built, the master enabled
+  *
+  * @retval 0= OK, other= error, eg. no group.
+  *
+  * @note   it may be called again, to start over, the statistics too.
+            'load_pm' tells if the groups fit the bus, the scheduler runs
+            anyway, over 1000 the slower groups skip periods.
+  *****************************************************************************/
+int32_t mb_sched_init(MB_SCHED_STRU *s)
+{
+    MB_SCHED_GROUP_STRU *g;
+    uint32_t             now;
+    uint16_t             i;
+
+    if(s == 0 || s->p_master == 0 || s->p_master->p_tick_ms == 0 || s->p_groups == 0 || s->group_num == 0){
+        return __LINE__;
+    }
+    now         = s->p_master->p_tick_ms();
+    s->load_pm  = 0;
+    s->read_cnt = 0;
+    s->idle_cnt = 0;
+    for(i = 0; i < s->group_num; i++){
+        g = &s->p_groups[i];
+        if(g->p_plan == 0 || g->period_ms == 0){
+            return __LINE__;
+        }
+        if(g->deadline_ms == 0){
+            g->deadline_ms = g->period_ms;
+        }
+        s->load_pm += g->p_plan->scan_us / g->period_ms;    //us per ms is per mille
+        g->active        = 0;
+        g->next          = 0;
+        g->release_ms    = now;
+        g->done_ms       = now;
+        g->scan_cnt      = 0;                               //the statistics start again, as the scans
+        g->miss_cnt      = 0;
+        g->skip_cnt      = 0;
+        g->lat_max_ms    = 0;
+        g->resp_max_ms   = 0;
+        g->jitter_max_ms = 0;
+        g->jitter_sum_ms = 0;
+    }
+    s->state = STATE_READY;
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  send the next read of the scan due first
+  *
+  * @param  s
+  *
+  * @retval 0= a read was sent, call again at once,
+            > 0 = no scan released, the ms until the next release,
+            < 0 = error.
+  *
+  * @note   it blocks for the read, its answer or its timeout, see
+            mb_master_request().
+  *****************************************************************************/
+int32_t mb_sched_poll(MB_SCHED_STRU *s)
+{
+    MB_SCHED_GROUP_STRU *g, *best = 0;
+    uint32_t             now, wait = 0xFFFFFFFFUL;
+    uint16_t             i;
+
+    if(s == 0 || s->state != STATE_READY){
+        return MB_MASTER_ESTATE;
+    }
+    now = s->p_master->p_tick_ms();
+
+    for(i = 0; i < s->group_num; i++){
+        g = &s->p_groups[i];
+        if(!g->active){
+            if(MB_SCHED_BEFORE(now, g->release_ms)){        //not yet, how long to sleep
+                if(g->release_ms - now < wait){
+                    wait = g->release_ms - now;
+                }
+                continue;
+            }
+            mb_sched_release(g, now);
+        }
+        while(MB_SCHED_BEFORE(g->due_ms, now)){             //missed, goes on as the next period's scan
+            g->miss_cnt++;
+            g->skip_cnt++;
+            g->release_ms += g->period_ms;
+            g->due_ms     += g->period_ms;
+        }
+        if(best == 0 || MB_SCHED_BEFORE(g->due_ms, best->due_ms)
+           || (g->due_ms == best->due_ms && g->period_ms < best->period_ms)){
+            best = g;
+        }
+    }
+    if(best == 0){
+        s->idle_cnt++;
+        return (int32_t)(wait ? wait : 1);
+    }
+
+    if(best->next == 0){                                    //the first read of the scan
+        if(mb_sched_diff(now, best->release_ms) > best->lat_max_ms){
+            best->lat_max_ms = mb_sched_diff(now, best->release_ms);
+        }
+    }
+    if(best->next < best->p_plan->req_num){
+        (void)mb_plan_read(best->p_plan, s->p_master, best->next);  //a failed read is in its 'result'
+        best->next++;
+        s->read_cnt++;
+    }
+    if(best->next >= best->p_plan->req_num){
+        mb_sched_done(best, s->p_master->p_tick_ms());
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+******************************* Private functions ******************************
+*******************************************************************************/
+static void mb_sched_release(MB_SCHED_GROUP_STRU *g, uint32_t now)
+{
+    uint32_t n = mb_sched_diff(now, g->release_ms) / g->period_ms;
+
+    if(n > 0){                                              //behind by whole periods, eg. a long read of another group
+        g->skip_cnt   += n;                                 //...they had no scan, so missed
+        g->miss_cnt   += n;
+        g->release_ms += n * g->period_ms;
+    }
+    g->active = 1;
+    g->next   = 0;
+    g->due_ms = g->release_ms + g->deadline_ms;
+}
+
+
+static void mb_sched_done(MB_SCHED_GROUP_STRU *g, uint32_t now)
+{
+    uint32_t t, j;
+
+    t = mb_sched_diff(now, g->release_ms);
+    if(t > g->resp_max_ms){
+        g->resp_max_ms = t;
+    }
+    if(MB_SCHED_BEFORE(g->due_ms, now)){                    //done, but late
+        g->miss_cnt++;
+    }
+    if(g->scan_cnt > 0){
+        t = mb_sched_diff(now, g->done_ms);
+        j = t > g->period_ms ? t - g->period_ms : g->period_ms - t;
+        if(j > g->jitter_max_ms){
+            g->jitter_max_ms = j;
+        }
+        g->jitter_sum_ms += j;
+    }
+    g->scan_cnt++;
+    g->done_ms     = now;
+    g->active      = 0;
+    g->next        = 0;
+    g->release_ms += g->period_ms;
+}
+
+
+static uint32_t mb_sched_diff(uint32_t a, uint32_t b)
+{
+    return MB_SCHED_BEFORE(a, b) ? 0 : a - b;
+}
+
+#endif //#if MB_MASTER_ENABLED > 0
@@ -0,0 +1,596 @@
+/**
+  ******************************************************************************
+  * @file    module of the connections of a modbus tcp server
+  * @author  arthur.qiang.li
+  * @version V1
+  * @date    2021/12/04
+  * @brief   the table of clients of a tcp port, each one has its own receive
+             buffer and MBAP state, so a slow client or a half received adu
+             does not block the others. the requests are taken round robin,
+             one from each connection in turn, so every client gets the same
+             share of mb_poll() and of the registers behind it.
+             made for many clients, eg. 10k: open, close and the next request
+             are O(1), a free stack and a ready queue, no scan of the table.
+             the receive buffers are slabs, a client holds one only while it
+             has bytes not served, so an idle client costs its small entry.
+             the receive buffer is a stream reassembler, a client may send
+             the next requests before the responses (pipelining), several
+             adus in one segment and an adu split over segments are both OK.
+             the adus of a client are served in the order they came, each
+             response carries the MBAP, so the transaction id, of its request.
+             zero copy, mb_tcp_conn_next_ref() gives the adu where it was
+             received, the lib parses it and builds the response there. it is
+             copied only if other bytes of the client are behind it, as the
+             response may be longer than the request.
+  *
+  ******************************************************************************
+  */
+
+/* ----------------------- System includes ----------------------------------*/
+#include <stdint.h>
+#include "string.h"
+
+/* ----------------------- Modbus includes ----------------------------------*/
+#include "mbtcp_conn.h"
+
+#if MB_TCP_ENABLED > 0
+
+/*******************************************************************************
+************************* Private function declaration *************************
+*******************************************************************************/
+static int32_t  mb_tcp_conn_adu_len (const uint8_t d[], uint16_t n);
+static int32_t  mb_tcp_conn_head    (const MB_TCP_CONN_STRU *c);
+static void     mb_tcp_conn_take    (MB_TCP_CONN_TABLE_STRU *tbl, MB_TCP_CONN_STRU *c, int32_t alen);
+static void     mb_tcp_conn_rq_push (MB_TCP_CONN_TABLE_STRU *tbl, int32_t idx);
+static uint8_t *mb_tcp_conn_slab_get(MB_TCP_CONN_TABLE_STRU *tbl);
+static void     mb_tcp_conn_slab_put(MB_TCP_CONN_TABLE_STRU *tbl, MB_TCP_CONN_STRU *c);
+
+/*******************************************************************************
+  * @brief  init the table, no connection.
+  *
+  * @param  tbl = the table
+  *
+  * @retval none
+  *****************************************************************************/
+void mb_tcp_conn_init(MB_TCP_CONN_TABLE_STRU *tbl)
+{
+    int32_t i;
+
+    memset(tbl, 0, sizeof(MB_TCP_CONN_TABLE_STRU));
+    tbl->cur = MB_TCP_CONN_NONE;
+    for(i = 0; i < MB_TCP_CONN_MAX; i++){                   //popped from the top, so 0 is given first
+        tbl->conn_free[i] = (uint16_t)(MB_TCP_CONN_MAX - 1 - i);
+    }
+    tbl->conn_free_num = MB_TCP_CONN_MAX;
+    for(i = 0; i < MB_TCP_SLAB_NUM; i++){
+        tbl->slab_free[i] = (uint16_t)(MB_TCP_SLAB_NUM - 1 - i);
+    }
+    tbl->slab_free_num = MB_TCP_SLAB_NUM;
+}
+
+
+/*******************************************************************************
+  * @brief  a client is accepted, give it a connection.
+  *
+  * @param  tbl = the table
+            handle = of the port, given back by mb_tcp_conn_cur()
+  *
+  * @retval index of the connection, MB_TCP_CONN_NONE= the table is full, the
+            port should close the client.
+  *****************************************************************************/
+int32_t mb_tcp_conn_open(MB_TCP_CONN_TABLE_STRU *tbl, intptr_t handle)
+{
+    MB_TCP_CONN_STRU *c;
+    int32_t           idx;
+    uint8_t           in_rq, rx_paused;
+
+    if(tbl->conn_free_num == 0){
+        tbl->refuse_cnt++;
+        return MB_TCP_CONN_NONE;
+    }
+    idx   = tbl->conn_free[--tbl->conn_free_num];
+    c     = &tbl->conn[idx];
+    in_rq     = c->in_rq;                                   //a stale entry of the closed one may be in the queue
+    rx_paused = c->rx_paused;                               //or in the list of the port
+    memset(c, 0, sizeof(MB_TCP_CONN_STRU));
+    c->in_rq     = in_rq;
+    c->rx_paused = rx_paused;
+    c->used    = 1;
+    c->handle  = handle;
+    c->last_ms = tbl->now_ms;
+    tbl->num++;
+    tbl->open_cnt++;
+    c->open_no = tbl->open_cnt;
+    return idx;
+}
+
+
+/*******************************************************************************
+  * @brief  the client is gone or closed by the port, free its connection.
+  *
+  * @param  tbl = the table
+            idx = the connection
+  *
+  * @retval none
+  *
+  * @note   a request of it being served is not answered, mb_tcp_conn_cur()
+            returns MB_TCP_CONN_NONE.
+  *****************************************************************************/
+void mb_tcp_conn_close(MB_TCP_CONN_TABLE_STRU *tbl, int32_t idx)
+{
+    if(idx < 0 || idx >= MB_TCP_CONN_MAX || tbl->conn[idx].used == 0){
+        return;
+    }
+    mb_tcp_conn_slab_put(tbl, &tbl->conn[idx]);
+    tbl->conn[idx].used   = 0;
+    tbl->conn[idx].rxhead = 0;
+    tbl->conn[idx].rxpos  = 0;
+    tbl->conn[idx].zc_len = 0;
+    tbl->conn_free[tbl->conn_free_num++] = (uint16_t)idx;   //its entry in the ready queue, if any, is skipped
+    if(tbl->cur == idx){
+        tbl->cur = MB_TCP_CONN_NONE;
+    }
+    tbl->num--;
+    tbl->close_cnt++;
+}
+
+
+/*******************************************************************************
+  * @brief  where to put the bytes received from a client.
+  *
+  * @param  tbl = the table
+            idx = the connection
+            space = output, how many bytes can be put there
+  *
+  * @retval the place in the receive buffer, call mb_tcp_conn_rxdone() after
+            writing. 0= bad idx, or no slab is free.
+  *
+  * @note   space is 0 when the buffer is full of adus not served yet, or
+            the response of the client is built in it, or no slab is free,
+            the port stops reading the client until mb_poll() serves one, the
+            bytes wait in the socket and tcp flow control slows the client.
+            the bytes not served are moved to the front only when they are a
+            part of an adu, eg. an adu split over segments.
+  *****************************************************************************/
+uint8_t *mb_tcp_conn_rxspace(MB_TCP_CONN_TABLE_STRU *tbl, int32_t idx, uint16_t *space)
+{
+    MB_TCP_CONN_STRU *c;
+    uint16_t          n;
+
+    if(idx < 0 || idx >= MB_TCP_CONN_MAX || tbl->conn[idx].used == 0){
+        *space = 0;
+        return 0;
+    }
+    c = &tbl->conn[idx];
+    if(c->zc_len > 0){                                      //served in place, the response goes after the request
+        *space = 0;
+        return &c->rxbuf[c->rxpos];
+    }
+    if(c->rxbuf == 0){
+        c->rxbuf = mb_tcp_conn_slab_get(tbl);
+        if(c->rxbuf == 0){                                  //all taken, try again after a request is served
+            *space = 0;
+            return 0;
+        }
+    }
+    if(c->rxhead > 0 && mb_tcp_conn_head(c) == 0){          //only a part of an adu is left, move it, it is short
+        n = c->rxpos - c->rxhead;
+        memmove(c->rxbuf, &c->rxbuf[c->rxhead], n);
+        tbl->copy_bytes += n;
+        c->rxhead = 0;
+        c->rxpos  = n;
+    }
+    *space = (uint16_t)(MB_TCP_BUF_SIZE - c->rxpos);
+    return &c->rxbuf[c->rxpos];
+}
+
+
+/*******************************************************************************
+  * @brief  n bytes are written to the place given by mb_tcp_conn_rxspace().
+  *
+  * @param  tbl = the table
+            idx = the connection
+            n = the bytes, any piece of the stream
+  *
+  * @retval 0= OK, other= the stream is broken, a bad MBAP length, all the
+            buffer is dropped, the port may close the client.
+  *
+  * @note   the MBAP of every adu in the buffer is checked, a bad LEN breaks
+            the framing of all that follows.
+  *****************************************************************************/
+int32_t mb_tcp_conn_rxdone(MB_TCP_CONN_TABLE_STRU *tbl, int32_t idx, uint16_t n)
+{
+    MB_TCP_CONN_STRU *c;
+    uint16_t          off;
+    int32_t           alen;
+
+    if(idx < 0 || idx >= MB_TCP_CONN_MAX || tbl->conn[idx].used == 0){
+        return -1;
+    }
+    c = &tbl->conn[idx];
+    if(c->rxbuf == 0 || c->rxpos + n > MB_TCP_BUF_SIZE){
+        return -2;
+    }
+    c->rxpos    += n;
+    c->rx_bytes += n;
+    c->last_ms   = tbl->now_ms;
+
+    for(off = c->rxhead; off < c->rxpos; off += (uint16_t)alen){
+        alen = mb_tcp_conn_adu_len(&c->rxbuf[off], (uint16_t)(c->rxpos - off));
+        if(alen < 0){                                       //bad MBAP
+            tbl->drop_cnt += c->rxpos - c->rxhead;
+            c->rxhead = 0;
+            c->rxpos  = 0;
+            mb_tcp_conn_slab_put(tbl, c);
+            return -3;
+        }
+        if(alen == 0){
+            break;                                          //MBAP not complete yet
+        }
+    }
+    if(c->in_rq == 0 && c->tx_hold == 0 && mb_tcp_conn_head(c) > 0){
+        mb_tcp_conn_rq_push(tbl, idx);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+  * @brief  take the next request, round robin over the connections, copy it.
+  *
+  * @param  tbl = the table
+            d = output the adu, MBAP + pdu, eg. slave->ucRTUBuf
+            len = output the adu len
+  *
+  * @retval index of the connection of the request, it is also the current
+            one, MB_TCP_CONN_NONE= no request.
+  *
+  * @note   a connection goes to the end of the ready queue after each
+            request, so a busy client can not starve the others.
+  *****************************************************************************/
+int32_t mb_tcp_conn_next(MB_TCP_CONN_TABLE_STRU *tbl, uint8_t d[], uint16_t *len)
+{
+    uint8_t *adu;
+    int32_t  idx;
+
+    idx = mb_tcp_conn_next_ref(tbl, d, &adu, len);
+    if(idx != MB_TCP_CONN_NONE && adu != d){                //it is in place, copy it and free the buffer
+        memcpy(d, adu, *len);
+        tbl->copy_bytes += *len;
+        mb_tcp_conn_done(tbl);
+    }
+    return idx;
+}
+
+
+/*******************************************************************************
+  * @brief  take the next request, round robin over the connections, in place
+            if it can be.
+  *
+  * @param  tbl = the table
+            d = the buffer to copy the adu to if it can not be served in
+                place, MB_TCP_BUF_SIZE at least, eg. slave->ucRTUBuf
+            adu = output the adu, MBAP + pdu, d[] or the receive buffer
+            len = output the adu len
+  *
+  * @retval index of the connection of the request, it is also the current
+            one, MB_TCP_CONN_NONE= no request.
+  *
+  * @note   in place, if the adu is alone in the receive buffer, from its
+            start. so there is MB_TCP_BUF_SIZE for the response, and no other
+            adu is overwritten. the buffer is kept until mb_tcp_conn_done().
+            the request before is done at first.
+  *****************************************************************************/
+int32_t mb_tcp_conn_next_ref(MB_TCP_CONN_TABLE_STRU *tbl, uint8_t d[], uint8_t **adu, uint16_t *len)
+{
+    MB_TCP_CONN_STRU *c;
+    int32_t           idx, alen;
+
+    mb_tcp_conn_done(tbl);
+
+    while(tbl->rq_num > 0){
+        idx          = tbl->rq[tbl->rq_head];
+        tbl->rq_head = (uint16_t)((tbl->rq_head + 1) % MB_TCP_CONN_MAX);
+        tbl->rq_num--;
+        c            = &tbl->conn[idx];
+        c->in_rq     = 0;
+        if(c->used == 0 || c->tx_hold){
+            continue;                                       //closed after it was queued, or held, mb_tcp_conn_hold() queues it again
+        }
+        alen = mb_tcp_conn_head(c);
+        if(alen <= 0){
+            continue;
+        }
+
+        if(c->rxhead == 0 && c->rxpos == alen){             //alone, serve it in place
+            *adu      = c->rxbuf;
+            c->zc_len = (uint16_t)alen;
+            tbl->zc_adu++;
+        }
+        else{                                               //the next adus of a pipelining client are behind it
+            memcpy(d, &c->rxbuf[c->rxhead], alen);
+            tbl->copy_bytes += alen;
+            mb_tcp_conn_take(tbl, c, alen);
+            *adu = d;
+            if(mb_tcp_conn_head(c) > 0){                    //the next one is complete too, back to the end
+                mb_tcp_conn_rq_push(tbl, idx);
+            }
+        }
+        *len = (uint16_t)alen;
+        c->rx_adu++;
+
+        tbl->cur = idx;
+        return idx;
+    }
+
+    tbl->cur = MB_TCP_CONN_NONE;
+    return MB_TCP_CONN_NONE;
+}
+
+
+/*******************************************************************************
+  * @brief  the current request is done, the response is sent or dropped.
+  *
+  * @param  tbl = the table
+  *
+  * @retval none
+  *
+  * @note   it frees the receive buffer of a request served in place, the port
+            calls it after mb_poll(), then the client can be read again.
+            the request was alone, so the slab goes back to the free ones.
+  *****************************************************************************/
+void mb_tcp_conn_done(MB_TCP_CONN_TABLE_STRU *tbl)
+{
+    MB_TCP_CONN_STRU *c;
+
+    if(tbl->cur == MB_TCP_CONN_NONE){
+        return;
+    }
+    c = &tbl->conn[tbl->cur];
+    if(c->used && c->zc_len > 0){
+        mb_tcp_conn_take(tbl, c, c->zc_len);
+        c->zc_len = 0;
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  hold the requests of a connection, or let them go again.
+  *
+  * @param  tbl = the table
+            idx = the connection
+            on = 1= hold, 0= release
+  *
+  * @retval none
+  *
+  * @note   the port holds a pipelining client while it has no room for one
+            more response, eg. its tx buffer is full and a send is not over.
+            mb_tcp_conn_next() skips it, its requests wait in the receive
+            buffer, then the port stops reading it and tcp flow control slows
+            the client. released, it goes to the end of the ready queue if it
+            has a complete request. a client which never reads is closed by
+            the idle timeout, it sends nothing more.
+  *****************************************************************************/
+void mb_tcp_conn_hold(MB_TCP_CONN_TABLE_STRU *tbl, int32_t idx, uint8_t on)
+{
+    MB_TCP_CONN_STRU *c;
+
+    if(idx < 0 || idx >= MB_TCP_CONN_MAX || tbl->conn[idx].used == 0){
+        return;
+    }
+    c          = &tbl->conn[idx];
+    c->tx_hold = on ? 1 : 0;
+    if(c->tx_hold == 0 && c->in_rq == 0 && mb_tcp_conn_head(c) > 0){
+        mb_tcp_conn_rq_push(tbl, idx);
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  how many connections have a complete request
+  *
+  * @param  tbl = the table
+  *
+  * @retval the number, the port posts EV_FRAME_RECEIVED again if it is > 0.
+  *
+  * @note   the length of the ready queue, it may count a client closed
+            meanwhile, then mb_tcp_conn_next() just finds nothing.
+  *****************************************************************************/
+int32_t mb_tcp_conn_ready(MB_TCP_CONN_TABLE_STRU *tbl)
+{
+    return tbl->rq_num;
+}
+
+
+/*******************************************************************************
+  * @brief  find a connection idle for more than MB_TCP_IDLE_TIMEOUT_MS.
+  *
+  * @param  tbl = the table
+            now_ms = time of the port in ms, it may wrap
+  *
+  * @retval its index, the port closes it and calls again,
+            MB_TCP_CONN_NONE= no more.
+  *
+  * @note   the port calls it in its loop, eg. each mb_poll(). the table is
+            swept once per MB_TCP_IDLE_TIMEOUT_MS / 8, so it costs nothing most
+            of the times. a connection with a request being served is not idle.
+  *****************************************************************************/
+int32_t mb_tcp_conn_idle(MB_TCP_CONN_TABLE_STRU *tbl, uint32_t now_ms)
+{
+#if MB_TCP_IDLE_TIMEOUT_MS > 0
+    MB_TCP_CONN_STRU *c;
+    int32_t           idx;
+#endif
+
+    tbl->now_ms = now_ms;
+#if MB_TCP_IDLE_TIMEOUT_MS > 0
+    if(tbl->sweep_idx == 0 && (uint32_t)(now_ms - tbl->sweep_ms) < MB_TCP_IDLE_TIMEOUT_MS / 8){
+        return MB_TCP_CONN_NONE;
+    }
+    while(tbl->sweep_idx < MB_TCP_CONN_MAX){
+        idx = tbl->sweep_idx++;
+        c   = &tbl->conn[idx];
+        if(c->used && c->zc_len == 0
+        && (uint32_t)(now_ms - c->last_ms) > MB_TCP_IDLE_TIMEOUT_MS){
+            tbl->idle_cnt++;
+            return idx;
+        }
+    }
+    tbl->sweep_idx = 0;
+    tbl->sweep_ms  = now_ms;
+#endif
+    return MB_TCP_CONN_NONE;
+}
+
+
+/*******************************************************************************
+  * @brief  the connection to send the response to
+  *
+  * @param  tbl = the table
+            handle = output, the handle of the port
+  *
+  * @retval its index, MB_TCP_CONN_NONE= it is closed meanwhile.
+  *****************************************************************************/
+int32_t mb_tcp_conn_cur(MB_TCP_CONN_TABLE_STRU *tbl, intptr_t *handle)
+{
+    if(tbl->cur == MB_TCP_CONN_NONE || tbl->conn[tbl->cur].used == 0){
+        return MB_TCP_CONN_NONE;
+    }
+    *handle = tbl->conn[tbl->cur].handle;
+    tbl->conn[tbl->cur].tx_adu++;
+    return tbl->cur;
+}
+
+
+/*******************************************************************************
+********************************************************************************
+*                              private functions                               *
+********************************************************************************
+*******************************************************************************/
+
+/*******************************************************************************
+  * @brief  length of the complete adu at the head of a connection
+  *
+  * @param  c = the connection
+  *
+  * @retval 6 + LEN, 0= no complete adu, or it is being served in place.
+  *****************************************************************************/
+static int32_t mb_tcp_conn_head(const MB_TCP_CONN_STRU *c)
+{
+    int32_t alen;
+
+    if(c->zc_len > 0){
+        return 0;
+    }
+    alen = mb_tcp_conn_adu_len(&c->rxbuf[c->rxhead], (uint16_t)(c->rxpos - c->rxhead));
+    if(alen <= 0 || c->rxpos - c->rxhead < alen){
+        return 0;
+    }
+    return alen;
+}
+
+
+/*******************************************************************************
+  * @brief  the adu at the head is taken, step over it.
+  *
+  * @param  tbl = the table
+            c = the connection
+            alen = its length
+  *
+  * @retval none
+  *****************************************************************************/
+static void mb_tcp_conn_take(MB_TCP_CONN_TABLE_STRU *tbl, MB_TCP_CONN_STRU *c, int32_t alen)
+{
+    c->rxhead += (uint16_t)alen;
+    if(c->rxhead >= c->rxpos){                              //empty, back to the start for free
+        c->rxhead = 0;
+        c->rxpos  = 0;
+        mb_tcp_conn_slab_put(tbl, c);
+    }
+}
+
+
+/*******************************************************************************
+  * @brief  a connection has a complete request, put it at the end of the
+            ready queue.
+  *
+  * @param  tbl = the table
+            idx = the connection, not in the queue
+  *
+  * @retval none
+  *
+  * @note   a connection is in the queue once at most, so MB_TCP_CONN_MAX
+            entries are enough.
+  *****************************************************************************/
+static void mb_tcp_conn_rq_push(MB_TCP_CONN_TABLE_STRU *tbl, int32_t idx)
+{
+    tbl->rq[(tbl->rq_head + tbl->rq_num) % MB_TCP_CONN_MAX] = (uint16_t)idx;
+    tbl->rq_num++;
+    tbl->conn[idx].in_rq = 1;
+}
+
+
+/*******************************************************************************
+  * @brief  take a free slab, a receive buffer.
+  *
+  * @param  tbl = the table
+  *
+  * @retval the slab, 0= none is free.
+  *****************************************************************************/
+static uint8_t *mb_tcp_conn_slab_get(MB_TCP_CONN_TABLE_STRU *tbl)
+{
+    uint32_t used;
+
+    if(tbl->slab_free_num == 0){
+        tbl->slab_wait_cnt++;
+        return 0;
+    }
+    used = MB_TCP_SLAB_NUM - tbl->slab_free_num + 1;
+    if(used > tbl->slab_max){
+        tbl->slab_max = used;
+    }
+    return tbl->slab[tbl->slab_free[--tbl->slab_free_num]];
+}
+
+
+/*******************************************************************************
+  * @brief  the connection has no bytes left, give its slab back.
+  *
+  * @param  tbl = the table
+            c = the connection, it may have no slab
+  *
+  * @retval none
+  *****************************************************************************/
+static void mb_tcp_conn_slab_put(MB_TCP_CONN_TABLE_STRU *tbl, MB_TCP_CONN_STRU *c)
+{
+    if(c->rxbuf == 0){
+        return;
+    }
+    tbl->slab_free[tbl->slab_free_num++] = (uint16_t)((c->rxbuf - tbl->slab[0]) / MB_TCP_BUF_SIZE);
+    c->rxbuf = 0;
+}
+
+
+/*******************************************************************************
+  * @brief  length of the adu which starts at d[0], from the MBAP
+  *
+  * @param  d, n = the bytes from the adu on
+  *
+  * @retval 6 + LEN, 0= MBAP not complete yet, -1= bad LEN.
+  *****************************************************************************/
+static int32_t mb_tcp_conn_adu_len(const uint8_t d[], uint16_t n)
+{
+    uint16_t usLength;                                      //LEN in MBAP, 1 unit id + pdu
+
+    if(n < MB_TCP_FUNC){
+        return 0;
+    }
+    usLength  = d[MB_TCP_LEN] << 8U;
+    usLength |= d[MB_TCP_LEN + 1];
+    if(usLength < 2 || usLength > MB_TCP_BUF_SIZE - MB_TCP_UID){
+        return -1;
+    }
+    return MB_TCP_UID + usLength;
+}
+
+#endif //#if MB_TCP_ENABLED > 0
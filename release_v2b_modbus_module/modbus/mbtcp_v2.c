@@ -130,7 +130,7 @@ void mb_tcp_enable(MB_SLAVE_STRU *slave, int32_t en)
             after some bytes are received.
   *
   * @param  oaddr = output the address
-            opdu = output the pdu array, a pointer, should be ucRTUBuf[7]
+            opdu = output the pdu array, a pointer, p_tcp_adu[7]
             opdulen = output length of pdu.
   *
   * @retval 0 = OK, EIO= length too short.
@@ -142,26 +142,50 @@ void mb_tcp_enable(MB_SLAVE_STRU *slave, int32_t en)
             when to call?
             ...in poll(), when get a event EV_FRAME_RECEIVED(meaning a completed frame), call this.
 
+            zero copy, if the port has p_tcpsvr_receive_ref, the adu is where
+            the port received it, with MB_TCP_BUF_SIZE room for the response,
+            or copied into ucRTUBuf by the port when it can not be.
+
+            unit id, a slave without a unit table is one device, any unit id
+            is its address. with a unit table, the unit id picks the unit, so
+            one connection reaches all of them; 0 and 255 are the server
+            itself, the unit of 'address'. the response keeps the unit id of
+            the request, its MBAP is sent back.
   *****************************************************************************/
 int32_t mb_tcp_receive_pdu(MB_SLAVE_STRU *slave, uint8_t * oaddr, uint8_t ** opdu, uint16_t * opdulen)
 {
     int               rtn_rcv;                              //rtn value of tcpsvr_receivng(), 0=ok
     uint16_t          mbap_pid;                             //temp fentch the PID in MBAP, this should be 0x0000 fixed
+    uint8_t          *p_adu;
+    uint8_t           uid;
 
-    rtn_rcv = slave->p_tcpsvr_receiving(slave->ucRTUBuf, &slave->pdu_len);
+    if(slave->p_tcpsvr_receive_ref != 0){
+        rtn_rcv = slave->p_tcpsvr_receive_ref(slave->ucRTUBuf, &p_adu, &slave->pdu_len);
+    }
+    else{
+        rtn_rcv = slave->p_tcpsvr_receiving(slave->ucRTUBuf, &slave->pdu_len);
+        p_adu   = slave->ucRTUBuf;
+    }
     if(rtn_rcv != 0){
         return rtn_rcv;
     }
+    slave->p_tcp_adu = p_adu;
 
                                                             //check if pid is 0x0000 correctly
-    mbap_pid  = slave->ucRTUBuf[MB_TCP_PID] << 8U;
-    mbap_pid |= slave->ucRTUBuf[MB_TCP_PID + 1];
+    mbap_pid  = p_adu[MB_TCP_PID] << 8U;
+    mbap_pid |= p_adu[MB_TCP_PID + 1];
     if(mbap_pid != MB_TCP_PROTOCOL_ID){
         return __LINE__;
     }
                                                             //now, pid check ok,
-    *oaddr   = slave->address;                              //set it's addr or will not pass checking in poll()
-    *opdu    = &(slave->ucRTUBuf[MB_TCP_FUNC]);             //pointer to RTUBuf[7]
+    uid = p_adu[MB_TCP_UID];
+    if(slave->p_unit_tbl == 0 || uid == MB_TCP_LOCAL_ADDRESS || uid == MB_TCP_PSEUDO_ADDRESS){
+        *oaddr = slave->address;                            //set it's addr or will not pass checking in poll()
+    }
+    else{
+        *oaddr = uid;                                       //mb_poll() finds its unit in p_unit_tbl->idx[]
+    }
+    *opdu    = &(p_adu[MB_TCP_FUNC]);                       //pointer to adu[7]
     *opdulen = slave->pdu_len - MB_TCP_FUNC;
 
     return 0;
@@ -173,28 +197,42 @@ int32_t mb_tcp_receive_pdu(MB_SLAVE_STRU *slave, uint8_t * oaddr, uint8_t ** opd
   * @brief  tcp send a frame, response or exception
   *
   * @param  addr = slave's address, useless in tcp
-            pdu = pdu ptr, pointer to some where in slave->ucRTUBuf[]
+            pdu = pdu ptr, p_tcp_adu[7]
             usLength = length of pdu
   *
   * @retval 0=OK
   *
   * @note   what's doing? 
             ...send the pdu, call port to asmber the adu.
-            ...here use adu = pdu - 7, actuall, adu pointer is fixed slave->ucRTUBuf[]
+            ...here use adu = pdu - 7, actuall, adu pointer is fixed slave->p_tcp_adu
+            ...if the port has p_tcpsvr_sendv, the MBAP and the pdu go as 2
+               pieces, the pdu may be anywhere, not only after the MBAP.
   *****************************************************************************/
 int32_t mb_tcp_send_pdu(MB_SLAVE_STRU *slave, uint8_t addr, const uint8_t * pdu, uint16_t pdulen )
 {
     uint8_t   *p_adu;                                       //adu pointer
     uint16_t   adu_len;                                     //adu len
-
+    MB_IOVEC_STRU v[2];                                     //MBAP, pdu
+
+    if(slave->p_tcpsvr_sendv != 0){
+        p_adu = slave->p_tcp_adu;                           //the MBAP of the request
+        p_adu[MB_TCP_LEN]     = (pdulen + 1) >> 8U;
+        p_adu[MB_TCP_LEN + 1] = (pdulen + 1) & 0xFF;
+        v[0].p   = p_adu;
+        v[0].len = MB_TCP_FUNC;
+        v[1].p   = pdu;
+        v[1].len = pdulen;
+        slave->p_tcpsvr_sendv(v, 2);
+        return 0;
+    }
 
     p_adu   = (uint8_t *)pdu - MB_TCP_FUNC;                 //adu = pdu - 7
-    if(slave->ucRTUBuf != p_adu){                           //check if padu is right, actuall padu is slave->ucRTUBuf[], there is no need to calculate
+    if(slave->p_tcp_adu != p_adu){                          //check if padu is right, actuall padu is slave->p_tcp_adu, there is no need to calculate
         return __LINE__;
     }
     adu_len = pdulen + MB_TCP_FUNC;                         //tcplen= pdulen + 7
     
-                                                            /* The MBAP header is already initialized because we use slave->ucRTUBuf[] 
+                                                            /* The MBAP header is already initialized because we use slave->p_tcp_adu 
                                                             ...for both receive and send we only need to update the LEN of MBAP header,
                                                             ...it is speciall, LEN= pdulen+1, the '1' is the UID byte. */
     p_adu[MB_TCP_LEN]     = (pdulen + 1) >> 8U;             //d[4]
@@ -0,0 +1,136 @@
+/**
+  ******************************************************************************
+  * @file    bench of the tcp master against the tcp slave over loopback,
+             mbmaster.c, mb_port_tcp_master_linux.c
+  * @author  arthur.qiang.li
+  * @brief   the slave mb_slave_tcp_linux runs in a thread on
+             MB_PORT_TCP_LISTEN_PORT, the master mb_link_tcp_master_linux
+             connects to it, one request at a time:
+                ./bin/bench_master [requests]
+                - the functions 01 02 03 04 05 06 15 16 23 are checked against
+                  the image of the slave, an exception and a count over the
+                  limit of the function too.
+                - requests of each function are timed, it prints req/s and
+                  us per request.
+                - the slave is stopped, a read times out after one retry, the
+                  slave goes on, the answers of the two tries come late and
+                  are dropped, the next read gets its own answer.
+             it returns the checks which failed. the master shares the cpu
+             with the slave on the host, the rate is of both.
+  *
+  ******************************************************************************
+  */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "mb.h"
+#include "mbmaster.h"
+#include "mb_port_linux.h"
+#include "t_common.h"
+
+#define B_RUNS          ( 50000 )
+#define B_UID           ( 5 )                               //MB_PORT_ADDRESS of the slave
+
+static volatile int   stop;
+static MB_MASTER_STRU m = {
+    .p_link     = &mb_link_tcp_master_linux,
+    .p_wait     = mb_port_tcp_master_linux_wait,
+    .p_tick_ms  = mb_port_linux_tick_ms,
+    .timeout_ms = 500,
+    .retries    = 1,
+};
+static uint16_t       w[125], r[125];
+static uint8_t        b[2];
+
+static void *slave(void *a)
+{
+    (void)a;
+    while(!stop){
+        mb_port_tcp_linux_wait(50);
+        mb_poll(&mb_slave_tcp_linux);
+    }
+    return 0;
+}
+
+                                                            //the request k of the table below
+static int32_t request(int k, int i)
+{
+    switch(k){
+        case 0:  return mb_master_read_holding(&m, B_UID, 0, 1, r);
+        case 1:  return mb_master_read_holding(&m, B_UID, 0, 125, r);
+        case 2:  return mb_master_write_registers(&m, B_UID, 300, 120, w);
+        case 3:  return mb_master_read_coils(&m, B_UID, 0, 16, b);
+        case 4:  return mb_master_readwrite_registers(&m, B_UID, 400, 125, r, 400, 121, w);
+        default: return mb_master_write_register(&m, B_UID, 1, (uint16_t)i);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const char *name[] = { "03 x1", "03 x125", "16 x120", "01 x16", "23 r125/w121", "06" };
+    pthread_t          th;
+    uint64_t           t0;
+    uint8_t            c[2];
+    int                n, k, i, err;
+
+    n = (argc > 1) ? atoi(argv[1]) : B_RUNS;
+    if(mb_init(&mb_slave_tcp_linux) != 0){
+        printf("slave init failed\n");
+        return 1;
+    }
+    mb_enable(&mb_slave_tcp_linux, 1);
+    pthread_create(&th, 0, slave, 0);
+    mb_link_tcp_master_linux.port_id = MB_PORT_TCP_LISTEN_PORT;
+    if(mb_master_init(&m) != 0 || mb_master_enable(&m, 1) != 0){
+        printf("master init failed\n");
+        return 1;
+    }
+
+    for(i = 0; i < 125; i++){
+        w[i] = (uint16_t)(0x1234 + i * 7);
+    }
+    CHECK(mb_master_write_registers(&m, B_UID, 100, 120, w) == 0);
+    CHECK(mb_master_read_holding(&m, B_UID, 100, 120, r) == 0 && memcmp(w, r, 240) == 0);
+    CHECK(mb_master_write_register(&m, B_UID, 7, 0xBEEF) == 0);
+    CHECK(mb_master_read_holding(&m, B_UID, 7, 1, r) == 0 && r[0] == 0xBEEF);
+    b[0] = 0xA5;
+    b[1] = 0x3C;
+    CHECK(mb_master_write_coils(&m, B_UID, 0, 14, b) == 0);
+    CHECK(mb_master_read_coils(&m, B_UID, 0, 14, c) == 0 && c[0] == 0xA5 && c[1] == (0x3C & 0x3F));
+    CHECK(mb_master_write_coil(&m, B_UID, 15, 1) == 0);
+    CHECK(mb_master_read_coils(&m, B_UID, 15, 1, c) == 0 && c[0] == 1);
+    CHECK(mb_master_read_discrete(&m, B_UID, 0, 16, c) == 0);
+    CHECK(mb_master_read_input(&m, B_UID, 0, 124, r) == 0);
+    CHECK(mb_master_readwrite_registers(&m, B_UID, 200, 4, r, 200, 4, w) == 0 && memcmp(r, w, 8) == 0);
+    CHECK(mb_master_read_holding(&m, B_UID, 2099, 2, r) == MB_EX_ILLEGAL_DATA_ADDRESS);
+    CHECK(mb_master_read_holding(&m, B_UID, 0, 126, r) == MB_MASTER_EARG);
+    printf("functions: ok %u, exceptions %u, dropped %u, bad %u\n", m.ok_cnt, m.ex_cnt, m.drop_cnt, m.bad_cnt);
+
+    for(k = 0; k < 6; k++){
+        t0 = t_now_us();
+        for(i = 0, err = 0; i < n; i++){
+            err += (request(k, i) != 0);
+        }
+        t0 = t_now_us() - t0;
+        printf("  %-14s %8.0f req/s, %6.1f us/req, errors %d\n", name[k], n * 1e6 / t0, (double)t0 / n, err);
+        CHECK(err == 0);
+    }
+
+    stop = 1;                                               //no answer, a retry, then the timeout
+    pthread_join(th, 0);
+    m.timeout_ms = 100;
+    t0 = t_now_us();
+    CHECK(mb_master_read_holding(&m, B_UID, 0, 1, r) == MB_MASTER_ETIMEOUT);
+    printf("timeout after %.0f ms, timeouts %u, retries %u\n", (t_now_us() - t0) / 1e3, m.timeout_cnt, m.retry_cnt);
+    CHECK(m.timeout_cnt == 2 && m.retry_cnt == 1);
+
+    stop = 0;                                               //the two late answers come before the next one
+    k    = (int)m.drop_cnt;
+    pthread_create(&th, 0, slave, 0);
+    CHECK(mb_master_read_holding(&m, B_UID, 100, 1, r) == 0 && r[0] == w[0]);
+    printf("late answers dropped %d\n", (int)m.drop_cnt - k);
+    CHECK((int)m.drop_cnt - k == 2);
+    stop = 1;
+    pthread_join(th, 0);
+    return t_done("bench_master");
+}
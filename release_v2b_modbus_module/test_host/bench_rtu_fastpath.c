@@ -0,0 +1,135 @@
+/**
+  ******************************************************************************
+  * @file    bench of the turnaround of the rtu fast path, mbrtu_v2.c
+  * @author  arthur.qiang.li
+  * @brief   no port, the bench is the uart and the t35 isr of the slave, the
+             slave task is a thread which runs mb_poll() on a semaphore, as
+             the task of the rtos waits for its event. a request is put on
+             the port and mb_rtu_t35_callback() is called, the turnaround is
+             the time until the response is started:
+                - 03, isr_fastpath off, the task answers.
+                - 03, isr_fastpath on, the 'isr' answers.
+                - 06, isr_fastpath on, a write, the task answers.
+             it prints p50 p90 p99 max of each and the counters of the
+             slave. built with MB_RTU_ISR_FASTPATH_ENABLED, see the make
+             target. the task switch of the host is the one of linux, the
+             gap is larger on the mcu, a switch and the wait in the queue of
+             the task.
+  *
+  ******************************************************************************
+  */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "mb.h"
+#include "mbrtu.h"
+#include "t_common.h"
+
+#define B_RUNS          ( 5000 )
+
+static sem_t             ev_sem, tx_sem;
+static volatile uint32_t ev;
+static uint8_t           rx[300];                           //the frame on the port
+static int               rx_n;
+static volatile uint64_t tx_at;                             //when the response was started, ns
+
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+static int32_t port_ok(void)                 { return 0; }
+static int32_t port_done(void)               { return 1; }
+static int32_t port_post(uint32_t e)         { ev = e; sem_post(&ev_sem); return 0; }
+static int32_t port_get(uint32_t *e)         { sem_wait(&ev_sem); *e = ev; return 0; }
+static void    port_enable(uint32_t r, uint32_t t) { (void)r; (void)t; }
+static void    port_send(uint8_t d[], int n) { (void)d; (void)n; tx_at = now_ns(); sem_post(&tx_sem); }
+static int32_t port_serial_init(uint8_t p, uint32_t b, uint8_t d, uint8_t pa) { (void)p; (void)b; (void)d; (void)pa; return 0; }
+static int32_t timer_init(uint32_t n)        { (void)n; return 0; }
+static void    timer_enable(uint32_t en)     { (void)en; }
+
+static int32_t port_read(uint8_t d[], int n)
+{
+    int m = (rx_n < n) ? rx_n : n;
+
+    memcpy(d, rx, (size_t)m);
+    rx_n = 0;
+    return m;
+}
+
+static MB_SLAVE_STRU rs = {
+    .address               = 1,
+    .mode                  = MB_RTU,
+    .baudrate              = 19200,
+    .p_event_init          = port_ok,
+    .p_event_post          = port_post,
+    .p_event_get           = port_get,
+    .p_serial_init         = port_serial_init,
+    .p_serial_enable       = port_enable,
+    .p_serial_start_send   = port_send,
+    .p_serial_read_receive = port_read,
+    .p_serial_check_TC     = port_done,
+    .p_serial_check_IDLE   = port_done,
+    .p_timer_init          = timer_init,
+    .p_timer_enable        = timer_enable,
+};
+
+static void *task(void *a)
+{
+    (void)a;
+    for(;;){
+        mb_poll(&rs);
+    }
+    return 0;
+}
+
+static int lat_cmp(const void *a, const void *b)
+{
+    return (*(const uint64_t *)a > *(const uint64_t *)b) ? 1 : -1;
+}
+
+static void run(const char *name, const uint8_t p[], int n)
+{
+    static uint64_t lat[B_RUNS];
+    uint64_t        t0;
+    int             k;
+
+    for(k = 0; k < B_RUNS; k++){
+        rx_n = t_rtu_frame(rx, rs.address, p, n);
+        t0   = now_ns();
+        mb_rtu_t35_callback(&rs);
+        sem_wait(&tx_sem);
+        lat[k] = tx_at - t0;
+    }
+    qsort(lat, B_RUNS, sizeof(uint64_t), lat_cmp);
+    printf("%-26s p50 %6.2f us, p90 %6.2f us, p99 %6.2f us, max %7.2f us\n", name, lat[B_RUNS / 2] / 1e3,
+           lat[B_RUNS * 9 / 10] / 1e3, lat[B_RUNS * 99 / 100] / 1e3, lat[B_RUNS - 1] / 1e3);
+}
+
+int main(void)
+{
+    static const uint8_t rd[] = { 3, 0, 0, 0, 10 };
+    static const uint8_t wr[] = { 6, 0, 1, 0, 5 };
+    pthread_t            th;
+
+    sem_init(&ev_sem, 0, 0);
+    sem_init(&tx_sem, 0, 0);
+    if(mb_init(&rs) != 0){
+        printf("mb_init failed\n");
+        return 1;
+    }
+    mb_enable(&rs, 1);
+    pthread_create(&th, 0, task, 0);
+
+    rs.isr_fastpath = 0;
+    run("03, fast path off", rd, sizeof(rd));
+    rs.isr_fastpath = 1;
+    run("03, fast path on", rd, sizeof(rd));
+    run("06, fast path on, a write", wr, sizeof(wr));
+    printf("fast %u, deferred %u\n", rs.isr_fast_cnt, rs.isr_defer_cnt);
+    return 0;
+}
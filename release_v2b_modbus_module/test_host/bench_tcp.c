@@ -0,0 +1,402 @@
+/**
+  ******************************************************************************
+  * @file    load bench of the linux tcp slaves, mb_port_tcp_linux.c and
+             mb_port_tcp_uring.c
+  * @author  arthur.qiang.li
+  * @brief   the slave runs in a child process on MB_PORT_TCP_LISTEN_PORT,
+             one thread, as the loop of mb_port_linux.h, built for 10k
+             clients, see the make target. bin/bench_tcp is the epoll slave,
+             bin/bench_tcp_uring the io_uring one, B_URING. the bench is a
+             client of -c connections in one epoll loop, each one keeps -d
+             reads of 10 holding registers (03) on the way, sent in one
+             write at the start, a new one as soon as one is answered, for
+             -t seconds:
+                ./bin/bench_tcp [-c conns] [-d depth] [-t seconds]
+             it prints the rate, the latency p50 p99 max, the answers with a
+             wrong tid or a wrong size, and the counters of the slave, the
+             bytes it copied per request in user space, the slabs, its
+             static memory, its rss and its syscalls per request among them.
+             the client shares the cpu with the slave on the host, the rate
+             is of both.
+                ./bin/bench_tcp -r runs
+             a client connects, reads once and closes, runs times, it prints
+             the time from connect() to the answer.
+                ./bin/bench_tcp_idle -i
+             3 clients send nothing beside one which reads all the time, it
+             prints when the silent ones are closed, built with
+             MB_TCP_IDLE_TIMEOUT_MS of 800 ms.
+  *
+  ******************************************************************************
+  */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "mb.h"
+#include "mb_port_linux.h"
+#include "t_common.h"
+
+#define B_REGS          ( 10 )
+#define B_RSP_LEN       ( 9 + 2 * B_REGS )                  //MBAP, fc, byte count, the registers
+#define B_LAT_MAX       ( 1 << 24 )                         //latencies kept
+#define B_DEPTH_MAX     ( 64 )
+
+#ifdef B_URING
+#define B_SLAVE         mb_slave_tcp_uring
+#define B_WAIT          mb_port_tcp_uring_wait
+#define B_GET_STAT      mb_port_tcp_uring_get_stat
+#else
+#define B_SLAVE         mb_slave_tcp_linux
+#define B_WAIT          mb_port_tcp_linux_wait
+#define B_GET_STAT      mb_port_tcp_linux_get_stat
+#endif
+
+typedef struct
+{
+    int             fd;
+    uint16_t        tid;                                    //of the next request
+    uint16_t        rx_tid;                                 //of the next answer
+    uint8_t         rb[B_RSP_LEN * B_DEPTH_MAX];
+    int             rn;
+    uint64_t        sent_us[B_DEPTH_MAX];                   //when the requests on the way were sent, by tid
+} B_CONN_STRU;
+
+static volatile int stop;
+static uint32_t    *lat;
+static uint32_t     lat_n;
+static uint64_t     sys_cnt;                                //syscalls of the socket calls below, in the process
+
+                                                            //the calls of the ports are counted, then go to libc
+#define B_SYSCALL(ret, name, params, args)                                          \
+    ret name params                                                                 \
+    {                                                                               \
+        static ret (*f) params;                                                     \
+        if(f == 0){                                                                 \
+            f = (ret (*) params)dlsym(RTLD_NEXT, #name);                            \
+        }                                                                           \
+        sys_cnt++;                                                                  \
+        return f args;                                                              \
+    }
+
+B_SYSCALL(int,     epoll_wait, (int a, struct epoll_event *b, int c, int d),        (a, b, c, d))
+B_SYSCALL(int,     epoll_ctl,  (int a, int b, int c, struct epoll_event *d),        (a, b, c, d))
+B_SYSCALL(ssize_t, recv,       (int a, void *b, size_t c, int d),                   (a, b, c, d))
+B_SYSCALL(ssize_t, sendmsg,    (int a, const struct msghdr *b, int c),              (a, b, c))
+B_SYSCALL(ssize_t, writev,     (int a, const struct iovec *b, int c),               (a, b, c))
+B_SYSCALL(ssize_t, read,       (int a, void *b, size_t c),                          (a, b, c))
+B_SYSCALL(ssize_t, write,      (int a, const void *b, size_t c),                    (a, b, c))
+B_SYSCALL(int,     accept4,    (int a, struct sockaddr *b, socklen_t *c, int d),    (a, b, c, d))
+B_SYSCALL(int,     setsockopt, (int a, int b, int c, const void *d, socklen_t e),   (a, b, c, d, e))
+B_SYSCALL(int,     close,      (int a),                                             (a))
+
+static void on_term(int s)
+{
+    (void)s;
+    stop = 1;
+}
+
+                                                            //the child, it writes a byte to 'up' when it listens, the counters at SIGTERM
+static int slave(int up)
+{
+    MB_PORT_LINUX_TCP_STAT_STRU st;
+    struct rusage               ru;
+
+    signal(SIGTERM, on_term);
+    if(mb_init(&B_SLAVE) != 0){
+        return 1;
+    }
+    mb_enable(&B_SLAVE, 1);
+    if(write(up, "", 1) != 1){
+        return 1;
+    }
+    sys_cnt = 0;
+    while(!stop){
+        B_WAIT(100);
+        mb_poll(&B_SLAVE);
+    }
+    B_GET_STAT(&st);
+    sys_cnt += st.enter_cnt;                                //io_uring_enter() of the uring port, by syscall()
+    printf("slave: accept %u, close %u, conn max %u, rx adu %u, tx adu %u, drop %u bytes\n",
+           st.accept_cnt, st.close_cnt, st.conn_max, st.rx_adu, st.tx_adu, st.drop_bytes);
+    printf("slave: %u adus served in place, %.2f bytes copied per request\n",
+           st.zc_adu, st.rx_adu ? (double)st.copy_bytes / st.rx_adu : 0.0);
+    getrusage(RUSAGE_SELF, &ru);
+    printf("slave: slabs %u, most used %u, waited %u, port memory %u KB, %.1f B per conn, rss max %ld KB\n",
+           st.slab_num, st.slab_max, st.slab_wait_cnt, st.mem_bytes / 1024,
+           (double)st.mem_bytes / MB_TCP_CONN_MAX, ru.ru_maxrss);
+    printf("slave: %llu syscalls, %.3f per request, cpu %.2f s\n", (unsigned long long)sys_cnt,
+           st.rx_adu ? (double)sys_cnt / st.rx_adu : 0.0,
+           ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6);
+    return 0;
+}
+
+static int lat_cmp(const void *a, const void *b)
+{
+    return (*(const uint32_t *)a > *(const uint32_t *)b) ? 1 : -1;
+}
+
+                                                            //k requests in one write
+static void request(B_CONN_STRU *c, int k)
+{
+    uint8_t q[12 * B_DEPTH_MAX];
+    int     i;
+
+    for(i = 0; i < k; i++, c->tid++){
+        const uint8_t a[12] = { c->tid >> 8, c->tid & 0xFF, 0, 0, 0, 6, B_SLAVE.address, 3, 0, 0, 0, B_REGS };
+
+        memcpy(&q[12 * i], a, sizeof(a));
+        c->sent_us[c->tid % B_DEPTH_MAX] = t_now_us();
+    }
+    if(send(c->fd, q, (size_t)(12 * k), MSG_NOSIGNAL) != 12 * k){
+        stop = 1;
+    }
+}
+
+                                                            //the answers in c->rb, the next request for each one, the ones wrong counted
+static int answers(B_CONN_STRU *c)
+{
+    int bad = 0, got = 0, n;
+
+    while(c->rn >= 6 && c->rn >= (n = 6 + ((c->rb[4] << 8) | c->rb[5]))){
+        bad += (n != B_RSP_LEN || c->rb[7] != 3 || ((c->rb[0] << 8) | c->rb[1]) != c->rx_tid);
+        if(lat_n < B_LAT_MAX){
+            lat[lat_n++] = (uint32_t)(t_now_us() - c->sent_us[c->rx_tid % B_DEPTH_MAX]);
+        }
+        c->rx_tid++;
+        memmove(c->rb, &c->rb[n], (size_t)(c->rn - n));
+        c->rn -= n;
+        got++;
+    }
+    if(got != 0){
+        request(c, got);
+    }
+    return bad;
+}
+
+static int connect_to(void)
+{
+    struct sockaddr_in sa;
+    int                s = socket(AF_INET, SOCK_STREAM, 0), on = 1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family      = AF_INET;
+    sa.sin_port        = htons(MB_PORT_TCP_LISTEN_PORT);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(s < 0 || connect(s, (struct sockaddr *)&sa, sizeof(sa)) != 0){
+        printf("connect: %s\n", strerror(errno));
+        if(s >= 0){
+            close(s);
+        }
+        return -1;
+    }
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return s;
+}
+
+                                                            //one read on the blocking socket s, 0= answered
+static int read_once(int s, uint16_t tid)
+{
+    uint8_t q[12] = { tid >> 8, tid & 0xFF, 0, 0, 0, 6, B_SLAVE.address, 3, 0, 0, 0, B_REGS };
+    uint8_t b[B_RSP_LEN];
+    int     got = 0, r;
+
+    if(send(s, q, sizeof(q), MSG_NOSIGNAL) != sizeof(q)){
+        return -1;
+    }
+    while(got < B_RSP_LEN){
+        r = (int)recv(s, &b[got], (size_t)(B_RSP_LEN - got), 0);
+        if(r <= 0){
+            return -1;
+        }
+        got += r;
+    }
+    return (b[0] == (tid >> 8) && b[1] == (tid & 0xFF) && b[7] == 3) ? 0 : -1;
+}
+
+static int reconnect(int runs)
+{
+    uint64_t t0;
+    int      k, s;
+
+    lat = malloc(sizeof(uint32_t) * (size_t)runs);
+    for(k = 0; k < runs; k++){
+        t0 = t_now_us();
+        s  = connect_to();
+        if(s < 0 || read_once(s, (uint16_t)k) != 0){
+            printf("run %d failed\n", k);
+            return 1;
+        }
+        lat[k] = (uint32_t)(t_now_us() - t0);
+        close(s);
+    }
+    qsort(lat, (size_t)runs, sizeof(uint32_t), lat_cmp);
+    printf("reconnect to the first answer, %d runs: p50 %u us, p99 %u us, max %u us\n", runs,
+           lat[runs / 2], lat[(uint64_t)runs * 99 / 100], lat[runs - 1]);
+    return 0;
+}
+
+static int idle(void)
+{
+    struct pollfd p[3];
+    uint64_t      t0, t_end, closed_ms[3] = { 0 };
+    int           k, s, n = 0, reads = 0, bad = 0;
+    char          b;
+
+    for(k = 0; k < 3; k++){
+        p[k].fd     = connect_to();
+        p[k].events = POLLIN;
+    }
+    s = connect_to();
+    if(s < 0 || p[0].fd < 0 || p[1].fd < 0 || p[2].fd < 0){
+        return 1;
+    }
+    t0    = t_now_us();
+    t_end = t0 + 3ULL * MB_TCP_IDLE_TIMEOUT_MS * 1000ULL;
+    while(t_now_us() < t_end){
+        bad += (read_once(s, (uint16_t)reads++) != 0);
+        usleep(10000);
+        if(n < 3 && poll(p, 3, 0) > 0){
+            for(k = 0; k < 3; k++){
+                if(p[k].fd >= 0 && (p[k].revents & (POLLIN | POLLHUP)) && recv(p[k].fd, &b, 1, 0) <= 0){
+                    closed_ms[k] = (t_now_us() - t0) / 1000;
+                    close(p[k].fd);
+                    p[k].fd = -1;
+                    n++;
+                }
+            }
+        }
+    }
+    for(k = 0; k < 3; k++){
+        printf("silent client %d: %s %u ms\n", k, (p[k].fd < 0) ? "closed after" : "still open after",
+               (unsigned)((p[k].fd < 0) ? closed_ms[k] : (t_now_us() - t0) / 1000));
+    }
+    printf("idle timeout %u ms, the reading client: %d reads, %d failed\n", MB_TCP_IDLE_TIMEOUT_MS, reads, bad);
+    close(s);
+    return (n != 3 || bad != 0);
+}
+
+static int load(int conns, int depth, int secs)
+{
+    B_CONN_STRU        *cs = calloc((size_t)conns, sizeof(B_CONN_STRU));
+    struct epoll_event  e[256];
+    uint64_t            t0, t_end;
+    int                 ep, i, k, n, r, bad = 0;
+
+    lat = malloc(sizeof(uint32_t) * B_LAT_MAX);
+    ep  = epoll_create1(0);
+    for(i = 0; i < conns; i++){
+        cs[i].fd = connect_to();
+        if(cs[i].fd < 0){
+            printf("client %d of %d\n", i, conns);
+            return 1;
+        }
+        e[0].events   = EPOLLIN;
+        e[0].data.u32 = (uint32_t)i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, cs[i].fd, &e[0]);
+    }
+    for(i = 0; i < conns; i++){
+        request(&cs[i], depth);
+    }
+
+    t0    = t_now_us();
+    t_end = t0 + (uint64_t)secs * 1000000ULL;
+    while(!stop && t_now_us() < t_end){
+        n = epoll_wait(ep, e, 256, 100);
+        for(k = 0; k < n; k++){
+            B_CONN_STRU *c = &cs[e[k].data.u32];
+
+            r = (int)recv(c->fd, &c->rb[c->rn], sizeof(c->rb) - (size_t)c->rn, 0);
+            if(r <= 0){
+                printf("conn %u closed by the slave, %s\n", e[k].data.u32, (r < 0) ? strerror(errno) : "eof");
+                return 1;
+            }
+            c->rn += r;
+            bad   += answers(c);
+        }
+    }
+    if(lat_n == 0){
+        printf("no answer\n");
+        return 1;
+    }
+    qsort(lat, lat_n, sizeof(uint32_t), lat_cmp);
+    printf("conns %d, depth %d: %.1fk req/s, p50 %u us, p99 %u us, max %u us, wrong %d\n", conns, depth,
+           lat_n / ((t_now_us() - t0) / 1e6) / 1000.0, lat[lat_n / 2], lat[(uint64_t)lat_n * 99 / 100],
+           lat[lat_n - 1], bad);
+    for(i = 0; i < conns; i++){
+        close(cs[i].fd);
+    }
+    return bad != 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct rlimit rl;
+    int           conns = 64, depth = 1, secs = 2, runs = 0, idle_test = 0, up[2], o, r;
+    pid_t         pid;
+    char          b;
+
+    while((o = getopt(argc, argv, "c:d:t:r:i")) != -1){
+        if(o == 'c'){
+            conns = atoi(optarg);
+        }
+        else if(o == 'd' && atoi(optarg) >= 1 && atoi(optarg) <= B_DEPTH_MAX){
+            depth = atoi(optarg);
+        }
+        else if(o == 't'){
+            secs = atoi(optarg);
+        }
+        else if(o == 'r' && atoi(optarg) > 0){
+            runs = atoi(optarg);
+        }
+        else if(o == 'i'){
+            idle_test = 1;
+        }
+        else{
+            printf("usage: %s [-c conns] [-d depth, 1 ~ %d] [-t seconds] | -r runs | -i\n", argv[0], B_DEPTH_MAX);
+            return 1;
+        }
+    }
+    getrlimit(RLIMIT_NOFILE, &rl);                          //a socket for each client, on both sides
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    if(pipe(up) != 0){
+        return 1;
+    }
+    fflush(stdout);
+    pid = fork();
+    if(pid == 0){
+        close(up[0]);
+        exit(slave(up[1]));
+    }
+    close(up[1]);
+    if(read(up[0], &b, 1) != 1){
+        printf("the slave did not start, the port %d is busy?\n", MB_PORT_TCP_LISTEN_PORT);
+        waitpid(pid, 0, 0);
+        return 1;
+    }
+    if(runs > 0){
+        r = reconnect(runs);
+    }
+    else if(idle_test){
+        r = idle();
+    }
+    else{
+        r = load(conns, depth, secs);
+    }
+    fflush(stdout);                                         //before the counters of the slave
+    kill(pid, SIGTERM);
+    waitpid(pid, 0, 0);
+    return r;
+}
@@ -0,0 +1,65 @@
+/**
+  ******************************************************************************
+  * @file    bench of the lateness of the timerfd of the linux ports,
+             mb_port_linux.c
+  * @author  arthur.qiang.li
+  * @brief   the timer is armed B_RUNS times to t3.5 at 9600 (1750 us) from
+             now, as the rtu port does after a byte, and waited for in
+             epoll_wait() as in mb_port_rtu_linux_wait(). it prints the
+             lateness of the expiries, p50 p99 max and the histogram of the
+             timer, which the rtu port shows in its statistics too. the
+             numbers are of the host, run it on the target box:
+                ./bin/bench_timer [runs]
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include "mb_port_linux.h"
+
+#define B_RUNS          ( 2000 )
+#define B_T35_US        ( 1750 )
+
+static int lat_cmp(const void *a, const void *b)
+{
+    return (*(const uint32_t *)a > *(const uint32_t *)b) ? 1 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    MB_PORT_LINUX_TIMER_STRU t;
+    struct epoll_event       e;
+    uint32_t                 *lat;
+    uint64_t                 dl;
+    int                      ep, k, n;
+
+    n   = (argc > 1) ? atoi(argv[1]) : B_RUNS;
+    lat = malloc(sizeof(uint32_t) * (size_t)n);
+    ep  = epoll_create1(0);
+    if(lat == 0 || ep < 0 || mb_port_linux_timer_open(&t, ep) != 0){
+        printf("timerfd failed\n");
+        return 1;
+    }
+    for(k = 0; k < n; k++){
+        dl = mb_port_linux_now_us() + B_T35_US;
+        mb_port_linux_timer_arm(&t, dl);
+        while(epoll_wait(ep, &e, 1, 100) <= 0){
+            ;
+        }
+        lat[k] = (uint32_t)(mb_port_linux_now_us() - dl);
+        mb_port_linux_timer_expired(&t);
+    }
+    qsort(lat, (size_t)n, sizeof(uint32_t), lat_cmp);
+
+    printf("t35 %u us x %u: late p50 %u us, p99 %u us, max %u us\n", B_T35_US, t.expire_cnt,
+           lat[n / 2], lat[(uint64_t)n * 99 / 100], t.late_max_us);
+    for(k = 0; k < MB_PORT_LINUX_JITTER_BINS; k++){
+        if(t.late_hist[k] != 0){
+            printf("  < %6u us: %u\n", (k == 0) ? 1U : (1U << k), t.late_hist[k]);
+        }
+    }
+    free(lat);
+    return 0;
+}
@@ -0,0 +1,217 @@
+/**
+  ******************************************************************************
+  * @file    discrete event simulator of one gateway line, mbgw.c
+  * @author  arthur.qiang.li
+  * @brief   virtual time, no port, no thread. the clients submit to the
+             line, the device answers each frame right after t35 with an
+             answer of the size of the request, and the clients get their
+             answers by mb_gw_reply(). one 9600 baud line for 60 s:
+                - bulk,   4 deep, 03 x 125, again at once
+                - hmi1~4, 1 deep, 03 / 04 x 10 and 01 x 32, 100 ms think
+                - writer, 1 deep, 06, every 500 ms
+             it prints the latency of each client, p50 p99 max, its rate,
+             and the bus utilization. coalescing and the cache are off, see
+             the make target 'sim', so each request is a bus transaction.
+             it uses only the calls and counters of the line the fifo one
+             had too, the numbers of the fifo line come from the tree before
+             the deficit round robin:
+                make sim M=<that tree>/release_v2b_modbus_module
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mbgw.h"
+#include "mbcrc.h"
+
+#define S_TIME_US       ( 60000000ULL )                     //virtual time of the run
+#define S_UID           ( 10 )
+#define S_CLIENT_NUM    ( 6 )
+#define S_LAT_MAX       ( 200000 )
+
+typedef struct
+{
+    const char      *name;
+    int             depth;                                  //requests on the way at most
+    uint8_t         fc;
+    uint16_t        num;                                    //registers or bits, the value of a write
+    uint64_t        think_us;                               //after an answer, before the next request, if 1 deep
+
+    int             out;
+    uint64_t        next_us;
+    uint64_t        sent_us[256];                           //by tid
+    uint16_t        tid;
+    uint32_t        n;
+    uint32_t        lat_num;
+    uint32_t        lat[S_LAT_MAX];
+} SIM_CLIENT_STRU;
+
+static MB_GW_LINE_STRU  line = { .baudrate = 9600, .timeout_ms = 500 };
+static MB_GW_STRU       gw   = { .p_lines = { &line }, .num = 1 };
+
+static SIM_CLIENT_STRU  cl[S_CLIENT_NUM] = {
+    { "bulk",   4, 3, 125, 0      },
+    { "hmi1",   1, 3, 10,  100000 },
+    { "hmi2",   1, 3, 10,  100000 },
+    { "hmi3",   1, 4, 10,  100000 },
+    { "hmi4",   1, 1, 32,  100000 },
+    { "writer", 1, 6, 1,   500000 },
+};
+
+static int lat_cmp(const void *a, const void *b)
+{
+    return (*(const uint32_t *)a > *(const uint32_t *)b) ? 1 : -1;
+}
+
+                                                            //the requests the clients may send now
+static void sim_submit(uint64_t t)
+{
+    SIM_CLIENT_STRU *c;
+    uint8_t          a[MB_TCP_BUF_SIZE];
+    uint16_t         len, addr;
+    int              k;
+
+    for(k = 0; k < S_CLIENT_NUM; k++){
+        c = &cl[k];
+        while(c->out < c->depth && t >= c->next_us){
+            c->tid++;
+            addr  = (uint16_t)(k * 200);                    //apart, no coalescing anyway
+            a[0]  = (uint8_t)(c->tid >> 8);
+            a[1]  = (uint8_t)(c->tid & 0xFF);
+            a[2]  = 0;
+            a[3]  = 0;
+            a[4]  = 0;
+            a[5]  = 6;
+            a[6]  = S_UID;
+            a[7]  = c->fc;
+            a[8]  = (uint8_t)(addr >> 8);
+            a[9]  = (uint8_t)(addr & 0xFF);
+            a[10] = (uint8_t)(c->num >> 8);
+            a[11] = (uint8_t)(c->num & 0xFF);
+            len   = 12;
+            if(mb_gw_submit(&gw, a, &len, k, 0, t) != 0){
+                printf("submit of %s refused, the queue is too short\n", c->name);
+                exit(1);
+            }
+            c->sent_us[c->tid & 0xFF] = t;
+            c->out++;
+            c->next_us = (c->depth > 1) ? t : t + c->think_us;
+        }
+    }
+}
+
+                                                            //the answer of the device to frame f[n], its len
+static uint16_t sim_answer(const uint8_t f[], uint16_t n, uint8_t a[])
+{
+    uint16_t num, crc, i, m = 0;
+
+    (void)n;
+    num    = (uint16_t)((f[4] << 8) | f[5]);
+    a[m++] = f[0];
+    switch(f[1]){
+    case 3:
+    case 4:
+        a[m++] = f[1];
+        a[m++] = (uint8_t)(num * 2);
+        for(i = 0; i < num * 2; i++){
+            a[m++] = (uint8_t)i;
+        }
+        break;
+    case 1:
+    case 2:
+        a[m++] = f[1];
+        a[m++] = (uint8_t)((num + 7) / 8);
+        for(i = 0; i < (num + 7) / 8; i++){
+            a[m++] = 0x55;
+        }
+        break;
+    default:                                                //a write, the echo of the request
+        memcpy(a, f, 6);
+        m = 6;
+        break;
+    }
+    crc    = usMBCRC16(a, m);
+    a[m++] = (uint8_t)(crc & 0xFF);
+    a[m++] = (uint8_t)(crc >> 8);
+    return m;
+}
+
+int main(void)
+{
+    SIM_CLIENT_STRU *c;
+    uint8_t          ans[300], d[MB_TCP_BUF_SIZE], *f;
+    uint16_t         ans_n = 0, n, len, tid;
+    uint64_t         t = 0, ans_us = 0, busy_us = 0, nx, dl;
+    int32_t          conn;
+    uint32_t         tag;
+    int              k;
+
+    if(mb_gw_init(&gw) != 0 || mb_gw_route(&gw, S_UID, 0) != 0){
+        printf("init failed\n");
+        return 1;
+    }
+    for(k = 0; k < S_CLIENT_NUM; k++){
+        cl[k].next_us = (uint64_t)k * 1000;                 //not all at the same instant
+    }
+
+    while(t < S_TIME_US){
+        sim_submit(t);
+
+        if(ans_n > 0 && t >= ans_us){
+            mb_gw_line_frame(&line, ans, ans_n, t);
+            ans_n = 0;
+        }
+        mb_gw_line_poll(&line, t);
+        if(ans_n == 0 && mb_gw_line_next(&line, t, &f, &n) == 0){
+            ans_n   = sim_answer(f, n, ans);                //right after t35
+            ans_us  = t + (uint64_t)(n + ans_n) * line.char_us + line.t35_us;
+            busy_us += (uint64_t)(n + ans_n) * line.char_us;
+        }
+
+        while(mb_gw_reply(&gw, d, &len, &conn, &tag, t) == 0){
+            c   = &cl[conn];
+            tid = (uint16_t)((d[0] << 8) | d[1]);
+            c->out--;
+            c->n++;
+            if(c->lat_num < S_LAT_MAX){
+                c->lat[c->lat_num++] = (uint32_t)(t - c->sent_us[tid & 0xFF]);
+            }
+            if(c->depth > 1){
+                c->next_us = t;
+            }
+        }
+
+        nx = S_TIME_US;                                     //the next event
+        for(k = 0; k < S_CLIENT_NUM; k++){
+            if(cl[k].out < cl[k].depth && cl[k].next_us < nx){
+                nx = cl[k].next_us;
+            }
+        }
+        if(ans_n > 0 && ans_us < nx){
+            nx = ans_us;
+        }
+        dl = mb_gw_line_deadline(&line);
+        if(dl != 0 && dl < nx){
+            nx = dl;
+        }
+        t = (nx > t) ? nx : t + 1;
+    }
+
+    printf("ok %u  timeout %u  junk %u  transactions %u  bus utilization %.1f%%\n",
+           line.ok_cnt, line.timeout_cnt, line.junk_cnt, line.bus_cnt, 100.0 * busy_us / S_TIME_US);
+    for(k = 0; k < S_CLIENT_NUM; k++){
+        c = &cl[k];
+        if(c->lat_num == 0){
+            printf("  %-6s no answer\n", c->name);
+            continue;
+        }
+        qsort(c->lat, c->lat_num, sizeof(uint32_t), lat_cmp);
+        printf("  %-6s fc%02u x%-3u  req/s %6.1f  p50 %7.1f ms  p99 %7.1f ms  max %7.1f ms\n",
+               c->name, c->fc, c->num, c->n / (S_TIME_US / 1e6),
+               c->lat[c->lat_num / 2] / 1000.0, c->lat[(uint64_t)c->lat_num * 99 / 100] / 1000.0,
+               c->lat[c->lat_num - 1] / 1000.0);
+    }
+    return 0;
+}
@@ -0,0 +1,259 @@
+/**
+  ******************************************************************************
+  * @file    discrete event simulator of many clients on one gateway line,
+             mbgw.c
+  * @author  arthur.qiang.li
+  * @brief   virtual time, no port, no thread, as sim_gw_drr.c. -c clients
+             on one 19200 baud line, each one is 1 deep and sends a request
+             every 200 ms, or at once if the answer came later, for -t
+             seconds:
+                ./bin/sim_gw_load [-c clients] [-t seconds] [-C cache ttl ms]
+             a request is one of a mix of reads of two units of the line,
+             whose ranges overlap or touch. the device answers right after
+             t35, the register i of unit u is i * 3 + u, the coil i is on if
+             i % 3 == 0, each answer is checked against it. it prints the
+             requests answered, the wrong ones, the bus transactions, the
+             latency p50 p99 and the bus bytes per answer. -C keeps the
+             answers of the reads for the ttl, see mbgw_cache.h, a read
+             answered from the cache is counted with the latency 0.
+             bin/sim_gw_load coalesces, bin/sim_gw_load_single does not, see
+             MB_GW_COALESCE_ENABLED.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mbgw.h"
+#include "mbcrc.h"
+
+#define S_PERIOD_US     ( 200000 )
+#define S_CLIENT_MAX    ( MB_GW_QUEUE_LEN )                 //1 deep each, the queue never refuses
+#define S_LAT_MAX       ( 1 << 20 )
+
+typedef struct
+{
+    uint8_t         uid;
+    uint8_t         fc;
+    uint16_t        addr;
+    uint16_t        num;
+} SIM_READ_STRU;
+
+typedef struct
+{
+    int             out;                                    //1= a request is on the way
+    uint64_t        next_us;
+    uint64_t        sent_us;
+    uint16_t        tid;
+    const SIM_READ_STRU *rd;                                //the request on the way
+    unsigned int    seed;
+} SIM_CLIENT_STRU;
+
+static const SIM_READ_STRU mix[] = {
+    { 10, 3, 0,   10 }, { 10, 3, 0,   10 }, { 10, 3, 5,  10 }, { 10, 3, 0,   20 }, { 10, 3, 15, 10 },
+    { 10, 1, 0,   16 }, { 10, 1, 4,   20 }, { 11, 4, 100, 8 }, { 11, 4, 104, 8 }, { 10, 3, 200, 4 },
+};
+
+static MB_GW_LINE_STRU  line = { .baudrate = 19200, .timeout_ms = 1000 };
+static MB_GW_STRU       gw   = { .p_lines = { &line }, .num = 1 };
+static SIM_CLIENT_STRU  cl[S_CLIENT_MAX];
+static uint32_t         lat[S_LAT_MAX];
+static uint32_t         lat_num;
+static uint32_t         bad;
+
+static int lat_cmp(const void *a, const void *b)
+{
+    return (*(const uint32_t *)a > *(const uint32_t *)b) ? 1 : -1;
+}
+
+                                                            //the answer of the device to frame f[n], its len
+static uint16_t sim_answer(const uint8_t f[], uint16_t n, uint8_t a[])
+{
+    uint16_t addr, num, crc, i, m = 0;
+
+    (void)n;
+    addr   = (uint16_t)((f[2] << 8) | f[3]);
+    num    = (uint16_t)((f[4] << 8) | f[5]);
+    a[m++] = f[0];
+    a[m++] = f[1];
+    if(f[1] == 3 || f[1] == 4){
+        a[m++] = (uint8_t)(num * 2);
+        for(i = 0; i < num; i++){
+            a[m++] = (uint8_t)(((addr + i) * 3 + f[0]) >> 8);
+            a[m++] = (uint8_t)((addr + i) * 3 + f[0]);
+        }
+    }
+    else{
+        a[m++] = (uint8_t)((num + 7) / 8);
+        memset(&a[m], 0, (num + 7) / 8);
+        for(i = 0; i < num; i++){
+            a[m + i / 8] |= (uint8_t)(((addr + i) % 3 == 0) << (i % 8));
+        }
+        m += (num + 7) / 8;
+    }
+    crc    = usMBCRC16(a, m);
+    a[m++] = (uint8_t)(crc & 0xFF);
+    a[m++] = (uint8_t)(crc >> 8);
+    return m;
+}
+
+                                                            //the answer d[len] is the one of the request of c
+static int sim_good(const SIM_CLIENT_STRU *c, const uint8_t d[], uint16_t len)
+{
+    const SIM_READ_STRU *r = c->rd;
+    uint8_t              e[256];
+    uint16_t             i, m;
+
+    if(r->fc == 3 || r->fc == 4){
+        for(i = 0, m = 0; i < r->num; i++){
+            e[m++] = (uint8_t)(((r->addr + i) * 3 + r->uid) >> 8);
+            e[m++] = (uint8_t)((r->addr + i) * 3 + r->uid);
+        }
+    }
+    else{
+        m = (uint16_t)((r->num + 7) / 8);
+        memset(e, 0, m);
+        for(i = 0; i < r->num; i++){
+            e[i / 8] |= (uint8_t)(((r->addr + i) % 3 == 0) << (i % 8));
+        }
+    }
+    return ((d[0] << 8) | d[1]) == c->tid && d[6] == r->uid && d[7] == r->fc
+        && d[8] == m && len == 9 + m && memcmp(&d[9], e, m) == 0;
+}
+
+                                                            //client k got the answer d[len] at t
+static void sim_answered(int k, const uint8_t d[], uint16_t len, uint64_t t)
+{
+    SIM_CLIENT_STRU *c = &cl[k];
+
+    c->out = 0;
+    bad   += !sim_good(c, d, len);
+    if(lat_num < S_LAT_MAX){
+        lat[lat_num++] = (uint32_t)(t - c->sent_us);
+    }
+}
+
+static void sim_submit(int clients, uint64_t t)
+{
+    SIM_CLIENT_STRU *c;
+    uint8_t          a[MB_TCP_BUF_SIZE];
+    uint16_t         len;
+    int32_t          r;
+    int              k;
+
+    for(k = 0; k < clients; k++){
+        c = &cl[k];
+        if(c->out || t < c->next_us){
+            continue;
+        }
+        c->tid++;
+        c->rd = &mix[rand_r(&c->seed) % (sizeof(mix) / sizeof(mix[0]))];
+        a[0]  = (uint8_t)(c->tid >> 8);
+        a[1]  = (uint8_t)(c->tid & 0xFF);
+        a[2]  = 0;
+        a[3]  = 0;
+        a[4]  = 0;
+        a[5]  = 6;
+        a[6]  = c->rd->uid;
+        a[7]  = c->rd->fc;
+        a[8]  = (uint8_t)(c->rd->addr >> 8);
+        a[9]  = (uint8_t)(c->rd->addr & 0xFF);
+        a[10] = (uint8_t)(c->rd->num >> 8);
+        a[11] = (uint8_t)(c->rd->num & 0xFF);
+        len   = 12;
+        c->sent_us = t;
+        c->next_us = t + S_PERIOD_US;
+        c->out     = 1;
+        r = mb_gw_submit(&gw, a, &len, k, 0, t);
+        if(r == MB_GW_CACHED){
+            sim_answered(k, a, len, t);
+        }
+        else if(r != 0){                                    //0= queued
+            printf("submit refused\n");
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t          ans[300], d[MB_TCP_BUF_SIZE], *f;
+    uint16_t         ans_n = 0, n, len;
+    uint64_t         t = 0, t_end, ans_us = 0, nx, dl;
+    int32_t          conn;
+    uint32_t         tag;
+    int              clients = 48, secs = 5, k, o;
+
+    while((o = getopt(argc, argv, "c:t:C:")) != -1){
+        if(o == 'c' && atoi(optarg) >= 1 && atoi(optarg) <= S_CLIENT_MAX){
+            clients = atoi(optarg);
+        }
+        else if(o == 't'){
+            secs = atoi(optarg);
+        }
+        else if(o == 'C'){
+            line.cache_ttl_ms = (uint32_t)atoi(optarg);
+        }
+        else{
+            printf("usage: %s [-c clients, 1 ~ %d] [-t seconds] [-C cache ttl ms]\n", argv[0], S_CLIENT_MAX);
+            return 1;
+        }
+    }
+    if(mb_gw_init(&gw) != 0 || mb_gw_route(&gw, 10, 0) != 0 || mb_gw_route(&gw, 11, 0) != 0){
+        printf("init failed\n");
+        return 1;
+    }
+    for(k = 0; k < clients; k++){
+        cl[k].seed    = (unsigned int)k + 1;
+        cl[k].next_us = (uint64_t)rand_r(&cl[k].seed) % S_PERIOD_US;
+    }
+    t_end = (uint64_t)secs * 1000000ULL;
+
+    while(t < t_end){
+        sim_submit(clients, t);
+
+        if(ans_n > 0 && t >= ans_us){
+            mb_gw_line_frame(&line, ans, ans_n, t);
+            ans_n = 0;
+        }
+        mb_gw_line_poll(&line, t);
+        if(ans_n == 0 && mb_gw_line_next(&line, t, &f, &n) == 0){
+            ans_n  = sim_answer(f, n, ans);                 //right after t35
+            ans_us = t + (uint64_t)(n + ans_n) * line.char_us + line.t35_us;
+        }
+
+        while(mb_gw_reply(&gw, d, &len, &conn, &tag, t) == 0){
+            sim_answered(conn, d, len, t);
+        }
+
+        nx = t_end;                                         //the next event
+        for(k = 0; k < clients; k++){
+            if(cl[k].out == 0 && cl[k].next_us < nx){
+                nx = cl[k].next_us;
+            }
+        }
+        if(ans_n > 0 && ans_us < nx){
+            nx = ans_us;
+        }
+        dl = mb_gw_line_deadline(&line);
+        if(dl != 0 && dl < nx){
+            nx = dl;
+        }
+        t = (nx > t) ? nx : t + 1;
+    }
+
+    if(lat_num == 0){
+        printf("no answer\n");
+        return 1;
+    }
+    qsort(lat, lat_num, sizeof(uint32_t), lat_cmp);
+    printf("clients %d, coalescing %s, cache ttl %u ms: answered %u, wrong %u, bus transactions %u, merged %u, "
+           "cache hits %u, p50 %.1f ms, p99 %.1f ms, bus bytes per answer %.1f\n",
+           clients, MB_GW_COALESCE_ENABLED ? "on" : "off", line.cache_ttl_ms, lat_num, bad, line.bus_cnt,
+           line.merge_cnt, line.hit_cnt,
+           lat[lat_num / 2] / 1000.0, lat[(uint64_t)lat_num * 99 / 100] / 1000.0,
+           (double)line.busy_us / line.char_us / lat_num);
+    return bad != 0;
+}
@@ -0,0 +1,275 @@
+/**
+  ******************************************************************************
+  * @file    simulator of the poll list planner, before and after, mbplan.c
+  * @author  arthur.qiang.li
+  * @brief   a tag list of 3 units is made, the same each run, the holding
+             registers in clusters of words and floats with small and large
+             gaps, input registers and coils spread, a hole of 40 holding
+             registers in each unit, the tags in it are left out:
+                ./bin/sim_plan
+                - the plan is built for lines of 9600, 19200, 115200 baud and
+                  tcp, it prints the reads and the bus time of one scan, a
+                  read for each tag before, the plan after, mb_plan_read_us().
+                - no read of the plan is over 125 registers or 2000 bits, or
+                  over a hole.
+                - the tags of unit 1 are scanned through the master, against
+                  mb_slave_tcp_linux in a thread on MB_PORT_TCP_LISTEN_PORT,
+                  each value is checked against a read of the tag alone, and
+                  the time of a scan is taken, a read for each tag and the
+                  plan.
+             it returns the checks which failed.
+  *
+  ******************************************************************************
+  */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "mb.h"
+#include "mbmaster.h"
+#include "mbplan.h"
+#include "mb_port_linux.h"
+#include "t_common.h"
+
+#define S_TAG_MAX       ( 1200 )
+#define S_HOLE_MAX      ( 8 )
+#define S_ADDR_HI       ( 2000 )                            //holding registers of a unit
+#define S_SCANS         ( 200 )
+
+typedef struct
+{
+    uint32_t        baudrate;
+    uint32_t        turnaround_us;
+    const char      *name;
+} SIM_LINE_STRU;
+
+static const SIM_LINE_STRU lines[] = {
+    { 9600,   5000, "rtu 9600, 5 ms turnaround" },
+    { 19200,  5000, "rtu 19200, 5 ms" },
+    { 115200, 2000, "rtu 115200, 2 ms" },
+    { 0,      1000, "tcp, 1 ms round trip" },
+};
+
+static MB_PLAN_TAG_STRU  tags[S_TAG_MAX];
+static int               tag_n;
+static MB_PLAN_HOLE_STRU holes[S_HOLE_MAX];
+static int               hole_n;
+static MB_PLAN_REQ_STRU  reqs[S_TAG_MAX];
+static uint16_t          regs[20000];
+static uint8_t           bits[2000];
+static MB_PLAN_STRU      p;
+static unsigned int      seed;
+static volatile int      stop;
+static MB_MASTER_STRU    m = {
+    .p_link     = &mb_link_tcp_master_linux,
+    .p_wait     = mb_port_tcp_master_linux_wait,
+    .p_tick_ms  = mb_port_linux_tick_ms,
+    .timeout_ms = 500,
+    .retries    = 1,
+};
+
+static int rnd(int n)
+{
+    seed = seed * 1103515245U + 12345U;
+    return (int)((seed >> 16) % (unsigned int)n);
+}
+
+static void add(int uid, int fc, int addr, int width)
+{
+    tags[tag_n].uid   = (uint8_t)uid;
+    tags[tag_n].fc    = (uint8_t)fc;
+    tags[tag_n].addr  = (uint16_t)addr;
+    tags[tag_n].width = (uint16_t)width;
+    tags[tag_n].id    = (uint16_t)tag_n;
+    tag_n++;
+}
+
+                                                            //1 if the range is over a hole
+static int in_hole(uint8_t uid, uint8_t fc, uint32_t addr, uint32_t num)
+{
+    int h;
+
+    for(h = 0; h < hole_n; h++){
+        if(uid == holes[h].uid && fc == holes[h].fc
+           && addr < (uint32_t)holes[h].addr + holes[h].num && addr + num > holes[h].addr){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+                                                            //the tag list, input registers in [0, in_hi), coils in [0, coil_hi)
+static void gen(int in_hi, int coil_hi)
+{
+    int u, a, k, w, blk, i, j;
+
+    tag_n  = 0;
+    hole_n = 0;
+    seed   = 12345;
+    for(u = 1; u <= 3; u++){
+        a = 0;
+        while(tag_n < u * 300 - 100 && a < S_ADDR_HI){
+            blk = 5 + rnd(20);
+            for(k = 0; k < blk; k++){
+                w  = rnd(3) ? 2 : 1;
+                add(u, MB_FUNC_READ_HOLDING_REGISTER, a, w);
+                a += w + ((rnd(4) == 0) ? rnd(6) : 0);
+            }
+            a += 10 + rnd(150);
+        }
+        for(k = 0; k < 60; k++){
+            add(u, MB_FUNC_READ_INPUT_REGISTER, rnd(in_hi), 1);
+        }
+        for(k = 0; k < 40; k++){
+            add(u, MB_FUNC_READ_COILS, rnd(coil_hi), 1);
+        }
+        holes[hole_n].uid  = (uint8_t)u;
+        holes[hole_n].fc   = MB_FUNC_READ_HOLDING_REGISTER;
+        holes[hole_n].addr = S_ADDR_HI / 4;
+        holes[hole_n].num  = 40;
+        hole_n++;
+    }
+    for(i = 0, j = 0; i < tag_n; i++){
+        if(!in_hole(tags[i].uid, tags[i].fc, tags[i].addr, tags[i].width)){
+            tags[j++] = tags[i];
+        }
+    }
+    tag_n = j;
+}
+
+static void plan_cfg(uint32_t baudrate, uint32_t turnaround_us)
+{
+    memset(&p, 0, sizeof(p));
+    p.baudrate      = baudrate;
+    p.turnaround_us = turnaround_us;
+    p.p_holes       = holes;
+    p.hole_num      = (uint16_t)hole_n;
+    p.p_reqs        = reqs;
+    p.req_max       = S_TAG_MAX;
+    p.p_regs        = regs;
+    p.reg_size      = sizeof(regs) / sizeof(regs[0]);
+    p.p_bits        = bits;
+    p.bit_size      = sizeof(bits);
+}
+
+                                                            //a read of the tag alone, 1 if it is not the value of the plan
+static int tag_differs(const MB_PLAN_TAG_STRU *t)
+{
+    uint16_t v[2];
+    uint8_t  b[1];
+    int      k, n = 0;
+
+    if(t->fc == MB_FUNC_READ_HOLDING_REGISTER){
+        n += (mb_master_read_holding(&m, t->uid, t->addr, t->width, v) != 0);
+    }
+    else if(t->fc == MB_FUNC_READ_INPUT_REGISTER){
+        n += (mb_master_read_input(&m, t->uid, t->addr, t->width, v) != 0);
+    }
+    else{
+        n += (mb_master_read_coils(&m, t->uid, t->addr, 1, b) != 0);
+        return n || (b[0] & 0x01) != mb_plan_tag_bit(&p, t, 0);
+    }
+    for(k = 0; k < t->width; k++){
+        n += (v[k] != mb_plan_tag_reg(&p, t, (uint16_t)k));
+    }
+    return n != 0;
+}
+
+static void *slave(void *a)
+{
+    (void)a;
+    while(!stop){
+        mb_port_tcp_linux_wait(50);
+        mb_poll(&mb_slave_tcp_linux);
+    }
+    return 0;
+}
+
+int main(void)
+{
+    MB_PLAN_REQ_STRU *q;
+    pthread_t         th;
+    uint64_t          t0, naive_us, plan_us;
+    uint32_t          num;
+    uint16_t          w[120];
+    int               l, i, j, k, bad, fail;
+
+    gen(1000, 1500);
+    printf("%d tags of 3 units, holding, input and coils, %d holes\n", tag_n, hole_n);
+    for(l = 0; l < (int)(sizeof(lines) / sizeof(lines[0])); l++){
+        plan_cfg(lines[l].baudrate, lines[l].turnaround_us);
+        if(mb_plan_build(&p, tags, (uint16_t)tag_n) != 0){
+            printf("build failed\n");
+            return 1;
+        }
+        for(i = 0, num = 0; i < p.req_num; i++){
+            num += reqs[i].num;
+        }
+        printf("  %-26s before %4u reads %9.1f ms, after %3u reads %8.1f ms, x%.1f, %u registers and bits read\n", lines[l].name,
+               p.naive_num, p.naive_us / 1e3, p.req_num, p.scan_us / 1e3, (double)p.naive_us / p.scan_us, num);
+
+        for(i = 0, bad = 0; i < p.req_num; i++){
+            q    = &reqs[i];
+            bad += (q->num > ((q->fc <= MB_FUNC_READ_DISCRETE_INPUTS) ? MB_PDU_FUNC_READ_COILCNT_MAX
+                                                                       : MB_PDU_FUNC_READ_REGCNT_MAX));
+            bad += in_hole(q->uid, q->fc, q->addr, q->num);
+        }
+        CHECK(bad == 0);
+    }
+
+    if(mb_init(&mb_slave_tcp_linux) != 0){
+        printf("slave init failed\n");
+        return 1;
+    }
+    mb_enable(&mb_slave_tcp_linux, 1);
+    pthread_create(&th, 0, slave, 0);
+    mb_link_tcp_master_linux.port_id = MB_PORT_TCP_LISTEN_PORT;
+    if(mb_master_init(&m) != 0 || mb_master_enable(&m, 1) != 0){
+        printf("master init failed\n");
+        return 1;
+    }
+    for(i = 0; i < S_ADDR_HI; i += 120){                    //values to tell the registers apart
+        for(k = 0; k < 120; k++){
+            w[k] = (uint16_t)(i + k + 0x100);
+        }
+        CHECK(mb_master_write_registers(&m, 1, (uint16_t)i, (uint16_t)((i + 120 > S_ADDR_HI) ? S_ADDR_HI - i : 120), w) == 0);
+    }
+    for(i = 0; i < 16; i += 3){
+        CHECK(mb_master_write_coil(&m, 1, (uint16_t)i, 1) == 0);
+    }
+
+    gen(640, 16);                                           //in the image of the slave, the tags of unit 1, no hole
+    hole_n = 0;
+    for(i = 0, j = 0; i < tag_n; i++){
+        if(tags[i].uid == 1){
+            tags[j++] = tags[i];
+        }
+    }
+    tag_n = j;
+    plan_cfg(0, 1000);
+    CHECK(mb_plan_build(&p, tags, (uint16_t)tag_n) == 0);
+    fail = mb_plan_scan(&p, &m);
+    for(i = 0, bad = 0; i < tag_n; i++){
+        bad += tag_differs(&tags[i]);
+    }
+    printf("tcp scan of unit 1: %d tags in %u reads, failed %d, values differ %d\n", tag_n, p.req_num, fail, bad);
+    CHECK(fail == 0 && bad == 0);
+
+    t0 = t_now_us();
+    for(k = 0; k < S_SCANS; k++){
+        mb_plan_scan(&p, &m);
+    }
+    plan_us = (t_now_us() - t0) / S_SCANS;
+    t0 = t_now_us();
+    for(k = 0; k < S_SCANS / 10; k++){
+        for(i = 0; i < tag_n; i++){
+            tag_differs(&tags[i]);
+        }
+    }
+    naive_us = (t_now_us() - t0) / (S_SCANS / 10);
+    printf("loopback scan: a read for each tag %llu us, the plan %llu us\n",
+           (unsigned long long)naive_us, (unsigned long long)plan_us);
+
+    stop = 1;
+    pthread_join(th, 0);
+    return t_done("sim_plan");
+}
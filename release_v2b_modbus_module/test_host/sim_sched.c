@@ -0,0 +1,345 @@
+/**
+  ******************************************************************************
+  * @file    simulator of the scan scheduler under load, mbsched.c
+  * @author  arthur.qiang.li
+  * @brief   virtual time, as sim_gw_drr.c, the master reads through a link
+             which is the bus, a read moves the clock by its bus time,
+             mb_plan_read_us() at 115200 with 1 ms turnaround, and up to
+             0.5 ms more of the device. 3 groups, 20 ms of 1 read, 100 ms of
+             2 reads, 1 s of n reads of 125 registers, n grows the load, 60 s
+             each, then the slow one with reads of 40 registers:
+                ./bin/sim_sched
+                - fixed, the task loop of CFG_TASK_MBPOLL_PERIOD_MS 10 ms, a
+                  group whose period is up gets its whole scan, in order.
+                - edf, mb_sched_poll(), it sleeps the time it gives.
+             it prints for each group the scans, the missed deadlines, the
+             skipped periods, the max latency, response and jitter, and the
+             mean jitter. then the same scheduler over loopback against
+             mb_slave_tcp_linux on MB_PORT_TCP_LISTEN_PORT, 10, 100 and
+             1000 ms groups, 3 s. it returns the checks which failed, no
+             group stops, the 100 ms one never misses on the virtual bus,
+             no read fails on loopback.
+  *
+  ******************************************************************************
+  */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "mb.h"
+#include "mbtcp.h"
+#include "mbmaster.h"
+#include "mbplan.h"
+#include "mbsched.h"
+#include "mb_port_linux.h"
+#include "t_common.h"
+
+#define S_GROUPS        ( 3 )
+#define S_SECS          ( 60 )
+#define S_LOOP_MS       ( 10 )                              //of the fixed task loop
+#define S_TCP_SECS      ( 3 )
+
+typedef struct
+{
+    uint32_t        scans;
+    uint32_t        miss;
+    uint32_t        lat_max;
+    uint32_t        resp_max;
+    uint32_t        jit_max;
+    uint64_t        jit_sum;
+    uint32_t        release;
+    uint32_t        done;
+} SIM_LOOP_STRU;                                            //a group in the fixed loop, as MB_SCHED_GROUP_STRU counts
+
+static const uint32_t     period[S_GROUPS] = { 20, 100, 1000 };
+static MB_PLAN_STRU       plan[S_GROUPS];
+static MB_PLAN_REQ_STRU   reqs[S_GROUPS][64];
+static uint16_t           regs[S_GROUPS][8000];
+static uint8_t            bits[S_GROUPS][64];
+static MB_PLAN_TAG_STRU   tags[S_GROUPS][64];
+static MB_SCHED_GROUP_STRU grp[S_GROUPS];
+
+static uint64_t           vus;                              //the virtual clock
+static unsigned int       seed = 7;
+static uint8_t            ans[MB_TCP_BUF_SIZE];             //the answer on the bus, not taken yet
+static uint16_t           ans_len;
+static volatile int       stop;
+
+static int32_t  v_ok(void)              { return 0; }
+static int32_t  v_post(uint32_t e)      { (void)e; return 0; }
+static int32_t  v_get(uint32_t *e)      { *e = EV_FRAME_RECEIVED; return (ans_len > 0) ? 0 : 1; }
+static int32_t  v_init(uint16_t p)      { (void)p; return 0; }
+static void     v_enable(uint32_t en)   { (void)en; }
+static int32_t  v_wait(int32_t ms)      { (void)ms; return 0; }
+static uint32_t v_tick_ms(void)         { return (uint32_t)(vus / 1000); }
+
+static int32_t v_receiving(uint8_t d[], uint16_t *len)
+{
+    if(ans_len == 0){
+        return __LINE__;
+    }
+    memcpy(d, ans, ans_len);
+    *len    = ans_len;
+    ans_len = 0;
+    return 0;
+}
+
+                                                            //the read is on the bus for its time, the answer is its size, zeros
+static int32_t v_send(uint8_t d[], uint16_t len)
+{
+    uint8_t  fc  = d[MB_TCP_FUNC];
+    uint16_t num = (uint16_t)((d[MB_TCP_FUNC + 3] << 8) | d[MB_TCP_FUNC + 4]);
+    uint16_t n   = (fc <= MB_FUNC_READ_DISCRETE_INPUTS) ? (uint16_t)((num + 7) / 8) : (uint16_t)(num * 2);
+
+    (void)len;
+    seed = seed * 1103515245U + 12345U;
+    vus += mb_plan_read_us(&plan[0], fc, num) + (seed >> 16) % 500;     //the plans are of one line
+    memcpy(ans, d, MB_TCP_FUNC + 1);
+    ans[MB_TCP_LEN]     = (uint8_t)((n + 3) >> 8);
+    ans[MB_TCP_LEN + 1] = (uint8_t)((n + 3) & 0xFF);
+    ans[MB_TCP_FUNC + 1] = (uint8_t)n;
+    memset(&ans[MB_TCP_FUNC + 2], 0, n);
+    ans_len = (uint16_t)(MB_TCP_FUNC + 2 + n);
+    return 0;
+}
+
+static MB_SLAVE_STRU vlink = {
+    .mode               = MB_TCP,
+    .p_event_init       = v_ok,
+    .p_event_post       = v_post,
+    .p_event_get        = v_get,
+    .p_tcpsvr_init      = v_init,
+    .p_tcpsvr_enable    = v_enable,
+    .p_tcpsvr_receiving = v_receiving,
+    .p_tcpsvr_send      = v_send,
+};
+
+static MB_MASTER_STRU vm = { .p_link = &vlink, .p_wait = v_wait, .p_tick_ms = v_tick_ms };
+
+static void plan_cfg(int g, uint32_t baudrate, uint32_t turnaround_us)
+{
+    MB_PLAN_STRU *p = &plan[g];
+
+    memset(p, 0, sizeof(*p));
+    p->baudrate      = baudrate;
+    p->turnaround_us = turnaround_us;
+    p->p_reqs        = reqs[g];
+    p->req_max       = 64;
+    p->p_regs        = regs[g];
+    p->reg_size      = 8000;
+    p->p_bits        = bits[g];
+    p->bit_size      = 64;
+}
+
+                                                            //the plan of group g, n reads of w holding registers, far apart
+static void plan_make(int g, int n, int w, uint32_t baudrate, uint32_t turnaround_us)
+{
+    int i;
+
+    plan_cfg(g, baudrate, turnaround_us);
+    for(i = 0; i < n; i++){
+        tags[g][i].uid   = 1;
+        tags[g][i].fc    = MB_FUNC_READ_HOLDING_REGISTER;
+        tags[g][i].addr  = (uint16_t)(i * 200);
+        tags[g][i].width = (uint16_t)w;
+    }
+    if(mb_plan_build(&plan[g], tags[g], (uint16_t)n) != 0){
+        printf("build failed\n");
+        exit(1);
+    }
+}
+
+                                                            //the fixed task loop, a whole scan of each group whose period is up
+static void run_fixed(SIM_LOOP_STRU st[])
+{
+    SIM_LOOP_STRU *s;
+    uint32_t       now, rel, d, iv, j;
+    int            g;
+
+    vus = 0;
+    memset(st, 0, sizeof(SIM_LOOP_STRU) * S_GROUPS);
+    while(vus < (uint64_t)S_SECS * 1000000ULL){
+        for(g = 0; g < S_GROUPS; g++){
+            s   = &st[g];
+            now = v_tick_ms();
+            if((int32_t)(now - s->release) < 0){
+                continue;
+            }
+            rel = s->release;
+            if(now - rel > s->lat_max){
+                s->lat_max = now - rel;
+            }
+            mb_plan_scan(&plan[g], &vm);
+            d = v_tick_ms();
+            if(d - rel > s->resp_max){
+                s->resp_max = d - rel;
+            }
+            if(d > rel + period[g]){
+                s->miss++;
+            }
+            if(s->scans > 0){
+                iv = d - s->done;
+                j  = (iv > period[g]) ? iv - period[g] : period[g] - iv;
+                if(j > s->jit_max){
+                    s->jit_max = j;
+                }
+                s->jit_sum += j;
+            }
+            s->scans++;
+            s->done     = d;
+            s->release += period[g];
+            if((int32_t)(d - s->release) >= (int32_t)period[g]){    //a period behind, the next one from now
+                s->release += (d - s->release) / period[g] * period[g];
+            }
+        }
+        vus += S_LOOP_MS * 1000;
+    }
+}
+
+static void run_edf(MB_SCHED_STRU *s)
+{
+    int32_t n;
+    int     g;
+
+    vus = 0;
+    memset(grp, 0, sizeof(grp));
+    for(g = 0; g < S_GROUPS; g++){
+        grp[g].p_plan    = &plan[g];
+        grp[g].period_ms = period[g];
+    }
+    s->p_master  = &vm;
+    s->p_groups  = grp;
+    s->group_num = S_GROUPS;
+    if(mb_sched_init(s) != 0){
+        printf("sched init failed\n");
+        exit(1);
+    }
+    while(vus < (uint64_t)S_SECS * 1000000ULL){
+        n = mb_sched_poll(s);
+        if(n > 0){
+            vus += (uint64_t)n * 1000;
+        }
+    }
+}
+
+static void *slave(void *a)
+{
+    (void)a;
+    while(!stop){
+        mb_port_tcp_linux_wait(50);
+        mb_poll(&mb_slave_tcp_linux);
+    }
+    return 0;
+}
+
+                                                            //the scheduler in real time, over loopback
+static void run_tcp(void)
+{
+    static const int  n[S_GROUPS]  = { 3, 10, 40 };
+    static const uint32_t per[S_GROUPS] = { 10, 100, 1000 };
+    static MB_MASTER_STRU m = {
+        .p_link     = &mb_link_tcp_master_linux,
+        .p_wait     = mb_port_tcp_master_linux_wait,
+        .p_tick_ms  = mb_port_linux_tick_ms,
+        .timeout_ms = 500,
+    };
+    MB_SCHED_STRU        s = { .p_master = &m, .p_groups = grp, .group_num = S_GROUPS };
+    MB_SCHED_GROUP_STRU *gp;
+    pthread_t            th;
+    uint32_t             t0;
+    int32_t              r;
+    int                  g, i;
+
+    if(mb_init(&mb_slave_tcp_linux) != 0){
+        printf("slave init failed\n");
+        exit(1);
+    }
+    mb_enable(&mb_slave_tcp_linux, 1);
+    pthread_create(&th, 0, slave, 0);
+    mb_link_tcp_master_linux.port_id = MB_PORT_TCP_LISTEN_PORT;
+    if(mb_master_init(&m) != 0 || mb_master_enable(&m, 1) != 0){
+        printf("master init failed\n");
+        exit(1);
+    }
+    memset(grp, 0, sizeof(grp));
+    for(g = 0; g < S_GROUPS; g++){
+        plan_cfg(g, 0, 100);                                //tcp, 0.1 ms round trip
+        for(i = 0; i < n[g]; i++){
+            tags[g][i].uid   = 1;
+            tags[g][i].fc    = (g == 2) ? MB_FUNC_READ_INPUT_REGISTER : MB_FUNC_READ_HOLDING_REGISTER;
+            tags[g][i].addr  = (uint16_t)(g * 40 + i * 13);     //in the 660 input registers of the slave
+            tags[g][i].width = 2;
+        }
+        CHECK(mb_plan_build(&plan[g], tags[g], (uint16_t)n[g]) == 0);
+        grp[g].p_plan    = &plan[g];
+        grp[g].period_ms = per[g];
+    }
+    CHECK(mb_sched_init(&s) == 0);
+
+    t0 = mb_port_linux_tick_ms();
+    while(mb_port_linux_tick_ms() - t0 < S_TCP_SECS * 1000){
+        r = mb_sched_poll(&s);
+        if(r > 0){
+            usleep((useconds_t)r * 1000);
+        }
+        else if(r < 0){
+            printf("poll %d\n", (int)r);
+            break;
+        }
+    }
+    printf("loopback tcp, %d s, load %u per mille, reads %u, idle polls %u\n", S_TCP_SECS, s.load_pm, s.read_cnt, s.idle_cnt);
+    for(g = 0; g < S_GROUPS; g++){
+        gp = &grp[g];
+        printf("  %4u ms, %2u reads: scans %4u, miss %u, skip %u, lat/resp/jit max %u/%u/%u ms, jit mean %.2f ms, failed %u\n",
+               per[g], plan[g].req_num, gp->scan_cnt, gp->miss_cnt, gp->skip_cnt, gp->lat_max_ms, gp->resp_max_ms,
+               gp->jitter_max_ms, (gp->scan_cnt > 1) ? (double)gp->jitter_sum_ms / (gp->scan_cnt - 1) : 0.0,
+               plan[g].fail_cnt);
+        CHECK(gp->scan_cnt > 0 && plan[g].fail_cnt == 0);
+    }
+    stop = 1;
+    pthread_join(th, 0);
+}
+
+int main(void)
+{
+    static const char *name[S_GROUPS] = { "20 ms, 1 read", "100 ms, 2 reads", "1 s, slow" };
+    static const int   slow_n[]       = { 4, 10, 16, 24, 30 };
+    static const int   slow_w[]       = { 125, 125, 125, 125, 40 };
+    SIM_LOOP_STRU      st[S_GROUPS];
+    MB_SCHED_STRU      s;
+    MB_SCHED_GROUP_STRU *gp;
+    uint32_t           load;
+    int                k, g;
+
+    if(mb_master_init(&vm) != 0 || mb_master_enable(&vm, 1) != 0){
+        printf("master init failed\n");
+        return 1;
+    }
+    for(k = 0; k < (int)(sizeof(slow_n) / sizeof(slow_n[0])); k++){
+        plan_make(0, 1, 10, 115200, 1000);
+        plan_make(1, 2, 20, 115200, 1000);
+        plan_make(2, slow_n[k], slow_w[k], 115200, 1000);
+        for(g = 0, load = 0; g < S_GROUPS; g++){
+            load += plan[g].scan_us / period[g];
+        }
+        printf("load %u per mille, 115200, 1 ms turnaround, the slow group %d reads of %d registers\n",
+               load, slow_n[k], slow_w[k]);
+        run_fixed(st);
+        memset(&s, 0, sizeof(s));
+        run_edf(&s);
+        printf("  %-16s  fixed: scans  miss lat/resp/jit max   mean | edf: scans  miss  skip lat/resp/jit max   mean\n", "");
+        for(g = 0; g < S_GROUPS; g++){
+            gp = &grp[g];
+            printf("  %-16s  %12u %5u %4u/%4u/%4u %6.1f | %10u %5u %5u %4u/%4u/%4u %6.1f\n", name[g],
+                   st[g].scans, st[g].miss, st[g].lat_max, st[g].resp_max, st[g].jit_max,
+                   (st[g].scans > 1) ? (double)st[g].jit_sum / (st[g].scans - 1) : 0.0,
+                   gp->scan_cnt, gp->miss_cnt, gp->skip_cnt, gp->lat_max_ms, gp->resp_max_ms, gp->jitter_max_ms,
+                   (gp->scan_cnt > 1) ? (double)gp->jitter_sum_ms / (gp->scan_cnt - 1) : 0.0);
+            CHECK(gp->scan_cnt > 0);
+        }
+        CHECK(grp[1].miss_cnt == 0);
+    }
+
+    run_tcp();
+    return t_done("sim_sched");
+}
@@ -0,0 +1,5 @@
+/* the host tests have no rtos, mb_method.c includes it. a task is a pthread. */
+
+#include <pthread.h>
+
+#define osThreadGetId()     ( (void *)pthread_self() )
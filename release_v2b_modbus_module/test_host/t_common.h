@@ -0,0 +1,70 @@
+/**
+  ******************************************************************************
+  * @file    HEADER FILE, helpers of the host tests
+  * @author  arthur.qiang.li
+  * @brief   a test prints a line for each check which fails, and returns the
+             number of them from main(), 0= passed.
+  *
+  ******************************************************************************
+  */
+
+#ifndef _T_COMMON_H
+#define _T_COMMON_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "mbcrc.h"
+
+static int t_fail;
+
+#define CHECK(x)    do{ if(!(x)){ printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #x); t_fail++; } }while(0)
+
+static inline uint64_t t_now_us(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000ULL + (uint64_t)t.tv_nsec / 1000ULL;
+}
+
+                                                            //an rtu frame of the pdu p[n] at uid, crc appended, its length
+static inline int t_rtu_frame(uint8_t f[], uint8_t uid, const uint8_t p[], int n)
+{
+    uint16_t c;
+
+    f[0] = uid;
+    memcpy(&f[1], p, (size_t)n);
+    c = usMBCRC16(f, (uint16_t)(n + 1));
+    f[n + 1] = (uint8_t)(c & 0xFF);
+    f[n + 2] = (uint8_t)(c >> 8);
+    return n + 3;
+}
+
+                                                            //an ascii frame of the adu a[n], LRC and CR LF appended, its length
+static inline int t_ascii_frame(uint8_t f[], const uint8_t a[], int n)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    uint8_t           b, lrc = 0;
+    int               i, m = 0;
+
+    f[m++] = ':';
+    for(i = 0; i <= n; i++){
+        b       = (i < n) ? a[i] : (uint8_t)-lrc;
+        lrc    += b;
+        f[m++]  = hex[b >> 4];
+        f[m++]  = hex[b & 0x0F];
+    }
+    f[m++] = '\r';
+    f[m++] = '\n';
+    return m;
+}
+
+static inline int t_done(const char *name)
+{
+    printf("%s: %s\n", name, t_fail ? "FAILED" : "passed");
+    return t_fail;
+}
+
+#endif
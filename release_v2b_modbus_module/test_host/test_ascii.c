@@ -0,0 +1,265 @@
+/**
+  ******************************************************************************
+  * @file    host test of the modbus ascii receiver, mbascii_v2.c
+  * @author  arthur.qiang.li
+  * @brief   no port, the test is the serial and the timer of the slave in
+             virtual time, the chars come a chunk at a time, each chunk ends
+             at an IDLE and is read by mb_ascii_receive_pdu(), as the dma
+             with IDLE of mb_port_ascii_03.c. the timer fires if the time of
+             a chunk is over its timeout, before the chunk is read:
+                - the default timeout of 9600 and 115200.
+                - a max frame with a small gap, then the rest in one run, and
+                  a max frame in 64 char packets of a usb adapter, both got.
+                - a frame with its end lost is dropped at the timeout, or at
+                  once by the ':' of the next frame.
+                - a short and a max frame split at each point, and a char at
+                  a time.
+                - frames back to back in one chunk, the chars after a LF are
+                  kept for the next call, the slave does not answer while
+                  they are there. a frame over the max is dropped.
+                - noise, T_NOISE_FRAMES frames, some with a bad char or with
+                  garbage in front. all but the ones with a bad char are got,
+                  no LRC error, no timeout. it prints the counters and the
+                  longest resync.
+  *
+  ******************************************************************************
+  */
+
+#include <stdlib.h>
+#include "mb.h"
+#include "mbascii.h"
+#include "t_common.h"
+
+#define T_CHAR_US       ( 10000000ULL / 9600 )              //a char at 9600, 10 bits
+#define T_NOISE_FRAMES  ( 100000 )
+
+static const uint8_t *rx;                                   //the chunk on the port
+static int            rx_n;
+static uint64_t       now;                                  //virtual time, us
+static uint32_t       tm_ticks;                             //50us ticks of the timer
+static int            tm_on;
+static uint64_t       tm_at;                                //when the timer was started
+static int            posted;                               //events posted by the slave
+static uint8_t        got_addr, *got_pdu;                   //the frame of the last mb_ascii_receive_pdu()
+
+static int32_t port_read(uint8_t d[], int n)
+{
+    int m = (rx_n < n) ? rx_n : n;
+
+    memcpy(d, rx, (size_t)m);
+    rx   += m;
+    rx_n -= m;
+    return m;
+}
+
+static int32_t port_ok(void)                 { return 0; }
+static int32_t port_post(uint32_t e)         { (void)e; posted++; return 0; }
+static int32_t port_get(uint32_t *e)         { (void)e; return -1; }
+static void    port_enable(uint32_t r, uint32_t t) { (void)r; (void)t; }
+static void    port_send(uint8_t d[], int n) { (void)d; (void)n; }
+static int32_t port_serial_init(uint8_t p, uint32_t b, uint8_t d, uint8_t pa) { (void)p; (void)b; (void)d; (void)pa; return 0; }
+static int32_t timer_init(uint32_t n)        { tm_ticks = n; return 0; }
+static void    timer_enable(uint32_t en)     { tm_on = (int)en; tm_at = now; }
+
+static uint8_t txbuf[520];
+
+static MB_SLAVE_STRU as = {
+    .address               = 1,
+    .mode                  = MB_ASCII,
+    .baudrate              = 9600,
+    .p_event_init          = port_ok,
+    .p_event_post          = port_post,
+    .p_event_get           = port_get,
+    .p_serial_init         = port_serial_init,
+    .p_serial_enable       = port_enable,
+    .p_serial_start_send   = port_send,
+    .p_serial_read_receive = port_read,
+    .p_serial_check_TC     = port_ok,
+    .p_serial_check_IDLE   = port_ok,
+    .p_timer_init          = timer_init,
+    .p_timer_enable        = timer_enable,
+    .p_ascii_txbuf         = txbuf,
+};
+
+                                                            //the chunk d[n] comes, its last char at t_end, the result of mb_ascii_receive_pdu()
+static int32_t chunk(const uint8_t d[], int n, uint64_t t_end, uint16_t *o_len)
+{
+    uint16_t len = 0;
+    int32_t  r;
+
+    if(tm_on && t_end - tm_at >= tm_ticks * 50ULL){
+        now = tm_at + tm_ticks * 50ULL;
+        mb_ascii_t1s_callback(&as);
+    }
+    now = t_end;
+    if(d != 0){                                             //0= nothing new, the rest on the port
+        rx   = d;
+        rx_n = n;
+    }
+    r    = mb_ascii_receive_pdu(&as, &got_addr, &got_pdu, &len);
+    if(o_len != 0){
+        *o_len = len;
+    }
+    return r;
+}
+
+                                                            //a frame of n bytes and the LRC, 255 bytes is the longest, 515 chars
+static int frame_n(uint8_t f[], int n)
+{
+    uint8_t a[300];
+    int     i;
+
+    a[0] = 1;
+    a[1] = 0x10;
+    for(i = 2; i < n; i++){
+        a[i] = (uint8_t)(i * 7);
+    }
+    return t_ascii_frame(f, a, n);
+}
+
+                                                            //the last frame got is the one of frame_n(n)
+static int got_n(int n)
+{
+    int i;
+
+    for(i = 2; i < n && got_pdu[i - 1] == (uint8_t)(i * 7); i++){
+        ;
+    }
+    return got_addr == 1 && got_pdu[0] == 0x10 && i == n;
+}
+
+int main(void)
+{
+    static uint8_t st[T_NOISE_FRAMES * 80];
+    static int     ends[T_NOISE_FRAMES];
+    const char    *good = ":011000020002040001000ADC\r\n";
+    uint8_t        f[600], b[1200];
+    uint16_t       len;
+    int            n, k, i, g, j, m, bad = 0, ok = 0;
+    uint64_t       t;
+
+    CHECK(mb_init(&as) == 0 && as.ascii_timeout_ms == 558 && tm_ticks == 558 * 20);
+    as.state            = 0;
+    as.ascii_timeout_ms = 0;
+    as.baudrate         = 115200;
+    CHECK(mb_init(&as) == 0 && as.ascii_timeout_ms == 47);
+    as.state            = 0;
+    as.ascii_timeout_ms = 0;
+    as.baudrate         = 9600;
+    CHECK(mb_init(&as) == 0);
+    mb_enable(&as, 1);
+
+                                                            //a max frame, 10 chars, a gap, the rest in one run
+    n = frame_n(f, 255);
+    CHECK(n == 515);
+    t = 1000000;
+    CHECK(chunk(f, 10, t, 0) == -2);
+    t += 3 * T_CHAR_US + (uint64_t)(n - 10) * T_CHAR_US;
+    CHECK(chunk(&f[10], n - 10, t, &len) == 0 && len == 254 && got_n(255));
+
+                                                            //in 64 char packets of a usb adapter, 67ms apart
+    for(k = 0; k < n; k += 64){
+        t += 67000;
+        i = (n - k < 64) ? n - k : 64;
+        CHECK(chunk(&f[k], i, t, &len) == ((k + i == n) ? 0 : -2));
+    }
+    CHECK(len == 254 && as.ascii_timeout_cnt == 0);
+
+                                                            //the end lost, dropped at the timeout, the next frame is got
+    CHECK(chunk(f, 100, t += 100 * T_CHAR_US, 0) == -2);
+    t += 1000000;
+    n = (int)strlen(good);
+    CHECK(chunk((const uint8_t *)good, n, t, &len) == 0 && len == 10);
+    CHECK(as.ascii_timeout_cnt == 1);
+
+                                                            //the end lost, the next frame comes at once
+    CHECK(chunk(f, 100, t += 100 * T_CHAR_US, 0) == -2);
+    CHECK(chunk((const uint8_t *)good, n, t += n * T_CHAR_US, &len) == 0 && len == 10);
+    CHECK(as.ascii_timeout_cnt == 1);
+
+                                                            //split at each point, a short and a max frame
+    for(m = 20; m <= 255; m += 235){
+        n = frame_n(f, m);
+        for(k = 1, ok = 0; k < n; k++){
+            ok += (chunk(f, k, t, 0) == -2 && chunk(&f[k], n - k, t, &len) == 0 && len == m - 1 && got_n(m));
+        }
+        CHECK(ok == n - 1);
+    }
+    for(k = 0, ok = 0; k < n; k++){                         //a char at a time
+        ok += (chunk(&f[k], 1, t, &len) == ((k == n - 1) ? 0 : -2));
+    }
+    CHECK(ok == n && got_n(255));
+
+                                                            //back to back in one IDLE, a short, a max and a short frame, garbage between
+    n  = frame_n(b, 20);
+    b[n++] = '#';
+    n += frame_n(&b[n], 255);
+    n += frame_n(&b[n], 30);
+    posted = 0;
+    CHECK(chunk(b, n, t, &len) == 0 && got_n(20) && as.ascii_tail_len > 0 && posted == 1);
+    CHECK(mb_ascii_send_pdu(&as, got_addr, got_pdu, len) == -1);   //the master sent on, no response
+    CHECK(chunk(0, 0, t, &len) == 0 && got_n(255));
+    CHECK(chunk(0, 0, t, &len) == 0 && got_n(30) && as.ascii_tail_len == 0);
+    CHECK(chunk(0, 0, t, &len) == -2);
+    CHECK(mb_ascii_send_pdu(&as, got_addr, got_pdu, len) == 0);
+
+                                                            //a frame and the head of the next one, the rest later
+    n = frame_n(b, 20);
+    m = frame_n(&b[n], 40);
+    CHECK(chunk(b, n + 10, t, &len) == 0 && got_n(20));
+    CHECK(chunk(&b[n + 10], m - 10, t, &len) == 0 && got_n(40));
+
+                                                            //over the max, dropped, the next frame is got
+    n  = frame_n(b, 256);
+    n += frame_n(&b[n], 255);
+    i  = (int)as.ascii_abort_cnt;
+    CHECK(chunk(b, n, t, &len) == 0 && got_n(255) && (int)as.ascii_abort_cnt == i + 1);
+    CHECK(as.ascii_timeout_cnt == 1 && as.ascii_lrc_err_cnt == 0);
+
+                                                            //noise, a bad char, or garbage in front
+    as.ascii_frame_cnt   = 0;
+    as.ascii_lrc_err_cnt = 0;
+    as.ascii_abort_cnt   = 0;
+    as.ascii_skip_chars  = 0;
+    as.ascii_skip_run    = 0;
+    as.ascii_skip_max    = 0;
+    srand(1);
+    for(i = 0, n = 0; i < T_NOISE_FRAMES; i++){
+        k = (int)strlen(good);
+        if(rand() % 4 == 0){
+            memcpy(&st[n], good, (size_t)k);
+            j = 1 + rand() % (k - 3);
+            st[n + j] = (uint8_t)('G' + rand() % 20);
+            bad++;
+        }
+        else if(rand() % 4 == 0){
+            g = rand() % 40;
+            for(j = 0; j < g; j++){
+                st[n + j] = (uint8_t)rand();
+                if(st[n + j] == ':'){
+                    st[n + j] = 'x';
+                }
+            }
+            memcpy(&st[n + g], good, (size_t)k);
+            k += g;
+        }
+        else{
+            memcpy(&st[n], good, (size_t)k);
+        }
+        n += k;
+        ends[i] = n;
+    }
+    ok = 0;
+    for(i = 0; i < T_NOISE_FRAMES; i++){
+        j = i ? ends[i - 1] : 0;
+        t += (uint64_t)(ends[i] - j) * T_CHAR_US;
+        ok += (chunk(&st[j], ends[i] - j, t, 0) == 0);
+    }
+    CHECK(as.ascii_lrc_err_cnt == 0 && as.ascii_timeout_cnt == 1);
+    CHECK(ok == T_NOISE_FRAMES - bad && ok == (int)as.ascii_frame_cnt && bad == (int)as.ascii_abort_cnt);
+    printf("noise: %d frames, %d with a bad char, got %d, abort %u, lrc err %u, skip %u chars, longest resync %u chars %.1f ms\n",
+           T_NOISE_FRAMES, bad, ok, as.ascii_abort_cnt, as.ascii_lrc_err_cnt, as.ascii_skip_chars,
+           as.ascii_skip_max, as.ascii_skip_max * T_CHAR_US / 1000.0);
+
+    return t_done("test_ascii");
+}
@@ -0,0 +1,272 @@
+/**
+  ******************************************************************************
+  * @file    host test of the gateway end to end, mb_port_tcp_linux.c and
+             mb_port_gw_linux.c over pty pairs
+  * @author  arthur.qiang.li
+  * @brief   two lines, each one a thread on the slave side of a pty, the
+             test is the rtu devices on the master sides and the tcp client:
+                - a request to a unit of a line is answered by the device,
+                  its MBAP kept.
+                - unit 255 is the tcp server itself, served by mb_poll().
+                - a unit which does not answer gets MB_EX_GATEWAY_TGT_FAILED
+                  after the timeout and the retry.
+                - requests pipelined to both lines are all answered.
+                - more pipelined requests than the queue, the ones over it
+                  get MB_EX_GATEWAY_PATH_FAILED, all are answered.
+                - a client closed with requests queued, the next client on
+                  its entry gets its own answer only.
+             the devices answer 03 with the register i = uid << 8 | i, after
+             the echo of the request, as a 2-wire bus without rs485 support,
+             and T_TURN_MS. unit T_UID_SILENT never answers.
+  *
+  ******************************************************************************
+  */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "mb.h"
+#include "mbgw.h"
+#include "mb_port_linux.h"
+#include "t_common.h"
+
+#define T_TURN_MS       ( 20 )                              //the device answers after it
+#define T_TIMEOUT_MS    ( 100 )
+#define T_UID_SILENT    ( 20 )
+
+static MB_GW_LINE_STRU l0 = { .baudrate = 115200, .timeout_ms = T_TIMEOUT_MS, .retries = 1 };
+static MB_GW_LINE_STRU l1 = { .baudrate = 115200, .timeout_ms = T_TIMEOUT_MS, .retries = 1 };
+static MB_GW_STRU      gw = { .p_lines = { &l0, &l1 }, .num = 2 };
+
+static volatile int stop;
+static int          mfd[2];
+
+                                                            //the rtu device on the master side of the pty of a line
+static void *device(void *a)
+{
+    struct pollfd p = { mfd[(long)a], POLLIN, 0 };
+    uint8_t       b[300], o[300], uid, fc;
+    uint16_t      c;
+    int           n = 0, m, k, i;
+
+    while(!stop){
+        if(poll(&p, 1, n ? 2 : 100) > 0){
+            k = (int)read(p.fd, b + n, sizeof(b) - n);
+            n += (k > 0) ? k : 0;
+            continue;
+        }
+        if(n < 4 || usMBCRC16(b, (uint16_t)n) != 0){       //the t35 gap, a frame is whole or dropped
+            n = 0;
+            continue;
+        }
+        uid = b[0];
+        fc  = b[1];
+        if(uid == T_UID_SILENT){
+            n = 0;
+            continue;
+        }
+        CHECK(write(p.fd, b, n) == n);                      //the echo
+        n = 0;
+        usleep(T_TURN_MS * 1000);
+        m = 0;
+        o[m++] = uid;
+        if(fc == 3){
+            o[m++] = 3;
+            o[m++] = (uint8_t)(b[5] * 2);
+            for(i = 0; i < b[5]; i++){
+                o[m++] = uid;
+                o[m++] = (uint8_t)(b[3] + i);
+            }
+        }
+        else{
+            o[m++] = fc | 0x80;
+            o[m++] = 1;
+        }
+        c = usMBCRC16(o, (uint16_t)m);
+        o[m++] = (uint8_t)(c & 0xFF);
+        o[m++] = (uint8_t)(c >> 8);
+        CHECK(write(p.fd, o, m) == m);
+    }
+    return 0;
+}
+
+static void *line(void *a)
+{
+    while(!stop){
+        mb_port_gw_linux_wait((int32_t)(long)a, 100);
+    }
+    return 0;
+}
+
+static void *server(void *a)
+{
+    (void)a;
+    while(!stop){
+        mb_port_tcp_linux_wait(100);
+        mb_poll(&mb_slave_tcp_linux);
+    }
+    return 0;
+}
+
+static int client(void)
+{
+    struct sockaddr_in sa;
+    int                s;
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family      = AF_INET;
+    sa.sin_port        = htons(MB_PORT_TCP_LISTEN_PORT);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(connect(s, (struct sockaddr *)&sa, sizeof(sa)) == 0);
+    return s;
+}
+
+                                                            //a read of the holding registers
+static int req(uint8_t q[], uint16_t tid, uint8_t uid, uint16_t addr, uint16_t num)
+{
+    const uint8_t a[12] = { tid >> 8, tid & 0xFF, 0, 0, 0, 6, uid, 3, addr >> 8, addr & 0xFF, num >> 8, num & 0xFF };
+
+    memcpy(q, a, sizeof(a));
+    return sizeof(a);
+}
+
+static int get_n(int s, uint8_t b[], int n)
+{
+    struct pollfd p = { s, POLLIN, 0 };
+    int           got = 0, r;
+
+    while(got < n){
+        if(poll(&p, 1, 3000) <= 0){
+            return -1;
+        }
+        r = (int)recv(s, b + got, (size_t)(n - got), 0);
+        if(r <= 0){
+            return -1;
+        }
+        got += r;
+    }
+    return 0;
+}
+
+                                                            //the next answer, MBAP + pdu in b[], its tid, -1= none
+static int get(int s, uint8_t b[])
+{
+    if(get_n(s, b, 7) != 0 || get_n(s, b + 7, ((b[4] << 8) | b[5]) - 1) != 0){
+        return -1;
+    }
+    return (b[0] << 8) | b[1];
+}
+
+int main(void)
+{
+    uint8_t   q[32 * 12], b[300], seen[32];
+    char      name[2][64];
+    int       s, k, n, ok, full, sl;
+    long      i;
+    uint64_t  t;
+    struct termios tio;
+    pthread_t th[5];
+
+    for(i = 0; i < 2; i++){
+        CHECK(openpty(&mfd[i], &sl, name[i], 0, 0) == 0);
+        tcgetattr(mfd[i], &tio);
+        cfmakeraw(&tio);
+        tcsetattr(mfd[i], TCSANOW, &tio);
+        pthread_create(&th[i], 0, device, (void *)i);
+    }
+    CHECK(mb_gw_init(&gw) == 0);
+    mb_gw_route(&gw, 10, 0);
+    mb_gw_route(&gw, 11, 0);
+    mb_gw_route(&gw, T_UID_SILENT, 1);
+    mb_gw_route(&gw, 21, 1);
+    for(i = 0; i < 2; i++){
+        CHECK(mb_port_gw_linux_open((int32_t)i, gw.p_lines[i], name[i], 8, 0) == 0);
+    }
+    if(mb_init(&mb_slave_tcp_linux) != 0 || mb_port_tcp_linux_gateway(&gw) != 0){
+        printf("FAIL mb_init\n");
+        return 1;
+    }
+    mb_enable(&mb_slave_tcp_linux, 1);
+    pthread_create(&th[2], 0, line, (void *)0);
+    pthread_create(&th[3], 0, line, (void *)1);
+    pthread_create(&th[4], 0, server, 0);
+    s = client();
+
+                                                            //one request, its tid kept
+    n = req(q, 0x1234, 10, 0, 3);
+    CHECK(send(s, q, n, 0) == n);
+    CHECK(get(s, b) == 0x1234 && b[6] == 10 && b[7] == 3 && b[8] == 6 && b[9] == 10 && b[14] == 2);
+
+                                                            //the server itself
+    n = req(q, 7, 255, 0, 1);
+    CHECK(send(s, q, n, 0) == n);
+    CHECK(get(s, b) == 7 && b[7] == 3 && b[8] == 2);
+
+                                                            //a device which does not answer, sent twice
+    n = req(q, 8, T_UID_SILENT, 0, 2);
+    t = t_now_us();
+    CHECK(send(s, q, n, 0) == n);
+    CHECK(get(s, b) == 8 && b[7] == 0x83 && b[8] == MB_EX_GATEWAY_TGT_FAILED);
+    t = t_now_us() - t;
+    CHECK(t >= 2 * T_TIMEOUT_MS * 1000ULL);
+
+                                                            //pipelined to both lines
+    for(k = 0, n = 0; k < 12; k++){
+        n += req(&q[n], (uint16_t)(100 + k), (uint8_t)((k % 3 == 2) ? 21 : 10 + k % 3), 0, 2);
+    }
+    CHECK(send(s, q, n, 0) == n);
+    memset(seen, 0, sizeof(seen));
+    for(k = 0, ok = 0; k < 12; k++){
+        n = get(s, b);
+        if(n >= 100 && n < 112 && seen[n - 100] == 0 && b[7] == 3 && b[9] == b[6]){
+            seen[n - 100] = 1;
+            ok++;
+        }
+    }
+    CHECK(ok == 12);
+
+                                                            //over the queue
+    for(k = 0, n = 0; k < 20; k++){
+        n += req(&q[n], (uint16_t)(200 + k), 10, 0, 2);
+    }
+    CHECK(send(s, q, n, 0) == n);
+    memset(seen, 0, sizeof(seen));
+    for(k = 0, ok = 0, full = 0; k < 20; k++){
+        n = get(s, b);
+        if(n < 200 || n >= 220 || seen[n - 200]){
+            continue;
+        }
+        seen[n - 200] = 1;
+        ok   += (b[7] == 3);
+        full += (b[7] == 0x83 && b[8] == MB_EX_GATEWAY_PATH_FAILED);
+    }
+    CHECK(ok + full == 20 && ok >= MB_GW_QUEUE_LEN);
+
+                                                            //closed with requests queued, a new client
+    for(k = 0, n = 0; k < 4; k++){
+        n += req(&q[n], (uint16_t)(300 + k), 11, 0, 2);
+    }
+    CHECK(send(s, q, n, 0) == n);
+    close(s);
+    s = client();
+    usleep(300000);
+    n = req(q, 400, 21, 0, 2);
+    CHECK(send(s, q, n, 0) == n);
+    CHECK(get(s, b) == 400 && b[7] == 3 && b[9] == 21);
+    close(s);
+
+    stop = 1;
+    for(k = 0; k < 5; k++){
+        pthread_join(th[k], 0);
+    }
+    printf("%d of 20 over the queue answered by the device\n", ok);
+    return t_done("test_gw");
+}
@@ -0,0 +1,228 @@
+/**
+  ******************************************************************************
+  * @file    host test of the read cache of the gateway, mbgw.c and
+             mbgw_cache.c
+  * @author  arthur.qiang.li
+  * @brief   no port, the test is both the tcp task and the rtu device of
+             one line, as test_gw_line.c. the device keeps its registers:
+                - a repeated read is answered from the cache, no bus.
+                - a read of another client, queued after a write, goes on
+                  the bus before it, the write waits for its turn. its old
+                  value must not be served once the write is answered.
+             and the cache alone, mbgw_cache.c:
+                - the arena full, a new answer evicts the least recently
+                  used entry, a hit makes an entry the most recent.
+                - an entry is dropped at the end of its ttl.
+                - a write drops the entries of its unit, line and read fc
+                  whose range it overlaps, a range which only touches it and
+                  the other units, lines and fcs are kept.
+  *
+  ******************************************************************************
+  */
+
+#include <stdlib.h>
+#include "mbgw.h"
+#include "mbcrc.h"
+#include "t_common.h"
+
+#define T_UID           ( 10 )
+
+static MB_GW_LINE_STRU line = { .baudrate = 115200, .timeout_ms = 100, .cache_ttl_ms = 10000, .quantum = 1 };
+static MB_GW_STRU      gw   = { .p_lines = { &line }, .num = 1 };
+static uint64_t        now  = 1000000;
+static uint16_t        reg[256];
+static uint8_t         bus_fc[32];                          //the frames on the bus, in order
+static uint16_t        bus_addr[32];
+static int             bus_num;
+
+                                                            //the device answers the frame on the bus, or not if nothing is sent
+static int device(void)
+{
+    uint8_t  *f, a[300];
+    uint16_t  n, addr, num, i;
+    int       m = 0;
+
+    now += 10000;
+    if(mb_gw_line_next(&line, now, &f, &n) != 0){
+        return 0;
+    }
+    addr = (uint16_t)((f[2] << 8) | f[3]);
+    num  = (uint16_t)((f[4] << 8) | f[5]);
+    if(bus_num < 32){
+        bus_fc[bus_num]   = f[1];
+        bus_addr[bus_num] = addr;
+        bus_num++;
+    }
+    if(f[1] == 6){
+        reg[addr & 0xFF] = num;
+        memcpy(a, f, 6);
+        m = 6;
+    }
+    else{
+        a[m++] = f[0];
+        a[m++] = 3;
+        a[m++] = (uint8_t)(num * 2);
+        for(i = 0; i < num; i++){
+            a[m++] = (uint8_t)(reg[(addr + i) & 0xFF] >> 8);
+            a[m++] = (uint8_t)(reg[(addr + i) & 0xFF] & 0xFF);
+        }
+    }
+    i = usMBCRC16(a, (uint16_t)m);
+    a[m++] = (uint8_t)(i & 0xFF);
+    a[m++] = (uint8_t)(i >> 8);
+    now += 10000;
+    mb_gw_line_frame(&line, a, (uint16_t)m, now);
+    return 1;
+}
+
+                                                            //an entry of the cache, its pdu is 3 bytes, the first one is v
+static void put(MB_GW_CACHE_STRU *c, uint8_t line, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num, uint8_t v)
+{
+    const uint8_t pdu[3] = { v, 0, 0 };
+
+    mb_gw_cache_put(c, line, uid, fc, addr, num, now + 1000000, pdu, sizeof(pdu));
+}
+
+                                                            //the first byte of the entry, -1= no hit
+static int get(MB_GW_CACHE_STRU *c, uint8_t line, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num)
+{
+    uint8_t  pdu[MB_GW_CACHE_PDU_MAX];
+    uint16_t len;
+
+    if(mb_gw_cache_get(c, line, uid, fc, addr, num, now, pdu, &len) != 0){
+        return -1;
+    }
+    return (len == 3) ? pdu[0] : -2;
+}
+
+                                                            //lru, ttl and invalidation of the cache alone
+static void cache_alone(void)
+{
+    static MB_GW_CACHE_STRU c;
+    int                     k, ok;
+
+    mb_gw_cache_init(&c);
+    for(k = 0; k < MB_GW_CACHE_NUM; k++){                   //full, entry 0 is the least recent
+        put(&c, 0, T_UID, 3, (uint16_t)(k * 10), 10, (uint8_t)k);
+    }
+    CHECK(c.num == MB_GW_CACHE_NUM && c.evict_cnt == 0);
+    CHECK(get(&c, 0, T_UID, 3, 0, 10) == 0);                //now the most recent, entry 1 the least
+    put(&c, 0, T_UID, 3, 5000, 10, 0xAA);
+    CHECK(c.evict_cnt == 1 && c.num == MB_GW_CACHE_NUM);
+    CHECK(get(&c, 0, T_UID, 3, 10, 10) == -1);              //evicted
+    CHECK(get(&c, 0, T_UID, 3, 0, 10) == 0 && get(&c, 0, T_UID, 3, 5000, 10) == 0xAA);
+    put(&c, 0, T_UID, 3, 5010, 10, 0xBB);                   //entry 2 goes next
+    CHECK(get(&c, 0, T_UID, 3, 20, 10) == -1 && c.evict_cnt == 2);
+    for(k = 3, ok = 0; k < MB_GW_CACHE_NUM; k++){
+        ok += (get(&c, 0, T_UID, 3, (uint16_t)(k * 10), 10) == k);
+    }
+    CHECK(ok == MB_GW_CACHE_NUM - 3);
+    put(&c, 0, T_UID, 3, 0, 10, 0xCC);                      //the same key is replaced, not added
+    CHECK(get(&c, 0, T_UID, 3, 0, 10) == 0xCC && c.evict_cnt == 2);
+
+                                                            //the ttl
+    now += 1000000;
+    CHECK(get(&c, 0, T_UID, 3, 0, 10) == -1 && c.expire_cnt == 1 && c.num == MB_GW_CACHE_NUM - 1);
+    now -= 1000000;
+
+                                                            //invalidation
+    mb_gw_cache_init(&c);
+    put(&c, 0, T_UID, 3, 0,  10, 1);                        //holding 0 ~ 9
+    put(&c, 0, T_UID, 3, 10, 10, 2);                        //10 ~ 19
+    put(&c, 0, T_UID, 3, 20, 5,  3);                        //20 ~ 24
+    put(&c, 0, T_UID + 1, 3, 0, 10, 4);                     //another unit
+    put(&c, 1, T_UID, 3, 0, 10, 5);                         //another line
+    put(&c, 0, T_UID, 1, 0, 16, 6);                         //the coils 0 ~ 15
+    put(&c, 0, T_UID, 4, 0, 10, 7);                         //the input registers, no write
+    mb_gw_cache_invalidate(&c, 0, T_UID, 3, 12, 1);         //06 to 12
+    CHECK(c.inval_cnt == 1 && get(&c, 0, T_UID, 3, 10, 10) == -1);
+    CHECK(get(&c, 0, T_UID, 3, 0, 10) == 1 && get(&c, 0, T_UID, 3, 20, 5) == 3);
+    mb_gw_cache_invalidate(&c, 0, T_UID, 3, 25, 10);        //16 to 25 ~ 34, touches 20 ~ 24 only
+    CHECK(c.inval_cnt == 1 && get(&c, 0, T_UID, 3, 20, 5) == 3);
+    mb_gw_cache_invalidate(&c, 0, T_UID, 3, 9, 12);         //16 to 9 ~ 20
+    CHECK(c.inval_cnt == 3 && get(&c, 0, T_UID, 3, 0, 10) == -1 && get(&c, 0, T_UID, 3, 20, 5) == -1);
+    CHECK(get(&c, 0, T_UID + 1, 3, 0, 10) == 4 && get(&c, 1, T_UID, 3, 0, 10) == 5);
+    CHECK(get(&c, 0, T_UID, 1, 0, 16) == 6 && get(&c, 0, T_UID, 4, 0, 10) == 7);
+    mb_gw_cache_invalidate(&c, 0, T_UID, 1, 15, 1);         //05 to the coil 15
+    CHECK(c.inval_cnt == 4 && get(&c, 0, T_UID, 1, 0, 16) == -1 && get(&c, 0, T_UID, 4, 0, 10) == 7);
+    CHECK(c.num == 3);                                      //the other unit, the other line, the inputs
+}
+
+                                                            //a request of fc 03 or 06, the result of mb_gw_submit(), the answer in q[] if cached
+static int32_t submit(uint8_t q[], uint16_t tid, int32_t conn, uint8_t fc, uint16_t addr, uint16_t v)
+{
+    const uint8_t a[12] = { tid >> 8, tid & 0xFF, 0, 0, 0, 6, T_UID, fc, addr >> 8, addr & 0xFF, v >> 8, v & 0xFF };
+    uint16_t      len = sizeof(a);
+
+    memcpy(q, a, sizeof(a));
+    return mb_gw_submit(&gw, q, &len, conn, 0, now);
+}
+
+                                                            //the next answer, its tid, -1= none
+static int reply(uint8_t d[])
+{
+    uint16_t len;
+    int32_t  conn;
+    uint32_t tag;
+
+    if(mb_gw_reply(&gw, d, &len, &conn, &tag, now) != 0){
+        return -1;
+    }
+    return (d[0] << 8) | d[1];
+}
+
+int main(void)
+{
+    uint8_t q[MB_TCP_BUF_SIZE], d[MB_TCP_BUF_SIZE];
+    int     k, w = -1, r = -1;
+
+    CHECK(mb_gw_init(&gw) == 0);
+    CHECK(mb_gw_route(&gw, T_UID, 0) == 0);
+
+                                                            //a repeated read is a hit
+    CHECK(submit(q, 1, 1, 3, 0, 1) == 0);
+    while(device()){
+        ;
+    }
+    CHECK(reply(d) == 1);
+    CHECK(submit(q, 2, 1, 3, 0, 1) == MB_GW_CACHED && q[0] == 0 && q[1] == 2);
+    CHECK(line.hit_cnt == 1);
+
+                                                            //client 1 reads, then writes reg 0, client 2 reads reg 0 after the write
+    bus_num = 0;
+    CHECK(submit(q, 10, 1, 3, 100, 1) == 0);
+    CHECK(submit(q, 11, 1, 3, 110, 1) == 0);
+    CHECK(submit(q, 12, 1, 6, 0, 0x5555) == 0);
+    CHECK(submit(q, 20, 2, 3, 0, 1) == 0);
+    while(device()){
+        ;
+    }
+    for(k = 0; k < bus_num; k++){
+        if(bus_fc[k] == 6){
+            w = k;
+        }
+        if(bus_fc[k] == 3 && bus_addr[k] == 0){
+            r = k;
+        }
+    }
+    CHECK(r >= 0 && w >= 0 && r < w);                       //the case, the read of client 2 went first
+    for(k = 0; k < 4; k++){
+        CHECK(reply(d) >= 0);
+    }
+    CHECK(reply(d) == -1);
+
+                                                            //the write is answered, its value is read
+    k = submit(q, 13, 1, 3, 0, 1);
+    CHECK(k == 0 || k == MB_GW_CACHED);
+    if(k == 0){
+        while(device()){
+            ;
+        }
+        CHECK(reply(q) == 13);
+    }
+    CHECK(q[MB_TCP_FUNC] == 3 && q[MB_TCP_FUNC + 2] == 0x55 && q[MB_TCP_FUNC + 3] == 0x55);
+
+    cache_alone();
+
+    return t_done("test_gw_cache");
+}
@@ -0,0 +1,122 @@
+/**
+  ******************************************************************************
+  * @file    host test of the bus side of the gateway, mbgw.c
+  * @author  arthur.qiang.li
+  * @brief   no port, the test is both the tcp task and the rtu device of
+             one line, it calls mb_gw_submit() / mb_gw_reply() and answers
+             the frames of mb_gw_line_next() by mb_gw_line_frame(). the
+             device maps the registers 0 ~ 1 and 4 ~ 5, 2 ~ 3 is a hole:
+                - two reads which touch go on the bus as one read, each
+                  client gets its part.
+                - three reads which touch, the middle one of the hole, are
+                  coalesced, the device answers the exception to the whole
+                  range. each read goes again by itself, only the one of the
+                  hole gets the exception, the others their registers.
+  *
+  ******************************************************************************
+  */
+
+#include <stdlib.h>
+#include "mbgw.h"
+#include "mbcrc.h"
+#include "t_common.h"
+
+#define T_UID           ( 10 )
+
+static MB_GW_LINE_STRU line = { .baudrate = 115200, .timeout_ms = 100 };
+static MB_GW_STRU      gw   = { .p_lines = { &line }, .num = 1 };
+static uint64_t        now  = 1000000;
+
+                                                            //the device answers the frame on the bus, or not if nothing is sent
+static int device(void)
+{
+    uint8_t  *f, a[300];
+    uint16_t  n, addr, num, i;
+    int       m = 0;
+
+    now += 10000;
+    if(mb_gw_line_next(&line, now, &f, &n) != 0){
+        return 0;
+    }
+    addr = (uint16_t)((f[2] << 8) | f[3]);
+    num  = (uint16_t)((f[4] << 8) | f[5]);
+    a[m++] = f[0];
+    if(f[1] != 3 || addr + num > 6 || (addr < 4 && addr + num > 2)){
+        a[m++] = f[1] | 0x80;
+        a[m++] = 2;                                         //illegal data address
+    }
+    else{
+        a[m++] = 3;
+        a[m++] = (uint8_t)(num * 2);
+        for(i = 0; i < num; i++){
+            a[m++] = 0x10;
+            a[m++] = (uint8_t)(addr + i);
+        }
+    }
+    i = usMBCRC16(a, (uint16_t)m);
+    a[m++] = (uint8_t)(i & 0xFF);
+    a[m++] = (uint8_t)(i >> 8);
+    now += 10000;
+    mb_gw_line_frame(&line, a, (uint16_t)m, now);
+    return 1;
+}
+
+static void submit(uint16_t tid, int32_t conn, uint16_t addr, uint16_t num)
+{
+    uint8_t  q[12] = { tid >> 8, tid & 0xFF, 0, 0, 0, 6, T_UID, 3, addr >> 8, addr & 0xFF, num >> 8, num & 0xFF };
+    uint16_t len = sizeof(q);
+
+    CHECK(mb_gw_submit(&gw, q, &len, conn, 0, now) == 0);
+}
+
+                                                            //the next answer, its pdu to p[], its tid, -1= none
+static int reply(uint8_t p[], int n_max)
+{
+    uint8_t  d[MB_TCP_BUF_SIZE];
+    uint16_t len;
+    int32_t  conn;
+    uint32_t tag;
+
+    if(mb_gw_reply(&gw, d, &len, &conn, &tag, now) != 0){
+        return -1;
+    }
+    memcpy(p, &d[MB_TCP_FUNC], (len - MB_TCP_FUNC) < n_max ? (len - MB_TCP_FUNC) : n_max);
+    return (d[0] << 8) | d[1];
+}
+
+int main(void)
+{
+    uint8_t p[300];
+    int     bus;
+
+    CHECK(mb_gw_init(&gw) == 0);
+    CHECK(mb_gw_route(&gw, T_UID, 0) == 0);
+
+                                                            //touching, one read of 0 ~ 1
+    submit(1, 1, 0, 1);
+    submit(2, 2, 1, 1);
+    bus = 0;
+    while(device()){
+        bus++;
+    }
+    CHECK(bus == 1);
+    CHECK(reply(p, sizeof(p)) == 1 && p[0] == 3 && p[1] == 2 && p[3] == 0);
+    CHECK(reply(p, sizeof(p)) == 2 && p[0] == 3 && p[1] == 2 && p[3] == 1);
+
+                                                            //over the hole, the exception is of one of them
+    submit(3, 1, 0, 2);
+    submit(4, 2, 2, 2);
+    submit(5, 3, 4, 2);
+    bus = 0;
+    while(device()){
+        bus++;
+    }
+    CHECK(bus == 4);                                        //the coalesced read, then each one alone
+    CHECK(line.split_cnt == 1);
+    CHECK(reply(p, sizeof(p)) == 3 && p[0] == 3 && p[1] == 4 && p[3] == 0 && p[5] == 1);
+    CHECK(reply(p, sizeof(p)) == 4 && p[0] == 0x83 && p[1] == 2);
+    CHECK(reply(p, sizeof(p)) == 5 && p[0] == 3 && p[1] == 4 && p[3] == 4 && p[5] == 5);
+    CHECK(reply(p, sizeof(p)) == -1);
+
+    return t_done("test_gw_line");
+}
@@ -0,0 +1,176 @@
+/**
+  ******************************************************************************
+  * @file    host test of the retries of the master, mbmaster.c
+  * @author  arthur.qiang.li
+  * @brief   no port, the test is the tcp link and the device, a read of one
+             holding register is answered with the tid of its request as the
+             value, so the answer taken tells which try it is of. the clock
+             moves only in p_wait():
+                - no answer to the first try, the retry goes with a new tid,
+                  its answer is taken.
+                - the answer of the first try comes late, in front of the one
+                  of the retry, it is dropped.
+                - a read times out, its answer comes before the next read is
+                  sent, or while it waits, it is dropped both times.
+                - an answer of another unit is dropped.
+                - no answer at all, the timeout after each try, the counters.
+  *
+  ******************************************************************************
+  */
+
+#include "mb.h"
+#include "mbmaster.h"
+#include "mbtcp.h"
+#include "t_common.h"
+
+#define T_UID           ( 7 )
+#define T_RXQ           ( 8 )
+
+static uint8_t  rxq[T_RXQ][MB_TCP_BUF_SIZE];                //the frames the device sent, not taken yet
+static uint16_t rxq_len[T_RXQ];
+static int      rxq_n;
+static uint16_t tids[16];                                   //of the requests sent
+static int      tx_n;
+static int      silent;                                     //requests the device does not answer
+static int      late;                                       //1= the answer of the request before goes first
+static uint8_t  uid = T_UID;                                //of the answers
+static uint32_t now_ms;
+
+                                                            //the answer of the read of tid, one register, its value is the tid
+static void answer(uint16_t tid)
+{
+    uint8_t *a = rxq[rxq_n];
+
+    a[0] = (uint8_t)(tid >> 8);
+    a[1] = (uint8_t)(tid & 0xFF);
+    a[2] = 0;
+    a[3] = 0;
+    a[4] = 0;
+    a[5] = 5;
+    a[6] = uid;
+    a[7] = 3;
+    a[8] = 2;
+    a[9] = (uint8_t)(tid >> 8);
+    a[10] = (uint8_t)(tid & 0xFF);
+    rxq_len[rxq_n++] = 11;
+}
+
+static int32_t  ev_init(void)        { rxq_n = 0; return 0; }
+static int32_t  ev_post(uint32_t e)  { (void)e; return 0; }
+static int32_t  ev_get(uint32_t *e)  { *e = EV_FRAME_RECEIVED; return (rxq_n > 0) ? 0 : 1; }
+static int32_t  cli_init(uint16_t p) { (void)p; return 0; }
+static void     cli_enable(uint32_t en) { (void)en; }
+static int32_t  wait_ms(int32_t ms)  { now_ms += (uint32_t)ms; return 0; }
+static uint32_t tick_ms(void)        { return now_ms; }
+
+static int32_t cli_receiving(uint8_t d[], uint16_t *len)
+{
+    if(rxq_n == 0){
+        return __LINE__;
+    }
+    memcpy(d, rxq[0], rxq_len[0]);
+    *len = rxq_len[0];
+    rxq_n--;
+    memmove(rxq[0], rxq[1], sizeof(rxq[0]) * (size_t)rxq_n);
+    memmove(&rxq_len[0], &rxq_len[1], sizeof(rxq_len[0]) * (size_t)rxq_n);
+    return 0;
+}
+
+static int32_t cli_send(uint8_t d[], uint16_t len)
+{
+    uint16_t tid = (uint16_t)((d[0] << 8) | d[1]);
+
+    (void)len;
+    tids[tx_n++] = tid;
+    if(silent > 0){
+        silent--;
+        return 0;
+    }
+    if(late){
+        answer((uint16_t)(tid - 1));
+    }
+    answer(tid);
+    return 0;
+}
+
+static MB_SLAVE_STRU link = {
+    .mode               = MB_TCP,
+    .p_event_init       = ev_init,
+    .p_event_post       = ev_post,
+    .p_event_get        = ev_get,
+    .p_tcpsvr_init      = cli_init,
+    .p_tcpsvr_enable    = cli_enable,
+    .p_tcpsvr_receiving = cli_receiving,
+    .p_tcpsvr_send      = cli_send,
+};
+
+static MB_MASTER_STRU m = {
+    .p_link     = &link,
+    .p_wait     = wait_ms,
+    .p_tick_ms  = tick_ms,
+    .timeout_ms = 100,
+    .retries    = 1,
+};
+
+int main(void)
+{
+    uint16_t r;
+    uint32_t t0, drop;
+
+    CHECK(mb_master_init(&m) == 0 && mb_master_enable(&m, 1) == 0);
+
+                                                            //the retry has a new tid
+    tx_n   = 0;
+    silent = 1;
+    t0     = now_ms;
+    CHECK(mb_master_read_holding(&m, T_UID, 0, 1, &r) == 0);
+    CHECK(tx_n == 2 && tids[1] == (uint16_t)(tids[0] + 1) && r == tids[1]);
+    CHECK(now_ms - t0 == 100 && m.timeout_cnt == 1 && m.retry_cnt == 1 && m.drop_cnt == 0);
+
+                                                            //the late answer of the first try, in front of the one of the retry
+    tx_n   = 0;
+    silent = 1;
+    late   = 1;
+    CHECK(mb_master_read_holding(&m, T_UID, 0, 1, &r) == 0);
+    CHECK(tx_n == 2 && r == tids[1] && m.drop_cnt == 1 && m.retry_cnt == 2);
+    late   = 0;
+
+                                                            //a read times out, its answer comes before the next read is sent
+    m.retries = 0;
+    tx_n   = 0;
+    silent = 1;
+    CHECK(mb_master_read_holding(&m, T_UID, 0, 1, &r) == MB_MASTER_ETIMEOUT);
+    answer(tids[0]);
+    drop   = m.drop_cnt;
+    CHECK(mb_master_read_holding(&m, T_UID, 0, 1, &r) == 0);
+    CHECK(r == tids[1] && m.drop_cnt == drop + 1);
+
+                                                            //and while the next read waits
+    tx_n   = 0;
+    silent = 1;
+    CHECK(mb_master_read_holding(&m, T_UID, 0, 1, &r) == MB_MASTER_ETIMEOUT);
+    late   = 1;
+    CHECK(mb_master_read_holding(&m, T_UID, 0, 1, &r) == 0);
+    CHECK(r == tids[1] && m.drop_cnt == drop + 2);
+    late   = 0;
+
+                                                            //another unit
+    uid    = T_UID + 1;
+    CHECK(mb_master_read_holding(&m, T_UID, 0, 1, &r) == MB_MASTER_ETIMEOUT);
+    CHECK(m.drop_cnt == drop + 3);
+    uid    = T_UID;
+
+                                                            //no answer to any try
+    m.retries = 2;
+    m.timeout_cnt = 0;
+    m.retry_cnt   = 0;
+    tx_n   = 0;
+    silent = 3;
+    t0     = now_ms;
+    CHECK(mb_master_read_holding(&m, T_UID, 0, 1, &r) == MB_MASTER_ETIMEOUT);
+    CHECK(tx_n == 3 && tids[2] == (uint16_t)(tids[0] + 2) && now_ms - t0 == 300);
+    CHECK(m.timeout_cnt == 3 && m.retry_cnt == 2);
+
+    printf("requests %u, answers %u, timeouts %u, dropped %u\n", m.req_cnt, m.ok_cnt, m.timeout_cnt, m.drop_cnt);
+    return t_done("test_master");
+}
@@ -0,0 +1,140 @@
+/**
+  ******************************************************************************
+  * @file    host test of the poll list planner, mbplan.c
+  * @author  arthur.qiang.li
+  * @brief   no master, no port, only mb_plan_build(), the reads it makes of
+             a few tags, given out of order:
+                - tags which overlap or touch are one read, on any line.
+                - on rtu a gap is read while the longer read costs no more
+                  than two reads, mb_plan_read_us(), at the last such gap and
+                  one register after it. on tcp any gap is read.
+                - a hole in the gap splits the read, at the first and the last
+                  register of the gap. a hole which only touches the gap, or
+                  is of another unit or table, does not.
+                - a read is 125 registers or 2000 bits at most, or the less
+                  of the device, reg_max and bit_max. a tag wider than the
+                  limit is refused.
+                - the pos of the tags, in p_regs[] and in p_bits[], where a
+                  read starts in a byte of its own.
+  *
+  ******************************************************************************
+  */
+
+#include "mbplan.h"
+#include "t_common.h"
+
+#define T_REQ_MAX       ( 16 )
+
+static MB_PLAN_REQ_STRU  reqs[T_REQ_MAX];
+static uint16_t          regs[1024];
+static uint8_t           bits[512];
+static MB_PLAN_HOLE_STRU holes[2];
+static MB_PLAN_STRU      p;
+static MB_PLAN_TAG_STRU  tags[4];
+
+static void cfg(uint32_t baudrate, int hole_num)
+{
+    memset(&p, 0, sizeof(p));
+    p.baudrate      = baudrate;
+    p.turnaround_us = 5000;
+    p.p_holes       = holes;
+    p.hole_num      = (uint16_t)hole_num;
+    p.p_reqs        = reqs;
+    p.req_max       = T_REQ_MAX;
+    p.p_regs        = regs;
+    p.reg_size      = sizeof(regs) / sizeof(regs[0]);
+    p.p_bits        = bits;
+    p.bit_size      = sizeof(bits);
+}
+
+static void hole(int k, uint8_t uid, uint8_t fc, uint16_t addr, uint16_t num)
+{
+    holes[k].uid  = uid;
+    holes[k].fc   = fc;
+    holes[k].addr = addr;
+    holes[k].num  = num;
+}
+
+                                                            //two tags of unit 1, the second one first, the reads of the plan, -1= refused
+static int plan2(uint8_t fc, uint16_t a, uint16_t aw, uint16_t b, uint16_t bw)
+{
+    memset(tags, 0, sizeof(tags));
+    tags[0].uid   = 1;
+    tags[0].fc    = fc;
+    tags[0].addr  = b;
+    tags[0].width = bw;
+    tags[1].uid   = 1;
+    tags[1].fc    = fc;
+    tags[1].addr  = a;
+    tags[1].width = aw;
+    return (mb_plan_build(&p, tags, 2) == 0) ? (int)p.req_num : -1;
+}
+
+int main(void)
+{
+    const uint8_t H = MB_FUNC_READ_HOLDING_REGISTER, C = MB_FUNC_READ_COILS;
+    uint16_t      g;
+
+                                                            //overlap and touch
+    cfg(19200, 0);
+    CHECK(plan2(H, 0, 2, 1, 2) == 1 && reqs[0].addr == 0 && reqs[0].num == 3);
+    CHECK(plan2(H, 0, 2, 2, 2) == 1 && reqs[0].num == 4);
+    CHECK(plan2(H, 0, 4, 1, 2) == 1 && reqs[0].num == 4);
+    CHECK(tags[0].addr == 0 && tags[1].addr == 1);          //sorted
+
+                                                            //the gap at the cost of a read
+    for(g = 0; mb_plan_read_us(&p, H, (uint16_t)(g + 3)) <= 2 * mb_plan_read_us(&p, H, 1); g++){
+        ;
+    }
+    CHECK(g > 1 && g < 100);                                //g is the last gap read, 2 tags of 1 and g registers between
+    CHECK(plan2(H, 0, 1, (uint16_t)(1 + g), 1) == 1 && reqs[0].num == g + 2);
+    CHECK(plan2(H, 0, 1, (uint16_t)(2 + g), 1) == 2);
+    cfg(0, 0);
+    CHECK(plan2(H, 0, 1, 124, 1) == 1 && reqs[0].num == 125);
+
+                                                            //a hole in the gap [1, 50)
+    hole(0, 1, H, 1, 1);
+    cfg(0, 1);
+    CHECK(plan2(H, 0, 1, 50, 1) == 2);
+    hole(0, 1, H, 49, 1);
+    CHECK(plan2(H, 0, 1, 50, 1) == 2);
+    hole(0, 1, H, 0, 1);                                    //touches the gap, before it
+    CHECK(plan2(H, 0, 1, 50, 1) == 1);
+    hole(0, 2, H, 10, 5);
+    hole(1, 1, MB_FUNC_READ_INPUT_REGISTER, 10, 5);
+    cfg(0, 2);
+    CHECK(plan2(H, 0, 1, 50, 1) == 1 && reqs[0].num == 51);
+    hole(0, 1, H, 0, 2);                                    //over an overlap, it is read anyway
+    cfg(0, 1);
+    CHECK(plan2(H, 0, 2, 1, 2) == 1);
+
+                                                            //the limits
+    cfg(0, 0);
+    CHECK(plan2(H, 0, 1, 124, 1) == 1);
+    CHECK(plan2(H, 0, 1, 125, 1) == 2 && reqs[0].num == 1 && reqs[1].num == 1);
+    CHECK(plan2(H, 0, 100, 100, 25) == 1 && reqs[0].num == 125);
+    CHECK(plan2(H, 0, 100, 100, 26) == 2);
+    CHECK(plan2(H, 0, 125, 200, 1) == 2);
+    CHECK(plan2(H, 0, 126, 200, 1) == -1);
+    CHECK(plan2(C, 0, 1, 1999, 1) == 1 && reqs[0].num == 2000);
+    CHECK(plan2(C, 0, 1, 2000, 1) == 2);
+    CHECK(plan2(C, 0, 2000, 3000, 1) == 2);
+    CHECK(plan2(C, 0, 2001, 3000, 1) == -1);
+    p.reg_max = 10;
+    p.bit_max = 64;
+    CHECK(plan2(H, 0, 1, 9, 1) == 1);
+    CHECK(plan2(H, 0, 1, 10, 1) == 2);
+    CHECK(plan2(H, 0, 11, 20, 1) == -1);
+    CHECK(plan2(C, 0, 1, 63, 1) == 1);
+    CHECK(plan2(C, 0, 1, 64, 1) == 2);
+
+                                                            //pos
+    cfg(0, 0);
+    CHECK(plan2(H, 10, 2, 14, 2) == 1 && tags[0].pos == 0 && tags[1].pos == 4);
+    CHECK(plan2(H, 10, 2, 200, 2) == 2 && tags[1].pos == 2 && reqs[1].pos == 2 && p.reg_num == 4);
+    CHECK(plan2(C, 3, 3, 9, 1) == 1 && tags[0].pos == 0 && tags[1].pos == 6);
+    CHECK(plan2(C, 3, 3, 3000, 1) == 2 && reqs[1].pos == 1 && tags[1].pos == 8 && p.bit_num == 2);
+
+    printf("gap read on rtu 19200, 5 ms turnaround: up to %u registers\n", g);
+    return t_done("test_plan");
+}
@@ -0,0 +1,115 @@
+/**
+  ******************************************************************************
+  * @file    host test of the linux rtu slave port, mb_port_rtu_linux.c
+  * @author  arthur.qiang.li
+  * @brief   the slave runs in a thread on the slave side of a pty, opened by
+             the name MB_PORT_SERIAL_DEVICE, a link to it. the test is the
+             master on the other side:
+                - 200 reads, each answered whole with a good crc.
+                - a request to another unit and ours right behind it, in one
+                  write, as a usb adapter gives them in one chunk, ours must
+                  be answered at once, not at the timeout of the wait.
+  *
+  ******************************************************************************
+  */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+#include <poll.h>
+#include "mb.h"
+#include "mb_port_linux.h"
+#include "t_common.h"
+
+#define T_WAIT_MS       ( 500 )                             //of the slave loop, a frame left behind waits this long
+
+static volatile int stop;
+
+static void *slave(void *a)
+{
+    (void)a;
+    while(!stop){
+        mb_port_rtu_linux_wait(T_WAIT_MS);
+        mb_poll(&mb_slave_rtu_linux);
+    }
+    return 0;
+}
+
+                                                            //read an answer of n bytes, its time in us, 0= none
+static uint64_t answer(int m, uint8_t b[], int n, uint64_t t0)
+{
+    struct pollfd p = { m, POLLIN, 0 };
+    int           got = 0, r;
+
+    while(got < n){
+        if(poll(&p, 1, 2 * T_WAIT_MS) <= 0){
+            return 0;
+        }
+        r = (int)read(m, b + got, 300 - got);
+        if(r > 0){
+            got += r;
+        }
+    }
+    return usMBCRC16(b, (uint16_t)n) == 0 ? t_now_us() - t0 : 0;
+}
+
+int main(void)
+{
+    const uint8_t  rd[] = { 3, 0, 0, 0, 10 };
+    uint8_t        req[16], other[16], two[32], b[300];
+    int            m, k, n, ok = 0;
+    uint64_t       t, mx = 0;
+    struct termios tio;
+    pthread_t      th;
+
+    m = posix_openpt(O_RDWR | O_NOCTTY);
+    CHECK(m >= 0 && grantpt(m) == 0 && unlockpt(m) == 0);
+    unlink(MB_PORT_SERIAL_DEVICE);
+    CHECK(symlink(ptsname(m), MB_PORT_SERIAL_DEVICE) == 0);
+    tcgetattr(m, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(m, TCSANOW, &tio);
+
+    if(mb_init(&mb_slave_rtu_linux) != 0){
+        printf("FAIL mb_init\n");
+        return 1;
+    }
+    mb_enable(&mb_slave_rtu_linux, 1);
+    pthread_create(&th, 0, slave, 0);
+    usleep(100000);
+
+    n = t_rtu_frame(req, 1, rd, sizeof(rd));
+    for(k = 0; k < 200; k++){
+        t = t_now_us();
+        CHECK(write(m, req, n) == n);
+        t = answer(m, b, 25, t);
+        ok += (t != 0 && b[0] == 1 && b[1] == 3 && b[2] == 20);
+        if(t > mx){
+            mx = t;
+        }
+        usleep(2000);
+    }
+    CHECK(ok == 200);
+
+                                                            //two frames in one chunk, the first is not ours
+    t_rtu_frame(other, 2, rd, sizeof(rd));
+    memcpy(two, other, n);
+    memcpy(two + n, req, n);
+    for(k = 0; k < 20; k++){
+        tcflush(m, TCIFLUSH);
+        t = t_now_us();
+        CHECK(write(m, two, 2 * n) == 2 * n);
+        t = answer(m, b, 25, t);
+        CHECK(t != 0 && t < 50000);                         //well below T_WAIT_MS
+        usleep(5000);
+    }
+
+    stop = 1;
+    pthread_join(th, 0);
+    unlink(MB_PORT_SERIAL_DEVICE);
+    printf("200 reads, round trip max %llu us\n", (unsigned long long)mx);
+    return t_done("test_rtu_linux");
+}
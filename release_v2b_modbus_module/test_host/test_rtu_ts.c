@@ -0,0 +1,100 @@
+/**
+  ******************************************************************************
+  * @file    host test of the timestamp rtu framing, mbrtu_ts.c
+  * @author  arthur.qiang.li
+  * @brief   synthetic timestamps first, back to back frames in one chunk, a
+             frame of an unknown function closed by the gap, a gap between
+             two chunks, an overrun. then a pty pair, the master side writes a
+             request in two pieces and another right behind it, the slave
+             side reads the chunks as they come, each must come out whole.
+  *
+  ******************************************************************************
+  */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "mbrtu_ts.h"
+#include "t_common.h"
+
+int main(void)
+{
+    MB_RTU_TS_STRU ts;
+    uint8_t        a[300], b[300], buf[600], o[300];
+    const uint8_t  r1[] = { 3, 0, 0, 0, 10 };
+    const uint8_t  r2[] = { 16, 0, 1, 0, 2, 4, 1, 2, 3, 4 };
+    const uint8_t  g[]  = { 1, 0x55, 1, 2, 3, 4, 5 };       //function 0x55, no known length
+    int            na, nb, m, s, k, l, ok = 0;
+    struct termios tio;
+    uint64_t       t0;
+
+    na = t_rtu_frame(a, 1, r1, sizeof(r1));
+    nb = t_rtu_frame(b, 1, r2, sizeof(r2));
+
+    /* back to back in one chunk, split by the length and the crc */
+    mb_rtu_ts_init(&ts, 9600, 0);
+    memcpy(buf, a, na);
+    memcpy(buf + na, b, nb);
+    mb_rtu_ts_feed(&ts, buf, (uint16_t)(na + nb), 100000);
+    CHECK(ts.q_cnt == 2);
+    CHECK(ts.split_len_cnt == 2);
+    CHECK(mb_rtu_ts_get(&ts, o, 300) == na && memcmp(o, a, na) == 0);
+    CHECK(mb_rtu_ts_get(&ts, o, 300) == nb && memcmp(o, b, nb) == 0);
+
+    /* unknown function, closed by the gap only, not before t35 + tol */
+    mb_rtu_ts_feed(&ts, g, 4, 200000);
+    mb_rtu_ts_feed(&ts, g + 4, 3, 200000 + 3 * 1145 + 500);
+    CHECK(mb_rtu_ts_poll(&ts, 200000 + 3 * 1145 + 600) == 0);
+    CHECK(mb_rtu_ts_deadline(&ts) != 0);
+    CHECK(mb_rtu_ts_poll(&ts, 300000) == 1);
+    CHECK(mb_rtu_ts_deadline(&ts) == 0);
+    CHECK(mb_rtu_ts_get(&ts, o, 300) == 7);
+
+    /* a gap longer than t35 between two chunks makes two frames */
+    mb_rtu_ts_feed(&ts, g, 4, 400000);
+    mb_rtu_ts_feed(&ts, g + 4, 3, 400000 + 3 * 1145 + 5000);
+    mb_rtu_ts_poll(&ts, 500000);
+    CHECK(mb_rtu_ts_get(&ts, o, 300) == 4);
+    CHECK(mb_rtu_ts_get(&ts, o, 300) == 3);
+
+    /* more than a frame, dropped up to the next gap */
+    memset(buf, 0x77, sizeof(buf));
+    mb_rtu_ts_feed(&ts, buf, 300, 600000);
+    mb_rtu_ts_poll(&ts, 700000);
+    CHECK(ts.overrun_cnt == 1);
+    CHECK(ts.q_cnt == 0);
+
+    /* a pty, the frames come in the chunks the kernel makes of them */
+    m = posix_openpt(O_RDWR | O_NOCTTY);
+    CHECK(m >= 0 && grantpt(m) == 0 && unlockpt(m) == 0);
+    s = open(ptsname(m), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    CHECK(s >= 0);
+    tcgetattr(s, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(s, TCSANOW, &tio);
+    mb_rtu_ts_init(&ts, 115200, 2000);
+    for(k = 0; k < 50; k++){
+        CHECK(write(m, a, 3) == 3);
+        usleep(300);
+        CHECK(write(m, a + 3, na - 3) == na - 3);
+        CHECK(write(m, b, nb) == nb);
+        t0 = t_now_us();
+        while(t_now_us() - t0 < 20000){
+            l = (int)read(s, buf, sizeof(buf));
+            if(l > 0){
+                mb_rtu_ts_feed(&ts, buf, (uint16_t)l, t_now_us());
+            }
+            mb_rtu_ts_poll(&ts, t_now_us());
+            while((l = mb_rtu_ts_get(&ts, o, 300)) > 0){
+                ok += (l == na && memcmp(o, a, na) == 0) || (l == nb && memcmp(o, b, nb) == 0);
+            }
+        }
+    }
+    CHECK(ok == 100);
+    CHECK(ts.frame_cnt == 100);
+    close(s);
+    close(m);
+    return t_done("test_rtu_ts");
+}
@@ -0,0 +1,190 @@
+/**
+  ******************************************************************************
+  * @file    host test of the accounting of the scan scheduler, mbsched.c
+  * @author  arthur.qiang.li
+  * @brief   no port, the master reads through a link which is the bus, a
+             read of n registers takes n ms of a virtual clock, the clock
+             moves else only by the sleeps mb_sched_poll() gives. each period
+             of a group is a scan or a skip, so scans + skips is the periods
+             run, to one:
+                - in load, no miss, no skip, a scan each period.
+                - a slow group over its period, each scan misses its
+                  deadline once and goes on as the scan of the next period,
+                  a miss and a skip. the fast group never misses.
+                - a scan which ends past its deadline, shorter than the
+                  period, is a miss without a skip.
+                - a long read of another group holds a group back by whole
+                  periods, they are skipped and missed at its release.
+                - mb_sched_init() again starts the statistics over, no group
+                  is refused.
+  *
+  ******************************************************************************
+  */
+
+#include "mb.h"
+#include "mbtcp.h"
+#include "mbmaster.h"
+#include "mbplan.h"
+#include "mbsched.h"
+#include "t_common.h"
+
+#define T_TAG_MAX       ( 64 )
+
+static MB_PLAN_STRU        plan[2];
+static MB_PLAN_REQ_STRU    reqs[2][T_TAG_MAX];
+static uint16_t            regs[2][T_TAG_MAX * 125];
+static MB_PLAN_TAG_STRU    tags[2][T_TAG_MAX];
+static MB_SCHED_GROUP_STRU grp[2];
+static MB_SCHED_STRU       s;
+
+static uint32_t            now_ms;
+static uint8_t             ans[MB_TCP_BUF_SIZE];
+static uint16_t            ans_len;
+
+static int32_t  v_ok(void)              { return 0; }
+static int32_t  v_post(uint32_t e)      { (void)e; return 0; }
+static int32_t  v_get(uint32_t *e)      { *e = EV_FRAME_RECEIVED; return (ans_len > 0) ? 0 : 1; }
+static int32_t  v_init(uint16_t p)      { (void)p; return 0; }
+static void     v_enable(uint32_t en)   { (void)en; }
+static int32_t  v_wait(int32_t ms)      { (void)ms; return 0; }
+static uint32_t v_tick_ms(void)         { return now_ms; }
+
+static int32_t v_receiving(uint8_t d[], uint16_t *len)
+{
+    if(ans_len == 0){
+        return __LINE__;
+    }
+    memcpy(d, ans, ans_len);
+    *len    = ans_len;
+    ans_len = 0;
+    return 0;
+}
+
+                                                            //a read of n holding registers, n ms, answered with zeros
+static int32_t v_send(uint8_t d[], uint16_t len)
+{
+    uint16_t num = (uint16_t)((d[MB_TCP_FUNC + 3] << 8) | d[MB_TCP_FUNC + 4]);
+
+    (void)len;
+    now_ms += num;
+    memcpy(ans, d, MB_TCP_FUNC + 1);
+    ans[MB_TCP_LEN]      = (uint8_t)((num * 2 + 3) >> 8);
+    ans[MB_TCP_LEN + 1]  = (uint8_t)((num * 2 + 3) & 0xFF);
+    ans[MB_TCP_FUNC + 1] = (uint8_t)(num * 2);
+    memset(&ans[MB_TCP_FUNC + 2], 0, num * 2U);
+    ans_len = (uint16_t)(MB_TCP_FUNC + 2 + num * 2);
+    return 0;
+}
+
+static MB_SLAVE_STRU link = {
+    .mode               = MB_TCP,
+    .p_event_init       = v_ok,
+    .p_event_post       = v_post,
+    .p_event_get        = v_get,
+    .p_tcpsvr_init      = v_init,
+    .p_tcpsvr_enable    = v_enable,
+    .p_tcpsvr_receiving = v_receiving,
+    .p_tcpsvr_send      = v_send,
+};
+
+static MB_MASTER_STRU m = { .p_link = &link, .p_wait = v_wait, .p_tick_ms = v_tick_ms };
+
+                                                            //group g, n reads of w ms each, its period and deadline
+static void group(int g, int n, int w, uint32_t period_ms, uint32_t deadline_ms)
+{
+    MB_PLAN_STRU *p = &plan[g];
+    int           i;
+
+    memset(p, 0, sizeof(*p));
+    p->turnaround_us = (uint32_t)w * 1000;                  //tcp, the bus time of a read is the one of the link
+    p->p_reqs        = reqs[g];
+    p->req_max       = T_TAG_MAX;
+    p->p_regs        = regs[g];
+    p->reg_size      = sizeof(regs[g]) / sizeof(regs[g][0]);
+    for(i = 0; i < n; i++){
+        tags[g][i].uid   = 1;
+        tags[g][i].fc    = MB_FUNC_READ_HOLDING_REGISTER;
+        tags[g][i].addr  = (uint16_t)(i * 200);             //a read each
+        tags[g][i].width = (uint16_t)w;
+    }
+    CHECK(mb_plan_build(p, tags[g], (uint16_t)n) == 0 && p->req_num == n);
+    memset(&grp[g], 0, sizeof(grp[g]));
+    grp[g].p_plan      = p;
+    grp[g].period_ms   = period_ms;
+    grp[g].deadline_ms = deadline_ms;
+}
+
+                                                            //from now, for ms
+static void run(uint16_t group_num, uint32_t ms)
+{
+    uint32_t end;
+    int32_t  n;
+
+    s.p_master  = &m;
+    s.p_groups  = grp;
+    s.group_num = group_num;
+    CHECK(mb_sched_init(&s) == 0);
+    end = now_ms + ms;
+    while((int32_t)(now_ms - end) < 0){
+        n = mb_sched_poll(&s);
+        CHECK(n >= 0);
+        if(n < 0){
+            break;
+        }
+        now_ms += (uint32_t)n;
+    }
+}
+
+                                                            //scans + skips is the periods run, to one, the one going on
+static int periods_ok(const MB_SCHED_GROUP_STRU *g, uint32_t ms)
+{
+    uint32_t n = g->scan_cnt + g->skip_cnt;
+
+    return n + 1 >= ms / g->period_ms && n <= ms / g->period_ms + 1;
+}
+
+int main(void)
+{
+    CHECK(mb_master_init(&m) == 0 && mb_master_enable(&m, 1) == 0);
+
+                                                            //in load, 20% and 40%
+    group(0, 1, 2, 10, 0);
+    group(1, 4, 10, 100, 0);
+    run(2, 1000);
+    CHECK(grp[0].miss_cnt == 0 && grp[0].skip_cnt == 0 && periods_ok(&grp[0], 1000));
+    CHECK(grp[1].miss_cnt == 0 && grp[1].skip_cnt == 0 && periods_ok(&grp[1], 1000));
+    CHECK(grp[0].lat_max_ms <= 10 && grp[0].resp_max_ms <= 10 && grp[1].resp_max_ms <= 100);
+    CHECK(s.load_pm == 200 + 400);
+
+                                                            //overload, the slow group 120 ms of reads each 100 ms
+    group(0, 1, 2, 10, 0);
+    group(1, 60, 2, 100, 0);
+    run(2, 2000);
+    CHECK(s.load_pm == 200 + 1200);
+    CHECK(grp[0].miss_cnt == 0 && grp[0].skip_cnt == 0 && periods_ok(&grp[0], 2000));
+    CHECK(grp[1].scan_cnt >= 9 && grp[1].miss_cnt == grp[1].skip_cnt && periods_ok(&grp[1], 2000));
+    CHECK(grp[1].skip_cnt >= grp[1].scan_cnt);              //a scan takes 150 ms, so a period of two
+
+                                                            //done after the deadline, before the next release
+    group(0, 1, 60, 100, 50);
+    run(1, 1000);
+    CHECK(grp[0].scan_cnt == 10 && grp[0].miss_cnt == 10 && grp[0].skip_cnt == 0);
+    CHECK(grp[0].resp_max_ms == 60 && grp[0].lat_max_ms == 0);
+
+                                                            //held back by a read of 35 ms of another group
+    group(0, 1, 2, 10, 0);
+    group(1, 1, 35, 1000, 0);
+    run(2, 1000);
+    CHECK(grp[0].skip_cnt == 2 && grp[0].miss_cnt == 2 && periods_ok(&grp[0], 1000));
+    CHECK(grp[1].scan_cnt == 1 && grp[1].miss_cnt == 0);
+
+                                                            //start over
+    CHECK(mb_sched_init(&s) == 0);
+    CHECK(grp[0].scan_cnt == 0 && grp[0].miss_cnt == 0 && grp[0].skip_cnt == 0 && grp[0].lat_max_ms == 0
+          && grp[0].resp_max_ms == 0 && grp[0].jitter_max_ms == 0 && grp[0].jitter_sum_ms == 0);
+    CHECK(s.read_cnt == 0 && s.idle_cnt == 0);
+    s.group_num = 0;
+    CHECK(mb_sched_init(&s) != 0);
+
+    return t_done("test_sched");
+}
@@ -0,0 +1,157 @@
+/**
+  ******************************************************************************
+  * @file    host test of the connections of a tcp server, mbtcp_conn.c
+  * @author  arthur.qiang.li
+  * @brief   no port, the test is the port, it writes the bytes of the
+             clients by mb_tcp_conn_rxspace() / mb_tcp_conn_rxdone() and
+             takes the requests by mb_tcp_conn_next_ref():
+                - an adu split at each point, the MBAP too, it is ready only
+                  when it is complete, and served in place.
+                - an adu and the head of the next one, the MBAP of it split,
+                  the first is copied, the head is moved to the front, the
+                  second is served in place when the rest comes.
+                - T_PIPE adus byte by byte, and in one burst larger than the
+                  buffer, all are taken in order.
+                - two clients are served in turn.
+                - a bad MBAP length drops the buffer, the good adus before it
+                  too, the framing of the stream is lost.
+  *
+  ******************************************************************************
+  */
+
+#include "mbtcp_conn.h"
+#include "t_common.h"
+
+#define T_PIPE          ( 30 )
+
+static MB_TCP_CONN_TABLE_STRU tbl;
+static uint8_t                d[MB_TCP_BUF_SIZE];       //ucRTUBuf of the slave
+
+                                                            //a read of the holding registers, its tid
+static int read_adu(uint8_t q[], uint16_t tid)
+{
+    const uint8_t a[12] = { tid >> 8, tid & 0xFF, 0, 0, 0, 6, 1, 3, 0, 0, 0, 10 };
+
+    memcpy(q, a, sizeof(a));
+    return sizeof(a);
+}
+
+                                                            //the client sends b[n], as much as there is room for, the bytes taken, -1= bad MBAP
+static int feed(int32_t idx, const uint8_t b[], int n)
+{
+    uint16_t space;
+    uint8_t  *p = mb_tcp_conn_rxspace(&tbl, idx, &space);
+
+    if(p == 0 || space == 0){
+        return 0;
+    }
+    if(n > space){
+        n = space;
+    }
+    memcpy(p, b, (size_t)n);
+    return (mb_tcp_conn_rxdone(&tbl, idx, (uint16_t)n) == 0) ? n : -1;
+}
+
+                                                            //the next request, its tid, -1= none, the connection of it to *o_idx, then done as after mb_poll()
+static int next(int32_t *o_idx, int *in_place)
+{
+    uint8_t  *adu;
+    uint16_t  len;
+    int32_t   idx = mb_tcp_conn_next_ref(&tbl, d, &adu, &len);
+    int       tid;
+
+    if(idx == MB_TCP_CONN_NONE){
+        return -1;
+    }
+    if(o_idx != 0){
+        *o_idx = idx;
+    }
+    if(in_place != 0){
+        *in_place = (adu != d);
+    }
+    tid = (len == 12 && adu[7] == 3) ? (adu[0] << 8) | adu[1] : -2;
+    mb_tcp_conn_done(&tbl);
+    return tid;
+}
+
+int main(void)
+{
+    uint8_t b[T_PIPE * 12];
+    int32_t a, c, idx;
+    int     n, k, i, zc, ok;
+
+    mb_tcp_conn_init(&tbl);
+    a = mb_tcp_conn_open(&tbl, 100);
+    c = mb_tcp_conn_open(&tbl, 200);
+    CHECK(a != MB_TCP_CONN_NONE && c != MB_TCP_CONN_NONE);
+
+                                                            //split at each point
+    n = read_adu(b, 0x1234);
+    for(k = 1, ok = 0; k < n; k++){
+        feed(a, b, k);
+        ok += (mb_tcp_conn_ready(&tbl) == 0 && next(0, 0) == -1);
+        feed(a, &b[k], n - k);
+        ok += (mb_tcp_conn_ready(&tbl) == 1 && next(&idx, &zc) == 0x1234 && idx == a && zc);
+    }
+    CHECK(ok == 2 * (n - 1));
+    CHECK(tbl.copy_bytes == 0 && tbl.slab_free_num == MB_TCP_SLAB_NUM);
+
+                                                            //an adu and 3 bytes of the next, its MBAP split
+    n  = read_adu(b, 1);
+    n += read_adu(&b[n], 2);
+    CHECK(feed(a, b, 15) == 15);
+    CHECK(next(0, &zc) == 1 && zc == 0);
+    CHECK(next(0, 0) == -1);
+    CHECK(feed(a, &b[15], n - 15) == n - 15);
+    CHECK(tbl.copy_bytes == 12 + 3);                        //the first adu, then the head moved to the front
+    CHECK(next(0, &zc) == 2 && zc);
+    CHECK(next(0, 0) == -1 && tbl.slab_free_num == MB_TCP_SLAB_NUM);
+
+                                                            //byte by byte
+    for(k = 0, n = 0; k < T_PIPE; k++){
+        n += read_adu(&b[n], (uint16_t)(100 + k));
+    }
+    for(i = 0, k = 0, ok = 0; i < n; i++){
+        CHECK(feed(a, &b[i], 1) == 1);
+        if(next(0, 0) == 100 + k){
+            ok++;
+            k++;
+        }
+    }
+    CHECK(ok == T_PIPE && next(0, 0) == -1);
+
+                                                            //in one burst, larger than the buffer, read again when served
+    for(i = 0, k = 0, ok = 0; k < T_PIPE;){
+        i += feed(a, &b[i], n - i);
+        if(next(0, 0) != 100 + k){
+            break;
+        }
+        k++;
+        ok++;
+    }
+    CHECK(i == n && ok == T_PIPE && next(0, 0) == -1);
+
+                                                            //two clients in turn
+    n  = read_adu(b, 1);
+    n += read_adu(&b[n], 2);
+    feed(a, b, n);
+    read_adu(b, 3);
+    feed(c, b, 12);
+    CHECK(next(&idx, 0) == 1 && idx == a);
+    CHECK(next(&idx, 0) == 3 && idx == c);
+    CHECK(next(&idx, 0) == 2 && idx == a);
+    CHECK(next(0, 0) == -1);
+
+                                                            //a bad MBAP length, alone and behind a good adu
+    n = read_adu(b, 7);
+    b[4] = 0xFF;                                            //LEN 0xFF06
+    CHECK(feed(a, b, n) == -1 && (int)tbl.drop_cnt == n);
+    n  = read_adu(b, 8);
+    n += read_adu(&b[n], 9);
+    b[12 + 4] = 0xFF;
+    CHECK(feed(a, b, n) == -1 && (int)tbl.drop_cnt == 12 + n);
+    CHECK(next(0, 0) == -1 && tbl.slab_free_num == MB_TCP_SLAB_NUM);
+
+    printf("%d adus reassembled, %u bytes copied\n", (int)tbl.conn[a].rx_adu + (int)tbl.conn[c].rx_adu, tbl.copy_bytes);
+    return t_done("test_tcp_conn");
+}
@@ -0,0 +1,132 @@
+/**
+  ******************************************************************************
+  * @file    host test of the io_uring tcp slave port, mb_port_tcp_uring.c
+  * @author  arthur.qiang.li
+  * @brief   the slave runs in a thread on MB_PORT_TCP_LISTEN_PORT, the test
+             is a client which pipelines:
+                - T_PIPE reads of 125 registers in one write, read back only
+                  after a while, so the responses fill the tx buffer while a
+                  send is not over. all must come, in order, and the client
+                  must not be closed.
+                - a read after them is answered, the client is still there.
+             no io_uring in the kernel, the test is skipped.
+  *
+  ******************************************************************************
+  */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "mb.h"
+#include "mb_port_linux.h"
+#include "t_common.h"
+
+#define T_PIPE          ( 40 )                              //reads pipelined in one write
+#define T_REGS          ( 125 )
+#define T_RSP_LEN       ( 9 + 2 * T_REGS )                  //MBAP, fc, byte count, the registers
+
+static volatile int stop, ready;
+
+                                                            //the ring is of one issuer, the thread which sets it up runs it
+static void *slave(void *a)
+{
+    int k;
+
+    (void)a;
+    for(k = 0; mb_init(&mb_slave_tcp_uring) != 0; k++){    //the ring of a run just before may still hold the port
+        if(k == 50){
+            ready = -1;
+            return 0;
+        }
+        usleep(100000);
+    }
+    mb_enable(&mb_slave_tcp_uring, 1);
+    ready = 1;
+    while(!stop){
+        mb_port_tcp_uring_wait(100);
+        mb_poll(&mb_slave_tcp_uring);
+    }
+    return 0;
+}
+
+                                                            //a read of the holding registers, its tid
+static int read_adu(uint8_t q[], uint16_t tid, uint16_t num)
+{
+    const uint8_t a[12] = { tid >> 8, tid & 0xFF, 0, 0, 0, 6, mb_slave_tcp_uring.address, 3, 0, 0, num >> 8, num & 0xFF };
+
+    memcpy(q, a, sizeof(a));
+    return sizeof(a);
+}
+
+                                                            //read n bytes, 0= OK
+static int get(int s, uint8_t b[], int n)
+{
+    struct pollfd p = { s, POLLIN, 0 };
+    int           got = 0, r;
+
+    while(got < n){
+        if(poll(&p, 1, 2000) <= 0){
+            return -1;
+        }
+        r = (int)recv(s, b + got, (size_t)(n - got), 0);
+        if(r <= 0){
+            return -1;
+        }
+        got += r;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    uint8_t            q[T_PIPE * 12], b[T_RSP_LEN];
+    int                s, k, n = 0, ok = 0, rcv = 4096;
+    struct sockaddr_in sa;
+    pthread_t          th;
+
+    pthread_create(&th, 0, slave, 0);
+    while(ready == 0){
+        usleep(1000);
+    }
+    if(ready < 0){
+        pthread_join(th, 0);
+        printf("test_tcp_uring: skipped, no io_uring, or the port is busy\n");
+        return 0;
+    }
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcv, sizeof(rcv));    //small, so the sends of the slave wait
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family      = AF_INET;
+    sa.sin_port        = htons(MB_PORT_TCP_LISTEN_PORT);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(connect(s, (struct sockaddr *)&sa, sizeof(sa)) == 0);
+
+    for(k = 0; k < T_PIPE; k++){
+        n += read_adu(&q[n], (uint16_t)k, T_REGS);
+    }
+    CHECK(send(s, q, (size_t)n, 0) == n);
+    usleep(300000);                                         //the client does not read for a while
+    for(k = 0; k < T_PIPE; k++){
+        if(get(s, b, T_RSP_LEN) != 0){
+            break;
+        }
+        ok += (b[0] == (k >> 8) && b[1] == (k & 0xFF) && b[7] == 3 && b[8] == 2 * T_REGS);
+    }
+    CHECK(ok == T_PIPE);
+
+    n = read_adu(q, 0xABCD, 1);
+    CHECK(send(s, q, (size_t)n, MSG_NOSIGNAL) == n);
+    CHECK(get(s, b, 11) == 0 && b[0] == 0xAB && b[1] == 0xCD && b[7] == 3);
+
+    close(s);
+    stop = 1;
+    pthread_join(th, 0);
+    printf("%d pipelined reads answered in order\n", ok);
+    return t_done("test_tcp_uring");
+}
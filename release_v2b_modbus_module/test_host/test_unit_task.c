@@ -0,0 +1,136 @@
+/**
+  ******************************************************************************
+  * @file    host test of the image being served for each task, mb_v2.c
+  * @author  arthur.qiang.li
+  * @brief   built as the rtos build, no MB_THREAD_LOCAL, the table of
+             MB_SERVING_TASK_MAX (2) entries by mb_port_task_id(), a task is a
+             pthread. two tasks, each one runs mb_poll() on its own ascii
+             slave with one unit, the units have their own images:
+                - T_ROUNDS reads of each task, the handler of 03 sleeps in
+                  the middle so the other task serves meanwhile. each read
+                  gets the register of its own unit.
+                - a third task has no entry left, mb_init() of a slave with
+                  units fails.
+  *
+  ******************************************************************************
+  */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "mb.h"
+#include "mbascii.h"
+#include "mbfunc.h"
+#include "t_common.h"
+
+#define T_ROUNDS        ( 200 )
+
+static __thread uint8_t  rx[64];                            //the port of each task, the request
+static __thread int      rx_n;
+static __thread uint8_t  tx[520];                           //the response
+static __thread int      tx_n;
+
+static int32_t port_read(uint8_t d[], int n)
+{
+    int m = (rx_n < n) ? rx_n : n;
+
+    memcpy(d, rx, (size_t)m);
+    rx_n -= m;
+    return m;
+}
+
+static int32_t port_ok(void)                 { return 0; }
+static int32_t port_post(uint32_t e)         { (void)e; return 0; }
+static int32_t port_get(uint32_t *e)         { *e = EV_FRAME_RECEIVED; return 0; }
+static void    port_enable(uint32_t r, uint32_t t) { (void)r; (void)t; }
+static void    port_send(uint8_t d[], int n) { memcpy(tx, d, (size_t)n); tx_n = n; }
+static int32_t port_serial_init(uint8_t p, uint32_t b, uint8_t d, uint8_t pa) { (void)p; (void)b; (void)d; (void)pa; return 0; }
+static int32_t timer_init(uint32_t n)        { (void)n; return 0; }
+static void    timer_enable(uint32_t en)     { (void)en; }
+
+                                                            //03 of the units, the image is read twice, the other task runs between
+static eMBException read_slow(uint8_t *frame, uint16_t *len)
+{
+    MB_REG_IMAGE_STRU *img = mb_get_serving_image();
+
+    usleep(100);
+    if(mb_get_serving_image() != img){
+        return MB_EX_SLAVE_DEVICE_FAILURE;
+    }
+    return eMBFuncReadHoldingRegister(frame, len);
+}
+
+static xMBFunctionHandler handlers[MB_FUNC_HANDLERS_MAX] = { { MB_FUNC_READ_HOLDING_REGISTER, read_slow } };
+
+static uint16_t           reg[3] = { 0x1111, 0x2222, 0x3333 };
+static MB_REG_IMAGE_STRU  img[3] = {
+    { .p_hold = &reg[0], .hold_num = 1 },
+    { .p_hold = &reg[1], .hold_num = 1 },
+    { .p_hold = &reg[2], .hold_num = 1 },
+};
+static MB_UNIT_STRU       unit[3] = {
+    { .address = 10, .p_image = &img[0], .p_handlers = handlers },
+    { .address = 20, .p_image = &img[1], .p_handlers = handlers },
+    { .address = 30, .p_image = &img[2], .p_handlers = handlers },
+};
+static MB_UNIT_TABLE_STRU tbl[3] = { { &unit[0], 1 }, { &unit[1], 1 }, { &unit[2], 1 } };
+static uint8_t            txbuf[3][520];
+static MB_SLAVE_STRU      sl[3];
+static int                ok[3];
+
+static void *task(void *a)
+{
+    MB_SLAVE_STRU *s = &sl[(long)a];
+    uint8_t        q[6] = { unit[(long)a].address, 3, 0, 0, 0, 1 };
+    char           want[8];
+    int            k;
+
+    s->mode                  = MB_ASCII;
+    s->baudrate              = 9600;
+    s->p_unit_tbl            = &tbl[(long)a];
+    s->p_event_init          = port_ok;
+    s->p_event_post          = port_post;
+    s->p_event_get           = port_get;
+    s->p_serial_init         = port_serial_init;
+    s->p_serial_enable       = port_enable;
+    s->p_serial_start_send   = port_send;
+    s->p_serial_read_receive = port_read;
+    s->p_serial_check_TC     = port_ok;
+    s->p_serial_check_IDLE   = port_ok;
+    s->p_timer_init          = timer_init;
+    s->p_timer_enable        = timer_enable;
+    s->p_ascii_txbuf         = txbuf[(long)a];
+    if(mb_init(s) != 0){
+        ok[(long)a] = -1;
+        return 0;
+    }
+    mb_enable(s, 1);
+    snprintf(want, sizeof(want), "%04X", reg[(long)a]);
+    for(k = 0; k < T_ROUNDS; k++){
+        rx_n = t_ascii_frame(rx, q, sizeof(q));
+        tx_n = 0;
+        mb_poll(s);
+        ok[(long)a] += (tx_n > 11 && tx[3] == '0' && tx[4] == '3' && memcmp(&tx[7], want, 4) == 0);
+    }
+    return 0;
+}
+
+int main(void)
+{
+    pthread_t th[2];
+    long      i;
+
+    for(i = 0; i < 2; i++){
+        pthread_create(&th[i], 0, task, (void *)i);
+    }
+    for(i = 0; i < 2; i++){
+        pthread_join(th[i], 0);
+    }
+    CHECK(ok[0] == T_ROUNDS && ok[1] == T_ROUNDS);
+
+    task((void *)2);                                        //the third task
+    CHECK(ok[2] == -1);
+
+    printf("%d and %d of %d reads got the register of their unit\n", ok[0], ok[1], T_ROUNDS);
+    return t_done("test_unit_task");
+}